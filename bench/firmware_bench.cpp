@@ -0,0 +1,398 @@
+// Firmware microbenchmarks for the native environment.
+//
+// Runs the managers from src/ against the fake core in hal/native and measures
+// the hot paths of a wake cycle: time per operation, heap allocations (operator
+// new and String buffers, counted the way the ESP8266 core makes them) and
+// EEPROM commits that rewrite the flash sector, plus bytes on the wire and
+// round trips for the benchmarks that talk to the server. Results are printed to stdout
+// as one JSON document so runs from different commits can be compared with
+// tools/bench_compare.py.
+//
+//   pio run -e native && .pio/build/native/program [--filter name] [--min-time-ms 200]
+//
+// Host timings only rank changes against each other; allocation and flash
+// write counts carry over to the device. ArduinoJson slots are twice as large
+// on a 64-bit host, so a StaticJsonDocument fills up sooner than on the device:
+// every benchmark checks its output and reports "ok": false if it came out
+// incomplete.
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include "NativeHal.h"
+#include "platform_config.h"
+#include "version.h"
+#include "EEPROMManager.h"
+#include "RTCMemoryManager.h"
+#include "WiFiManager.h"
+#include "SensorManager.h"
+#include "DeviceManager.h"
+#include "WebServerManager.h"
+
+struct BenchResult {
+    const char* name;
+    uint32_t iterations;
+    double nsPerOp;
+    double allocationsPerOp;
+    double allocatedBytesPerOp;
+    double eepromCommitsPerOp;
+    double flashWritesPerOp;
+    double wireBytesPerOp;
+    double roundTripsPerOp;
+    bool ok;
+};
+
+static const int MAX_RESULTS = 16;
+static BenchResult results[MAX_RESULTS];
+static int resultCount = 0;
+static const char* filter = nullptr;
+static double minTimeMs = 200;
+
+static EEPROMManager* eepromManager;
+static RTCMemoryManager* rtcMemoryManager;
+static WiFiManager* wifiManager;
+static SensorManager* sensorManager;
+static DeviceManager* deviceManager;
+static WebServerManager* webServerManager;
+
+// Keeps results alive so the work is not optimized away
+static volatile unsigned long sink;
+
+// Doubles the iteration count until one batch runs for minTimeMs, then reports
+// that batch. check() runs afterwards on the state the operation left behind.
+template <typename Operation, typename Check>
+static void bench(const char* name, Operation operation, Check check) {
+    if (filter && !strstr(name, filter)) {
+        return;
+    }
+
+    operation();    // Warm up
+    uint32_t iterations = 1;
+    double elapsedNs = 0;
+    NativeHal::Counters counters;
+    while (true) {
+        NativeHal::resetCounters();
+        auto startedAt = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; i++) {
+            operation();
+        }
+        auto endedAt = std::chrono::steady_clock::now();
+        counters = NativeHal::getCounters();
+        elapsedNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(endedAt - startedAt).count();
+        if (elapsedNs >= minTimeMs * 1e6 || iterations >= (1u << 30)) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    if (resultCount >= MAX_RESULTS) {
+        return;
+    }
+    BenchResult& result = results[resultCount++];
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerOp = elapsedNs / iterations;
+    result.allocationsPerOp = (double)counters.allocations / iterations;
+    result.allocatedBytesPerOp = (double)counters.allocatedBytes / iterations;
+    result.eepromCommitsPerOp = (double)counters.eepromCommits / iterations;
+    result.flashWritesPerOp = (double)counters.flashWrites / iterations;
+    result.wireBytesPerOp = (double)counters.wireBytes / iterations;
+    result.roundTripsPerOp = (double)counters.roundTrips / iterations;
+    result.ok = check();
+}
+
+// A configured relay on a network with a server, as after setup()
+static void bootDevice() {
+    NativeHal::reset();
+    NativeHal::setSerialEnabled(false);
+    NativeHal::setWiFiConnected(true);
+
+    eepromManager = new EEPROMManager();
+    eepromManager->init();
+    eepromManager->saveWiFiCredentials("greenhouse", "correct horse battery");
+    eepromManager->setAlias("Greenhouse relay");
+    eepromManager->setServerUrl("http://192.168.1.10:3000");
+    eepromManager->setMode(4);
+
+    rtcMemoryManager = new RTCMemoryManager();
+    rtcMemoryManager->load();
+
+    wifiManager = new WiFiManager();
+    sensorManager = new SensorManager(eepromManager, 5, 14);
+    deviceManager = new DeviceManager(eepromManager, sensorManager, wifiManager, rtcMemoryManager);
+    webServerManager = new WebServerManager(eepromManager, wifiManager, sensorManager, deviceManager);
+    deviceManager->init();
+    sensorManager->init();
+    wifiManager->init(deviceManager->getDeviceId(), eepromManager);
+}
+
+static String setConfigBody(const String& alias) {
+    String body = "{\"ssid\":\"" + eepromManager->getSSID() + "\",\"alias\":\"" + alias +
+        "\",\"server\":\"" + eepromManager->getServerUrl() + "\",\"mode\":" + String(eepromManager->getMode()) + "}";
+    return body;
+}
+
+// The server's CoAP listener, for requests that always succeed: a piggybacked
+// 2.05 with "0" for a GET, an empty 2.04 for anything else. dropEvery > 0 loses
+// the first copy of every dropEvery-th message.
+static uint32_t coapMessages;
+static uint32_t coapDropEvery;
+static uint16_t coapLastMessageId;
+static size_t respondToCoap(uint16_t port, const uint8_t* datagram, size_t length, uint8_t* reply, size_t capacity) {
+    if (port != 5683 || length < 4) {
+        return 0;
+    }
+    uint16_t messageId = (datagram[2] << 8) | datagram[3];
+    bool firstCopy = coapMessages == 0 || messageId != coapLastMessageId;
+    if (firstCopy) {
+        coapMessages++;
+        coapLastMessageId = messageId;
+        if (coapDropEvery > 0 && coapMessages % coapDropEvery == 0) {
+            return 0;
+        }
+    }
+    uint8_t tokenLength = datagram[0] & 0x0F;
+    bool get = datagram[1] == 0x01;
+    size_t replyLength = 4 + tokenLength + (get ? 3 : 0);
+    if (replyLength > capacity || length < 4u + tokenLength) {
+        return 0;
+    }
+    reply[0] = 0x60 | tokenLength;      // Version 1, ACK
+    reply[1] = get ? 0x45 : 0x44;
+    reply[2] = datagram[2];
+    reply[3] = datagram[3];
+    memcpy(reply + 4, datagram + 4, tokenLength);
+    if (get) {
+        reply[4 + tokenLength] = 0xC0;  // Content-Format, empty: text/plain
+        reply[5 + tokenLength] = 0xFF;
+        reply[6 + tokenLength] = '0';
+    }
+    return replyLength;
+}
+
+static bool responseContains(int code, const char* text) {
+    return NativeHal::getResponseCode() == code && NativeHal::getResponseBody().indexOf(text) >= 0;
+}
+
+static void runBenchmarks() {
+    bench("eeprom_config_load", []() {
+        String ssid = eepromManager->getSSID();
+        String password = eepromManager->getPassword();
+        String alias = eepromManager->getAlias();
+        String server = eepromManager->getServerUrl();
+        sink = ssid.length() + password.length() + alias.length() + server.length() + eepromManager->getMode();
+    }, []() {
+        return eepromManager->getSSID() == "greenhouse" && eepromManager->getMode() == 4;
+    });
+
+    // Alternates between two configurations so every save changes the sector
+    static bool flip = false;
+    bench("eeprom_config_save", []() {
+        flip = !flip;
+        eepromManager->saveWiFiCredentials(flip ? "greenhouse-2" : "greenhouse", "correct horse battery");
+        eepromManager->setAlias(flip ? "Greenhouse relay 2" : "Greenhouse relay");
+        eepromManager->setServerUrl("http://192.168.1.10:3000");
+        eepromManager->setMode(4);
+    }, []() {
+        return eepromManager->getAlias() == (flip ? "Greenhouse relay 2" : "Greenhouse relay");
+    });
+
+    bench("eeprom_config_save_unchanged", []() {
+        eepromManager->saveWiFiCredentials("greenhouse", "correct horse battery");
+        eepromManager->setAlias("Greenhouse relay");
+        eepromManager->setServerUrl("http://192.168.1.10:3000");
+        eepromManager->setMode(4);
+    }, []() {
+        return eepromManager->getSSID() == "greenhouse";
+    });
+
+    // A run of failed connections, as logged by WiFiManager across wakes
+    bench("failure_log_append_x8", []() {
+        eepromManager->clearWiFiFailureLog();
+        for (unsigned long i = 0; i < 8; i++) {
+            eepromManager->addWiFiFailure(30000 + i * 60000);
+        }
+    }, []() {
+        String log = eepromManager->getWiFiFailureLog();
+        return log.startsWith("[30000,") && log.endsWith(",450000]");
+    });
+
+    // Eight probes from the saved ROM list: one conversion, no bus search.
+    // The check also holds the simulated wait to a single conversion.
+    NativeHal::setProbeCount(8);
+    sensorManager->beginProbes();
+    static unsigned long readStartedAt;
+    static unsigned long lastReadMs;
+    bench("temperature_read_x8", []() {
+        float celsius[SensorManager::MAX_PROBES];
+        readStartedAt = millis();
+        sink = sensorManager->readTemperatures(celsius);
+        lastReadMs = millis() - readStartedAt;
+    }, []() {
+        return sink == 8 && lastReadMs <= SensorManager::CONVERSION_MS &&
+            NativeHal::getCounters().oneWireSearches == 0;
+    });
+
+    // Registration body plus the server's time reply
+    static bool registrationComplete = false;
+    NativeHal::setHttpResponder([](const String& method, const String& url, const String& body, String& response) {
+        registrationComplete = body.indexOf("\"outputOn\"") >= 0 && body.indexOf("\"missedSlots\"") >= 0;
+        response = "{\"timestamp\":1760000000000,\"receivedAt\":1759999999990}";
+        return 200;
+    });
+    bench("registration_json", []() {
+        deviceManager->registerWithServer();
+    }, []() {
+        return registrationComplete;
+    });
+    NativeHal::setHttpResponder(NativeHal::HttpResponder());
+
+    // /api/config with the stored configuration: diff only, nothing written
+    NativeHal::setRequestArg("plain", setConfigBody(eepromManager->getAlias()));
+    bench("set_config_unchanged", []() {
+        webServerManager->handleSetConfig();
+    }, []() {
+        return responseContains(200, "\"updated\":false");
+    });
+
+    // Alias changes on every call: diff, EEPROM write and registration under
+    // the new name, without a restart
+    static bool renamed = false;
+    static String bodies[2] = { setConfigBody("Greenhouse relay"), setConfigBody("Greenhouse relay 2") };
+    bench("set_config_changed", []() {
+        renamed = !renamed;
+        NativeHal::setRequestArg("plain", bodies[renamed ? 1 : 0]);
+        webServerManager->handleSetConfig();
+    }, []() {
+        return responseContains(200, "\"updated\":true") && NativeHal::getCounters().restarts == 0 &&
+            NativeHal::getCounters().httpRequests > 0;
+    });
+    NativeHal::clearRequest();
+
+    // Relay to RGB light and back: one mode torn down, the other started
+    static bool lightMode = false;
+    bench("set_mode_switch", []() {
+        lightMode = !lightMode;
+        NativeHal::setRequestArg("mode", lightMode ? "5" : "4");
+        webServerManager->handleSetMode();
+    }, []() {
+        return NativeHal::getResponseCode() == 200 && NativeHal::getCounters().restarts == 0 &&
+            deviceManager->getOperatingMode() == (lightMode ? 5 : 4);
+    });
+    NativeHal::clearRequest();
+    eepromManager->setMode(4);
+    deviceManager->applyMode();
+
+    // What a wake sends the server: the stay-awake check and the readings,
+    // with eight probes on the bus. wireBytesPerOp and roundTripsPerOp
+    // compare the transports.
+    static uint32_t uplinkRequests;
+    NativeHal::setHttpResponder([](const String& method, const String& url, const String& body, String& response) {
+        uplinkRequests++;
+        response = url.indexOf("/should-remain-awake") >= 0 ? "0" : "{\"success\":true}";
+        return 200;
+    });
+    bench("wake_uplink_http", []() {
+        deviceManager->askServerIfShouldStayUp();
+        deviceManager->reportNow();
+    }, []() {
+        return uplinkRequests > 0 && NativeHal::getCounters().roundTrips > 0;
+    });
+
+    NativeHal::setUdpResponder(respondToCoap);
+    uplinkRequests = 0;
+    bench("wake_uplink_coap", []() {
+        deviceManager->setTransport(EEPROMManager::TRANSPORT_COAP);
+        deviceManager->askServerIfShouldStayUp();
+        deviceManager->reportNow();
+    }, []() {
+        return uplinkRequests == 0 && coapMessages > 0;
+    });
+
+    // One datagram in four lost: each loss costs a retransmission after 1-1.5 s
+    coapDropEvery = 4;
+    bench("wake_uplink_coap_lossy", []() {
+        deviceManager->setTransport(EEPROMManager::TRANSPORT_COAP);
+        deviceManager->askServerIfShouldStayUp();
+        deviceManager->reportNow();
+    }, []() {
+        return uplinkRequests == 0;
+    });
+    coapDropEvery = 0;
+    deviceManager->setTransport(EEPROMManager::TRANSPORT_HTTP);
+    NativeHal::setUdpResponder(NativeHal::UdpResponder());
+
+    // Whole wakes against an https:// server: sleep, boot and the two
+    // requests. With the TLS session kept in RTC memory each wake resumes it;
+    // with a server that forgets sessions every connection is a full handshake.
+    eepromManager->setServerUrl("https://192.168.1.10:3443");
+    deviceManager->init();
+    uplinkRequests = 0;
+    NativeHal::setTlsResumption(false);
+    bench("wake_uplink_https_full", []() {
+        deviceManager->enterDeepSleep();
+        deviceManager->init();
+        deviceManager->askServerIfShouldStayUp();
+        deviceManager->reportNow();
+    }, []() {
+        return uplinkRequests > 0 && NativeHal::getCounters().tlsResumptions == 0;
+    });
+
+    NativeHal::setTlsResumption(true);
+    bench("wake_uplink_https_resumed", []() {
+        deviceManager->enterDeepSleep();
+        deviceManager->init();
+        deviceManager->askServerIfShouldStayUp();
+        deviceManager->reportNow();
+    }, []() {
+        return NativeHal::getCounters().tlsHandshakes == 0 && NativeHal::getCounters().tlsResumptions > 0;
+    });
+    eepromManager->setServerUrl("http://192.168.1.10:3000");
+    deviceManager->init();
+    NativeHal::setHttpResponder(NativeHal::HttpResponder());
+}
+
+static void printResults() {
+    printf("{\n");
+    printf("  \"firmwareVersion\": \"%s\",\n", FIRMWARE_VERSION);
+    printf("  \"buildNumber\": %d,\n", FIRMWARE_BUILD_NUMBER);
+    printf("  \"platform\": \"%s\",\n", PLATFORM_NAME);
+    printf("  \"benchmarks\": [\n");
+    for (int i = 0; i < resultCount; i++) {
+        const BenchResult& result = results[i];
+        printf("    {\"name\": \"%s\", \"iterations\": %u, \"nsPerOp\": %.1f, \"allocationsPerOp\": %.2f, "
+            "\"allocatedBytesPerOp\": %.1f, \"eepromCommitsPerOp\": %.2f, \"flashWritesPerOp\": %.2f, "
+            "\"wireBytesPerOp\": %.1f, \"roundTripsPerOp\": %.2f, \"ok\": %s}%s\n",
+            result.name, result.iterations, result.nsPerOp, result.allocationsPerOp, result.allocatedBytesPerOp,
+            result.eepromCommitsPerOp, result.flashWritesPerOp, result.wireBytesPerOp, result.roundTripsPerOp,
+            result.ok ? "true" : "false",
+            i + 1 < resultCount ? "," : "");
+    }
+    printf("  ]\n");
+    printf("}\n");
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--min-time-ms") == 0 && i + 1 < argc) {
+            minTimeMs = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--filter name] [--min-time-ms ms]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    bootDevice();
+    runBenchmarks();
+    printResults();
+
+    for (int i = 0; i < resultCount; i++) {
+        if (!results[i].ok) {
+            fprintf(stderr, "%s: output incomplete or wrong\n", results[i].name);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -190,7 +190,8 @@ if (-not (Generate-HtmlConstants)) {
 # Determine which environments to build
 $envsToBuild = @()
 if ($Environment -eq "all") {
-    $envsToBuild = $availableEnvs
+    # The native environment builds the host benchmarks, not firmware
+    $envsToBuild = $availableEnvs | Where-Object { $_ -ne "native" }
 }
 elseif ($Environment -in $availableEnvs) {
     $envsToBuild = @($Environment)
@@ -0,0 +1,193 @@
+// One device of the fleet simulator (server/tools/fleetSimulator.ts).
+//
+// Runs the firmware itself, setup() from WifiTempSensor.cpp and then loop()
+// until it deep sleeps or restarts, on the native HAL in live mode: real time,
+// real HTTP to the server, and the device's web server and control channel on
+// real sockets. Each run is one wake. Flash and RTC memory are kept in a state
+// file between runs, so a deep sleep is this process exiting and the next wake
+// is the next run; a run without a state file is a freshly flashed device,
+// provisioned as a relay on the given server.
+//
+//   pio run -e fleet
+//   .pio/build/fleet/program --state <file> --port <n> --index <n> [--server <url>] [--mode <n>]
+//
+// Each device needs its own --port (its web server) and --index (its MAC, and
+// so its serial number). Tells the supervisor what happened as one JSON object
+// per line on stdout:
+//   {"event":"boot","id":"..."}                          setup() is done
+//   {"event":"request","route":"/register","ms":3.1,"code":200}
+//   {"event":"output","on":true}                          the relay switched
+//   {"event":"sleep","ms":60000}  or  {"event":"restart"}  last
+
+#include <chrono>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "NativeHal.h"
+#include "platform_config.h"
+#include "EEPROMManager.h"
+#include "DeviceManager.h"
+
+// The firmware's own entry points and managers, from WifiTempSensor.cpp
+void setup();
+void loop();
+extern DeviceManager* deviceManager;
+
+// SENSE_POWER_PIN in WifiTempSensor.cpp, which drives the relay
+static const uint8_t OUTPUT_PIN = 14;
+static const char STATE_MAGIC[8] = { 'O', 'M', 'N', 'I', 'F', 'L', 'T', '1' };
+
+static const char* statePath = nullptr;
+static uint16_t port = 0;
+static long deviceIndex = -1;
+static const char* serverUrl = nullptr;
+static int mode = 4;                 // Relay
+
+static bool loadState() {
+    FILE* file = fopen(statePath, "rb");
+    if (!file) {
+        return false;
+    }
+    char magic[sizeof(STATE_MAGIC)];
+    char reason[64] = {};
+    bool loaded = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+        memcmp(magic, STATE_MAGIC, sizeof(magic)) == 0 &&
+        fread(NativeHal::eepromFlash(), 1, NativeHal::eepromFlashSize(), file) == NativeHal::eepromFlashSize() &&
+        fread(NativeHal::rtcMemory(), 1, NativeHal::rtcMemorySize(), file) == NativeHal::rtcMemorySize();
+    if (loaded && fgets(reason, sizeof(reason), file)) {
+        NativeHal::setResetReason(reason);
+    }
+    fclose(file);
+    return loaded;
+}
+
+// Written aside and renamed over, so a killed run leaves the last good state
+static bool saveState() {
+    String temporary = String(statePath) + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    String reason = NativeHal::getResetReason();
+    bool saved = fwrite(STATE_MAGIC, 1, sizeof(STATE_MAGIC), file) == sizeof(STATE_MAGIC) &&
+        fwrite(NativeHal::eepromFlash(), 1, NativeHal::eepromFlashSize(), file) == NativeHal::eepromFlashSize() &&
+        fwrite(NativeHal::rtcMemory(), 1, NativeHal::rtcMemorySize(), file) == NativeHal::rtcMemorySize() &&
+        fwrite(reason.c_str(), 1, reason.length(), file) == reason.length();
+    saved = fclose(file) == 0 && saved;
+    return saved && rename(temporary.c_str(), statePath) == 0;
+}
+
+// What the captive portal would have stored on a new device
+static void provision() {
+    EEPROMManager eeprom;
+    eeprom.init();
+    eeprom.saveWiFiCredentials("fleet", "fleet-password");
+    eeprom.setServerUrl(serverUrl);
+    eeprom.setAlias("Fleet " + String(deviceIndex));
+    eeprom.setMode(mode);
+    eeprom.setTransport(EEPROMManager::TRANSPORT_HTTP);
+}
+
+static void report(const char* format, ...) __attribute__((format(printf, 1, 2)));
+static void report(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    putchar('\n');
+    fflush(stdout);
+}
+
+// Passes the firmware's requests on to the server and times them
+static int forwardRequest(const String& method, const String& url, const String& body, String& response) {
+    // The server reaches devices at the address they register; this one's web
+    // server is on loopback at its own port, where a device's would be on port 80
+    String sent = body;
+    sent.replace("\"ipAddress\":\"127.0.0.1\"", "\"ipAddress\":\"127.0.0.1:" + String((unsigned int)port) + "\"");
+
+    auto startedAt = std::chrono::steady_clock::now();
+    int code = NativeHal::fetchHttp(method, url, sent, response);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startedAt).count();
+
+    int pathStart = url.indexOf('/', url.indexOf("://") + 3);
+    String route = pathStart < 0 ? String("/") : url.substring(pathStart);
+    int query = route.indexOf('?');
+    if (query >= 0) {
+        route = route.substring(0, query);
+    }
+    report("{\"event\":\"request\",\"route\":\"%s\",\"ms\":%.1f,\"code\":%d}", route.c_str(), ms, code);
+    return code;
+}
+
+static bool parseArgs(int argc, char** argv) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--state") == 0) {
+            statePath = argv[i + 1];
+        } else if (strcmp(argv[i], "--port") == 0) {
+            port = (uint16_t)atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--index") == 0) {
+            deviceIndex = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--server") == 0) {
+            serverUrl = argv[i + 1];
+        } else if (strcmp(argv[i], "--mode") == 0) {
+            mode = atoi(argv[i + 1]);
+        } else {
+            return false;
+        }
+    }
+    return statePath && port != 0 && deviceIndex >= 0 && deviceIndex <= 0xFFFFFF;
+}
+
+int main(int argc, char** argv) {
+    if (!parseArgs(argc, argv)) {
+        fprintf(stderr, "usage: %s --state <file> --port <n> --index <n> [--server <url>] [--mode <n>]\n", argv[0]);
+        return 2;
+    }
+
+    // Locally administered MAC numbered by index
+    const uint8_t mac[6] = { 0x5E, 0x00, 0x00, (uint8_t)(deviceIndex >> 16), (uint8_t)(deviceIndex >> 8),
+        (uint8_t)deviceIndex };
+    NativeHal::setMacAddress(mac);
+    NativeHal::setSerialEnabled(false);
+    NativeHal::setLive(true);
+    NativeHal::setWebServerPort(port);
+    NativeHal::setWiFiConnected(true);
+    NativeHal::setHttpResponder(forwardRequest);
+
+    if (!loadState()) {
+        if (!serverUrl || strncmp(serverUrl, "http://", 7) != 0) {
+            fprintf(stderr, "A new device needs --server http://host:port (TLS is not simulated)\n");
+            return 2;
+        }
+        provision();
+    }
+
+    setup();
+    report("{\"event\":\"boot\",\"id\":\"%s\"}", deviceManager->getSerialNumber().c_str());
+
+    int output = NativeHal::getPinState(OUTPUT_PIN);
+    while (true) {
+        loop();
+
+        if (NativeHal::getPinState(OUTPUT_PIN) != output) {
+            output = NativeHal::getPinState(OUTPUT_PIN);
+            report("{\"event\":\"output\",\"on\":%s}", output == HIGH ? "true" : "false");
+        }
+        const NativeHal::Counters& counters = NativeHal::getCounters();
+        if (counters.deepSleeps > 0) {
+            report("{\"event\":\"sleep\",\"ms\":%llu}", (unsigned long long)(NativeHal::getDeepSleepMicros() / 1000));
+            break;
+        }
+        if (counters.restarts > 0) {
+            report("{\"event\":\"restart\"}");
+            break;
+        }
+    }
+
+    if (!saveState()) {
+        fprintf(stderr, "Could not write %s\n", statePath);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,167 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Host stand-in for the ESP8266 Arduino core, for the native environment.
+// Covers what the firmware uses; the outside world behind it (clock, pins,
+// network, flash) is driven through NativeHal.h.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "WString.h"
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x00
+#define OUTPUT 0x01
+#define INPUT_PULLUP 0x02
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define A0 17
+#define NUM_PINS 18
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define PROGMEM
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define F(string_literal) (string_literal)
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+
+inline uint16_t word(uint8_t h, uint8_t l) {
+    return (uint16_t)((h << 8) | l);
+}
+
+// Time runs on a simulated clock: delay() advances it instantly (in live mode
+// it follows the host clock and sleeps)
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+inline void analogWriteRange(uint32_t) {}
+inline void analogWriteFreq(uint32_t) {}
+
+// Handlers run synchronously from NativeHal::setDigitalInput(), so there is
+// nothing to mask
+#define digitalPinToInterrupt(pin) (pin)
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode);
+void detachInterrupt(uint8_t interrupt);
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+class Print;
+
+class Printable {
+public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* str) { return str ? write((const uint8_t*)str, strlen(str)) : 0; }
+
+    size_t print(const char* str) { return write(str); }
+    size_t print(const String& s) { return write((const uint8_t*)s.c_str(), s.length()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char value, int base = DEC) { return print((unsigned long long)value, base); }
+    size_t print(int value, int base = DEC) { return print((long long)value, base); }
+    size_t print(unsigned int value, int base = DEC) { return print((unsigned long long)value, base); }
+    size_t print(long value, int base = DEC) { return print((long long)value, base); }
+    size_t print(unsigned long value, int base = DEC) { return print((unsigned long long)value, base); }
+    size_t print(long long value, int base = DEC);
+    size_t print(unsigned long long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+    size_t print(const Printable& x) { return x.printTo(*this); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T& value) { size_t n = print(value); return n + println(); }
+    template <typename T>
+    size_t println(const T& value, int format) { size_t n = print(value, format); return n + println(); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    void flush() {}
+};
+
+class Stream : public Print {
+public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    void setTimeout(unsigned long) {}
+};
+
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+typedef enum {
+    FM_QIO = 0x00,
+    FM_QOUT = 0x01,
+    FM_DIO = 0x02,
+    FM_DOUT = 0x03,
+    FM_UNKNOWN = 0xff
+} FlashMode_t;
+
+class EspClass {
+public:
+    void deepSleep(uint64_t timeUs);
+    void restart();
+    String getResetReason();
+    uint32_t getFreeHeap();
+    uint32_t getChipId() { return 0x00C0FFEE; }
+    uint8_t getCpuFreqMHz() { return 80; }
+    uint32_t getFlashChipId() { return 0x1640EF; }
+    uint32_t getFlashChipSize() { return 4 * 1024 * 1024; }
+    uint32_t getFlashChipRealSize() { return 4 * 1024 * 1024; }
+    uint32_t getFlashChipSpeed() { return 40000000; }
+    FlashMode_t getFlashChipMode() { return FM_DIO; }
+    const char* getSdkVersion() { return "native"; }
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size);
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size);
+};
+
+extern EspClass ESP;
+
+#endif
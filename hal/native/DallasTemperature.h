@@ -0,0 +1,55 @@
+#ifndef NATIVE_DALLAS_TEMPERATURE_H
+#define NATIVE_DALLAS_TEMPERATURE_H
+
+#include <string.h>
+#include "Arduino.h"
+#include "OneWire.h"
+#include "NativeHal.h"
+
+#define DEVICE_DISCONNECTED_C -127
+
+typedef uint8_t DeviceAddress[8];
+
+// The probes NativeHal::setProbeCount() puts on the bus, each reading what
+// NativeHal::setTemperature() last set for it. Probe n has ROM ID 28 n 00...;
+// a conversion takes CONVERSION_MS of simulated time.
+class DallasTemperature {
+public:
+    static const unsigned long CONVERSION_MS = 600;
+
+    explicit DallasTemperature(OneWire* oneWire) : waitForConversion(true), requestedAt(0) { (void)oneWire; }
+
+    void begin() { NativeHal::countOneWireSearch(); }
+    uint8_t getDeviceCount() { return NativeHal::getProbeCount(); }
+    bool isParasitePowerMode() { return false; }
+
+    bool getAddress(uint8_t* address, uint8_t index) {
+        if (index >= NativeHal::getProbeCount()) {
+            return false;
+        }
+        memset(address, 0, 8);
+        address[0] = 0x28;
+        address[1] = index;
+        return true;
+    }
+
+    void setWaitForConversion(bool wait) { waitForConversion = wait; }
+    void requestTemperatures() {
+        requestedAt = millis();
+        if (waitForConversion) {
+            delay(CONVERSION_MS);
+        }
+    }
+    bool isConversionComplete() { return millis() - requestedAt >= CONVERSION_MS; }
+
+    float getTempC(const uint8_t* address) {
+        return address[0] == 0x28 ? NativeHal::getTemperature(address[1]) : DEVICE_DISCONNECTED_C;
+    }
+    float getTempCByIndex(uint8_t index) { return NativeHal::getTemperature(index); }
+
+private:
+    bool waitForConversion;
+    unsigned long requestedAt;
+};
+
+#endif
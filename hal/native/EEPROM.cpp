@@ -0,0 +1,53 @@
+#include "EEPROM.h"
+#include "NativeHal.h"
+#include <stdlib.h>
+
+EEPROMClass EEPROM;
+
+void EEPROMClass::begin(size_t requestedSize) {
+    if (requestedSize == 0 || requestedSize > NativeHal::eepromFlashSize()) {
+        return;
+    }
+    free(data);
+    data = (uint8_t*)malloc(requestedSize);
+    size = requestedSize;
+    memcpy(data, NativeHal::eepromFlash(), size);
+    dirty = false;
+}
+
+uint8_t EEPROMClass::read(int address) {
+    if (address < 0 || (size_t)address >= size) {
+        return 0;
+    }
+    return data[address];
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+    if (address < 0 || (size_t)address >= size) {
+        return;
+    }
+    // Unchanged bytes do not make the sector dirty
+    if (data[address] != value) {
+        data[address] = value;
+        dirty = true;
+    }
+}
+
+bool EEPROMClass::commit() {
+    if (!data) {
+        return false;
+    }
+    NativeHal::countEepromCommit(dirty);
+    if (dirty) {
+        memcpy(NativeHal::eepromFlash(), data, size);
+        dirty = false;
+    }
+    return true;
+}
+
+void EEPROMClass::end() {
+    commit();
+    free(data);
+    data = nullptr;
+    size = 0;
+}
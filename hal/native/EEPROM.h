@@ -0,0 +1,50 @@
+#ifndef NATIVE_EEPROM_H
+#define NATIVE_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// ESP8266 EEPROM emulation: begin() copies the flash sector into a RAM buffer,
+// writes go to the buffer and commit() writes it back, only if anything changed
+class EEPROMClass {
+private:
+    uint8_t* data;
+    size_t size;
+    bool dirty;
+
+public:
+    EEPROMClass() : data(nullptr), size(0), dirty(false) {}
+
+    void begin(size_t size);
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    bool commit();
+    void end();
+    size_t length() const { return size; }
+
+    template <typename T>
+    T& get(int address, T& t) {
+        if (address < 0 || address + sizeof(T) > size) {
+            return t;
+        }
+        memcpy((uint8_t*)&t, data + address, sizeof(T));
+        return t;
+    }
+
+    template <typename T>
+    const T& put(int address, const T& t) {
+        if (address < 0 || address + sizeof(T) > size) {
+            return t;
+        }
+        if (memcmp(data + address, (const uint8_t*)&t, sizeof(T)) != 0) {
+            dirty = true;
+            memcpy(data + address, (const uint8_t*)&t, sizeof(T));
+        }
+        return t;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,103 @@
+#include "ESP8266HTTPClient.h"
+#include "ESP8266httpUpdate.h"
+#include "NativeHal.h"
+
+ESP8266HTTPUpdate ESPhttpUpdate;
+
+// User-Agent, Accept-Encoding and Connection lines the core adds to each request
+static const size_t CORE_HEADER_BYTES = 107;
+// Status line, content-type, vary, CORS, date and the blank line from the
+// server, content-length aside
+static const size_t SERVER_HEADER_BYTES = 176;
+// TLS record header, explicit nonce and AES-GCM tag on each side's record
+static const size_t TLS_RECORD_OVERHEAD = 5 + 8 + 16;
+
+static size_t decimalDigits(size_t value) {
+    size_t digits = 1;
+    while (value >= 10) {
+        value /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+bool HTTPClient::begin(WiFiClient& client, const String& url) {
+    (void)client;
+    this->client.reset();
+    this->url = url;
+    int pathStart = url.indexOf('/', url.indexOf("://") + 3);
+    uriLength = pathStart < 0 ? 1 : url.length() - pathStart;
+    addedHeaderBytes = 0;
+    response = "";
+    return url.startsWith("http://") || url.startsWith("https://");
+}
+
+bool HTTPClient::begin(WiFiClient& client, const String& host, uint16_t port, const String& uri, bool https) {
+    this->client = client.clone();
+    this->host = host;
+    this->port = port;
+    url = https ? "https://" : "http://";
+    url += host;
+    url += ':';
+    url += port;
+    url += uri;
+    uriLength = uri.length();
+    addedHeaderBytes = 0;
+    response = "";
+    return true;
+}
+
+void HTTPClient::end() {
+    if (client) {
+        client->stop();
+    }
+    url = "";
+}
+
+void HTTPClient::addHeader(const String& name, const String& value, bool first, bool replace) {
+    (void)first;
+    (void)replace;
+    addedHeaderBytes += name.length() + 2 + value.length() + 2;
+}
+
+int HTTPClient::GET() {
+    return sendRequest("GET", String());
+}
+
+int HTTPClient::POST(const String& payload) {
+    return sendRequest("POST", payload);
+}
+
+int HTTPClient::POST(const uint8_t* payload, size_t size) {
+    String body;
+    body.concat((const char*)payload, size);
+    return sendRequest("POST", body);
+}
+
+int HTTPClient::sendRequest(const char* type, const String& payload) {
+    if (url.length() == 0) {
+        return HTTPC_ERROR_CONNECTION_FAILED;
+    }
+    if (client && !client->connected() && !client->connect(host.c_str(), port)) {
+        return HTTPC_ERROR_CONNECTION_FAILED;
+    }
+    int code = NativeHal::respondToHttp(type, url, payload, response);
+    if (code > 0) {
+        size_t requestBytes = strlen(type) + 1 + uriLength + 11 + 6 + host.length() + 2 + CORE_HEADER_BYTES +
+            addedHeaderBytes + 2 + payload.length();
+        if (port != 80 && port != 443) {
+            requestBytes += 1 + decimalDigits(port);
+        }
+        if (payload.length() > 0) {
+            requestBytes += 18 + decimalDigits(payload.length());
+        }
+        size_t responseBytes = SERVER_HEADER_BYTES + 18 + decimalDigits(response.length()) + response.length();
+        if (url.startsWith("https://")) {
+            requestBytes += TLS_RECORD_OVERHEAD;
+            responseBytes += TLS_RECORD_OVERHEAD;
+        }
+        // Each side's data segment and the other's ACK of it
+        NativeHal::countWireTraffic(requestBytes + responseBytes + 4 * WiFiClient::SEGMENT_OVERHEAD, 1);
+    }
+    return code;
+}
@@ -0,0 +1,45 @@
+#ifndef NATIVE_ESP8266_HTTP_CLIENT_H
+#define NATIVE_ESP8266_HTTP_CLIENT_H
+
+#include <memory>
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+#define HTTPC_ERROR_CONNECTION_FAILED (-1)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+#define HTTP_CODE_OK 200
+
+// Each request is answered synchronously by NativeHal's HTTP responder. Given
+// a host and port, it first connects a copy of the client there, as the
+// ESP8266 core does, so a refused connection fails the request. Requests and
+// responses are counted on the wire with the header lines the core and the
+// server would add.
+class HTTPClient {
+private:
+    String url;
+    String response;
+    std::unique_ptr<WiFiClient> client;
+    String host;
+    uint16_t port = 0;
+    size_t uriLength = 0;
+    size_t addedHeaderBytes = 0;
+
+public:
+    bool begin(WiFiClient& client, const String& url);
+    bool begin(WiFiClient& client, const String& host, uint16_t port, const String& uri = "/", bool https = false);
+    void end();
+    void addHeader(const String& name, const String& value, bool first = false, bool replace = true);
+    void setTimeout(uint16_t timeout) { (void)timeout; }
+    void setReuse(bool reuse) { (void)reuse; }
+
+    int GET();
+    int POST(const String& payload);
+    int POST(const uint8_t* payload, size_t size);
+    int sendRequest(const char* type, const String& payload);
+
+    String getString() { return response; }
+    int getSize() { return response.length(); }
+};
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef NATIVE_ESP8266_HTTP_UPDATE_SERVER_H
+#define NATIVE_ESP8266_HTTP_UPDATE_SERVER_H
+
+#include "ESP8266WebServer.h"
+
+class ESP8266HTTPUpdateServer {
+public:
+    void setup(ESP8266WebServer* server) { (void)server; }
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef NATIVE_ESP8266_SSDP_H
+#define NATIVE_ESP8266_SSDP_H
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+// Nothing is announced from the host
+class SSDPClass {
+public:
+    bool begin() { return true; }
+    void schema(WiFiClient& client) { (void)client; }
+    void setSchemaURL(const String&) {}
+    void setHTTPPort(uint16_t) {}
+    void setName(const String&) {}
+    void setSerialNumber(const String&) {}
+    void setURL(const String&) {}
+    void setModelName(const String&) {}
+    void setModelNumber(const String&) {}
+    void setModelURL(const String&) {}
+    void setManufacturer(const String&) {}
+    void setManufacturerURL(const String&) {}
+    void setDeviceType(const String&) {}
+};
+
+extern SSDPClass SSDP;
+
+#endif
@@ -0,0 +1,194 @@
+#include "ESP8266WebServer.h"
+#include "ESP8266SSDP.h"
+#include "NativeHal.h"
+
+SSDPClass SSDP;
+
+// Requests are small; one that has not arrived in this long is dropped
+static const unsigned long REQUEST_TIMEOUT_MS = 2000;
+static const size_t MAX_REQUEST_BYTES = 16384;
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static String urlDecode(const String& encoded) {
+    String decoded;
+    for (unsigned int i = 0; i < encoded.length(); i++) {
+        char c = encoded[i];
+        if (c == '+') {
+            decoded += ' ';
+        } else if (c == '%' && i + 2 < encoded.length() && hexValue(encoded[i + 1]) >= 0 &&
+            hexValue(encoded[i + 2]) >= 0) {
+            decoded += (char)(hexValue(encoded[i + 1]) * 16 + hexValue(encoded[i + 2]));
+            i += 2;
+        } else {
+            decoded += c;
+        }
+    }
+    return decoded;
+}
+
+// name=value&name=value into the request arguments
+static void addFields(const String& fields) {
+    int start = 0;
+    while (start < (int)fields.length()) {
+        int end = fields.indexOf('&', start);
+        if (end < 0) {
+            end = fields.length();
+        }
+        String field = fields.substring(start, end);
+        int equals = field.indexOf('=');
+        if (field.length() > 0) {
+            NativeHal::setRequestArg(urlDecode(equals < 0 ? field : field.substring(0, equals)),
+                equals < 0 ? String() : urlDecode(field.substring(equals + 1)));
+        }
+        start = end + 1;
+    }
+}
+
+static HTTPMethod parseMethod(const String& name) {
+    static const struct {
+        const char* name;
+        HTTPMethod method;
+    } methods[] = {
+        { "GET", HTTP_GET }, { "HEAD", HTTP_HEAD }, { "POST", HTTP_POST }, { "PUT", HTTP_PUT },
+        { "PATCH", HTTP_PATCH }, { "DELETE", HTTP_DELETE }, { "OPTIONS", HTTP_OPTIONS }
+    };
+    for (const auto& candidate : methods) {
+        if (name == candidate.name) {
+            return candidate.method;
+        }
+    }
+    return HTTP_ANY;
+}
+
+void ESP8266WebServer::begin() {
+    if (NativeHal::isLive() && listener < 0) {
+        uint16_t livePort = NativeHal::getWebServerPort();
+        listener = NativeHal::listenOn(livePort ? livePort : port);
+    }
+}
+
+void ESP8266WebServer::close() {
+    NativeHal::closeSocket(listener);
+    listener = -1;
+}
+
+// Reads the request line, headers and body, and sets the arguments
+bool ESP8266WebServer::readRequest(int socket, HTTPMethod& method, String& uri) {
+    String request;
+    uint8_t buffer[1024];
+    int headerEnd = -1;
+    while (headerEnd < 0 && request.length() < MAX_REQUEST_BYTES) {
+        int received = NativeHal::readSocket(socket, buffer, sizeof(buffer), REQUEST_TIMEOUT_MS);
+        if (received <= 0) {
+            return false;
+        }
+        request.concat((const char*)buffer, received);
+        headerEnd = request.indexOf("\r\n\r\n");
+    }
+    if (headerEnd < 0) {
+        return false;
+    }
+
+    int methodEnd = request.indexOf(' ');
+    int uriEnd = request.indexOf(' ', methodEnd + 1);
+    if (methodEnd < 0 || uriEnd < 0) {
+        return false;
+    }
+    method = parseMethod(request.substring(0, methodEnd));
+    uri = request.substring(methodEnd + 1, uriEnd);
+
+    String headers = request.substring(0, headerEnd);
+    headers.toLowerCase();
+    long contentLength = 0;
+    int lengthAt = headers.indexOf("\r\ncontent-length:");
+    if (lengthAt >= 0) {
+        contentLength = headers.substring(lengthAt + 17).toInt();
+    }
+    if (contentLength < 0 || (size_t)contentLength > MAX_REQUEST_BYTES) {
+        return false;
+    }
+    String body = request.substring(headerEnd + 4);
+    while ((long)body.length() < contentLength) {
+        int received = NativeHal::readSocket(socket, buffer, sizeof(buffer), REQUEST_TIMEOUT_MS);
+        if (received <= 0) {
+            return false;
+        }
+        body.concat((const char*)buffer, received);
+    }
+
+    NativeHal::clearRequest();
+    int query = uri.indexOf('?');
+    if (query >= 0) {
+        addFields(uri.substring(query + 1));
+        uri = uri.substring(0, query);
+    }
+    if (body.length() > 0) {
+        if (headers.indexOf("\r\ncontent-type: application/x-www-form-urlencoded") >= 0) {
+            addFields(body);
+        }
+        NativeHal::setRequestArg("plain", body);
+    }
+    return true;
+}
+
+void ESP8266WebServer::handleClient() {
+    if (listener < 0) {
+        return;
+    }
+    int socket = NativeHal::acceptFrom(listener);
+    if (socket < 0) {
+        return;
+    }
+
+    HTTPMethod method;
+    String uri;
+    if (readRequest(socket, method, uri)) {
+        requestSocket = socket;
+        const Route* matched = nullptr;
+        for (const Route& route : routes) {
+            if (route.uri == uri && (route.method == HTTP_ANY || route.method == method)) {
+                matched = &route;
+                break;
+            }
+        }
+        if (matched) {
+            matched->handler();
+        } else {
+            send(404, "text/plain", "Not found");
+        }
+        requestSocket = -1;
+    }
+    NativeHal::closeSocket(socket);
+}
+
+String ESP8266WebServer::arg(const String& name) {
+    return NativeHal::getRequestArg(name);
+}
+
+bool ESP8266WebServer::hasArg(const String& name) {
+    return NativeHal::hasRequestArg(name);
+}
+
+void ESP8266WebServer::send(int code, const char* contentType, const String& content) {
+    NativeHal::recordResponse(code, contentType, content);
+    if (requestSocket < 0) {
+        return;
+    }
+    // The core's reason phrases aside; clients only read the code
+    String reply = "HTTP/1.1 " + String(code) + (code < 400 ? " OK" : " Error") + "\r\nContent-Type: " +
+        contentType + "\r\nContent-Length: " + String((unsigned long)content.length()) +
+        "\r\nConnection: close\r\n\r\n" + content;
+    NativeHal::writeSocket(requestSocket, (const uint8_t*)reply.c_str(), reply.length());
+}
@@ -0,0 +1,64 @@
+#ifndef NATIVE_ESP8266_WEB_SERVER_H
+#define NATIVE_ESP8266_WEB_SERVER_H
+
+#include <functional>
+#include <vector>
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+enum HTTPMethod {
+    HTTP_ANY,
+    HTTP_GET,
+    HTTP_HEAD,
+    HTTP_POST,
+    HTTP_PUT,
+    HTTP_PATCH,
+    HTTP_DELETE,
+    HTTP_OPTIONS
+};
+
+// Without live mode, routes are registered but never dispatched from a
+// socket: a harness calls the handlers directly, with the request arguments set
+// through NativeHal, and reads the reply back from it. In live mode the server
+// listens on NativeHal's web server port and handleClient() serves one waiting
+// request: query and form fields become arguments, the body is "plain".
+class ESP8266WebServer {
+public:
+    typedef std::function<void(void)> THandlerFunction;
+
+    explicit ESP8266WebServer(int port = 80) : port(port) {}
+    ~ESP8266WebServer() { close(); }
+
+    void begin();
+    void close();
+    void handleClient();
+    void on(const String& uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+    void on(const String& uri, HTTPMethod method, THandlerFunction handler) {
+        routes.push_back({ uri, method, handler });
+    }
+
+    String arg(const String& name);
+    bool hasArg(const String& name);
+    void send(int code, const char* contentType, const String& content);
+    void send(int code, const String& contentType, const String& content) {
+        send(code, contentType.c_str(), content);
+    }
+    WiFiClient& client() { return currentClient; }
+
+private:
+    struct Route {
+        String uri;
+        HTTPMethod method;
+        THandlerFunction handler;
+    };
+
+    int port;
+    std::vector<Route> routes;
+    int listener = -1;
+    int requestSocket = -1;     // Connection of the request being handled
+    WiFiClient currentClient;
+
+    bool readRequest(int socket, HTTPMethod& method, String& uri);
+};
+
+#endif
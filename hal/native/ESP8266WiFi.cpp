@@ -0,0 +1,75 @@
+#include "ESP8266WiFi.h"
+#include "NativeHal.h"
+
+ESP8266WiFiClass WiFi;
+
+wl_status_t ESP8266WiFiClass::begin(const char* ssid, const char* passphrase) {
+    (void)passphrase;
+    this->ssid = ssid;
+    return status();
+}
+
+bool ESP8266WiFiClass::disconnect(bool wifiOff) {
+    (void)wifiOff;
+    ssid = "";
+    return true;
+}
+
+wl_status_t ESP8266WiFiClass::status() {
+    return NativeHal::isWiFiConnected() ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+String ESP8266WiFiClass::macAddress() {
+    const uint8_t* mac = NativeHal::getMacAddress();
+    char buf[18];
+    snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return String(buf);
+}
+
+uint8_t* ESP8266WiFiClass::macAddress(uint8_t* mac) {
+    memcpy(mac, NativeHal::getMacAddress(), 6);
+    return mac;
+}
+
+IPAddress ESP8266WiFiClass::localIP() {
+    if (!isConnected()) {
+        return IPAddress();
+    }
+    // Live, the web server listens on loopback
+    return NativeHal::isLive() ? IPAddress(127, 0, 0, 1) : IPAddress(192, 168, 1, 50);
+}
+
+IPAddress ESP8266WiFiClass::gatewayIP() {
+    return isConnected() ? IPAddress(192, 168, 1, 1) : IPAddress();
+}
+
+IPAddress ESP8266WiFiClass::subnetMask() {
+    return isConnected() ? IPAddress(255, 255, 255, 0) : IPAddress();
+}
+
+IPAddress ESP8266WiFiClass::dnsIP(uint8_t index) {
+    (void)index;
+    return gatewayIP();
+}
+
+int ESP8266WiFiClass::hostByName(const char* host, IPAddress& address) {
+    String found;
+    return NativeHal::lookUpHost(host, found) && address.fromString(found) ? 1 : 0;
+}
+
+String ESP8266WiFiClass::SSID() const {
+    return ssid;
+}
+
+bool ESP8266WiFiClass::softAPConfig(IPAddress localIp, IPAddress gateway, IPAddress subnet) {
+    (void)gateway;
+    (void)subnet;
+    softApAddress = localIp;
+    return true;
+}
+
+bool ESP8266WiFiClass::softAP(const char* ssid, const char* passphrase) {
+    (void)ssid;
+    (void)passphrase;
+    return true;
+}
@@ -0,0 +1,95 @@
+#ifndef NATIVE_ESP8266_WIFI_H
+#define NATIVE_ESP8266_WIFI_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "WiFiClient.h"
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_WRONG_PASSWORD = 6,
+    WL_DISCONNECTED = 7
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} WiFiMode_t;
+
+typedef enum {
+    WIFI_PHY_MODE_11B = 1,
+    WIFI_PHY_MODE_11G = 2,
+    WIFI_PHY_MODE_11N = 3
+} WiFiPhyMode_t;
+
+typedef enum {
+    WIFI_NONE_SLEEP = 0,
+    WIFI_LIGHT_SLEEP = 1,
+    WIFI_MODEM_SLEEP = 2
+} WiFiSleepType_t;
+
+enum wl_enc_type {
+    ENC_TYPE_WEP = 5,
+    ENC_TYPE_TKIP = 2,
+    ENC_TYPE_CCMP = 4,
+    ENC_TYPE_NONE = 7,
+    ENC_TYPE_AUTO = 8
+};
+
+// Station that is connected exactly when NativeHal says so, with fixed
+// addresses (loopback in live mode). Scans find nothing.
+class ESP8266WiFiClass {
+public:
+    bool mode(WiFiMode_t mode) { (void)mode; return true; }
+    wl_status_t begin(const char* ssid, const char* passphrase = nullptr);
+    bool disconnect(bool wifiOff = false);
+    wl_status_t status();
+    bool isConnected() { return status() == WL_CONNECTED; }
+
+    String macAddress();
+    uint8_t* macAddress(uint8_t* mac);
+    IPAddress localIP();
+    IPAddress gatewayIP();
+    IPAddress subnetMask();
+    IPAddress dnsIP(uint8_t index = 0);
+    int hostByName(const char* host, IPAddress& address);
+    String SSID() const;
+    int32_t RSSI() { return -60; }
+
+    bool hostname(const String& name) { (void)name; return true; }
+    void setOutputPower(float dBm) { (void)dBm; }
+    bool setPhyMode(WiFiPhyMode_t mode) { (void)mode; return true; }
+    bool setSleepMode(WiFiSleepType_t type, uint8_t listenInterval = 0) {
+        sleepType = type;
+        (void)listenInterval;
+        return true;
+    }
+    WiFiSleepType_t getSleepMode() { return sleepType; }
+
+    bool enableAP(bool enable) { (void)enable; return true; }
+    bool softAPConfig(IPAddress localIp, IPAddress gateway, IPAddress subnet);
+    bool softAP(const char* ssid, const char* passphrase = nullptr);
+    bool softAPdisconnect(bool wifiOff = false) { (void)wifiOff; return true; }
+    IPAddress softAPIP() { return softApAddress; }
+
+    int8_t scanNetworks() { return 0; }
+    String SSID(uint8_t index) { (void)index; return String(); }
+    int32_t RSSI(uint8_t index) { (void)index; return 0; }
+    uint8_t encryptionType(uint8_t index) { (void)index; return ENC_TYPE_NONE; }
+
+private:
+    String ssid;
+    IPAddress softApAddress;
+    WiFiSleepType_t sleepType = WIFI_NONE_SLEEP;
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef NATIVE_ESP8266_HTTP_UPDATE_H
+#define NATIVE_ESP8266_HTTP_UPDATE_H
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+enum HTTPUpdateResult {
+    HTTP_UPDATE_FAILED,
+    HTTP_UPDATE_NO_UPDATES,
+    HTTP_UPDATE_OK
+};
+typedef HTTPUpdateResult t_httpUpdate_return;
+
+// There is no flash to update on the host; every update fails cleanly
+class ESP8266HTTPUpdate {
+public:
+    void rebootOnUpdate(bool reboot) { (void)reboot; }
+    t_httpUpdate_return update(WiFiClient& client, const String& url) {
+        (void)client;
+        (void)url;
+        return HTTP_UPDATE_FAILED;
+    }
+    String getLastErrorString() { return String("Firmware updates are not supported on native"); }
+};
+
+extern ESP8266HTTPUpdate ESPhttpUpdate;
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef NATIVE_IPADDRESS_H
+#define NATIVE_IPADDRESS_H
+
+#include "Arduino.h"
+
+class IPAddress : public Printable {
+private:
+    uint8_t octets[4];
+
+public:
+    IPAddress() : octets{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets{a, b, c, d} {}
+
+    uint8_t operator[](int index) const { return octets[index]; }
+    uint8_t& operator[](int index) { return octets[index]; }
+    bool operator==(const IPAddress& rhs) const { return memcmp(octets, rhs.octets, 4) == 0; }
+    bool isSet() const { return octets[0] || octets[1] || octets[2] || octets[3]; }
+
+    bool fromString(const char* address) {
+        unsigned int parts[4];
+        char extra;
+        if (sscanf(address, "%u.%u.%u.%u%c", &parts[0], &parts[1], &parts[2], &parts[3], &extra) != 4) {
+            return false;
+        }
+        for (int i = 0; i < 4; i++) {
+            if (parts[i] > 255) {
+                return false;
+            }
+            octets[i] = parts[i];
+        }
+        return true;
+    }
+    bool fromString(const String& address) { return fromString(address.c_str()); }
+
+    String toString() const {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+        return String(buf);
+    }
+
+    size_t printTo(Print& p) const override {
+        return p.print(toString());
+    }
+};
+
+#endif
@@ -0,0 +1,846 @@
+#include "NativeHal.h"
+#include "Arduino.h"
+#include "DallasTemperature.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <map>
+#include <set>
+#include <new>
+#include <string>
+#include <thread>
+
+static const size_t EEPROM_FLASH_SIZE = 4096;
+static const size_t RTC_USER_MEMORY_SIZE = 512;
+static const uint8_t DEFAULT_MAC[6] = { 0x5E, 0xCF, 0x7F, 0x00, 0x00, 0x01 };
+// How long fetchHttp() waits on a server, as HTTPClient's default timeout
+static const int HTTP_TIMEOUT_MS = 5000;
+
+struct Timer {
+    const void* owner;
+    unsigned long dueAt;
+    std::function<void()> callback;
+};
+
+static struct {
+    unsigned long nowMs;
+    unsigned long nowUsRemainder;
+    int pins[NUM_PINS];
+    void (*interruptHandlers[NUM_PINS])();
+    int interruptModes[NUM_PINS];
+    int analogInput;
+    uint8_t probeCount;
+    float temperatures[NativeHal::MAX_PROBES];
+    bool wifiConnected;
+    bool serialEnabled = true;
+    bool live;
+    bool followingHostClock;
+    std::chrono::steady_clock::time_point liveEpoch;    // Host time at millis() == 0
+    uint16_t webServerPort;
+    String resetReason;
+    uint64_t deepSleepUs;
+    uint8_t mac[6];
+    NativeHal::HttpResponder httpResponder;
+    NativeHal::UdpResponder udpResponder;
+    std::map<std::string, String> requestArgs;
+    std::map<std::string, String> hostAddresses;
+    std::set<std::string> unreachableAddresses;
+    bool tlsResumption;
+    std::set<std::string> tlsSessions;
+    uint32_t tlsSessionsIssued;
+    int responseCode;
+    String responseBody;
+    uint8_t eepromFlash[EEPROM_FLASH_SIZE];
+    uint8_t rtcUserMemory[RTC_USER_MEMORY_SIZE];
+    Timer timers[8];
+    NativeHal::Counters counters;
+} hal;
+
+namespace NativeHal {
+
+    void reset() {
+        hal.nowMs = 0;
+        hal.nowUsRemainder = 0;
+        for (int i = 0; i < NUM_PINS; i++) {
+            hal.pins[i] = HIGH;     // Inputs float high under their pull-ups
+            hal.interruptHandlers[i] = nullptr;
+        }
+        hal.analogInput = 512;
+        hal.probeCount = 1;
+        for (float& temperature : hal.temperatures) {
+            temperature = 21.5f;
+        }
+        hal.wifiConnected = false;
+        hal.resetReason = "External System";
+        hal.deepSleepUs = 0;
+        memcpy(hal.mac, DEFAULT_MAC, sizeof(hal.mac));
+        hal.httpResponder = HttpResponder();
+        hal.udpResponder = UdpResponder();
+        hal.hostAddresses.clear();
+        hal.unreachableAddresses.clear();
+        hal.tlsResumption = true;
+        hal.tlsSessions.clear();
+        hal.tlsSessionsIssued = 0;
+        clearRequest();
+        hal.responseCode = 0;
+        hal.responseBody = "";
+        memset(hal.eepromFlash, 0xFF, sizeof(hal.eepromFlash));
+        memset(hal.rtcUserMemory, 0, sizeof(hal.rtcUserMemory));
+        for (Timer& timer : hal.timers) {
+            timer.owner = nullptr;
+            timer.callback = nullptr;
+        }
+        resetCounters();
+    }
+
+    // Power on
+    static bool poweredOn = (reset(), true);
+
+    void advanceMillis(unsigned long ms) {
+        unsigned long target = hal.nowMs + ms;
+        // Fire due timers in order, each seeing the clock at its due time
+        while (true) {
+            Timer* next = nullptr;
+            for (Timer& timer : hal.timers) {
+                if (timer.owner && timer.dueAt <= target && (!next || timer.dueAt < next->dueAt)) {
+                    next = &timer;
+                }
+            }
+            if (!next) {
+                break;
+            }
+            if (next->dueAt > hal.nowMs) {
+                hal.nowMs = next->dueAt;
+            }
+            std::function<void()> callback = next->callback;
+            next->owner = nullptr;
+            next->callback = nullptr;
+            callback();
+        }
+        hal.nowMs = target;
+    }
+
+    void setDigitalInput(uint8_t pin, int value) {
+        if (pin >= NUM_PINS) {
+            return;
+        }
+        int previous = hal.pins[pin];
+        hal.pins[pin] = value ? HIGH : LOW;
+
+        void (*handler)() = hal.interruptHandlers[pin];
+        int mode = hal.interruptModes[pin];
+        bool rose = previous == LOW && hal.pins[pin] == HIGH;
+        bool fell = previous == HIGH && hal.pins[pin] == LOW;
+        if (handler && ((rose && mode != FALLING) || (fell && mode != RISING))) {
+            handler();
+        }
+    }
+
+    int getPinState(uint8_t pin) {
+        return pin < NUM_PINS ? hal.pins[pin] : LOW;
+    }
+
+    void setAnalogInput(int value) {
+        hal.analogInput = value;
+    }
+
+    void setProbeCount(uint8_t count) {
+        hal.probeCount = std::min<uint8_t>(count, MAX_PROBES);
+    }
+
+    uint8_t getProbeCount() {
+        return hal.probeCount;
+    }
+
+    void setTemperature(float celsius, uint8_t probe) {
+        if (probe < MAX_PROBES) {
+            hal.temperatures[probe] = celsius;
+        }
+    }
+
+    float getTemperature(uint8_t probe) {
+        return probe < hal.probeCount ? hal.temperatures[probe] : DEVICE_DISCONNECTED_C;
+    }
+
+    void countOneWireSearch() {
+        hal.counters.oneWireSearches++;
+    }
+
+    void setWiFiConnected(bool connected) {
+        hal.wifiConnected = connected;
+    }
+
+    bool isWiFiConnected() {
+        return hal.wifiConnected;
+    }
+
+    void setHttpResponder(HttpResponder responder) {
+        hal.httpResponder = responder;
+    }
+
+    int respondToHttp(const String& method, const String& url, const String& body, String& response) {
+        hal.counters.httpRequests++;
+        response = "";
+        if (!hal.wifiConnected || !hal.httpResponder) {
+            return -1;  // HTTPC_ERROR_CONNECTION_FAILED
+        }
+        return hal.httpResponder(method, url, body, response);
+    }
+
+    void setHostAddress(const String& host, const String& address) {
+        hal.hostAddresses[host.c_str()] = address;
+    }
+
+    bool lookUpHost(const String& host, String& address) {
+        hal.counters.dnsLookups++;
+        auto found = hal.hostAddresses.find(host.c_str());
+        if (hal.wifiConnected && found == hal.hostAddresses.end() && hal.live) {
+            addrinfo hints = {};
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo* results = nullptr;
+            if (getaddrinfo(host.c_str(), nullptr, &hints, &results) == 0 && results) {
+                char dotted[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &((sockaddr_in*)results->ai_addr)->sin_addr, dotted, sizeof(dotted));
+                found = hal.hostAddresses.emplace(host.c_str(), String(dotted)).first;
+            }
+            if (results) {
+                freeaddrinfo(results);
+            }
+        }
+        if (!hal.wifiConnected || found == hal.hostAddresses.end()) {
+            return false;
+        }
+        address = found->second;
+        return true;
+    }
+
+    void setAddressReachable(const String& address, bool reachable) {
+        if (reachable) {
+            hal.unreachableAddresses.erase(address.c_str());
+        } else {
+            hal.unreachableAddresses.insert(address.c_str());
+        }
+    }
+
+    bool connectTo(const String& address) {
+        hal.counters.tcpConnects++;
+        return hal.wifiConnected && hal.unreachableAddresses.count(address.c_str()) == 0;
+    }
+
+    void setUdpResponder(UdpResponder responder) {
+        hal.udpResponder = responder;
+    }
+
+    size_t respondToUdp(uint16_t port, const uint8_t* datagram, size_t length, uint8_t* reply, size_t capacity) {
+        // IPv4 and UDP headers
+        static const size_t DATAGRAM_OVERHEAD = 28;
+        if (!hal.wifiConnected) {
+            return 0;
+        }
+        hal.counters.wireBytes += DATAGRAM_OVERHEAD + length;
+        size_t replyLength = hal.udpResponder ? hal.udpResponder(port, datagram, length, reply, capacity) : 0;
+        if (replyLength > 0) {
+            hal.counters.wireBytes += DATAGRAM_OVERHEAD + replyLength;
+            hal.counters.roundTrips++;
+        }
+        return replyLength;
+    }
+
+    void countWireTraffic(size_t bytes, uint32_t roundTrips) {
+        hal.counters.wireBytes += bytes;
+        hal.counters.roundTrips += roundTrips;
+    }
+
+    void setTlsResumption(bool enabled) {
+        hal.tlsResumption = enabled;
+        if (!enabled) {
+            hal.tlsSessions.clear();
+        }
+    }
+
+    bool resumeTlsSession(const uint8_t* id, size_t length) {
+        if (!hal.tlsSessions.count(std::string((const char*)id, length))) {
+            return false;
+        }
+        hal.counters.tlsResumptions++;
+        return true;
+    }
+
+    void addTlsSession(uint8_t* id, size_t length) {
+        hal.counters.tlsHandshakes++;
+        // Numbered rather than random, so runs repeat
+        uint32_t number = ++hal.tlsSessionsIssued;
+        memset(id, 0, length);
+        memcpy(id, &number, length < sizeof(number) ? length : sizeof(number));
+        if (hal.tlsResumption) {
+            hal.tlsSessions.insert(std::string((const char*)id, length));
+        }
+    }
+
+    void setLive(bool live) {
+        hal.live = live;
+        if (live) {
+            // The clock carries on from where it is
+            hal.liveEpoch = std::chrono::steady_clock::now() - std::chrono::milliseconds(hal.nowMs);
+        }
+    }
+
+    bool isLive() {
+        return hal.live;
+    }
+
+    // Brings the simulated clock up to the host's, firing timers on the way
+    static void followHostClock() {
+        if (!hal.live || hal.followingHostClock) {
+            return;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - hal.liveEpoch).count();
+        if ((unsigned long)elapsed > hal.nowMs) {
+            // Timer callbacks read millis() too
+            hal.followingHostClock = true;
+            advanceMillis((unsigned long)elapsed - hal.nowMs);
+            hal.followingHostClock = false;
+        }
+    }
+
+    void setWebServerPort(uint16_t port) {
+        hal.webServerPort = port;
+    }
+
+    uint16_t getWebServerPort() {
+        return hal.webServerPort;
+    }
+
+    int openSocket(const String& address, uint16_t port) {
+        sockaddr_in peer = {};
+        peer.sin_family = AF_INET;
+        peer.sin_port = htons(port);
+        if (inet_pton(AF_INET, address.c_str(), &peer.sin_addr) != 1) {
+            return -1;
+        }
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (connect(fd, (sockaddr*)&peer, sizeof(peer)) != 0) {
+            close(fd);
+            return -1;
+        }
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        return fd;
+    }
+
+    int listenOn(uint16_t port) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_port = htons(port);
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd, (sockaddr*)&local, sizeof(local)) != 0 || listen(fd, 8) != 0) {
+            close(fd);
+            return -1;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        return fd;
+    }
+
+    int acceptFrom(int listener) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd >= 0) {
+            // Accepted sockets inherit O_NONBLOCK on some systems; reads poll anyway
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        }
+        return fd;
+    }
+
+    int socketAvailable(int socket) {
+        int pending = 0;
+        if (ioctl(socket, FIONREAD, &pending) != 0) {
+            return -1;
+        }
+        if (pending > 0) {
+            return pending;
+        }
+        // Nothing queued: either quiet or closed
+        uint8_t probe;
+        ssize_t peeked = recv(socket, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (peeked == 0 || (peeked < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            return -1;
+        }
+        return peeked > 0 ? 1 : 0;
+    }
+
+    int readSocket(int socket, uint8_t* buffer, size_t capacity, unsigned long timeoutMs) {
+        pollfd waiting = { socket, POLLIN, 0 };
+        if (poll(&waiting, 1, (int)timeoutMs) <= 0) {
+            return 0;
+        }
+        ssize_t received = recv(socket, buffer, capacity, MSG_DONTWAIT);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        return received > 0 ? (int)received : -1;
+    }
+
+    bool writeSocket(int socket, const uint8_t* data, size_t length) {
+        while (length > 0) {
+            ssize_t sent = send(socket, data, length, MSG_NOSIGNAL);
+            if (sent <= 0) {
+                return false;
+            }
+            data += sent;
+            length -= sent;
+        }
+        return true;
+    }
+
+    void closeSocket(int socket) {
+        if (socket >= 0) {
+            close(socket);
+        }
+    }
+
+    // Splits http://host[:port]/path; https is not spoken here
+    static bool splitUrl(const String& url, String& host, uint16_t& port, String& path) {
+        if (!url.startsWith("http://")) {
+            return false;
+        }
+        int hostStart = 7;
+        int pathStart = url.indexOf('/', hostStart);
+        String authority = pathStart < 0 ? url.substring(hostStart) : url.substring(hostStart, pathStart);
+        path = pathStart < 0 ? String("/") : url.substring(pathStart);
+        int colon = authority.indexOf(':');
+        host = colon < 0 ? authority : authority.substring(0, colon);
+        long parsedPort = colon < 0 ? 80 : authority.substring(colon + 1).toInt();
+        if (host.length() == 0 || parsedPort <= 0 || parsedPort > 65535) {
+            return false;
+        }
+        port = (uint16_t)parsedPort;
+        return true;
+    }
+
+    // Undoes Transfer-Encoding: chunked
+    static String unchunk(const String& body) {
+        String joined;
+        int position = 0;
+        while (position < (int)body.length()) {
+            int lineEnd = body.indexOf("\r\n", position);
+            if (lineEnd < 0) {
+                break;
+            }
+            long size = strtol(body.substring(position, lineEnd).c_str(), nullptr, 16);
+            if (size <= 0) {
+                break;
+            }
+            joined += body.substring(lineEnd + 2, lineEnd + 2 + size);
+            position = lineEnd + 2 + size + 2;
+        }
+        return joined;
+    }
+
+    int fetchHttp(const String& method, const String& url, const String& body, String& response) {
+        response = "";
+        String host;
+        String path;
+        uint16_t port;
+        String address;
+        if (!splitUrl(url, host, port, path) || !lookUpHost(host, address)) {
+            return -1;  // HTTPC_ERROR_CONNECTION_FAILED
+        }
+        int fd = openSocket(address, port);
+        if (fd < 0) {
+            return -1;
+        }
+
+        // The firmware only ever posts JSON
+        String request = method + " " + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n";
+        if (body.length() > 0) {
+            request += "Content-Type: application/json\r\n";
+        }
+        request += "Content-Length: " + String((unsigned long)body.length()) + "\r\n\r\n" + body;
+        if (!writeSocket(fd, (const uint8_t*)request.c_str(), request.length())) {
+            close(fd);
+            return -1;
+        }
+
+        // Connection: close, so the reply ends where the stream does
+        String reply;
+        uint8_t buffer[1024];
+        while (true) {
+            int received = readSocket(fd, buffer, sizeof(buffer), HTTP_TIMEOUT_MS);
+            if (received == 0) {
+                close(fd);
+                return -11;     // HTTPC_ERROR_READ_TIMEOUT
+            }
+            if (received < 0) {
+                break;
+            }
+            reply.concat((const char*)buffer, received);
+        }
+        close(fd);
+
+        int headerEnd = reply.indexOf("\r\n\r\n");
+        int code = reply.startsWith("HTTP/1.") ? reply.substring(9, 12).toInt() : 0;
+        if (headerEnd < 0 || code <= 0) {
+            return -1;
+        }
+        String headers = reply.substring(0, headerEnd);
+        headers.toLowerCase();
+        response = reply.substring(headerEnd + 4);
+        if (headers.indexOf("transfer-encoding: chunked") >= 0) {
+            response = unchunk(response);
+        }
+        return code;
+    }
+
+    void setRequestArg(const String& name, const String& value) {
+        hal.requestArgs[name.c_str()] = value;
+    }
+
+    void clearRequest() {
+        hal.requestArgs.clear();
+    }
+
+    String getRequestArg(const String& name) {
+        auto found = hal.requestArgs.find(name.c_str());
+        return found == hal.requestArgs.end() ? String() : found->second;
+    }
+
+    bool hasRequestArg(const String& name) {
+        return hal.requestArgs.count(name.c_str()) > 0;
+    }
+
+    void recordResponse(int code, const String& contentType, const String& body) {
+        (void)contentType;
+        hal.responseCode = code;
+        hal.responseBody = body;
+    }
+
+    int getResponseCode() {
+        return hal.responseCode;
+    }
+
+    const String& getResponseBody() {
+        return hal.responseBody;
+    }
+
+    void setResetReason(const String& reason) {
+        hal.resetReason = reason;
+    }
+
+    String getResetReason() {
+        return hal.resetReason;
+    }
+
+    uint64_t getDeepSleepMicros() {
+        return hal.deepSleepUs;
+    }
+
+    void setMacAddress(const uint8_t* mac) {
+        memcpy(hal.mac, mac, sizeof(hal.mac));
+    }
+
+    const uint8_t* getMacAddress() {
+        return hal.mac;
+    }
+
+    void setSerialEnabled(bool enabled) {
+        hal.serialEnabled = enabled;
+    }
+
+    bool isSerialEnabled() {
+        return hal.serialEnabled;
+    }
+
+    const Counters& getCounters() {
+        return hal.counters;
+    }
+
+    void resetCounters() {
+        hal.counters = Counters();
+    }
+
+    void countAllocation(size_t bytes) {
+        hal.counters.allocations++;
+        hal.counters.allocatedBytes += bytes;
+    }
+
+    uint8_t* eepromFlash() {
+        return hal.eepromFlash;
+    }
+
+    size_t eepromFlashSize() {
+        return sizeof(hal.eepromFlash);
+    }
+
+    uint8_t* rtcMemory() {
+        return hal.rtcUserMemory;
+    }
+
+    size_t rtcMemorySize() {
+        return sizeof(hal.rtcUserMemory);
+    }
+
+    void countEepromCommit(bool wroteFlash) {
+        hal.counters.eepromCommits++;
+        if (wroteFlash) {
+            hal.counters.flashWrites++;
+        }
+    }
+
+    void scheduleTimer(const void* owner, unsigned long delayMs, std::function<void()> callback) {
+        cancelTimer(owner);
+        for (Timer& timer : hal.timers) {
+            if (!timer.owner) {
+                timer.owner = owner;
+                timer.dueAt = hal.nowMs + delayMs;
+                timer.callback = callback;
+                return;
+            }
+        }
+    }
+
+    void cancelTimer(const void* owner) {
+        for (Timer& timer : hal.timers) {
+            if (timer.owner == owner) {
+                timer.owner = nullptr;
+                timer.callback = nullptr;
+            }
+        }
+    }
+}
+
+// Every heap allocation the firmware makes through new is counted
+void* operator new(size_t size) {
+    NativeHal::countAllocation(size);
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+// Kept out of line: inlined at -O2, GCC pairs the free() with the library's
+// operator new and warns about a mismatch that is not there
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+// Arduino core
+
+HardwareSerial Serial;
+EspClass ESP;
+
+// lwIP's TIME_WAIT list, drained by the firmware before sleeping
+struct tcp_pcb* tcp_tw_pcbs = nullptr;
+extern "C" void tcp_abort(struct tcp_pcb*) {}
+
+unsigned long millis() {
+    NativeHal::followHostClock();
+    return hal.nowMs;
+}
+
+unsigned long micros() {
+    if (hal.live) {
+        return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - hal.liveEpoch).count();
+    }
+    return hal.nowMs * 1000 + hal.nowUsRemainder;
+}
+
+void delay(unsigned long ms) {
+    if (hal.live) {
+        std::this_thread::sleep_until(hal.liveEpoch + std::chrono::milliseconds(millis() + ms));
+        NativeHal::followHostClock();
+        return;
+    }
+    NativeHal::advanceMillis(ms);
+}
+
+void delayMicroseconds(unsigned int us) {
+    if (hal.live) {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+        return;
+    }
+    hal.nowUsRemainder += us;
+    if (hal.nowUsRemainder >= 1000) {
+        unsigned long ms = hal.nowUsRemainder / 1000;
+        hal.nowUsRemainder %= 1000;
+        NativeHal::advanceMillis(ms);
+    }
+}
+
+void yield() {
+    NativeHal::followHostClock();
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin < NUM_PINS && mode == INPUT_PULLUP) {
+        hal.pins[pin] = HIGH;
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin < NUM_PINS) {
+        hal.pins[pin] = value ? HIGH : LOW;
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    return NativeHal::getPinState(pin);
+}
+
+int analogRead(uint8_t pin) {
+    (void)pin;
+    return hal.analogInput;
+}
+
+void analogWrite(uint8_t pin, int value) {
+    (void)pin;
+    (void)value;
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode) {
+    if (interrupt < NUM_PINS) {
+        hal.interruptHandlers[interrupt] = handler;
+        hal.interruptModes[interrupt] = mode;
+    }
+}
+
+void detachInterrupt(uint8_t interrupt) {
+    if (interrupt < NUM_PINS) {
+        hal.interruptHandlers[interrupt] = nullptr;
+    }
+}
+
+long random(long howBig) {
+    return howBig > 0 ? rand() % howBig : 0;
+}
+
+long random(long howSmall, long howBig) {
+    return howSmall >= howBig ? howSmall : howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed) {
+    srand((unsigned int)seed);
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        n += write(*buffer++);
+    }
+    return n;
+}
+
+size_t Print::print(long long value, int base) {
+    return print(String(value, (unsigned char)base));
+}
+
+size_t Print::print(unsigned long long value, int base) {
+    return print(String(value, (unsigned char)base));
+}
+
+size_t Print::print(double value, int digits) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", digits, value);
+    return write(buf);
+}
+
+size_t Print::printf(const char* format, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (length < 0) {
+        return 0;
+    }
+    return write((const uint8_t*)buf, (size_t)length < sizeof(buf) ? length : sizeof(buf) - 1);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    if (hal.serialEnabled) {
+        fputc(c, stdout);
+    }
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    if (hal.serialEnabled) {
+        fwrite(buffer, 1, size, stdout);
+    }
+    return size;
+}
+
+// On a device neither of these returns; here the harness sees the counter and
+// decides what happens next, with the reset reason the next boot would report
+void EspClass::deepSleep(uint64_t timeUs) {
+    hal.deepSleepUs = timeUs;
+    hal.counters.deepSleeps++;
+    hal.resetReason = "Deep-Sleep Wake";
+}
+
+void EspClass::restart() {
+    hal.counters.restarts++;
+    hal.resetReason = "Software/System restart";
+}
+
+String EspClass::getResetReason() {
+    return hal.resetReason;
+}
+
+uint32_t EspClass::getFreeHeap() {
+    // Typical for the firmware once WiFi is up on an ESP-12F
+    return 40000;
+}
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size) {
+    if (offset * 4 + size > RTC_USER_MEMORY_SIZE) {
+        return false;
+    }
+    memcpy(data, hal.rtcUserMemory + offset * 4, size);
+    return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size) {
+    if (offset * 4 + size > RTC_USER_MEMORY_SIZE) {
+        return false;
+    }
+    memcpy(hal.rtcUserMemory + offset * 4, data, size);
+    return true;
+}
@@ -0,0 +1,134 @@
+#ifndef NATIVE_HAL_H
+#define NATIVE_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include "WString.h"
+
+// Host side of the native HAL: the firmware talks to the fake Arduino core,
+// EEPROM, WiFi, HTTPClient, web server and OneWire APIs as usual, and a harness
+// uses these functions to play the world around it and to read what the
+// firmware did.
+namespace NativeHal {
+
+    struct Counters {
+        uint32_t allocations;       // operator new and String buffer (re)allocations
+        uint64_t allocatedBytes;
+        uint32_t eepromCommits;     // EEPROM.commit() calls
+        uint32_t flashWrites;       // Commits that had changed bytes to write out
+        uint32_t httpRequests;
+        uint32_t restarts;
+        uint32_t deepSleeps;
+        uint32_t oneWireSearches;   // DallasTemperature::begin() bus searches
+        uint32_t dnsLookups;        // WiFi.hostByName() calls
+        uint32_t tcpConnects;       // WiFiClient connection attempts
+        uint64_t wireBytes;         // IP packets sent and received, headers included
+        uint32_t roundTrips;        // Waits for the network: handshakes, requests, datagram replies
+        uint32_t tlsHandshakes;     // Full TLS handshakes
+        uint32_t tlsResumptions;    // TLS sessions resumed by ID
+    };
+
+    // Answers the firmware's outgoing HTTP requests: returns the status code
+    // (negative for a connection failure) and fills in the response body
+    typedef std::function<int(const String& method, const String& url, const String& body, String& response)> HttpResponder;
+
+    // Answers datagrams the firmware sends: fills in up to capacity bytes of
+    // reply and returns its length, 0 for none (or a lost datagram)
+    typedef std::function<size_t(uint16_t port, const uint8_t* datagram, size_t length, uint8_t* reply,
+        size_t capacity)> UdpResponder;
+
+    // Back to a freshly flashed device: erased EEPROM, empty RTC memory, clock
+    // at zero, WiFi down, no responder, counters cleared
+    void reset();
+
+    // Clock
+    void advanceMillis(unsigned long ms);   // Runs any Ticker callbacks that fall due
+
+    // GPIO and sensors
+    void setDigitalInput(uint8_t pin, int value);  // Runs an attached interrupt handler on a matching edge
+    int getPinState(uint8_t pin);
+    void setAnalogInput(int value);
+    static const uint8_t MAX_PROBES = 16;
+    void setProbeCount(uint8_t count);      // DS18B20s on the OneWire bus, 1 after reset()
+    uint8_t getProbeCount();
+    void setTemperature(float celsius, uint8_t probe = 0);
+    float getTemperature(uint8_t probe = 0);
+    void countOneWireSearch();
+
+    // Network
+    void setWiFiConnected(bool connected);
+    bool isWiFiConnected();
+    void setHttpResponder(HttpResponder responder);
+    int respondToHttp(const String& method, const String& url, const String& body, String& response);
+    // Addresses are dotted quads. Hosts resolve only once given an address;
+    // every address accepts connections while WiFi is up unless marked otherwise.
+    void setHostAddress(const String& host, const String& address);
+    bool lookUpHost(const String& host, String& address);
+    void setAddressReachable(const String& address, bool reachable);
+    bool connectTo(const String& address);
+    void setUdpResponder(UdpResponder responder);
+    size_t respondToUdp(uint16_t port, const uint8_t* datagram, size_t length, uint8_t* reply, size_t capacity);
+    void countWireTraffic(size_t bytes, uint32_t roundTrips);
+    // TLS server side: sessions it remembers for resumption, each given a new
+    // ID on a full handshake. Resumption is on after reset().
+    void setTlsResumption(bool enabled);
+    bool resumeTlsSession(const uint8_t* id, size_t length);
+    void addTlsSession(uint8_t* id, size_t length);
+
+    // Live mode runs the firmware as a device on the host (fleet/). The clock
+    // follows the host's and delay() sleeps; hosts without an address given
+    // resolve through the host; WiFiClient connections and the web server use
+    // real TCP sockets. HTTPClient still goes through the HTTP responder, which
+    // can pass requests on to a real server with fetchHttp(). UDP stays with
+    // its responder, and TLS connections fail.
+    void setLive(bool live);
+    bool isLive();
+    void setWebServerPort(uint16_t port);   // Listened on instead of the port the firmware asks for
+    uint16_t getWebServerPort();
+    int fetchHttp(const String& method, const String& url, const String& body, String& response);
+    // Blocking connect on a TCP socket; -1 on failure
+    int openSocket(const String& address, uint16_t port);
+    int listenOn(uint16_t port);
+    int acceptFrom(int listener);           // -1 when no connection is waiting
+    int socketAvailable(int socket);        // Bytes readable now, -1 once the peer has closed
+    // Waits up to timeoutMs for data; 0 when none came, -1 once the peer has closed
+    int readSocket(int socket, uint8_t* buffer, size_t capacity, unsigned long timeoutMs = 0);
+    bool writeSocket(int socket, const uint8_t* data, size_t length);
+    void closeSocket(int socket);
+
+    // Request seen by the web server route handlers, and the reply they sent
+    void setRequestArg(const String& name, const String& value);
+    void clearRequest();
+    String getRequestArg(const String& name);
+    bool hasRequestArg(const String& name);
+    void recordResponse(int code, const String& contentType, const String& body);
+    int getResponseCode();
+    const String& getResponseBody();
+
+    // Boot state
+    void setResetReason(const String& reason);
+    String getResetReason();
+    uint64_t getDeepSleepMicros();          // Asked for by the last ESP.deepSleep()
+    void setMacAddress(const uint8_t* mac); // 5E:CF:7F:00:00:01 after reset()
+    const uint8_t* getMacAddress();
+
+    // Serial output goes to stdout unless muted
+    void setSerialEnabled(bool enabled);
+    bool isSerialEnabled();
+
+    const Counters& getCounters();
+    void resetCounters();
+    void countAllocation(size_t bytes);
+
+    // Bookkeeping for the fakes
+    uint8_t* eepromFlash();                 // Committed EEPROM contents
+    size_t eepromFlashSize();
+    uint8_t* rtcMemory();                   // RTC user memory, kept across deep sleep
+    size_t rtcMemorySize();
+    void countEepromCommit(bool wroteFlash);
+    void scheduleTimer(const void* owner, unsigned long delayMs, std::function<void()> callback);
+    void cancelTimer(const void* owner);
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef NATIVE_ONEWIRE_H
+#define NATIVE_ONEWIRE_H
+
+#include <stdint.h>
+
+// The bus itself is not modelled; DallasTemperature reads NativeHal directly
+class OneWire {
+public:
+    explicit OneWire(uint8_t pin) : pin(pin) {}
+    uint8_t getPin() const { return pin; }
+
+private:
+    uint8_t pin;
+};
+
+#endif
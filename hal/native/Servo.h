@@ -0,0 +1,27 @@
+#ifndef NATIVE_SERVO_H
+#define NATIVE_SERVO_H
+
+#include <stdint.h>
+
+// Keeps the pulse width it was last given; nothing is generated
+class Servo {
+public:
+    uint8_t attach(int pin, uint16_t minUs, uint16_t maxUs, int value) {
+        this->pin = pin;
+        (void)minUs;
+        (void)maxUs;
+        pulseUs = value;
+        return 0;
+    }
+
+    void detach() { pin = -1; }
+    bool attached() const { return pin >= 0; }
+    void writeMicroseconds(int value) { pulseUs = value; }
+    int readMicroseconds() const { return pulseUs; }
+
+private:
+    int pin = -1;
+    int pulseUs = 0;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef NATIVE_TICKER_H
+#define NATIVE_TICKER_H
+
+#include "NativeHal.h"
+
+// Runs on the simulated clock: callbacks fire from delay() or
+// NativeHal::advanceMillis() once their time comes
+class Ticker {
+public:
+    ~Ticker() { detach(); }
+
+    template <typename TArg>
+    void once_ms(uint32_t milliseconds, void (*callback)(TArg), TArg arg) {
+        NativeHal::scheduleTimer(this, milliseconds, [callback, arg]() { callback(arg); });
+    }
+
+    void once_ms(uint32_t milliseconds, void (*callback)()) {
+        NativeHal::scheduleTimer(this, milliseconds, callback);
+    }
+
+    // Re-armed after each call, so the period is measured from when it fired
+    template <typename TArg>
+    void attach_ms(uint32_t milliseconds, void (*callback)(TArg), TArg arg) {
+        NativeHal::scheduleTimer(this, milliseconds, [this, milliseconds, callback, arg]() {
+            attach_ms(milliseconds, callback, arg);
+            callback(arg);
+        });
+    }
+
+    void detach() { NativeHal::cancelTimer(this); }
+};
+
+#endif
@@ -0,0 +1,557 @@
+#include "WString.h"
+#include "NativeHal.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void formatInteger(char* buf, size_t size, unsigned long long value, bool negative, unsigned char base) {
+    char digits[66];
+    int count = 0;
+    if (base < 2 || base > 36) {
+        base = 10;
+    }
+    do {
+        unsigned int digit = (unsigned int)(value % base);
+        digits[count++] = (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+        value /= base;
+    } while (value != 0);
+
+    size_t pos = 0;
+    if (negative && pos < size - 1) {
+        buf[pos++] = '-';
+    }
+    while (count > 0 && pos < size - 1) {
+        buf[pos++] = digits[--count];
+    }
+    buf[pos] = 0;
+}
+
+static void formatSigned(char* buf, size_t size, long long value, unsigned char base) {
+    // Like the core: only base 10 prints a sign, other bases show the bits
+    if (base == 10 && value < 0) {
+        formatInteger(buf, size, 0ULL - (unsigned long long)value, true, base);
+    } else {
+        formatInteger(buf, size, (unsigned long long)value, false, base);
+    }
+}
+
+void String::init() {
+    buffer = inlineBuffer;
+    buffer[0] = 0;
+    capacity = SSO_CAPACITY;
+    len = 0;
+}
+
+void String::invalidate() {
+    if (!isInline()) {
+        free(buffer);
+    }
+    init();
+}
+
+bool String::changeBuffer(unsigned int maxStrLen) {
+    // Heap blocks come in 16-byte steps, always with room for the terminator
+    size_t newSize = (maxStrLen + 16) & ~(size_t)0xf;
+    char* newBuffer;
+    if (isInline()) {
+        newBuffer = (char*)malloc(newSize);
+        if (newBuffer) {
+            memcpy(newBuffer, buffer, len + 1);
+        }
+    } else {
+        newBuffer = (char*)realloc(buffer, newSize);
+    }
+    if (!newBuffer) {
+        return false;
+    }
+    NativeHal::countAllocation(newSize);
+    buffer = newBuffer;
+    capacity = newSize - 1;
+    return true;
+}
+
+bool String::reserve(unsigned int size) {
+    if (capacity >= size) {
+        return true;
+    }
+    return changeBuffer(size);
+}
+
+String& String::copy(const char* cstr, unsigned int length) {
+    if (!reserve(length)) {
+        invalidate();
+        return *this;
+    }
+    len = length;
+    memmove(buffer, cstr, length);
+    buffer[len] = 0;
+    return *this;
+}
+
+void String::move(String& rhs) {
+    if (rhs.isInline()) {
+        copy(rhs.buffer, rhs.len);
+        rhs.init();
+        return;
+    }
+    if (!isInline()) {
+        free(buffer);
+    }
+    buffer = rhs.buffer;
+    capacity = rhs.capacity;
+    len = rhs.len;
+    rhs.init();
+}
+
+String::String(const char* cstr) {
+    init();
+    if (cstr) {
+        copy(cstr, strlen(cstr));
+    }
+}
+
+String::String(const String& str) {
+    init();
+    *this = str;
+}
+
+String::String(String&& rval) {
+    init();
+    move(rval);
+}
+
+String::String(char c) {
+    init();
+    char buf[2] = { c, 0 };
+    *this = buf;
+}
+
+String::String(unsigned char value, unsigned char base) {
+    init();
+    char buf[66];
+    formatInteger(buf, sizeof(buf), value, false, base);
+    *this = buf;
+}
+
+String::String(int value, unsigned char base) {
+    init();
+    char buf[66];
+    formatSigned(buf, sizeof(buf), value, base);
+    *this = buf;
+}
+
+String::String(unsigned int value, unsigned char base) {
+    init();
+    char buf[66];
+    formatInteger(buf, sizeof(buf), value, false, base);
+    *this = buf;
+}
+
+String::String(long value, unsigned char base) {
+    init();
+    char buf[66];
+    formatSigned(buf, sizeof(buf), value, base);
+    *this = buf;
+}
+
+String::String(unsigned long value, unsigned char base) {
+    init();
+    char buf[66];
+    formatInteger(buf, sizeof(buf), value, false, base);
+    *this = buf;
+}
+
+String::String(long long value, unsigned char base) {
+    init();
+    char buf[66];
+    formatSigned(buf, sizeof(buf), value, base);
+    *this = buf;
+}
+
+String::String(unsigned long long value, unsigned char base) {
+    init();
+    char buf[66];
+    formatInteger(buf, sizeof(buf), value, false, base);
+    *this = buf;
+}
+
+String::String(float value, unsigned char decimalPlaces) {
+    init();
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, (double)value);
+    *this = buf;
+}
+
+String::String(double value, unsigned char decimalPlaces) {
+    init();
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+    *this = buf;
+}
+
+String::~String() {
+    if (!isInline()) {
+        free(buffer);
+    }
+}
+
+String& String::operator=(const String& rhs) {
+    if (this == &rhs) {
+        return *this;
+    }
+    return copy(rhs.buffer, rhs.len);
+}
+
+String& String::operator=(String&& rval) {
+    if (this != &rval) {
+        move(rval);
+    }
+    return *this;
+}
+
+String& String::operator=(const char* cstr) {
+    if (cstr) {
+        copy(cstr, strlen(cstr));
+    } else {
+        invalidate();
+    }
+    return *this;
+}
+
+String& String::operator=(char c) {
+    char buf[2] = { c, 0 };
+    return *this = buf;
+}
+
+bool String::concat(const char* cstr, unsigned int length) {
+    if (!cstr) {
+        return false;
+    }
+    if (length == 0) {
+        return true;
+    }
+    unsigned int newLen = len + length;
+    // cstr may point into this string's own buffer
+    if (cstr >= buffer && cstr < buffer + len) {
+        size_t offset = cstr - buffer;
+        if (!reserve(newLen)) {
+            return false;
+        }
+        memmove(buffer + len, buffer + offset, length);
+    } else {
+        if (!reserve(newLen)) {
+            return false;
+        }
+        memmove(buffer + len, cstr, length);
+    }
+    len = newLen;
+    buffer[len] = 0;
+    return true;
+}
+
+bool String::concat(const String& str) {
+    return concat(str.c_str(), str.len);
+}
+
+bool String::concat(const char* cstr) {
+    return cstr ? concat(cstr, strlen(cstr)) : false;
+}
+
+bool String::concat(char c) {
+    return concat(&c, 1);
+}
+
+bool String::concat(unsigned char num) {
+    return concat(String(num));
+}
+
+bool String::concat(int num) {
+    return concat(String(num));
+}
+
+bool String::concat(unsigned int num) {
+    return concat(String(num));
+}
+
+bool String::concat(long num) {
+    return concat(String(num));
+}
+
+bool String::concat(unsigned long num) {
+    return concat(String(num));
+}
+
+bool String::concat(long long num) {
+    return concat(String(num));
+}
+
+bool String::concat(unsigned long long num) {
+    return concat(String(num));
+}
+
+bool String::concat(float num) {
+    return concat(String(num));
+}
+
+bool String::concat(double num) {
+    return concat(String(num));
+}
+
+int String::compareTo(const String& s) const {
+    return strcmp(c_str(), s.c_str());
+}
+
+bool String::equals(const String& s) const {
+    return len == s.len && compareTo(s) == 0;
+}
+
+bool String::equals(const char* cstr) const {
+    return strcmp(c_str(), cstr ? cstr : "") == 0;
+}
+
+bool String::equalsIgnoreCase(const String& s) const {
+    if (len != s.len) {
+        return false;
+    }
+    for (unsigned int i = 0; i < len; i++) {
+        if (tolower((unsigned char)buffer[i]) != tolower((unsigned char)s.buffer[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool String::startsWith(const String& prefix) const {
+    return len >= prefix.len && strncmp(c_str(), prefix.c_str(), prefix.len) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+    return len >= suffix.len && strcmp(c_str() + len - suffix.len, suffix.c_str()) == 0;
+}
+
+char String::charAt(unsigned int index) const {
+    return index < len ? buffer[index] : 0;
+}
+
+void String::setCharAt(unsigned int index, char c) {
+    if (index < len) {
+        buffer[index] = c;
+    }
+}
+
+char& String::operator[](unsigned int index) {
+    static char dummy;
+    if (index >= len) {
+        dummy = 0;
+        return dummy;
+    }
+    return buffer[index];
+}
+
+void String::getBytes(unsigned char* buf, unsigned int bufsize, unsigned int index) const {
+    if (!bufsize || !buf) {
+        return;
+    }
+    if (index >= len) {
+        buf[0] = 0;
+        return;
+    }
+    unsigned int n = bufsize - 1;
+    if (n > len - index) {
+        n = len - index;
+    }
+    memcpy(buf, buffer + index, n);
+    buf[n] = 0;
+}
+
+void String::toCharArray(char* buf, unsigned int bufsize, unsigned int index) const {
+    getBytes((unsigned char*)buf, bufsize, index);
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const {
+    if (fromIndex >= len) {
+        return -1;
+    }
+    const char* found = strchr(buffer + fromIndex, ch);
+    return found ? (int)(found - buffer) : -1;
+}
+
+int String::indexOf(const String& str, unsigned int fromIndex) const {
+    if (fromIndex >= len) {
+        return -1;
+    }
+    const char* found = strstr(buffer + fromIndex, str.c_str());
+    return found ? (int)(found - buffer) : -1;
+}
+
+int String::lastIndexOf(char ch) const {
+    if (len == 0) {
+        return -1;
+    }
+    const char* found = strrchr(buffer, ch);
+    return found ? (int)(found - buffer) : -1;
+}
+
+int String::lastIndexOf(const String& str) const {
+    if (str.len > len) {
+        return -1;
+    }
+    for (int i = (int)(len - str.len); i >= 0; i--) {
+        if (strncmp(buffer + i, str.c_str(), str.len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const {
+    if (beginIndex > endIndex) {
+        unsigned int temp = endIndex;
+        endIndex = beginIndex;
+        beginIndex = temp;
+    }
+    String out;
+    if (beginIndex >= len) {
+        return out;
+    }
+    if (endIndex > len) {
+        endIndex = len;
+    }
+    out.copy(buffer + beginIndex, endIndex - beginIndex);
+    return out;
+}
+
+void String::replace(char find, char replace) {
+    for (unsigned int i = 0; i < len; i++) {
+        if (buffer[i] == find) {
+            buffer[i] = replace;
+        }
+    }
+}
+
+void String::replace(const String& find, const String& replace) {
+    if (len == 0 || find.len == 0) {
+        return;
+    }
+    String out;
+    unsigned int pos = 0;
+    int found;
+    while ((found = indexOf(find, pos)) >= 0) {
+        out.concat(buffer + pos, found - pos);
+        out.concat(replace);
+        pos = found + find.len;
+    }
+    if (pos == 0) {
+        return;
+    }
+    out.concat(buffer + pos, len - pos);
+    *this = out;
+}
+
+void String::remove(unsigned int index) {
+    remove(index, (unsigned int)-1);
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+    if (index >= len || count == 0) {
+        return;
+    }
+    if (count > len - index) {
+        count = len - index;
+    }
+    memmove(buffer + index, buffer + index + count, len - index - count);
+    len -= count;
+    buffer[len] = 0;
+}
+
+void String::toLowerCase() {
+    for (unsigned int i = 0; i < len; i++) {
+        buffer[i] = (char)tolower((unsigned char)buffer[i]);
+    }
+}
+
+void String::toUpperCase() {
+    for (unsigned int i = 0; i < len; i++) {
+        buffer[i] = (char)toupper((unsigned char)buffer[i]);
+    }
+}
+
+void String::trim() {
+    if (len == 0) {
+        return;
+    }
+    unsigned int start = 0;
+    while (start < len && isspace((unsigned char)buffer[start])) {
+        start++;
+    }
+    unsigned int end = len;
+    while (end > start && isspace((unsigned char)buffer[end - 1])) {
+        end--;
+    }
+    len = end - start;
+    if (start > 0) {
+        memmove(buffer, buffer + start, len);
+    }
+    buffer[len] = 0;
+}
+
+long String::toInt() const {
+    return atol(buffer);
+}
+
+float String::toFloat() const {
+    return (float)atof(buffer);
+}
+
+double String::toDouble() const {
+    return atof(buffer);
+}
+
+String operator+(const String& lhs, const String& rhs) {
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+String operator+(const String& lhs, const char* rhs) {
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+String operator+(const char* lhs, const String& rhs) {
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+String operator+(const String& lhs, char rhs) {
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+String operator+(const String& lhs, int rhs) {
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+String operator+(const String& lhs, unsigned int rhs) {
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+String operator+(const String& lhs, long rhs) {
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
+
+String operator+(const String& lhs, unsigned long rhs) {
+    String out(lhs);
+    out.concat(rhs);
+    return out;
+}
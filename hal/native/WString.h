@@ -0,0 +1,124 @@
+#ifndef NATIVE_WSTRING_H
+#define NATIVE_WSTRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Arduino String for the host, with the ESP8266 core's allocation behaviour so
+// counts measured here track the device: up to 11 characters are held inline
+// without touching the heap, longer strings live in a heap buffer that grows in
+// 16-byte steps, one reallocation each time an append outgrows it.
+class String {
+private:
+    static const unsigned int SSO_CAPACITY = 11;
+
+    char* buffer;                   // inlineBuffer or a heap block
+    unsigned int capacity;
+    unsigned int len;
+    char inlineBuffer[SSO_CAPACITY + 1];
+
+    bool isInline() const { return buffer == inlineBuffer; }
+
+    void init();
+    void invalidate();
+    bool changeBuffer(unsigned int maxStrLen);
+    String& copy(const char* cstr, unsigned int length);
+    void move(String& rhs);
+
+public:
+    String(const char* cstr = "");
+    String(const String& str);
+    String(String&& rval);
+    explicit String(char c);
+    explicit String(unsigned char value, unsigned char base = 10);
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(long long value, unsigned char base = 10);
+    explicit String(unsigned long long value, unsigned char base = 10);
+    explicit String(float value, unsigned char decimalPlaces = 2);
+    explicit String(double value, unsigned char decimalPlaces = 2);
+    ~String();
+
+    bool reserve(unsigned int size);
+    unsigned int length() const { return len; }
+    bool isEmpty() const { return len == 0; }
+    const char* c_str() const { return buffer; }
+    char* begin() { return buffer; }
+    char* end() { return buffer + len; }
+
+    String& operator=(const String& rhs);
+    String& operator=(String&& rval);
+    String& operator=(const char* cstr);
+    String& operator=(char c);
+
+    bool concat(const String& str);
+    bool concat(const char* cstr);
+    bool concat(const char* cstr, unsigned int length);
+    bool concat(char c);
+    bool concat(unsigned char num);
+    bool concat(int num);
+    bool concat(unsigned int num);
+    bool concat(long num);
+    bool concat(unsigned long num);
+    bool concat(long long num);
+    bool concat(unsigned long long num);
+    bool concat(float num);
+    bool concat(double num);
+
+    template <typename T>
+    String& operator+=(const T& rhs) {
+        concat(rhs);
+        return *this;
+    }
+
+    int compareTo(const String& s) const;
+    bool equals(const String& s) const;
+    bool equals(const char* cstr) const;
+    bool equalsIgnoreCase(const String& s) const;
+    bool operator==(const String& rhs) const { return equals(rhs); }
+    bool operator==(const char* cstr) const { return equals(cstr); }
+    bool operator!=(const String& rhs) const { return !equals(rhs); }
+    bool operator!=(const char* cstr) const { return !equals(cstr); }
+    bool operator<(const String& rhs) const { return compareTo(rhs) < 0; }
+    bool startsWith(const String& prefix) const;
+    bool endsWith(const String& suffix) const;
+
+    char charAt(unsigned int index) const;
+    void setCharAt(unsigned int index, char c);
+    char operator[](unsigned int index) const { return charAt(index); }
+    char& operator[](unsigned int index);
+    void toCharArray(char* buf, unsigned int bufsize, unsigned int index = 0) const;
+    void getBytes(unsigned char* buf, unsigned int bufsize, unsigned int index = 0) const;
+
+    int indexOf(char ch, unsigned int fromIndex = 0) const;
+    int indexOf(const String& str, unsigned int fromIndex = 0) const;
+    int lastIndexOf(char ch) const;
+    int lastIndexOf(const String& str) const;
+    String substring(unsigned int beginIndex) const { return substring(beginIndex, len); }
+    String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+    void replace(char find, char replace);
+    void replace(const String& find, const String& replace);
+    void remove(unsigned int index);
+    void remove(unsigned int index, unsigned int count);
+    void toLowerCase();
+    void toUpperCase();
+    void trim();
+
+    long toInt() const;
+    float toFloat() const;
+    double toDouble() const;
+};
+
+String operator+(const String& lhs, const String& rhs);
+String operator+(const String& lhs, const char* rhs);
+String operator+(const char* lhs, const String& rhs);
+String operator+(const String& lhs, char rhs);
+String operator+(const String& lhs, int rhs);
+String operator+(const String& lhs, unsigned int rhs);
+String operator+(const String& lhs, long rhs);
+String operator+(const String& lhs, unsigned long rhs);
+
+#endif
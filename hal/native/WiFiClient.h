@@ -0,0 +1,122 @@
+#ifndef NATIVE_WIFI_CLIENT_H
+#define NATIVE_WIFI_CLIENT_H
+
+#include <memory>
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "NativeHal.h"
+
+// A connection is only a yes or no from NativeHal; HTTPClient hands whole
+// requests to its responder rather than writing them here. Opening and closing
+// one is counted as the segments it would take on the wire. In live mode a
+// real socket to the peer is opened when the connection is first used, so
+// copies HTTPClient only connects to check reachability never reach the peer.
+class WiFiClient : public Stream {
+private:
+    bool open = false;
+    IPAddress peer;
+    uint16_t peerPort = 0;
+    int socket = -1;
+
+    bool liveSocket() {
+        if (open && socket < 0 && NativeHal::isLive()) {
+            socket = NativeHal::openSocket(peer.toString(), peerPort);
+            open = socket >= 0;
+        }
+        return socket >= 0;
+    }
+
+public:
+    // IPv4 and TCP headers; SYN and SYN-ACK carry 20 bytes of options
+    static const size_t SEGMENT_OVERHEAD = 40;
+    static const size_t HANDSHAKE_BYTES = 60 + 60 + 40;
+    static const size_t CLOSE_BYTES = 4 * 40;       // FIN and ACK each way
+
+    WiFiClient() {}
+    // A copy shares no socket with the original
+    WiFiClient(const WiFiClient& other) : Stream(other), open(other.open), peer(other.peer),
+        peerPort(other.peerPort) {}
+    WiFiClient& operator=(const WiFiClient&) = delete;
+    virtual ~WiFiClient() { NativeHal::closeSocket(socket); }
+
+    virtual int connect(IPAddress address, uint16_t port) {
+        stop();
+        open = NativeHal::connectTo(address.toString());
+        if (open) {
+            peer = address;
+            peerPort = port;
+            NativeHal::countWireTraffic(HANDSHAKE_BYTES, 1);
+        }
+        return open ? 1 : 0;
+    }
+
+    virtual int connect(const char* host, uint16_t port) {
+        IPAddress address;
+        String found;
+        if (!address.fromString(host)) {
+            if (!NativeHal::lookUpHost(host, found) || !address.fromString(found)) {
+                return 0;
+            }
+        }
+        return connect(address, port);
+    }
+
+    // HTTPClient keeps a copy, as the ESP8266 core's does
+    virtual std::unique_ptr<WiFiClient> clone() const {
+        return std::unique_ptr<WiFiClient>(new WiFiClient(*this));
+    }
+
+    size_t write(uint8_t value) override { return write(&value, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (!NativeHal::isLive()) {
+            return size;
+        }
+        return liveSocket() && NativeHal::writeSocket(socket, buffer, size) ? size : 0;
+    }
+    using Print::write;
+    // Simulated, nothing arrives on a raw connection: a WebSocket handshake times out
+    int available() override {
+        if (!liveSocket()) {
+            return 0;
+        }
+        int pending = NativeHal::socketAvailable(socket);
+        if (pending < 0) {
+            stop();
+            return 0;
+        }
+        return pending;
+    }
+    int read(uint8_t* buffer, size_t size) {
+        if (!liveSocket()) {
+            return 0;
+        }
+        int received = NativeHal::readSocket(socket, buffer, size);
+        if (received < 0) {
+            stop();
+            return 0;
+        }
+        return received;
+    }
+    int read() override {
+        uint8_t value;
+        return read(&value, 1) == 1 ? value : -1;
+    }
+    void setNoDelay(bool) {}
+    bool connected() {
+        if (socket >= 0 && NativeHal::socketAvailable(socket) < 0) {
+            stop();
+        }
+        return open;
+    }
+    void stop() {
+        if (open) {
+            NativeHal::countWireTraffic(CLOSE_BYTES, 0);
+        }
+        NativeHal::closeSocket(socket);
+        socket = -1;
+        open = false;
+    }
+    IPAddress remoteIP() { return open ? peer : IPAddress(127, 0, 0, 1); }
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef NATIVE_WIFI_CLIENT_SECURE_H
+#define NATIVE_WIFI_CLIENT_SECURE_H
+
+#include <string.h>
+#include <time.h>
+#include "WiFiClient.h"
+
+// BearSSL's client as the ESP8266 core has it, with the handshake played
+// against NativeHal's TLS session cache: a session the server still holds is
+// resumed in one round trip, anything else takes a full handshake in two.
+// Certificates are not checked; pins and trust anchors are only taken. In
+// live mode every connection fails.
+namespace BearSSL {
+
+    struct SessionParameters {
+        uint8_t session_id[32];
+        uint8_t session_id_len;
+        uint16_t version;
+        uint16_t cipher_suite;
+        uint8_t master_secret[48];
+    };
+
+    class Session {
+    private:
+        friend class WiFiClientSecure;
+        SessionParameters _session;
+
+    public:
+        Session() { memset(&_session, 0, sizeof(_session)); }
+    };
+
+    class X509List {
+    public:
+        X509List(const char* pem) { (void)pem; }
+    };
+
+    class WiFiClientSecure : public WiFiClient {
+    private:
+        Session* session = nullptr;
+
+    public:
+        // Hellos, certificate chain, key exchange and both Finished messages,
+        // in their TCP segments
+        static const size_t FULL_HANDSHAKE_BYTES = 2040;
+        // Hellos carrying the session ID, then ChangeCipherSpec and Finished
+        static const size_t RESUMED_HANDSHAKE_BYTES = 580;
+
+        void setSession(Session* offered) { session = offered; }
+        void setFingerprint(const uint8_t* fingerprint) { (void)fingerprint; }
+        void setTrustAnchors(X509List* anchors) { (void)anchors; }
+        void setInsecure() {}
+        void setX509Time(time_t now) { (void)now; }
+
+        int connect(IPAddress address, uint16_t port) override {
+            // Live devices have no TLS to speak to a real server
+            if (NativeHal::isLive() || !WiFiClient::connect(address, port)) {
+                return 0;
+            }
+            SessionParameters* parameters = session ? &session->_session : nullptr;
+            if (parameters && parameters->session_id_len > 0 &&
+                NativeHal::resumeTlsSession(parameters->session_id, parameters->session_id_len)) {
+                NativeHal::countWireTraffic(RESUMED_HANDSHAKE_BYTES, 1);
+                return 1;
+            }
+            SessionParameters issued = {};
+            issued.session_id_len = sizeof(issued.session_id);
+            issued.version = 0x0303;
+            issued.cipher_suite = 0xC02F;   // ECDHE_RSA_WITH_AES_128_GCM_SHA256
+            NativeHal::addTlsSession(issued.session_id, issued.session_id_len);
+            if (parameters) {
+                *parameters = issued;
+            }
+            NativeHal::countWireTraffic(FULL_HANDSHAKE_BYTES, 2);
+            return 1;
+        }
+        using WiFiClient::connect;
+
+        std::unique_ptr<WiFiClient> clone() const override {
+            return std::unique_ptr<WiFiClient>(new WiFiClientSecure(*this));
+        }
+    };
+}
+
+using BearSSL::WiFiClientSecure;
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef NATIVE_WIFI_UDP_H
+#define NATIVE_WIFI_UDP_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "NativeHal.h"
+
+// Each datagram goes to NativeHal's UDP responder as it is sent, and its
+// reply, if any, is the next packet parsePacket() finds. Without a responder
+// nothing answers, so callers wait out their timeouts (DNS queries then fall
+// back to WiFi.hostByName()).
+class WiFiUDP : public Stream {
+private:
+    static const size_t MAX_DATAGRAM = 1472;    // One unfragmented Ethernet frame
+
+    uint8_t outgoing[MAX_DATAGRAM];
+    size_t outgoingLength = 0;
+    uint16_t outgoingPort = 0;
+    bool sending = false;
+    uint8_t incoming[MAX_DATAGRAM];
+    size_t incomingLength = 0;
+    bool replyPending = false;
+
+public:
+    uint8_t begin(uint16_t port) { (void)port; return 1; }
+    void stop() { replyPending = false; }
+
+    int beginPacket(IPAddress address, uint16_t port) {
+        (void)address;
+        if (!NativeHal::isWiFiConnected()) {
+            return 0;
+        }
+        sending = true;
+        outgoingLength = 0;
+        outgoingPort = port;
+        return 1;
+    }
+
+    int beginPacketMulticast(IPAddress group, uint16_t port, IPAddress interfaceAddress, int ttl = 1) {
+        (void)interfaceAddress;
+        (void)ttl;
+        return beginPacket(group, port);
+    }
+
+    int endPacket() {
+        if (!sending) {
+            return 0;
+        }
+        sending = false;
+        size_t replyLength = NativeHal::respondToUdp(outgoingPort, outgoing, outgoingLength, incoming, sizeof(incoming));
+        if (replyLength > 0) {
+            incomingLength = replyLength;
+            replyPending = true;
+        }
+        return 1;
+    }
+
+    size_t write(uint8_t value) override { return write(&value, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (!sending || outgoingLength + size > sizeof(outgoing)) {
+            return 0;
+        }
+        memcpy(outgoing + outgoingLength, buffer, size);
+        outgoingLength += size;
+        return size;
+    }
+    using Print::write;
+
+    int parsePacket() {
+        if (!replyPending) {
+            return 0;
+        }
+        replyPending = false;
+        return incomingLength;
+    }
+
+    int read(uint8_t* buffer, size_t size) {
+        size_t length = incomingLength < size ? incomingLength : size;
+        memcpy(buffer, incoming, length);
+        incomingLength = 0;
+        return length;
+    }
+
+    IPAddress remoteIP() { return IPAddress(); }
+    uint16_t remotePort() { return 0; }
+};
+
+#endif
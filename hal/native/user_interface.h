@@ -0,0 +1,7 @@
+#ifndef NATIVE_USER_INTERFACE_H
+#define NATIVE_USER_INTERFACE_H
+
+// The SDK's user_interface.h, which WifiTempSensor.cpp includes; nothing from
+// it is used on the host
+
+#endif
@@ -8,8 +8,13 @@ import "./src/types/oak.d.ts";
 import { StateManager } from "./src/managers/StateManager.ts";
 import { CommandQueue } from "./src/managers/CommandQueue.ts";
 import { DeviceManager } from "./src/managers/DeviceManager.ts";
+import { FirmwareManager } from "./src/managers/FirmwareManager.ts";
+import { TimeSeriesStore } from "./src/storage/TimeSeriesStore.ts";
+import { StateStore } from "./src/storage/StateStore.ts";
 import { NetworkDiscovery, ServerConfig } from "./src/managers/NetworkDiscovery.ts";
 import { WebSocketHandler } from "./src/websocket/wsHandler.ts";
+import { DeviceChannels } from "./src/websocket/deviceChannel.ts";
+import { CoapServer, COAP_PORT } from "./src/coap/CoapServer.ts";
 
 import { createDeviceRoutes } from "./src/api/deviceRoutes.ts";
 import { createWebRoutes } from "./src/api/webRoutes.ts";
@@ -22,22 +27,40 @@ const configText = await Deno.readTextFile("./config.json");
 const config: ServerConfig = JSON.parse(configText);
 
 const PORT = parseInt(Deno.env.get("PORT") || config.server.port.toString());
+const COAP = parseInt(Deno.env.get("COAP_PORT") || COAP_PORT.toString());
+// PEM certificate and key files; with both set the server speaks HTTPS only.
+// Devices resume their TLS sessions from the TLS stack's session cache, which
+// Deno does not let us size: rustls keeps the 256 most recent sessions, so in
+// a larger fleet a device may find its session gone and make a full handshake.
+const TLS_CERT = Deno.env.get("TLS_CERT");
+const TLS_KEY = Deno.env.get("TLS_KEY");
 
 class WiFiDeviceServer {
   private app: Application;
+  private timeSeries: TimeSeriesStore;
+  private stateStore: StateStore;
   private stateManager: StateManager;
   private commandQueue: CommandQueue;
   private deviceManager: DeviceManager;
+  private firmwareManager: FirmwareManager;
   private networkDiscovery: NetworkDiscovery;
   private wsHandler: WebSocketHandler;
+  private deviceChannels: DeviceChannels;
+  private coapServer: CoapServer;
 
   constructor() {
     this.app = new Application();
-    this.stateManager = new StateManager();
+    this.timeSeries = new TimeSeriesStore(Deno.env.get("TIMESERIES_DIR") || "./data/timeseries");
+    this.stateStore = new StateStore(Deno.env.get("STATE_DIR") || "./data/state");
+    this.stateManager = new StateManager(this.timeSeries, this.stateStore);
     this.commandQueue = new CommandQueue(this.stateManager);
     this.deviceManager = new DeviceManager(this.stateManager, this.commandQueue);
+    this.firmwareManager = new FirmwareManager(Deno.env.get("FIRMWARE_DIR") || "./firmware");
     this.networkDiscovery = new NetworkDiscovery(this.deviceManager, config);
     this.wsHandler = new WebSocketHandler(this.stateManager);
+    this.deviceChannels = new DeviceChannels(this.stateManager, this.deviceManager);
+    this.commandQueue.setDeviceChannels(this.deviceChannels);
+    this.coapServer = new CoapServer(this.deviceManager, COAP);
     
     this.setupMiddleware();
     this.setupRoutes();
@@ -95,18 +118,27 @@ class WiFiDeviceServer {
           ctx.response.status = 400;
           ctx.response.body = "WebSocket upgrade required";
         }
+      } else if (ctx.request.url.pathname === "/device-ws") {
+        // Control channels devices open while they stay awake
+        const deviceId = ctx.request.url.searchParams.get("id");
+        if (ctx.isUpgradable && deviceId) {
+          this.deviceChannels.handleConnection(ctx.upgrade(), deviceId);
+        } else {
+          ctx.response.status = 400;
+          ctx.response.body = "WebSocket upgrade with a device ID required";
+        }
       } else {
         await next();
       }
     });
 
     // Device communication routes
-    const deviceRoutes = createDeviceRoutes(this.deviceManager);
+    const deviceRoutes = createDeviceRoutes(this.deviceManager, this.firmwareManager);
     this.app.use(deviceRoutes.routes());
     this.app.use(deviceRoutes.allowedMethods());
 
     // API routes
-    const apiRoutes = createApiRoutes(this.deviceManager);
+    const apiRoutes = createApiRoutes(this.deviceManager, this.firmwareManager);
     this.app.use(apiRoutes.routes());
     this.app.use(apiRoutes.allowedMethods());
 
@@ -122,18 +154,32 @@ class WiFiDeviceServer {
   }
 
   async start(): Promise<void> {
-    // Start managers
+    // Start managers; state is restored before the queue picks up its commands
+    await this.stateManager.start();
+    await this.timeSeries.start();
     this.commandQueue.start();
     this.deviceManager.start();
     await this.networkDiscovery.start();
+    this.coapServer.start();
 
+    const secure = Boolean(TLS_CERT && TLS_KEY);
+    const scheme = secure ? "https" : "http";
     console.log(`🚀 WiFi Device Management Server starting on port ${PORT}`);
-    console.log(`📊 Dashboard: http://localhost:${PORT}`);
-    console.log(`🔌 WebSocket: ws://localhost:${PORT}/ws`);
-    console.log(`📡 Device API: http://localhost:${PORT}/register`);
+    console.log(`📊 Dashboard: ${scheme}://localhost:${PORT}`);
+    console.log(`🔌 WebSocket: ${secure ? "wss" : "ws"}://localhost:${PORT}/ws`);
+    console.log(`📡 Device API: ${scheme}://localhost:${PORT}/register`);
     console.log(`🔍 Network Discovery: ${config.discovery.enabled ? 'Enabled' : 'Disabled'}`);
     
-    await this.app.listen({ port: PORT });
+    if (secure) {
+      await this.app.listen({
+        port: PORT,
+        secure: true,
+        cert: await Deno.readTextFile(TLS_CERT!),
+        key: await Deno.readTextFile(TLS_KEY!)
+      });
+    } else {
+      await this.app.listen({ port: PORT });
+    }
   }
 
   async stop(): Promise<void> {
@@ -142,6 +188,10 @@ class WiFiDeviceServer {
     this.deviceManager.stop();
     this.commandQueue.stop();
     await this.networkDiscovery.stop();
+    this.coapServer.stop();
+    this.deviceChannels.closeAll();
+    await this.timeSeries.stop();
+    await this.stateManager.stop();
     this.wsHandler.closeAllConnections();
     
     console.log("✅ Server stopped");
@@ -1,9 +1,12 @@
 import { Router } from "oak";
 import { DeviceManager } from "../managers/DeviceManager.ts";
-import { DeviceControlRequest, DeviceRenameRequest, DeviceForceAwakeRequest } from "../types/api.ts";
+import { FirmwareManager } from "../managers/FirmwareManager.ts";
+import { DeviceControlRequest, DeviceRenameRequest, DeviceForceAwakeRequest, DeviceRulesRequest, DeviceServoRequest, DeviceRgbRequest } from "../types/api.ts";
+import { validateDeviceRules, validateServoMove, validateRgbSequence } from "../types/deviceConfig.ts";
+import { FirmwareRolloutRequest, FirmwareRolloutUpdate, validateRolloutSettings } from "../types/firmware.ts";
 import { createApiResponse, createErrorResponse } from "../middleware/errorHandler.ts";
 
-export function createApiRoutes(deviceManager: DeviceManager): Router {
+export function createApiRoutes(deviceManager: DeviceManager, firmwareManager: FirmwareManager): Router {
   const router = new Router();
 
   // Get all devices
@@ -75,10 +78,140 @@ export function createApiRoutes(deviceManager: DeviceManager): Router {
     ctx.response.body = createApiResponse({ alias: body.alias.trim() });
   });
 
+  // Closed-loop rules run on the device
+  router.get("/api/devices/:id/rules", (ctx) => {
+    const ruleSet = deviceManager.getDeviceRules(ctx.params.id);
+
+    if (!ruleSet) {
+      const { status, response } = createErrorResponse("Device not found", 404);
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    ctx.response.body = createApiResponse(ruleSet);
+  });
+
+  router.put("/api/devices/:id/rules", async (ctx) => {
+    const deviceId = ctx.params.id;
+    const body: DeviceRulesRequest = await ctx.request.body({ type: "json" }).value;
+
+    const error = validateDeviceRules(body.rules);
+    if (error) {
+      const { status, response } = createErrorResponse(error);
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    const success = deviceManager.setDeviceRules(deviceId, body.rules);
+
+    if (!success) {
+      const { status, response } = createErrorResponse("Device not found", 404);
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    ctx.response.body = createApiResponse(deviceManager.getDeviceRules(deviceId));
+  });
+
+  // Servo move, queued like any other command
+  router.post("/api/devices/:id/servo", async (ctx) => {
+    const deviceId = ctx.params.id;
+    const body: DeviceServoRequest = await ctx.request.body({ type: "json" }).value;
+
+    const error = validateServoMove(body);
+    if (error) {
+      const { status, response } = createErrorResponse(error);
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    const { scheduleDelay, ...move } = body;
+    const commandId = deviceManager.moveServo(deviceId, move, scheduleDelay);
+
+    if (!commandId) {
+      const { status, response } = createErrorResponse("Device not found", 404);
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    ctx.response.body = createApiResponse({ commandId });
+  });
+
+  // Color or light sequence; the whole sequence goes to the device in one command
+  router.post("/api/devices/:id/rgb", async (ctx) => {
+    const deviceId = ctx.params.id;
+    const body: DeviceRgbRequest = await ctx.request.body({ type: "json" }).value;
+
+    const error = validateRgbSequence(body);
+    if (error) {
+      const { status, response } = createErrorResponse(error);
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    const { scheduleDelay, ...sequence } = body;
+    const commandId = deviceManager.playRgbSequence(deviceId, sequence, scheduleDelay);
+
+    if (!commandId) {
+      const { status, response } = createErrorResponse("Device not found", 404);
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    ctx.response.body = createApiResponse({ commandId });
+  });
+
+  // Time series for dashboard charts
+  router.get("/api/devices/:id/series", (ctx) => {
+    const names = deviceManager.getSeriesNames(ctx.params.id);
+
+    if (!names) {
+      const { status, response } = createErrorResponse("Device not found", 404);
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    ctx.response.body = createApiResponse(names);
+  });
+
+  // ?from=&to= in ms (default: the last 24 hours), ?points= caps the result
+  router.get("/api/devices/:id/series/:series", (ctx) => {
+    const params = ctx.request.url.searchParams;
+    const to = Number(params.get("to") ?? Date.now());
+    const from = Number(params.get("from") ?? to - 24 * 60 * 60 * 1000);
+    const maxPoints = Number(params.get("points") ?? 200);
+
+    if (!Number.isFinite(from) || !Number.isFinite(to) || from > to || !(maxPoints >= 1 && maxPoints <= 5000)) {
+      const { status, response } = createErrorResponse("Invalid from, to or points");
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    const points = deviceManager.getSeries(ctx.params.id, ctx.params.series, from, to, Math.floor(maxPoints));
+
+    if (!points) {
+      const { status, response } = createErrorResponse("Device not found", 404);
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    ctx.response.body = createApiResponse({ series: ctx.params.series, from, to, points });
+  });
+
   // Get system health
   router.get("/api/health", (ctx) => {
     const health = deviceManager.getSystemHealth();
-    ctx.response.body = createApiResponse(health);
+    ctx.response.body = createApiResponse({ ...health, memory: Deno.memoryUsage() });
   });
 
   // Bulk operations
@@ -121,6 +254,69 @@ export function createApiRoutes(deviceManager: DeviceManager): Router {
     ctx.response.body = createApiResponse({ retried: true });
   });
 
+  // Staged firmware rollout
+  router.get("/api/firmware/rollout", (ctx) => {
+    ctx.response.body = createApiResponse(firmwareManager.getRolloutStatus());
+  });
+
+  router.post("/api/firmware/rollout", async (ctx) => {
+    const body: FirmwareRolloutRequest = await ctx.request.body({ type: "json" }).value;
+
+    const error = !body.version || !Number.isInteger(body.build) ?
+      "Missing version or build" : validateRolloutSettings(body);
+    if (error) {
+      const { status, response } = createErrorResponse(error);
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    const rollout = await firmwareManager.startRollout(body);
+
+    if (!rollout) {
+      const { status, response } = createErrorResponse("No firmware image for this build", 404);
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    ctx.response.body = createApiResponse(rollout);
+  });
+
+  router.put("/api/firmware/rollout", async (ctx) => {
+    const body: FirmwareRolloutUpdate = await ctx.request.body({ type: "json" }).value;
+
+    const error = validateRolloutSettings(body);
+    if (error) {
+      const { status, response } = createErrorResponse(error);
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    const rollout = firmwareManager.updateRollout(body);
+
+    if (!rollout) {
+      const { status, response } = createErrorResponse("No rollout in progress", 404);
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    ctx.response.body = createApiResponse(rollout);
+  });
+
+  router.delete("/api/firmware/rollout", (ctx) => {
+    if (!firmwareManager.cancelRollout()) {
+      const { status, response } = createErrorResponse("No rollout in progress", 404);
+      ctx.response.status = status;
+      ctx.response.body = response;
+      return;
+    }
+
+    ctx.response.body = createApiResponse({ cancelled: true });
+  });
+
   // Force awake management
   router.post("/api/devices/:id/force-awake", async (ctx) => {
     const deviceId = ctx.params.id;
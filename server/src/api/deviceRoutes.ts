@@ -1,12 +1,52 @@
 import { Router } from "oak";
 import { DeviceManager } from "../managers/DeviceManager.ts";
-import { DeviceRegistration, WiFiFailureReport } from "../types/device.ts";
+import { FirmwareManager } from "../managers/FirmwareManager.ts";
+import { DeviceRegistration, WiFiFailureReport, RuleFiringReport, SensorReading, SensorReadingReport, SwitchEventReport, ServoStatus, RgbStatus } from "../types/device.ts";
+import { FirmwareResultReport } from "../types/firmware.ts";
+import { isEnergyReport } from "../types/energy.ts";
 
-export function createDeviceRoutes(deviceManager: DeviceManager): Router {
+const SENSOR_READING_TYPES: SensorReading['type'][] = ['temperature', 'soil_moisture', 'analog'];
+const PROBE_ID = /^[0-9A-F]{16}$/;
+
+// A /readings body, whichever transport it came over; null if it is not valid
+export function toSensorReadingReport(body: any): SensorReadingReport | null {
+  const report: SensorReadingReport = {
+    id: body?.id,
+    readings: body?.readings,
+    outputOn: typeof body?.outputOn === "boolean" ? body.outputOn : undefined
+  };
+
+  const valid = Array.isArray(report.readings) && report.readings.every(reading =>
+    SENSOR_READING_TYPES.includes(reading.type) && Number.isFinite(reading.value) &&
+    (reading.probe === undefined || PROBE_ID.test(reading.probe)));
+  return report.id && valid ? report : null;
+}
+
+// output=1 or output=0 on a check-in from a device with an output
+export function parseOutputParam(params: URLSearchParams): boolean | undefined {
+  const output = params.get("output");
+  return output === "1" ? true : output === "0" ? false : undefined;
+}
+
+function isServoStatus(value: unknown): value is ServoStatus {
+  const servo = value as ServoStatus;
+  return typeof servo === "object" && servo !== null && Number.isFinite(servo.position) &&
+    Number.isFinite(servo.target) && typeof servo.atTarget === "boolean";
+}
+
+function isRgbStatus(value: unknown): value is RgbStatus {
+  const rgb = value as RgbStatus;
+  return typeof rgb === "object" && rgb !== null && Number.isInteger(rgb.red) &&
+    Number.isInteger(rgb.green) && Number.isInteger(rgb.blue) && typeof rgb.playing === "boolean";
+}
+
+export function createDeviceRoutes(deviceManager: DeviceManager, firmwareManager: FirmwareManager): Router {
   const router = new Router();
 
   // Device registration endpoint
   router.post("/register", async (ctx) => {
+    // Taken before parsing so the device can subtract our processing time
+    const receivedAt = Date.now();
     try {
       const body = await ctx.request.body({ type: "json" }).value;
       
@@ -15,7 +55,18 @@ export function createDeviceRoutes(deviceManager: DeviceManager): Router {
         alias: body.alias,
         ipAddress: body.ipAddress,
         macAddress: body.macAddress,
-        mode: body.mode
+        mode: body.mode,
+        firmwareVersion: body.firmwareVersion,
+        buildNumber: body.buildNumber,
+        platform: body.platform,
+        missedSlots: body.missedSlots,
+        valveOpen: body.valveOpen,
+        outputOn: body.outputOn,
+        valveEventAt: body.valveEventAt,
+        energy: isEnergyReport(body.energy) ? body.energy : undefined,
+        switchClosed: typeof body.switchClosed === "boolean" ? body.switchClosed : undefined,
+        servo: isServoStatus(body.servo) ? body.servo : undefined,
+        rgb: isRgbStatus(body.rgb) ? body.rgb : undefined
       };
 
       // Validate required fields
@@ -30,10 +81,14 @@ export function createDeviceRoutes(deviceManager: DeviceManager): Router {
 
 
       deviceManager.handleDeviceRegistration(registration);
+      // Set only when the staged rollout picks this device
+      const firmware = firmwareManager.checkIn(registration.id, registration.platform, registration.buildNumber);
       
       ctx.response.status = 200;
       ctx.response.body = {
         success: true,
+        firmware: firmware ?? undefined,
+        receivedAt,
         timestamp: Date.now() // Unix timestamp in milliseconds
       };
       
@@ -55,7 +110,7 @@ export function createDeviceRoutes(deviceManager: DeviceManager): Router {
         return;
       }
 
-      const shouldStayAwake = deviceManager.handleShouldRemainAwake(deviceId);
+      const shouldStayAwake = deviceManager.handleShouldRemainAwake(deviceId, parseOutputParam(ctx.request.url.searchParams));
       
       // Return "1" for stay awake, "0" for sleep (as expected by device firmware)
       ctx.response.status = 200;
@@ -98,6 +153,216 @@ export function createDeviceRoutes(deviceManager: DeviceManager): Router {
     }
   });
 
+  // NTP-style time exchange: the device measures the round trip itself and
+  // uses receivedAt/timestamp to remove our processing time from it
+  router.get("/time", (ctx) => {
+    const receivedAt = Date.now();
+    ctx.response.status = 200;
+    ctx.response.body = {
+      receivedAt,
+      timestamp: Date.now()
+    };
+  });
+
+  // Local valve schedule. The device sends the version it already has and
+  // gets 304 if nothing changed.
+  router.get("/valve-schedule", (ctx) => {
+    const deviceId = ctx.request.url.searchParams.get("id");
+    if (!deviceId) {
+      ctx.response.status = 400;
+      ctx.response.body = { error: "Missing device ID" };
+      return;
+    }
+
+    const schedule = deviceManager.getValveSchedule(deviceId);
+    if (!schedule) {
+      ctx.response.status = 404;
+      ctx.response.body = { error: "Device not found" };
+      return;
+    }
+
+    if (ctx.request.url.searchParams.get("version") === String(schedule.version)) {
+      ctx.response.status = 304;
+      return;
+    }
+
+    ctx.response.status = 200;
+    ctx.response.body = schedule;
+  });
+
+  // Closed-loop rules, same versioning as the valve schedule
+  router.get("/rules", (ctx) => {
+    const deviceId = ctx.request.url.searchParams.get("id");
+    if (!deviceId) {
+      ctx.response.status = 400;
+      ctx.response.body = { error: "Missing device ID" };
+      return;
+    }
+
+    const ruleSet = deviceManager.getDeviceRules(deviceId);
+    if (!ruleSet) {
+      ctx.response.status = 404;
+      ctx.response.body = { error: "Device not found" };
+      return;
+    }
+
+    if (ctx.request.url.searchParams.get("version") === String(ruleSet.version)) {
+      ctx.response.status = 304;
+      return;
+    }
+
+    ctx.response.status = 200;
+    ctx.response.body = ruleSet;
+  });
+
+  // Sensor readings taken on a wake; stored against the time they arrive
+  router.post("/readings", async (ctx) => {
+    try {
+      const body = await ctx.request.body({ type: "json" }).value;
+
+      const report = toSensorReadingReport(body);
+      if (!report) {
+        ctx.response.status = 400;
+        ctx.response.body = { error: "Missing or invalid fields" };
+        return;
+      }
+
+      if (!deviceManager.handleSensorReadings(report)) {
+        ctx.response.status = 404;
+        ctx.response.body = { error: "Device not found" };
+        return;
+      }
+
+      ctx.response.status = 200;
+      ctx.response.body = { success: true };
+
+    } catch (error) {
+      console.error("Error in sensor readings:", error);
+      ctx.response.status = 500;
+      ctx.response.body = { error: "Internal server error" };
+    }
+  });
+
+  // Rules the device fired on its own since it last reported
+  router.post("/rule-firings", async (ctx) => {
+    try {
+      const body = await ctx.request.body({ type: "json" }).value;
+
+      const report: RuleFiringReport = {
+        id: body.id,
+        firings: body.firings,
+        dropped: body.dropped
+      };
+
+      if (!report.id || !Array.isArray(report.firings)) {
+        ctx.response.status = 400;
+        ctx.response.body = { error: "Missing required fields" };
+        return;
+      }
+
+      deviceManager.handleRuleFirings(report);
+
+      ctx.response.status = 200;
+      ctx.response.body = { success: true };
+
+    } catch (error) {
+      console.error("Error in rule firings:", error);
+      ctx.response.status = 500;
+      ctx.response.body = { error: "Internal server error" };
+    }
+  });
+
+  // Input switch edges, sent as soon as the device is online after an edge
+  router.post("/switch-events", async (ctx) => {
+    // Stamps the edges the device could not time itself
+    const receivedAt = Date.now();
+    try {
+      const body = await ctx.request.body({ type: "json" }).value;
+
+      const report: SwitchEventReport = {
+        id: body.id,
+        events: body.events,
+        dropped: body.dropped
+      };
+
+      const valid = Array.isArray(report.events) && report.events.every(event =>
+        typeof event.closed === "boolean" && (event.at === undefined || Number.isFinite(event.at)));
+      if (!report.id || !valid) {
+        ctx.response.status = 400;
+        ctx.response.body = { error: "Missing or invalid fields" };
+        return;
+      }
+
+      if (!deviceManager.handleSwitchEvents(report, receivedAt)) {
+        ctx.response.status = 404;
+        ctx.response.body = { error: "Device not found" };
+        return;
+      }
+
+      ctx.response.status = 200;
+      ctx.response.body = { success: true };
+
+    } catch (error) {
+      console.error("Error in switch events:", error);
+      ctx.response.status = 500;
+      ctx.response.body = { error: "Internal server error" };
+    }
+  });
+
+  // Firmware image for a device the rollout has offered it to
+  router.get("/firmware", async (ctx) => {
+    const deviceId = ctx.request.url.searchParams.get("id");
+    const build = Number(ctx.request.url.searchParams.get("build"));
+    if (!deviceId || !Number.isInteger(build)) {
+      ctx.response.status = 400;
+      ctx.response.body = { error: "Missing device ID or build" };
+      return;
+    }
+
+    const image = await firmwareManager.getImage(deviceId, build);
+    if (!image) {
+      ctx.response.status = 404;
+      ctx.response.body = { error: "No firmware offered to this device" };
+      return;
+    }
+
+    // Served as-is: ESP8266 images are gzip files the device flashes compressed
+    ctx.response.status = 200;
+    ctx.response.type = "application/octet-stream";
+    ctx.response.body = image;
+  });
+
+  // Outcome of a firmware update. Success is normally seen as the device
+  // registering on the new build; this is mostly for failures.
+  router.post("/firmware-result", async (ctx) => {
+    try {
+      const body = await ctx.request.body({ type: "json" }).value;
+
+      const report: FirmwareResultReport = {
+        id: body.id,
+        build: body.build,
+        success: body.success === true,
+        error: body.error
+      };
+
+      if (!report.id || !Number.isInteger(report.build)) {
+        ctx.response.status = 400;
+        ctx.response.body = { error: "Missing required fields" };
+        return;
+      }
+
+      firmwareManager.handleResult(report);
+
+      ctx.response.status = 200;
+      ctx.response.body = { success: true };
+
+    } catch (error) {
+      console.error("Error in firmware result:", error);
+      ctx.response.status = 500;
+      ctx.response.body = { error: "Internal server error" };
+    }
+  });
+
   // Health check endpoint for devices
   router.get("/is-up", (ctx) => {
     ctx.response.status = 200;
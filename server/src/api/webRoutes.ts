@@ -51,6 +51,8 @@ export function createWebRoutes(deviceManager: DeviceManager): Router {
     await ctx.render("pages/device", {
       title: `Device: ${device.alias}`,
       device,
+      contacts: deviceManager.getContactHistory(deviceId, 10),
+      series: deviceManager.getSeriesNames(deviceId) ?? [],
       currentTime: new Date().toISOString()
     });
   }));
@@ -0,0 +1,261 @@
+/// <reference lib="deno.unstable" />
+
+import { DeviceManager } from "../managers/DeviceManager.ts";
+import { parseOutputParam, toSensorReadingReport } from "../api/deviceRoutes.ts";
+
+export const COAP_PORT = 5683;
+
+// RFC 7252 defaults: a retransmitted request can turn up this long after the
+// first copy, so its response is kept that long
+const EXCHANGE_LIFETIME_MS = 247 * 1000;
+const CLEANUP_INTERVAL_MS = 60 * 1000;
+
+const TYPE_CON = 0;
+const TYPE_NON = 1;
+const TYPE_ACK = 2;
+const TYPE_RST = 3;
+
+// Codes are class << 5 | detail
+const CODE_EMPTY = 0x00;
+const CODE_GET = 0x01;
+const CODE_POST = 0x02;
+const CODE_CHANGED = 0x44;              // 2.04
+const CODE_CONTENT = 0x45;              // 2.05
+const CODE_BAD_REQUEST = 0x80;          // 4.00
+const CODE_NOT_FOUND = 0x84;            // 4.04
+const CODE_METHOD_NOT_ALLOWED = 0x85;   // 4.05
+const CODE_INTERNAL_ERROR = 0xA0;       // 5.00
+
+const OPTION_URI_PATH = 11;
+const OPTION_CONTENT_FORMAT = 12;
+const OPTION_URI_QUERY = 15;
+const FORMAT_TEXT = 0;
+
+interface CoapOption {
+  number: number;
+  value: Uint8Array;
+}
+
+interface CoapMessage {
+  type: number;
+  code: number;
+  messageId: number;
+  token: Uint8Array;
+  options: CoapOption[];
+  payload: Uint8Array;
+}
+
+interface CoapResponse {
+  code: number;
+  format?: number;
+  payload?: string;
+}
+
+// Undefined if data is not a well-formed CoAP message
+function parseMessage(data: Uint8Array): CoapMessage | undefined {
+  if (data.length < 4 || data[0] >> 6 !== 1) return undefined;
+  const tokenLength = data[0] & 0x0F;
+  if (tokenLength > 8 || data.length < 4 + tokenLength) return undefined;
+
+  const message: CoapMessage = {
+    type: (data[0] >> 4) & 0x03,
+    code: data[1],
+    messageId: (data[2] << 8) | data[3],
+    token: data.slice(4, 4 + tokenLength),
+    options: [],
+    payload: new Uint8Array(0)
+  };
+
+  let position = 4 + tokenLength;
+  let number = 0;
+  // Delta and length share a byte; 13 and 14 mean one or two more bytes follow
+  const extended = (nibble: number): number | undefined => {
+    if (nibble < 13) return nibble;
+    if (nibble === 13 && position < data.length) return data[position++] + 13;
+    if (nibble === 14 && position + 1 < data.length) {
+      const value = ((data[position] << 8) | data[position + 1]) + 269;
+      position += 2;
+      return value;
+    }
+    return undefined;
+  };
+  while (position < data.length) {
+    if (data[position] === 0xFF) {
+      message.payload = data.slice(position + 1);
+      // A payload marker with nothing after it is a format error
+      return message.payload.length > 0 ? message : undefined;
+    }
+    const header = data[position++];
+    const delta = extended(header >> 4);
+    const length = extended(header & 0x0F);
+    if (delta === undefined || length === undefined || position + length > data.length) return undefined;
+    number += delta;
+    message.options.push({ number, value: data.slice(position, position + length) });
+    position += length;
+  }
+  return message;
+}
+
+function encodeMessage(type: number, code: number, messageId: number, token: Uint8Array, response?: CoapResponse): Uint8Array {
+  const encoder = new TextEncoder();
+  const payload = response?.payload !== undefined ? encoder.encode(response.payload) : new Uint8Array(0);
+  const bytes: number[] = [0x40 | (type << 4) | token.length, code, messageId >> 8, messageId & 0xFF, ...token];
+  if (payload.length > 0) {
+    // Content-Format is the only option we send: delta 12, one byte of value
+    // (or none for text/plain, which is zero)
+    const format = response?.format ?? FORMAT_TEXT;
+    if (format === FORMAT_TEXT) {
+      bytes.push(OPTION_CONTENT_FORMAT << 4);
+    } else {
+      bytes.push((OPTION_CONTENT_FORMAT << 4) | 1, format);
+    }
+    bytes.push(0xFF, ...payload);
+  }
+  return new Uint8Array(bytes);
+}
+
+function optionStrings(message: CoapMessage, number: number): string[] {
+  const decoder = new TextDecoder();
+  return message.options.filter(option => option.number === number).map(option => decoder.decode(option.value));
+}
+
+// Readings and wake check-ins from devices set to the CoAP transport: the
+// same work as POST /readings and GET /should-remain-awake, in one datagram
+// each way instead of a TCP connection and HTTP headers. Requests are
+// confirmable and the device retransmits them until it hears back, so each
+// response is kept for the exchange lifetime and sent again for a duplicate
+// rather than handling the request twice.
+export class CoapServer {
+  private deviceManager: DeviceManager;
+  private port: number;
+  private socket?: Deno.DatagramConn;
+  private responses: Map<string, { reply: Uint8Array; expiresAt: number }> = new Map();
+  private nextMessageId = Math.floor(Math.random() * 0x10000);
+  private cleanupId?: number;
+  private duplicates = 0;
+
+  constructor(deviceManager: DeviceManager, port: number = COAP_PORT) {
+    this.deviceManager = deviceManager;
+    this.port = port;
+  }
+
+  start(): void {
+    this.socket = Deno.listenDatagram({ hostname: "0.0.0.0", port: this.port, transport: "udp" });
+    this.cleanupId = setInterval(() => this.cleanup(), CLEANUP_INTERVAL_MS);
+    this.listen();
+    console.log(`📨 CoAP readings on udp/${this.port}`);
+  }
+
+  private async listen(): Promise<void> {
+    if (!this.socket) return;
+    try {
+      for await (const [data, addr] of this.socket) {
+        const reply = this.handleDatagram(data, addr as Deno.NetAddr);
+        if (reply) {
+          await this.socket.send(reply, addr);
+        }
+      }
+    } catch (error: unknown) {
+      if (error instanceof Error && !error.message.includes('closed')) {
+        console.error('❌ Error in CoAP listener:', error);
+      }
+    }
+  }
+
+  private handleDatagram(data: Uint8Array, addr: Deno.NetAddr): Uint8Array | undefined {
+    const message = parseMessage(data);
+    if (!message) {
+      // Confirmable messages we cannot read are rejected so the sender stops retrying
+      if (data.length >= 4 && data[0] >> 6 === 1 && ((data[0] >> 4) & 0x03) === TYPE_CON) {
+        return encodeMessage(TYPE_RST, CODE_EMPTY, (data[2] << 8) | data[3], new Uint8Array(0));
+      }
+      return undefined;
+    }
+    // We never send confirmable messages, so there is nothing to acknowledge
+    if (message.type === TYPE_ACK || message.type === TYPE_RST) return undefined;
+    if (message.code === CODE_EMPTY) {
+      // An empty CON is a ping
+      return message.type === TYPE_CON ? encodeMessage(TYPE_RST, CODE_EMPTY, message.messageId, new Uint8Array(0)) : undefined;
+    }
+
+    const key = `${addr.hostname}:${addr.port}:${message.messageId}`;
+    const seen = this.responses.get(key);
+    if (seen) {
+      this.duplicates++;
+      return seen.reply;
+    }
+
+    const response = this.handleRequest(message);
+    // Piggybacked on the ACK for a confirmable request, its own message otherwise
+    const reply = message.type === TYPE_CON
+      ? encodeMessage(TYPE_ACK, response.code, message.messageId, message.token, response)
+      : encodeMessage(TYPE_NON, response.code, this.nextMessageId++ & 0xFFFF, message.token, response);
+    this.responses.set(key, { reply, expiresAt: Date.now() + EXCHANGE_LIFETIME_MS });
+    return reply;
+  }
+
+  private handleRequest(message: CoapMessage): CoapResponse {
+    const path = optionStrings(message, OPTION_URI_PATH).join("/");
+    const query = new URLSearchParams(optionStrings(message, OPTION_URI_QUERY).join("&"));
+    try {
+      switch (path) {
+        case "readings": {
+          if (message.code !== CODE_POST) return { code: CODE_METHOD_NOT_ALLOWED };
+          let body: unknown;
+          try {
+            body = JSON.parse(new TextDecoder().decode(message.payload));
+          } catch {
+            return { code: CODE_BAD_REQUEST, payload: "Invalid JSON" };
+          }
+          const report = toSensorReadingReport(body);
+          if (!report) {
+            return { code: CODE_BAD_REQUEST, payload: "Missing or invalid fields" };
+          }
+          if (!this.deviceManager.handleSensorReadings(report)) {
+            return { code: CODE_NOT_FOUND, payload: "Device not found" };
+          }
+          return { code: CODE_CHANGED };
+        }
+        case "should-remain-awake": {
+          if (message.code !== CODE_GET) return { code: CODE_METHOD_NOT_ALLOWED };
+          const deviceId = query.get("id");
+          if (!deviceId) {
+            return { code: CODE_BAD_REQUEST, payload: "Missing device ID" };
+          }
+          const shouldStayAwake = this.deviceManager.handleShouldRemainAwake(deviceId, parseOutputParam(query));
+          return { code: CODE_CONTENT, format: FORMAT_TEXT, payload: shouldStayAwake ? "1" : "0" };
+        }
+        default:
+          return { code: CODE_NOT_FOUND };
+      }
+    } catch (error) {
+      console.error(`Error in CoAP /${path}:`, error);
+      return { code: CODE_INTERNAL_ERROR };
+    }
+  }
+
+  private cleanup(): void {
+    const now = Date.now();
+    for (const [key, entry] of this.responses) {
+      if (entry.expiresAt <= now) {
+        this.responses.delete(key);
+      }
+    }
+    if (this.duplicates > 0) {
+      console.log(`📨 Answered ${this.duplicates} retransmitted CoAP request(s) from cache`);
+      this.duplicates = 0;
+    }
+  }
+
+  stop(): void {
+    if (this.cleanupId !== undefined) {
+      clearInterval(this.cleanupId);
+      this.cleanupId = undefined;
+    }
+    if (this.socket) {
+      this.socket.close();
+      this.socket = undefined;
+    }
+    this.responses.clear();
+  }
+}
@@ -1,38 +1,142 @@
-import { Command, CommandType, CommandRequest, CommandResult } from "../types/command.ts";
+import { Command, CommandType, CommandRequest, CommandResult, CommandQueueStats } from "../types/command.ts";
 import { StateManager } from "./StateManager.ts";
+import { DeviceChannels } from "../websocket/deviceChannel.ts";
 
+const REQUEST_TIMEOUT_MS = 10000;
+const RETRY_BASE_MS = 2000;      // First retry delay; doubles per consecutive failure
+const RETRY_MAX_MS = 60000;
+const MAX_TIMER_MS = 0x7fffffff; // setTimeout overflows past this
+
+// Commands driving the same actuator replace each other while they wait for
+// delivery - only the last one matters once the device is reachable
+const ACTUATOR_TARGETS: Partial<Record<CommandType, string>> = {
+  'output-on': 'output',
+  'output-off': 'output',
+  'one-sec-on': 'output',
+  'valve-open': 'output',
+  'valve-close': 'output',
+  'servo-move': 'servo',
+  'rgb-sequence': 'light'
+};
+
+// Output state a command leaves behind; pulses have none to compare against
+const DESIRED_OUTPUT: Partial<Record<CommandType, boolean>> = {
+  'output-on': true,
+  'output-off': false,
+  'valve-open': true,
+  'valve-close': false
+};
+
+interface Wake {
+  at: number;
+  deviceId: string;
+}
+
+// Binary min-heap of device wake-up deadlines
+class WakeHeap {
+  private items: Wake[] = [];
+
+  get size(): number {
+    return this.items.length;
+  }
+
+  peek(): Wake | undefined {
+    return this.items[0];
+  }
+
+  push(wake: Wake): void {
+    const items = this.items;
+    let i = items.push(wake) - 1;
+    while (i > 0) {
+      const parent = (i - 1) >> 1;
+      if (items[parent].at <= wake.at) break;
+      items[i] = items[parent];
+      i = parent;
+    }
+    items[i] = wake;
+  }
+
+  pop(): Wake | undefined {
+    const items = this.items;
+    const top = items[0];
+    const last = items.pop();
+    if (items.length === 0 || !last) return top;
+
+    let i = 0;
+    for (;;) {
+      let child = 2 * i + 1;
+      if (child >= items.length) break;
+      if (child + 1 < items.length && items[child + 1].at < items[child].at) child++;
+      if (items[child].at >= last.at) break;
+      items[i] = items[child];
+      i = child;
+    }
+    items[i] = last;
+    return top;
+  }
+}
+
+// Sends queued commands to devices. Each device's commands go out one at a
+// time in the order they were queued; different devices run concurrently up to
+// maxConcurrent requests. Nothing polls: a heap of scheduledFor and retry
+// deadlines arms a single timer, and a device that checks in is woken straight
+// away, so an unreachable device only ever holds up its own commands.
 export class CommandQueue {
   private stateManager: StateManager;
-  private executionInterval: number;
-  private intervalId?: number;
+  private deviceChannels?: DeviceChannels;
+  private maxConcurrent: number;
+  private running = false;
 
-  constructor(stateManager: StateManager, executionInterval = 5000) {
+  private wakes = new WakeHeap();
+  private nextWake: Map<string, number> = new Map();    // Earliest live heap entry per device
+  private ready: Set<string> = new Set();               // Due devices waiting for a free slot
+  private active: Set<string> = new Set();              // Devices with a request in flight
+  private failureStreak: Map<string, number> = new Map();
+  private backoffUntil: Map<string, number> = new Map();
+  private timerId?: number;
+  private timerAt = 0;
+
+  constructor(stateManager: StateManager, maxConcurrent = 16) {
     this.stateManager = stateManager;
-    this.executionInterval = executionInterval;
+    this.maxConcurrent = maxConcurrent;
+    this.stateManager.addListener(this.onStateChange);
+  }
+
+  // Awake devices with a control channel open get their commands down it
+  setDeviceChannels(deviceChannels: DeviceChannels): void {
+    this.deviceChannels = deviceChannels;
   }
 
   start(): void {
-    if (this.intervalId) return;
-    
-    this.intervalId = setInterval(() => {
-      this.processCommands();
-    }, this.executionInterval);
-    
-    console.log('Command queue started');
+    if (this.running) return;
+    this.running = true;
+
+    // Pick up whatever was queued before the dispatcher ran
+    for (const command of this.stateManager.getAllCommands()) {
+      if (command.status === 'pending' && !command.delegated) {
+        this.wakeAt(command.deviceId, command.scheduledFor.getTime());
+      }
+    }
+    this.armTimer();
+
+    console.log(`Command queue started (${this.maxConcurrent} concurrent devices)`);
   }
 
   stop(): void {
-    if (this.intervalId) {
-      clearInterval(this.intervalId);
-      this.intervalId = undefined;
-      console.log('Command queue stopped');
+    if (!this.running) return;
+    this.running = false;
+
+    if (this.timerId !== undefined) {
+      clearTimeout(this.timerId);
+      this.timerId = undefined;
     }
+    console.log('Command queue stopped');
   }
 
   queueCommand(deviceId: string, request: CommandRequest): string {
     const commandId = this.generateCommandId();
     const now = new Date();
-    const scheduledFor = request.scheduleDelay 
+    const scheduledFor = request.scheduleDelay
       ? new Date(now.getTime() + request.scheduleDelay)
       : now;
 
@@ -48,15 +152,15 @@ export class CommandQueue {
       status: 'pending'
     };
 
-    this.stateManager.addCommand(command);
+    this.enqueue(command);
     console.log(`Queued command ${commandId} for device ${deviceId}: ${request.type}`);
-    
+
     return commandId;
   }
 
   queueScheduledCommand(deviceId: string, type: CommandType, scheduleFor: Date, payload?: any): string {
     const commandId = this.generateCommandId();
-    
+
     const command: Command = {
       id: commandId,
       deviceId,
@@ -69,24 +173,166 @@ export class CommandQueue {
       status: 'pending'
     };
 
-    this.stateManager.addCommand(command);
+    this.enqueue(command);
     console.log(`Scheduled command ${commandId} for device ${deviceId}: ${type} at ${scheduleFor.toISOString()}`);
-    
+
     return commandId;
   }
 
-  private async processCommands(): Promise<void> {
-    const devices = this.stateManager.getAllDevices();
-    
-    for (const device of devices) {
-      if (!device.isOnline) continue;
-      
-      const pendingCommands = this.stateManager.getPendingCommandsForDevice(device.id);
-      
-      for (const command of pendingCommands) {
-        await this.executeCommand(command);
+  private enqueue(command: Command): void {
+    const due = command.scheduledFor.getTime() <= Date.now();
+    if (due) {
+      this.coalesce(command);
+    }
+
+    this.stateManager.addCommand(command);
+
+    const desired = DESIRED_OUTPUT[command.type];
+    if (due && desired !== undefined) {
+      this.stateManager.setDesiredOutput(command.deviceId, desired);
+    }
+
+    this.wakeAt(command.deviceId, command.scheduledFor.getTime());
+  }
+
+  // Last writer wins: a due command replaces the device's due commands for the
+  // same actuator that have not gone out yet. Future ones are left alone - they
+  // are separate points in the schedule, not stale intent.
+  private coalesce(command: Command): void {
+    const target = ACTUATOR_TARGETS[command.type];
+    if (!target) return;
+
+    let superseded = 0;
+    for (const queued of this.stateManager.getPendingCommandsForDevice(command.deviceId)) {
+      if (ACTUATOR_TARGETS[queued.type] === target) {
+        this.stateManager.updateCommand(queued.id, {
+          status: 'superseded',
+          supersededBy: command.id
+        });
+        superseded++;
       }
     }
+
+    if (superseded > 0) {
+      console.log(`Command ${command.id} supersedes ${superseded} undelivered ${target} command(s) for device ${command.deviceId}`);
+    }
+  }
+
+  // Any state change for a device may mean it is back online - if it has due
+  // work and is not already being served, let it through
+  private onStateChange = (deviceId?: string): void => {
+    if (!deviceId || !this.running || this.active.has(deviceId) || this.ready.has(deviceId)) return;
+    if ((this.backoffUntil.get(deviceId) ?? 0) > Date.now()) return;
+
+    const device = this.stateManager.getDevice(deviceId);
+    if (device?.isOnline && this.stateManager.getPendingCommandsForDevice(deviceId).length > 0) {
+      this.markReady(deviceId);
+    }
+  };
+
+  private wakeAt(deviceId: string, at: number): void {
+    if (at <= Date.now()) {
+      this.markReady(deviceId);
+      return;
+    }
+
+    // One live heap entry per device; a later one is superseded by the earlier
+    const current = this.nextWake.get(deviceId);
+    if (current !== undefined && current <= at) return;
+
+    this.nextWake.set(deviceId, at);
+    this.wakes.push({ at, deviceId });
+    this.armTimer();
+  }
+
+  private markReady(deviceId: string): void {
+    this.ready.add(deviceId);
+    if (this.running) {
+      queueMicrotask(() => this.dispatch());
+    }
+  }
+
+  private armTimer(): void {
+    const next = this.wakes.peek();
+    if (!this.running || !next) return;
+    if (this.timerId !== undefined && this.timerAt <= next.at) return;
+
+    if (this.timerId !== undefined) {
+      clearTimeout(this.timerId);
+    }
+    this.timerAt = next.at;
+    this.timerId = setTimeout(() => {
+      this.timerId = undefined;
+      this.onTimer();
+    }, Math.min(Math.max(next.at - Date.now(), 0), MAX_TIMER_MS));
+  }
+
+  private onTimer(): void {
+    const now = Date.now();
+    for (let wake = this.wakes.peek(); wake && wake.at <= now; wake = this.wakes.peek()) {
+      this.wakes.pop();
+      // Stale entries were superseded by an earlier wake that already ran
+      if (this.nextWake.get(wake.deviceId) === wake.at) {
+        this.nextWake.delete(wake.deviceId);
+        this.ready.add(wake.deviceId);
+      }
+    }
+    this.armTimer();
+    this.dispatch();
+  }
+
+  private dispatch(): void {
+    if (!this.running) return;
+
+    for (const deviceId of this.ready) {
+      if (this.active.size >= this.maxConcurrent) break;
+      this.ready.delete(deviceId);
+      if (this.active.has(deviceId)) continue;
+
+      const command = this.nextCommandFor(deviceId);
+      if (command) {
+        this.active.add(deviceId);
+        this.executeCommand(command).finally(() => {
+          this.active.delete(deviceId);
+          this.afterCommand(deviceId);
+        });
+      }
+    }
+  }
+
+  // Head of the device's queue if it may run now; otherwise arranges a wake
+  private nextCommandFor(deviceId: string): Command | undefined {
+    const device = this.stateManager.getDevice(deviceId);
+    if (!device || !device.isOnline) {
+      // Woken again when the device next checks in
+      return undefined;
+    }
+
+    const backoffUntil = this.backoffUntil.get(deviceId) ?? 0;
+    if (backoffUntil > Date.now()) {
+      this.wakeAt(deviceId, backoffUntil);
+      return undefined;
+    }
+
+    const due = this.stateManager.getPendingCommandsForDevice(deviceId);
+    if (due.length > 0) {
+      return due[0];
+    }
+
+    const later = device.pendingCommands
+      .map(id => this.stateManager.getCommand(id))
+      .filter((cmd): cmd is Command => cmd !== undefined && cmd.status === 'pending' && !cmd.delegated)
+      .reduce((earliest, cmd) => Math.min(earliest, cmd.scheduledFor.getTime()), Infinity);
+    if (later !== Infinity) {
+      this.wakeAt(deviceId, later);
+    }
+    return undefined;
+  }
+
+  private afterCommand(deviceId: string): void {
+    // Straight on to the device's next command, behind anyone already waiting
+    this.ready.add(deviceId);
+    this.dispatch();
   }
 
   private async executeCommand(command: Command): Promise<void> {
@@ -96,41 +342,66 @@ export class CommandQueue {
       return;
     }
 
+    const desired = DESIRED_OUTPUT[command.type];
+    if (desired !== undefined) {
+      this.stateManager.setDesiredOutput(command.deviceId, desired);
+
+      if (this.stateManager.isOutputSatisfied(command.deviceId, desired)) {
+        this.stateManager.updateCommand(command.id, {
+          status: 'completed',
+          executedAt: new Date(),
+          satisfied: true
+        });
+        console.log(`Command ${command.id} skipped - device ${command.deviceId} already reports its output ${desired ? 'on' : 'off'}`);
+        return;
+      }
+    }
+
     console.log(`Executing command ${command.id}: ${command.type} on device ${command.deviceId}`);
-    
+
     this.stateManager.updateCommand(command.id, {
       status: 'executing',
       attempts: command.attempts + 1
     });
 
     try {
-      const result = await this.sendCommandToDevice(device.ipAddress, command);
-      
+      const sentAt = Date.now();
+      const result = await this.sendCommandToDevice(device.id, device.ipAddress, command);
+
       if (result.success) {
+        // How long an awake device took to answer, radio power save included
+        this.stateManager.recordCommandLatency(command.deviceId, Date.now() - sentAt);
         this.stateManager.updateCommand(command.id, {
           status: 'completed',
           executedAt: new Date()
         });
-        
+        this.failureStreak.delete(command.deviceId);
+        this.backoffUntil.delete(command.deviceId);
+
         // Update device state based on command type
         this.updateDeviceStateAfterCommand(command, device);
-        
+
         console.log(`Command ${command.id} completed successfully`);
       } else {
-        await this.handleCommandFailure(command, result.error || 'Unknown error');
+        this.handleCommandFailure(command, result.error || 'Unknown error');
       }
     } catch (error) {
-      await this.handleCommandFailure(command, error instanceof Error ? error.message : 'Unknown error');
+      this.handleCommandFailure(command, error instanceof Error ? error.message : 'Unknown error');
     }
   }
 
-  private async sendCommandToDevice(deviceIp: string, command: Command): Promise<CommandResult> {
-    const url = this.buildDeviceUrl(deviceIp, command);
+  private async sendCommandToDevice(deviceId: string, deviceIp: string, command: Command): Promise<CommandResult> {
+    const route = this.deviceRoute(command);
+    if (this.deviceChannels?.isConnected(deviceId)) {
+      return this.deviceChannels.sendCommand(deviceId, route, command.payload);
+    }
+
+    const url = `http://${deviceIp}/${route}`;
     const timestamp = new Date();
 
     try {
       const controller = new AbortController();
-      const timeoutId = setTimeout(() => controller.abort(), 10000); // 10 second timeout
+      const timeoutId = setTimeout(() => controller.abort(), REQUEST_TIMEOUT_MS);
 
       const response = await fetch(url, {
         method: 'POST',
@@ -146,37 +417,40 @@ export class CommandQueue {
       if (response.ok) {
         return { success: true, timestamp };
       } else {
-        return { 
-          success: false, 
+        return {
+          success: false,
           error: `HTTP ${response.status}: ${response.statusText}`,
-          timestamp 
+          timestamp
         };
       }
     } catch (error) {
       if (error instanceof Error && error.name === 'AbortError') {
         return { success: false, error: 'Request timeout', timestamp };
       }
-      return { 
-        success: false, 
+      return {
+        success: false,
         error: error instanceof Error ? error.message : 'Network error',
-        timestamp 
+        timestamp
       };
     }
   }
 
-  private buildDeviceUrl(deviceIp: string, command: Command): string {
-    const baseUrl = `http://${deviceIp}`;
-    
+  // The device's HTTP path for a command, which the control channel uses too
+  private deviceRoute(command: Command): string {
     switch (command.type) {
       case 'output-on':
       case 'valve-open':
-        return `${baseUrl}/output-on`;
+        return 'output-on';
       case 'output-off':
       case 'valve-close':
-        return `${baseUrl}/output-off`;
+        return 'output-off';
       case 'one-sec-on':
         // For one-sec-on, we'll send output-on and schedule output-off
-        return `${baseUrl}/output-on`;
+        return 'output-on';
+      case 'servo-move':
+        return 'servo';
+      case 'rgb-sequence':
+        return 'rgb';
       default:
         throw new Error(`Unsupported command type: ${command.type}`);
     }
@@ -201,12 +475,24 @@ export class CommandQueue {
           new Date(Date.now() + 1000)
         );
         break;
+      case 'servo-move':
+        this.stateManager.updateServoTarget(device.id, command.payload.position);
+        break;
+      case 'rgb-sequence':
+        this.stateManager.updateRgbSequence(device.id, command.payload);
+        break;
     }
   }
 
-  private async handleCommandFailure(command: Command, error: string): Promise<void> {
+  private handleCommandFailure(command: Command, error: string): void {
     console.error(`Command ${command.id} failed (attempt ${command.attempts}): ${error}`);
-    
+
+    // Back the whole device off - its later commands queue behind this one
+    const streak = (this.failureStreak.get(command.deviceId) ?? 0) + 1;
+    const delay = Math.min(RETRY_BASE_MS * 2 ** (streak - 1), RETRY_MAX_MS);
+    this.failureStreak.set(command.deviceId, streak);
+    this.backoffUntil.set(command.deviceId, Date.now() + delay);
+
     if (command.attempts >= command.maxAttempts) {
       this.stateManager.updateCommand(command.id, {
         status: 'failed',
@@ -219,7 +505,7 @@ export class CommandQueue {
         status: 'pending',
         error
       });
-      console.log(`Command ${command.id} will be retried (attempt ${command.attempts}/${command.maxAttempts})`);
+      console.log(`Command ${command.id} will be retried in ${delay}ms (attempt ${command.attempts}/${command.maxAttempts})`);
     }
   }
 
@@ -253,18 +539,27 @@ export class CommandQueue {
       error: undefined
     });
 
+    // A manual retry skips any backoff
+    this.failureStreak.delete(command.deviceId);
+    this.backoffUntil.delete(command.deviceId);
+    this.wakeAt(command.deviceId, command.scheduledFor.getTime());
+
     return true;
   }
 
-  getQueueStats() {
+  getQueueStats(): CommandQueueStats {
     const commands = this.stateManager.getAllCommands();
-    
+
     return {
       pending: commands.filter(c => c.status === 'pending').length,
       executing: commands.filter(c => c.status === 'executing').length,
       completed: commands.filter(c => c.status === 'completed').length,
       failed: commands.filter(c => c.status === 'failed').length,
-      total: commands.length
+      superseded: commands.filter(c => c.status === 'superseded').length,
+      total: commands.length,
+      activeDevices: this.active.size,
+      waitingDevices: this.ready.size,
+      scheduledWakes: this.nextWake.size
     };
   }
-}
\ No newline at end of file
+}
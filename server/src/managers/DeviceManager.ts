@@ -1,6 +1,11 @@
 import { StateManager } from "./StateManager.ts";
 import { CommandQueue } from "./CommandQueue.ts";
-import { DeviceRegistration, WiFiFailureReport } from "../types/device.ts";
+import { DeviceRegistration, WiFiFailureReport, RuleFiringReport, SensorReadingReport, SwitchEventReport, ContactRecord, SeriesPoint } from "../types/device.ts";
+import { Command, ValveSchedule } from "../types/command.ts";
+import { DeviceRule, ServoMove, RgbSequence } from "../types/deviceConfig.ts";
+
+// Matches ValveSchedule::MAX_EVENTS in the firmware
+const MAX_VALVE_SCHEDULE_EVENTS = 16;
 
 export class DeviceManager {
   private stateManager: StateManager;
@@ -41,11 +46,179 @@ export class DeviceManager {
       alias: registration.alias,
       ipAddress: registration.ipAddress,
       macAddress: registration.macAddress,
-      mode: registration.mode
+      mode: registration.mode,
+      firmwareVersion: registration.firmwareVersion,
+      firmwareBuild: registration.buildNumber,
+      missedSlots: registration.missedSlots,
+      outputOn: registration.outputOn,
+      energy: registration.energy,
+      switchClosed: registration.switchClosed,
+      servo: registration.servo,
+      rgb: registration.rgb
     });
+
+    if (registration.valveEventAt !== undefined) {
+      this.handleValveReport(registration.id, registration.valveOpen ?? false, registration.valveEventAt);
+    }
+  }
+
+  // Hands the device its upcoming valve commands so it can run them from its own
+  // clock while asleep. Delegated commands are no longer pushed by the queue and
+  // are completed once the device reports having run them.
+  getValveSchedule(deviceId: string): ValveSchedule | null {
+    const device = this.stateManager.getDevice(deviceId);
+    if (!device) return null;
+
+    this.stateManager.updateDeviceContact(deviceId, 'valve-schedule');
+
+    const now = Date.now();
+    const commands = device.pendingCommands
+      .map(id => this.stateManager.getCommand(id))
+      .filter((cmd): cmd is Command => cmd !== undefined)
+      .filter(cmd => cmd.status === 'pending' && (cmd.type === 'valve-open' || cmd.type === 'valve-close'))
+      .filter(cmd => cmd.delegated || cmd.scheduledFor.getTime() > now)
+      .sort((a, b) => a.scheduledFor.getTime() - b.scheduledFor.getTime())
+      .slice(0, MAX_VALVE_SCHEDULE_EVENTS);
+
+    for (const command of commands) {
+      if (!command.delegated) {
+        this.stateManager.updateCommand(command.id, { delegated: true });
+      }
+    }
+
+    const events = commands.map(cmd => ({
+      at: cmd.scheduledFor.getTime(),
+      open: cmd.type === 'valve-open'
+    }));
+
+    const text = events.map(e => `${e.at}:${e.open ? 1 : 0}`).join(',');
+    return { version: this.contentVersion(text), events };
+  }
+
+  private handleValveReport(deviceId: string, open: boolean, lastEventAt: number): void {
+    this.stateManager.updateDeviceOutput(deviceId, open);
+
+    // Everything up to the last event the device ran is done (overdue ones are
+    // skipped on the device in favour of the latest)
+    const executedAt = new Date();
+    for (const command of this.stateManager.getAllCommands()) {
+      if (command.deviceId === deviceId && command.delegated && command.status === 'pending' &&
+          command.scheduledFor.getTime() <= lastEventAt) {
+        this.stateManager.updateCommand(command.id, { status: 'completed', executedAt });
+        console.log(`Delegated command ${command.id} run by device ${deviceId}`);
+      }
+    }
+  }
+
+  setDeviceRules(deviceId: string, rules: DeviceRule[]): boolean {
+    const success = this.stateManager.setDeviceRules(deviceId, rules);
+
+    if (success) {
+      console.log(`Device ${deviceId} rules updated (${rules.length} rules)`);
+    } else {
+      console.error(`Failed to set rules for device ${deviceId}: device not found`);
+    }
+
+    return success;
+  }
+
+  // Rules in the form the device fetches them, versioned so it can skip unchanged sets
+  getDeviceRules(deviceId: string): { version: number; rules: DeviceRule[] } | null {
+    const device = this.stateManager.getDevice(deviceId);
+    if (!device) return null;
+
+    const rules = device.rules ?? [];
+    return { version: this.contentVersion(rules.length ? JSON.stringify(rules) : ''), rules };
+  }
+
+  handleRuleFirings(report: RuleFiringReport): void {
+    this.stateManager.updateDeviceContact(report.id, 'rule-firings');
+
+    const firings = report.firings.map(firing => ({
+      rule: firing.rule,
+      at: new Date(firing.at),
+      value: firing.value
+    }));
+    this.stateManager.addRuleFirings(report.id, firings);
+
+    // A firing holds the output on for the rule's duration and then drops it,
+    // both without the server; the later switch is the one that counts
+    const rules = this.stateManager.getDevice(report.id)?.rules ?? [];
+    for (const firing of firings) {
+      const durationMs = (rules[firing.rule]?.durationSeconds ?? 0) * 1000;
+      this.stateManager.noteLocalOutputChange(report.id, new Date(firing.at.getTime() + durationMs));
+    }
+
+    for (const firing of firings) {
+      console.log(`Device ${report.id} rule ${firing.rule} fired at ${firing.at.toISOString()} on ${firing.value}`);
+    }
+    if (report.dropped) {
+      console.log(`Device ${report.id} dropped ${report.dropped} rule firings`);
+    }
   }
 
-  handleShouldRemainAwake(deviceId: string): boolean {
+  handleSensorReadings(report: SensorReadingReport): boolean {
+    this.stateManager.updateDeviceContact(report.id, 'readings');
+    if (report.outputOn !== undefined) {
+      this.stateManager.updateDeviceOutput(report.id, report.outputOn);
+    }
+    return this.stateManager.addSensorReadings(report.id, report.readings);
+  }
+
+  handleSwitchEvents(report: SwitchEventReport, receivedAt: number): boolean {
+    this.stateManager.updateDeviceContact(report.id, 'switch-events');
+
+    const events = report.events.map(event => ({
+      closed: event.closed,
+      at: new Date(event.at ?? receivedAt)
+    }));
+    if (!this.stateManager.addSwitchEvents(report.id, events)) return false;
+
+    for (const event of events) {
+      console.log(`Device ${report.id} switch ${event.closed ? 'closed' : 'opened'} at ${event.at.toISOString()}`);
+    }
+    if (report.dropped) {
+      console.log(`Device ${report.id} dropped ${report.dropped} switch events`);
+    }
+    return true;
+  }
+
+  getContactHistory(deviceId: string, limit?: number): ContactRecord[] {
+    return this.stateManager.getContactHistory(deviceId, limit);
+  }
+
+  getSeriesNames(deviceId: string): string[] | null {
+    if (!this.stateManager.getDevice(deviceId)) return null;
+    return this.stateManager.getSeriesNames(deviceId);
+  }
+
+  // Chart data for one series of a device, null if the device is unknown
+  getSeries(deviceId: string, series: string, from: number, to: number, maxPoints: number): SeriesPoint[] | null {
+    if (!this.stateManager.getDevice(deviceId)) return null;
+    return this.stateManager.querySeries(deviceId, series, from, to, maxPoints);
+  }
+
+  // FNV-1a; 0 is reserved for "nothing"
+  private contentVersion(text: string): number {
+    if (text.length === 0) return 0;
+
+    let hash = 0x811c9dc5;
+    for (let i = 0; i < text.length; i++) {
+      hash ^= text.charCodeAt(i);
+      hash = Math.imul(hash, 0x01000193) >>> 0;
+    }
+    return hash === 0 ? 1 : hash;
+  }
+
+  // Pending commands or forced awake; the answer without recording a check-in
+  shouldRemainAwake(deviceId: string): boolean {
+    const device = this.stateManager.getDevice(deviceId);
+    if (!device) return false;
+    return this.stateManager.getPendingCommandsForDevice(deviceId).length > 0 || device.forceAwake;
+  }
+
+  // outputOn is the device's output as of this check-in, for devices with one
+  handleShouldRemainAwake(deviceId: string, outputOn?: boolean): boolean {
     this.stateManager.updateDeviceContact(deviceId, 'should-remain-awake');
     
     const device = this.stateManager.getDevice(deviceId);
@@ -53,11 +226,12 @@ export class DeviceManager {
       console.log(`Device ${deviceId} not found`);
       return false;
     }
+    if (outputOn !== undefined) {
+      this.stateManager.updateDeviceOutput(deviceId, outputOn);
+    }
     
-    // Check if device has pending commands or is forced to stay awake
     const pendingCommands = this.stateManager.getPendingCommandsForDevice(deviceId);
-    const hasPendingCommands = pendingCommands.length > 0;
-    const shouldStayAwake = hasPendingCommands || device.forceAwake;
+    const shouldStayAwake = this.shouldRemainAwake(deviceId);
     
     // Update the device's sleep status based on our decision
     const sleepStatus = shouldStayAwake ? 'awake' : 'asleep';
@@ -105,6 +279,40 @@ export class DeviceManager {
     return commandId;
   }
 
+  moveServo(deviceId: string, move: ServoMove, scheduleDelay?: number): string | null {
+    const device = this.stateManager.getDevice(deviceId);
+    if (!device) {
+      console.error(`Cannot move servo of device ${deviceId}: device not found`);
+      return null;
+    }
+
+    const commandId = this.commandQueue.queueCommand(deviceId, {
+      type: 'servo-move',
+      payload: move,
+      scheduleDelay
+    });
+
+    console.log(`Queued servo move to ${move.position} for device ${deviceId} (${device.alias})`);
+    return commandId;
+  }
+
+  playRgbSequence(deviceId: string, sequence: RgbSequence, scheduleDelay?: number): string | null {
+    const device = this.stateManager.getDevice(deviceId);
+    if (!device) {
+      console.error(`Cannot set light of device ${deviceId}: device not found`);
+      return null;
+    }
+
+    const commandId = this.commandQueue.queueCommand(deviceId, {
+      type: 'rgb-sequence',
+      payload: sequence,
+      scheduleDelay
+    });
+
+    console.log(`Queued ${sequence.frames.length}-keyframe light sequence for device ${deviceId} (${device.alias})`);
+    return commandId;
+  }
+
   scheduleDeviceAction(deviceId: string, action: 'output-on' | 'output-off' | 'valve-open' | 'valve-close', scheduleFor: Date): string | null {
     const device = this.stateManager.getDevice(deviceId);
     if (!device) {
@@ -156,6 +364,7 @@ export class DeviceManager {
         offline: state.systemStats.totalDevices - state.systemStats.onlineDevices
       },
       commands: queueStats,
+      persistence: this.stateManager.getPersistenceStats(),
       uptime: state.systemStats.uptime,
       lastUpdate: state.systemStats.lastUpdate
     };
@@ -0,0 +1,233 @@
+import {
+  FirmwareOffer,
+  FirmwareResultReport,
+  FirmwareRolloutRequest,
+  FirmwareRolloutStatus,
+  FirmwareRolloutUpdate
+} from "../types/firmware.ts";
+
+// A device given the image that has not registered on the new build by then
+// counts as failed, which also frees its slot
+const UPDATE_TIMEOUT_MS = 10 * 60 * 1000;
+
+// Image suffixes each platform can flash, best first. ESP8266 devices inflate
+// gzip images while booting them; the ESP32 updater only takes plain ones.
+const PLATFORM_IMAGES: Record<string, string[]> = {
+  esp8266: ['.bin.gz', '.bin'],
+  esp32: ['.bin']
+};
+
+interface DeviceUpdate {
+  since: Date;
+  image: string;
+}
+
+interface FirmwareRollout {
+  version: string;
+  build: number;
+  percentage: number;
+  maxConcurrent: number;
+  maxFailures: number;
+  status: 'active' | 'paused';
+  pausedReason?: string;
+  startedAt: Date;
+  images: Record<string, string>;      // Platform -> image file name
+  updating: Map<string, DeviceUpdate>;
+  updated: Set<string>;
+  failed: Map<string, string>;
+}
+
+// Staged firmware rollout. Devices are offered the target build when they
+// register; only a percentage of the fleet is eligible and only maxConcurrent
+// devices may be mid-update at once, so a bad image reaches a few devices and
+// pauses the rollout instead of bricking the fleet.
+export class FirmwareManager {
+  private firmwareDir: string;
+  private rollout?: FirmwareRollout;
+
+  constructor(firmwareDir = "./firmware") {
+    this.firmwareDir = firmwareDir;
+  }
+
+  // Returns null if there is no image for the build
+  async startRollout(request: FirmwareRolloutRequest): Promise<FirmwareRolloutStatus | null> {
+    const images = await this.findImages(request.build);
+    if (Object.keys(images).length === 0) {
+      console.error(`No firmware images for build ${request.build} in ${this.firmwareDir}`);
+      return null;
+    }
+
+    this.rollout = {
+      version: request.version,
+      build: request.build,
+      percentage: request.percentage ?? 10,
+      maxConcurrent: request.maxConcurrent ?? 2,
+      maxFailures: request.maxFailures ?? 2,
+      status: 'active',
+      startedAt: new Date(),
+      images,
+      updating: new Map(),
+      updated: new Set(),
+      failed: new Map()
+    };
+
+    console.log(`Firmware rollout of ${request.version} (build ${request.build}) started for ` +
+      `${this.rollout.percentage}% of devices (${Object.keys(images).join(', ')})`);
+    return this.getRolloutStatus();
+  }
+
+  // Widen or narrow the rollout, or pause/resume it. Returns null if there is none.
+  updateRollout(update: FirmwareRolloutUpdate): FirmwareRolloutStatus | null {
+    const rollout = this.rollout;
+    if (!rollout) return null;
+
+    rollout.percentage = update.percentage ?? rollout.percentage;
+    rollout.maxConcurrent = update.maxConcurrent ?? rollout.maxConcurrent;
+    rollout.maxFailures = update.maxFailures ?? rollout.maxFailures;
+    if (update.status) {
+      rollout.status = update.status;
+      rollout.pausedReason = update.status === 'paused' ? 'Paused by user' : undefined;
+    }
+
+    console.log(`Firmware rollout of build ${rollout.build}: ${rollout.status}, ` +
+      `${rollout.percentage}% of devices, ${rollout.maxConcurrent} at a time`);
+    return this.getRolloutStatus();
+  }
+
+  cancelRollout(): boolean {
+    if (!this.rollout) return false;
+
+    console.log(`Firmware rollout of build ${this.rollout.build} cancelled`);
+    this.rollout = undefined;
+    return true;
+  }
+
+  getRolloutStatus(): FirmwareRolloutStatus | null {
+    const rollout = this.rollout;
+    if (!rollout) return null;
+
+    this.expireUpdates(rollout);
+    return {
+      version: rollout.version,
+      build: rollout.build,
+      percentage: rollout.percentage,
+      maxConcurrent: rollout.maxConcurrent,
+      maxFailures: rollout.maxFailures,
+      status: rollout.status,
+      pausedReason: rollout.pausedReason,
+      startedAt: rollout.startedAt,
+      platforms: Object.keys(rollout.images),
+      updating: [...rollout.updating.keys()],
+      updated: [...rollout.updated],
+      failed: Object.fromEntries(rollout.failed)
+    };
+  }
+
+  // Called on registration with the build the device is running. Returns the
+  // offer to put in the response, or null if this device should not update now.
+  checkIn(deviceId: string, platform: string | undefined, build: number | undefined): FirmwareOffer | null {
+    const rollout = this.rollout;
+    if (!rollout || build === undefined) return null;
+
+    this.expireUpdates(rollout);
+
+    if (build === rollout.build) {
+      if (rollout.updating.delete(deviceId)) {
+        rollout.updated.add(deviceId);
+        console.log(`Device ${deviceId} is running firmware build ${build}`);
+      }
+      return null;
+    }
+
+    if (rollout.status !== 'active' || rollout.failed.has(deviceId)) return null;
+
+    const image = platform ? rollout.images[platform.toLowerCase()] : undefined;
+    if (!image) return null;
+
+    // A device that already holds a slot is offered the image again; it may
+    // have postponed the update
+    if (!rollout.updating.has(deviceId)) {
+      if (this.bucket(deviceId) >= rollout.percentage) return null;
+      if (rollout.updating.size >= rollout.maxConcurrent) return null;
+
+      rollout.updating.set(deviceId, { since: new Date(), image });
+      console.log(`Offering firmware build ${rollout.build} to device ${deviceId} ` +
+        `(${rollout.updating.size}/${rollout.maxConcurrent} updating)`);
+    }
+
+    return {
+      version: rollout.version,
+      build: rollout.build,
+      path: `/firmware?id=${encodeURIComponent(deviceId)}&build=${rollout.build}`
+    };
+  }
+
+  // Only devices holding an update slot for the build may download it
+  async getImage(deviceId: string, build: number): Promise<Uint8Array | null> {
+    const rollout = this.rollout;
+    const update = rollout?.updating.get(deviceId);
+    if (!rollout || !update || rollout.build !== build) return null;
+
+    return await Deno.readFile(`${this.firmwareDir}/${update.image}`);
+  }
+
+  handleResult(report: FirmwareResultReport): void {
+    const rollout = this.rollout;
+    if (!rollout || rollout.build !== report.build || !rollout.updating.delete(report.id)) return;
+
+    if (report.success) {
+      rollout.updated.add(report.id);
+    } else {
+      this.recordFailure(rollout, report.id, report.error || 'Unknown error');
+    }
+  }
+
+  private recordFailure(rollout: FirmwareRollout, deviceId: string, error: string): void {
+    rollout.failed.set(deviceId, error);
+    console.error(`Firmware build ${rollout.build} failed on device ${deviceId}: ${error}`);
+
+    if (rollout.status === 'active' && rollout.failed.size >= rollout.maxFailures) {
+      rollout.status = 'paused';
+      rollout.pausedReason = `${rollout.failed.size} devices failed to update`;
+      console.error(`Firmware rollout of build ${rollout.build} paused: ${rollout.pausedReason}`);
+    }
+  }
+
+  private expireUpdates(rollout: FirmwareRollout): void {
+    const cutoff = Date.now() - UPDATE_TIMEOUT_MS;
+    for (const [deviceId, update] of rollout.updating) {
+      if (update.since.getTime() < cutoff) {
+        rollout.updating.delete(deviceId);
+        this.recordFailure(rollout, deviceId, 'Did not return on the new build');
+      }
+    }
+  }
+
+  private async findImages(build: number): Promise<Record<string, string>> {
+    const images: Record<string, string> = {};
+    for (const [platform, suffixes] of Object.entries(PLATFORM_IMAGES)) {
+      for (const suffix of suffixes) {
+        const fileName = `${platform}-${build}${suffix}`;
+        try {
+          await Deno.stat(`${this.firmwareDir}/${fileName}`);
+          images[platform] = fileName;
+          break;
+        } catch {
+          // Not built for this platform
+        }
+      }
+    }
+    return images;
+  }
+
+  // Stable 0-99 position of a device, so the same devices go first in every
+  // rollout and widening the percentage only adds devices
+  private bucket(deviceId: string): number {
+    let hash = 0x811c9dc5;
+    for (let i = 0; i < deviceId.length; i++) {
+      hash ^= deviceId.charCodeAt(i);
+      hash = Math.imul(hash, 0x01000193) >>> 0;
+    }
+    return hash % 100;
+  }
+}
@@ -8,6 +8,79 @@ import {
   isValidDeviceMode
 } from "../types/deviceConfig.ts";
 
+const PROBE_CONCURRENCY = 16;       // Devices being described/configured at once
+const SWEEP_CONCURRENCY = 64;       // /is-up requests in flight during a subnet sweep
+const SWEEP_TIMEOUT_MS = 1000;
+const DEFAULT_SSDP_MAX_AGE_S = 1800;
+const CLEANUP_INTERVAL_MS = 60 * 1000;
+
+// Devices announce themselves here each time they come online
+// (PresenceBeacon in the firmware)
+const PRESENCE_GROUP = "239.255.79.77";
+const PRESENCE_PORT = 4277;
+const PRESENCE_MISSED_ANNOUNCEMENTS = 3;    // Kept until this many are missed
+
+// What a device's SSDP announcement told us, valid until its max-age runs out.
+// A device that announces itself again within that time is not probed again.
+interface SsdpCacheEntry {
+  ip: string;
+  headers: Record<string, string>;
+  expiresAt: number;
+}
+
+interface PendingProbe {
+  ip: string;
+  headers: Record<string, string>;
+  verified: boolean;                // /is-up already answered (found by the sweep)
+}
+
+// Runs fn over items with at most limit calls in flight
+async function forEachLimited<T>(items: T[], limit: number, fn: (item: T) => Promise<void>): Promise<void> {
+  let next = 0;
+  const worker = async () => {
+    while (next < items.length) {
+      await fn(items[next++]);
+    }
+  };
+  await Promise.all(Array.from({ length: Math.min(limit, items.length) }, worker));
+}
+
+// One device's multicast announcement, sent as it wakes
+export interface PresenceAnnouncement {
+  omni: 1;
+  id: string;
+  alias: string;
+  ipAddress: string;
+  macAddress?: string;
+  mode: number;
+  firmwareVersion: string;
+  buildNumber: number;
+  platform?: string;
+  serverUrl: string;                // Empty until the device is given one
+  awake: boolean;
+  interval: number;                 // Seconds until the next announcement
+}
+
+function isPresenceAnnouncement(value: unknown): value is PresenceAnnouncement {
+  if (typeof value !== 'object' || value === null) return false;
+  const a = value as Record<string, unknown>;
+  return a.omni === 1 &&
+    typeof a.id === 'string' && a.id.length > 0 && a.id.length <= 64 &&
+    typeof a.alias === 'string' &&
+    typeof a.ipAddress === 'string' &&
+    typeof a.mode === 'number' && isValidDeviceMode(a.mode) &&
+    typeof a.firmwareVersion === 'string' &&
+    typeof a.buildNumber === 'number' &&
+    typeof a.serverUrl === 'string' &&
+    typeof a.awake === 'boolean' &&
+    typeof a.interval === 'number' && a.interval > 0;
+}
+
+function parseMaxAge(headers: Record<string, string>): number {
+  const match = headers['cache-control']?.match(/max-age\s*=\s*(\d+)/i);
+  return match ? parseInt(match[1]) : DEFAULT_SSDP_MAX_AGE_S;
+}
+
 export interface DiscoveredDevice {
   ip: string;
   hostname?: string;
@@ -17,6 +90,7 @@ export interface DiscoveredDevice {
   isConfigured: boolean;
   lastSeen: Date;
   ssdpInfo?: any;
+  announcement?: PresenceAnnouncement;
 }
 
 export interface ServerConfig {
@@ -27,7 +101,6 @@ export interface ServerConfig {
   };
   discovery: {
     enabled: boolean;
-    scanInterval: number;
     autoConfigureDevices: boolean;
     ssdpPort: number;
   };
@@ -51,13 +124,6 @@ class SSSDPClient {
     this.onDevice = onDevice;
   }
 
-  // Public method to trigger device discovery callback
-  public triggerDeviceFound(device: any): void {
-    if (this.onDevice) {
-      this.onDevice(device);
-    }
-  }
-
   async start(): Promise<void> {
     try {
       // Create UDP socket bound to SSDP multicast port for receiving responses
@@ -202,12 +268,78 @@ class SSSDPClient {
   }
 }
 
+// Listens on the presence multicast group. Nothing is sent: devices speak
+// when they wake, and this hears them.
+class PresenceListener {
+  private socket?: Deno.DatagramConn;
+  private onAnnouncement: (announcement: PresenceAnnouncement, ip: string) => void;
+
+  constructor(onAnnouncement: (announcement: PresenceAnnouncement, ip: string) => void) {
+    this.onAnnouncement = onAnnouncement;
+  }
+
+  async start(interfaceIp: string): Promise<void> {
+    this.socket = Deno.listenDatagram({
+      hostname: "0.0.0.0",
+      port: PRESENCE_PORT,
+      transport: "udp",
+      reuseAddress: true
+    });
+    await this.socket.joinMulticastV4(PRESENCE_GROUP, interfaceIp);
+    this.listen();
+    console.log(`📡 Listening for device announcements on ${PRESENCE_GROUP}:${PRESENCE_PORT}`);
+  }
+
+  private async listen(): Promise<void> {
+    if (!this.socket) return;
+    const decoder = new TextDecoder();
+    try {
+      for await (const [data, addr] of this.socket) {
+        let announcement: unknown;
+        try {
+          announcement = JSON.parse(decoder.decode(data));
+        } catch {
+          continue;
+        }
+        if (isPresenceAnnouncement(announcement)) {
+          // The sender's address, rather than the one it reports
+          this.onAnnouncement(announcement, (addr as Deno.NetAddr).hostname);
+        }
+      }
+    } catch (error: unknown) {
+      if (error instanceof Error && !error.message.includes('closed')) {
+        console.error('❌ Error listening for device announcements:', error);
+      }
+    }
+  }
+
+  stop(): void {
+    if (this.socket) {
+      this.socket.close();
+      this.socket = undefined;
+    }
+  }
+}
+
+// Finds devices on the LAN by listening for the announcement each one
+// multicasts as it wakes, so a device is known the moment it is online
+// without searching for it. For firmware that does not announce itself there
+// is one SSDP search at start, and SSDP plus an /is-up sweep of the /24 on
+// demand (forceDiscovery). Either way a device joins one bounded pipeline that
+// reads its configuration and, if needed, points it at this server.
 export class NetworkDiscovery {
   private deviceManager: DeviceManager;
   private discoveredDevices: Map<string, DiscoveredDevice> = new Map();
   private intervalId?: number;
   private config: ServerConfig;
   private ssdpClient?: SSSDPClient;
+  private presenceListener?: PresenceListener;
+  private ssdpCache: Map<string, SsdpCacheEntry> = new Map();
+  private presenceExpiry: Map<string, number> = new Map();    // By IP
+  private probeQueue: PendingProbe[] = [];
+  private probing: Set<string> = new Set();   // Queued or in flight, by IP
+  private activeProbes = 0;
+  private sweeping = false;
 
   constructor(deviceManager: DeviceManager, config: ServerConfig) {
     this.deviceManager = deviceManager;
@@ -222,30 +354,36 @@ export class NetworkDiscovery {
 
     if (this.intervalId) return;
     
-    console.log('🔍 Starting SSDP device discovery...');
+    console.log('🔍 Starting device discovery...');
     console.log(`🔍 Server IP: ${this.config.server.ip}:${this.config.server.port}`);
     
+    try {
+      this.presenceListener = new PresenceListener((announcement, ip) => {
+        this.handleAnnouncement(announcement, ip);
+      });
+      await this.presenceListener.start(this.config.server.ip);
+    } catch (error) {
+      console.error('❌ Failed to join the presence group:', error);
+    }
+    
     try {
       // Initialize SSDP client
       this.ssdpClient = new SSSDPClient((device) => {
-        this.handleDiscoveredDevice(device);
+        this.handleSsdpResponse(device);
       });
       
       await this.ssdpClient.start();
       
-      // Initial discovery
+      // Catch whatever is awake now and predates the announcements; after
+      // this, devices make themselves known
       await this.discoverDevices();
       
-      // Schedule periodic discovery
-      this.intervalId = setInterval(async () => {
-        await this.discoverDevices();
-        this.cleanupOldDevices();
-      }, this.config.discovery.scanInterval);
-      
-      console.log('🔍 SSDP discovery started successfully');
+      console.log('🔍 Device discovery started successfully');
     } catch (error) {
       console.error('❌ Failed to start SSDP discovery:', error);
     }
+    
+    this.intervalId = setInterval(() => this.cleanupOldDevices(), CLEANUP_INTERVAL_MS);
   }
 
   async stop(): Promise<void> {
@@ -254,12 +392,16 @@ export class NetworkDiscovery {
       this.intervalId = undefined;
     }
     
+    if (this.presenceListener) {
+      this.presenceListener.stop();
+      this.presenceListener = undefined;
+    }
     if (this.ssdpClient) {
       this.ssdpClient.stop();
       this.ssdpClient = undefined;
     }
     
-    console.log('🔍 SSDP discovery stopped');
+    console.log('🔍 Device discovery stopped');
   }
 
   private async discoverDevices(): Promise<void> {
@@ -277,17 +419,15 @@ export class NetworkDiscovery {
       
       await this.ssdpClient.search("ssdp:all");
       await new Promise(resolve => setTimeout(resolve, 500));
-      
-      // Also try a direct network scan as fallback
-      //await this.performNetworkScan();
-      
     } catch (error) {
       console.error('❌ Error during device discovery:', error);
     }
   }
 
+  // Probes the whole /24 at once (bounded), so a sweep takes about as long as
+  // the slowest few timeouts rather than 254 of them
   private async performNetworkScan(): Promise<void> {
-    console.log('🔍 Performing direct network scan as fallback...');
+    if (this.sweeping) return;
     
     // Get our server IP to determine network range
     const serverIP = this.config.server.ip;
@@ -298,77 +438,154 @@ export class NetworkDiscovery {
       return;
     }
     
-    const networkBase = `${ipParts[0]}.${ipParts[1]}.${ipParts[2]}`;
-    const promises: Promise<void>[] = [];
+    // Devices SSDP or their own announcements have recently vouched for need no probe
+    const known = new Set<string>();
+    const now = Date.now();
+    for (const entry of this.ssdpCache.values()) {
+      if (entry.expiresAt > now) known.add(entry.ip);
+    }
+    for (const [ip, expiresAt] of this.presenceExpiry.entries()) {
+      if (expiresAt > now) known.add(ip);
+    }
     
-    // Scan common IP ranges (last octet 1-254)
+    const networkBase = `${ipParts[0]}.${ipParts[1]}.${ipParts[2]}`;
+    const targets: string[] = [];
     for (let i = 1; i <= 254; i++) {
       const ip = `${networkBase}.${i}`;
-      
-      // Skip our own IP
-      if (ip === serverIP) continue;
-      
-      promises.push(this.checkDeviceDirectly(ip));
-      
-      // Limit concurrent requests to avoid overwhelming the network
-      if (promises.length >= 20) {
-        await Promise.allSettled(promises);
-        promises.length = 0;
-        await new Promise(resolve => setTimeout(resolve, 100)); // Small delay
+      if (ip !== serverIP && !known.has(ip)) {
+        targets.push(ip);
       }
     }
     
-    // Process remaining promises
-    if (promises.length > 0) {
-      await Promise.allSettled(promises);
+    this.sweeping = true;
+    const startedAt = Date.now();
+    let found = 0;
+    try {
+      await forEachLimited(targets, SWEEP_CONCURRENCY, async (ip) => {
+        if (await this.checkDeviceDirectly(ip)) {
+          found++;
+          this.enqueueProbe({ ip, headers: { server: 'Direct Scan Discovery' }, verified: true });
+        }
+      });
+    } finally {
+      this.sweeping = false;
     }
+    
+    console.log(`🔍 Swept ${targets.length} addresses in ${Date.now() - startedAt}ms, ${found} device(s) answered`);
   }
 
-  private async checkDeviceDirectly(ip: string): Promise<void> {
+  private async checkDeviceDirectly(ip: string): Promise<boolean> {
     try {
-      // Quick check with very short timeout
       const response = await fetch(`http://${ip}/is-up`, {
-        signal: AbortSignal.timeout(1000)
+        signal: AbortSignal.timeout(SWEEP_TIMEOUT_MS)
       });
-      
-      if (response.ok && (await response.text()).trim() === 'yes') {
-        console.log(`🔍 Found device via direct scan: ${ip}`);
-        
-        // Simulate SSDP discovery for this device
-        if (this.ssdpClient) {
-          this.ssdpClient.triggerDeviceFound({
-            ip,
-            headers: {
-              server: 'Direct Scan Discovery',
-              location: `http://${ip}/description.xml`
-            },
-            timestamp: new Date()
-          });
-        }
-      }
+      return response.ok && (await response.text()).trim() === 'yes';
     } catch (error) {
-      // Silently ignore errors for direct scan - most IPs won't respond
+      // Most addresses won't answer
+      return false;
     }
   }
 
-  private async handleDiscoveredDevice(ssdpDevice: any): Promise<void> {
-    const ip = ssdpDevice.ip;
-    
-    // Skip our own server IP
-    if (ip === this.config.server.ip) {
+  private handleAnnouncement(announcement: PresenceAnnouncement, ip: string): void {
+    if (ip === this.config.server.ip) return;
+    const now = Date.now();
+    this.presenceExpiry.set(ip, now + announcement.interval * 1000 * PRESENCE_MISSED_ANNOUNCEMENTS);
+
+    // A device that moved leaves its old address behind
+    for (const [otherIp, other] of this.discoveredDevices.entries()) {
+      if (otherIp !== ip && other.serialNumber === announcement.id) {
+        this.discoveredDevices.delete(otherIp);
+        this.presenceExpiry.delete(otherIp);
+      }
+    }
+
+    const known = this.discoveredDevices.get(ip);
+    const device: DiscoveredDevice = {
+      ip,
+      hostname: announcement.alias || known?.hostname || 'Unknown Device',
+      deviceId: known?.deviceId,
+      serialNumber: announcement.id,
+      modelName: 'WiFi Omni',
+      isConfigured: announcement.serverUrl !== '' && this.isOurServer(announcement.serverUrl),
+      lastSeen: new Date(now),
+      ssdpInfo: known?.ssdpInfo,
+      announcement
+    };
+    this.discoveredDevices.set(ip, device);
+    if (!known) {
+      console.log(`📡 ${device.hostname} (${announcement.id}) announced itself at ${ip} (configured: ${device.isConfigured})`);
+    }
+
+    // The announcement says everything a probe would, unless the device
+    // needs pointing at this server
+    if (this.config.discovery.autoConfigureDevices && !device.isConfigured) {
+      this.enqueueProbe({ ip, headers: { usn: announcement.id, server: 'Presence Announcement' }, verified: true });
+    }
+  }
+
+  private handleSsdpResponse(ssdpDevice: { ip: string; headers: Record<string, string> }): void {
+    const { ip, headers } = ssdpDevice;
+    const usn = headers['usn'];
+
+    if (usn && headers['nts'] === 'ssdp:byebye') {
+      this.ssdpCache.delete(usn);
+      return;
+    }
+
+    const now = Date.now();
+    if (usn) {
+      const cached = this.ssdpCache.get(usn);
+      const fresh = cached !== undefined && cached.expiresAt > now && cached.ip === ip;
+      this.ssdpCache.set(usn, { ip, headers, expiresAt: now + parseMaxAge(headers) * 1000 });
+
+      // Seen and settled within its max-age - just note that it is still around
+      const device = this.discoveredDevices.get(ip);
+      if (fresh && device && (device.isConfigured || !this.config.discovery.autoConfigureDevices)) {
+        device.lastSeen = new Date();
+        return;
+      }
+    }
+
+    this.enqueueProbe({ ip, headers, verified: false });
+  }
+
+  private enqueueProbe(probe: PendingProbe): void {
+    // Skip our own server IP, and devices already on their way through
+    if (probe.ip === this.config.server.ip || this.probing.has(probe.ip)) {
       return;
     }
+    this.probing.add(probe.ip);
+    this.probeQueue.push(probe);
+    this.pumpProbes();
+  }
+
+  private pumpProbes(): void {
+    while (this.activeProbes < PROBE_CONCURRENCY && this.probeQueue.length > 0) {
+      const probe = this.probeQueue.shift()!;
+      this.activeProbes++;
+      this.handleDiscoveredDevice(probe).finally(() => {
+        this.activeProbes--;
+        this.probing.delete(probe.ip);
+        this.pumpProbes();
+      });
+    }
+  }
+
+  private async handleDiscoveredDevice(probe: PendingProbe): Promise<void> {
+    const ip = probe.ip;
 
     try {
       // console.log(`🔍 Checking device at ${ip}...`);
 
       // Verify it's our device by checking the /is-up endpoint
-      const isUpResponse = await fetch(`http://${ip}/is-up`, {
-        signal: AbortSignal.timeout(2000)
-      });
+      if (!probe.verified) {
+        const isUpResponse = await fetch(`http://${ip}/is-up`, {
+          signal: AbortSignal.timeout(2000)
+        });
 
-      if (!isUpResponse.ok || (await isUpResponse.text()).trim() !== 'yes') {
-        return; // Not our device
+        if (!isUpResponse.ok || (await isUpResponse.text()).trim() !== 'yes') {
+          return; // Not our device
+        }
       }
 
       // Get device configuration using the new API
@@ -386,11 +603,11 @@ export class NetworkDiscovery {
         ip,
         hostname: currentConfig.alias || 'Unknown Device',
         deviceId: currentConfig.deviceId,
-        serialNumber: ssdpDevice.headers.usn,
+        serialNumber: probe.headers.usn,
         modelName: 'WiFi Omni',
         isConfigured: !!currentConfig.server && this.isOurServer(currentConfig.server),
         lastSeen: new Date(),
-        ssdpInfo: ssdpDevice.headers
+        ssdpInfo: probe.headers
       };
 
       this.discoveredDevices.set(ip, device);
@@ -508,8 +725,25 @@ export class NetworkDiscovery {
     const now = new Date();
     const maxAge = 5 * 60 * 1000; // 5 minutes
     
+    // A sleeping device stays known for as long as its announcement is valid
+    const announced = new Set<string>();
+    for (const [usn, entry] of this.ssdpCache.entries()) {
+      if (entry.expiresAt <= now.getTime()) {
+        this.ssdpCache.delete(usn);
+      } else {
+        announced.add(entry.ip);
+      }
+    }
+    for (const [ip, expiresAt] of this.presenceExpiry.entries()) {
+      if (expiresAt <= now.getTime()) {
+        this.presenceExpiry.delete(ip);
+      } else {
+        announced.add(ip);
+      }
+    }
+    
     for (const [ip, device] of this.discoveredDevices.entries()) {
-      if (now.getTime() - device.lastSeen.getTime() > maxAge) {
+      if (now.getTime() - device.lastSeen.getTime() > maxAge && !announced.has(ip)) {
         this.discoveredDevices.delete(ip);
         console.log(`🗑️ Removed stale device: ${ip}`);
       }
@@ -554,9 +788,9 @@ export class NetworkDiscovery {
     }
   }
 
-  // Force a new discovery scan
+  // Searches the LAN for devices that do not announce themselves
   async forceDiscovery(): Promise<void> {
     console.log('🔍 Forcing device discovery...');
-    await this.discoverDevices();
+    await Promise.all([this.discoverDevices(), this.performNetworkScan()]);
   }
 }
@@ -1,13 +1,25 @@
-import { DeviceState, SystemState, SerializableSystemState, SystemStats, ContactRecord } from "../types/device.ts";
+import { DeviceState, SystemState, SerializableSystemState, SystemStats, ContactRecord, RuleFiringRecord, SensorReading, SeriesPoint, ServoStatus, RgbStatus } from "../types/device.ts";
+import { DeviceRule, RgbSequence } from "../types/deviceConfig.ts";
+import { EnergyCycle, EnergyReport, ENERGY_SERIES } from "../types/energy.ts";
 import { Command } from "../types/command.ts";
+import { TimeSeriesStore } from "../storage/TimeSeriesStore.ts";
+import { StateStore, PersistedState, StateStoreStats } from "../storage/StateStore.ts";
+
+// Told which device changed (none for system-wide changes such as stats);
+// reads the state itself if it wants it
+export type StateListener = (deviceId?: string) => void;
 
 export class StateManager {
   private state: SystemState;
-  private listeners: Set<(state: SerializableSystemState) => void> = new Set();
+  private listeners: Set<StateListener> = new Set();
   private commands: Map<string, Command> = new Map();
   private startTime: Date = new Date();
+  private timeSeries: TimeSeriesStore;
+  private store: StateStore;
 
-  constructor() {
+  constructor(timeSeries: TimeSeriesStore, store: StateStore) {
+    this.timeSeries = timeSeries;
+    this.store = store;
     this.state = {
       devices: new Map(),
       systemStats: {
@@ -22,6 +34,43 @@ export class StateManager {
     this.updateStats();
   }
 
+  // Restores devices and commands from the store, then journals changes to it
+  async start(): Promise<void> {
+    this.restore(await this.store.load());
+    await this.store.start(() => this.exportState());
+  }
+
+  async stop(): Promise<void> {
+    await this.store.stop();
+  }
+
+  private restore(persisted: PersistedState): void {
+    this.state.devices = new Map(persisted.devices.map(device => [device.id, device]));
+    this.commands = new Map(persisted.commands.map(command => [command.id, command]));
+
+    // Whether an in-flight command reached the device is unknown - send it again
+    for (const command of this.commands.values()) {
+      if (command.status === 'executing') {
+        command.status = 'pending';
+        this.store.putCommand(command);
+      }
+    }
+
+    this.updateStats();
+    this.checkDeviceStatus();
+  }
+
+  private exportState(): PersistedState {
+    return {
+      devices: Array.from(this.state.devices.values()),
+      commands: Array.from(this.commands.values())
+    };
+  }
+
+  getPersistenceStats(): StateStoreStats {
+    return this.store.getStats();
+  }
+
   // Device Management
   registerDevice(deviceData: {
     id: string;
@@ -29,6 +78,14 @@ export class StateManager {
     ipAddress: string;
     macAddress: string;
     mode: number;
+    firmwareVersion?: string;
+    firmwareBuild?: number;
+    missedSlots?: number;
+    outputOn?: boolean;
+    energy?: EnergyReport;
+    switchClosed?: boolean;
+    servo?: ServoStatus;
+    rgb?: RgbStatus;
   }): void {
     const now = new Date();
     const existingDevice = this.state.devices.get(deviceData.id);
@@ -44,23 +101,40 @@ export class StateManager {
       alias: deviceData.alias,
       ipAddress: deviceData.ipAddress,
       macAddress: deviceData.macAddress,
+      firmwareVersion: deviceData.firmwareVersion ?? existingDevice?.firmwareVersion,
+      firmwareBuild: deviceData.firmwareBuild ?? existingDevice?.firmwareBuild,
       mode: deviceData.mode,
       isOnline: true,
       lastSeen: now,
-      contactHistory: existingDevice ?
-        [...existingDevice.contactHistory.slice(-49), contactRecord] :
-        [contactRecord],
-      currentOutput: existingDevice?.currentOutput ?? false,
-      sensorData: existingDevice?.sensorData ?? [],
+      currentOutput: deviceData.outputOn ?? existingDevice?.currentOutput ?? false,
+      reportedOutput: deviceData.outputOn ?? existingDevice?.reportedOutput,
+      outputReportedAt: deviceData.outputOn !== undefined ? now : existingDevice?.outputReportedAt,
+      outputChangedAt: existingDevice?.outputChangedAt,
+      desiredOutput: existingDevice?.desiredOutput,
       pendingCommands: existingDevice?.pendingCommands ?? [],
       sleepStatus: existingDevice?.sleepStatus ?? 'unknown',
       forceAwake: existingDevice?.forceAwake ?? false,
-      lastAwakeCheck: existingDevice?.lastAwakeCheck ?? now
+      lastAwakeCheck: existingDevice?.lastAwakeCheck ?? now,
+      missedSlots: deviceData.missedSlots ?? existingDevice?.missedSlots,
+      energy: deviceData.energy ?? existingDevice?.energy,
+      switchClosed: deviceData.switchClosed ?? existingDevice?.switchClosed,
+      servo: deviceData.servo ?? existingDevice?.servo,
+      rgb: deviceData.rgb ?? existingDevice?.rgb,
+      lastSwitchEdgeAt: existingDevice?.lastSwitchEdgeAt,
+      rules: existingDevice?.rules,
+      ruleFirings: existingDevice?.ruleFirings
     };
 
     this.state.devices.set(deviceData.id, device);
+    this.timeSeries.addContact(deviceData.id, contactRecord);
+    // Phase trace for tools/energyModel.ts
+    if (deviceData.energy) {
+      for (const [phase, series] of Object.entries(ENERGY_SERIES)) {
+        this.timeSeries.addSample(deviceData.id, series, deviceData.energy[phase as keyof EnergyCycle], now.getTime());
+      }
+    }
     this.updateStats();
-    this.notifyListeners();
+    this.notifyListeners(deviceData.id);
   }
 
   updateDeviceContact(deviceId: string, action: string): void {
@@ -75,10 +149,10 @@ export class StateManager {
 
     device.lastSeen = new Date();
     device.isOnline = true;
-    device.contactHistory = [...device.contactHistory.slice(-49), contactRecord];
+    this.timeSeries.addContact(deviceId, contactRecord);
     
     this.updateStats();
-    this.notifyListeners();
+    this.notifyListeners(deviceId);
   }
 
   updateDeviceAlias(deviceId: string, alias: string): boolean {
@@ -86,16 +160,66 @@ export class StateManager {
     if (!device) return false;
 
     device.alias = alias;
-    this.notifyListeners();
+    this.notifyListeners(deviceId);
     return true;
   }
 
+  // The device reported or acknowledged this output state
   updateDeviceOutput(deviceId: string, outputState: boolean): void {
     const device = this.state.devices.get(deviceId);
     if (!device) return;
 
     device.currentOutput = outputState;
-    this.notifyListeners();
+    device.reportedOutput = outputState;
+    device.outputReportedAt = new Date();
+    this.notifyListeners(deviceId);
+  }
+
+  // The device switched its output on its own at this time (a rule, say); any
+  // report from before then no longer says where the output is
+  noteLocalOutputChange(deviceId: string, at: Date): void {
+    const device = this.state.devices.get(deviceId);
+    if (!device) return;
+
+    if (!device.outputChangedAt || at > device.outputChangedAt) {
+      device.outputChangedAt = at;
+    }
+  }
+
+  setDesiredOutput(deviceId: string, outputState: boolean): void {
+    const device = this.state.devices.get(deviceId);
+    if (!device || device.desiredOutput === outputState) return;
+
+    device.desiredOutput = outputState;
+    this.notifyListeners(deviceId);
+  }
+
+  // Only a report counts - currentOutput may just be the default for a new
+  // device - and only one newer than the last change the device made itself
+  isOutputSatisfied(deviceId: string, outputState: boolean): boolean {
+    const device = this.state.devices.get(deviceId);
+    if (device?.reportedOutput !== outputState || !device.outputReportedAt) return false;
+    return !device.outputChangedAt || device.outputReportedAt > device.outputChangedAt;
+  }
+
+  // The device accepted a move; it reports where it ended up at its next check-in
+  updateServoTarget(deviceId: string, target: number): void {
+    const device = this.state.devices.get(deviceId);
+    if (!device) return;
+
+    device.servo = { position: device.servo?.position ?? target, target, atTarget: false };
+    this.notifyListeners(deviceId);
+  }
+
+  // The device accepted a sequence; shows the color it ends on until the
+  // device reports its own state
+  updateRgbSequence(deviceId: string, sequence: RgbSequence): void {
+    const device = this.state.devices.get(deviceId);
+    if (!device) return;
+
+    const [red, green, blue] = sequence.frames[sequence.frames.length - 1];
+    device.rgb = { red, green, blue, playing: true };
+    this.notifyListeners(deviceId);
   }
 
   updateDeviceSleepStatus(deviceId: string, sleepStatus: 'awake' | 'asleep' | 'unknown'): void {
@@ -104,7 +228,72 @@ export class StateManager {
 
     device.sleepStatus = sleepStatus;
     device.lastAwakeCheck = new Date();
-    this.notifyListeners();
+    this.notifyListeners(deviceId);
+  }
+
+  setDeviceRules(deviceId: string, rules: DeviceRule[]): boolean {
+    const device = this.state.devices.get(deviceId);
+    if (!device) return false;
+
+    device.rules = rules;
+    this.notifyListeners(deviceId);
+    return true;
+  }
+
+  addRuleFirings(deviceId: string, firings: RuleFiringRecord[]): void {
+    const device = this.state.devices.get(deviceId);
+    if (!device) return;
+
+    device.ruleFirings = [...(device.ruleFirings ?? []), ...firings].slice(-50);
+    this.notifyListeners(deviceId);
+  }
+
+  // Readings change no device state, so nobody is notified. Each probe on a
+  // multi-probe bus gets its own series, e.g. "temperature-28FF4A1C05160322".
+  addSensorReadings(deviceId: string, readings: SensorReading[]): boolean {
+    if (!this.state.devices.has(deviceId)) return false;
+
+    const now = Date.now();
+    for (const reading of readings) {
+      const series = reading.probe ? `${reading.type}-${reading.probe}` : reading.type;
+      this.timeSeries.addSample(deviceId, series, reading.value, now);
+    }
+    return true;
+  }
+
+  // Round trip of a command the device accepted, as the "command_latency_ms" series
+  recordCommandLatency(deviceId: string, latencyMs: number): void {
+    if (!this.state.devices.has(deviceId)) return;
+
+    this.timeSeries.addSample(deviceId, 'command_latency_ms', latencyMs, Date.now());
+  }
+
+  // Each edge is a 0/1 sample of the "switch" series at the time it happened
+  addSwitchEvents(deviceId: string, events: { closed: boolean; at: Date }[]): boolean {
+    const device = this.state.devices.get(deviceId);
+    if (!device) return false;
+    if (events.length === 0) return true;
+
+    for (const event of events) {
+      this.timeSeries.addSample(deviceId, 'switch', event.closed ? 1 : 0, event.at.getTime());
+    }
+    const last = events[events.length - 1];
+    device.switchClosed = last.closed;
+    device.lastSwitchEdgeAt = last.at;
+    this.notifyListeners(deviceId);
+    return true;
+  }
+
+  getContactHistory(deviceId: string, limit?: number): ContactRecord[] {
+    return this.timeSeries.getContacts(deviceId, limit);
+  }
+
+  getSeriesNames(deviceId: string): string[] {
+    return this.timeSeries.getSeriesNames(deviceId);
+  }
+
+  querySeries(deviceId: string, series: string, from: number, to: number, maxPoints: number): SeriesPoint[] {
+    return this.timeSeries.query(deviceId, series, from, to, maxPoints);
   }
 
   setDeviceForceAwake(deviceId: string, forceAwake: boolean): boolean {
@@ -112,13 +301,14 @@ export class StateManager {
     if (!device) return false;
 
     device.forceAwake = forceAwake;
-    this.notifyListeners();
+    this.notifyListeners(deviceId);
     return true;
   }
 
   // Command Management
   addCommand(command: Command): void {
     this.commands.set(command.id, command);
+    this.store.putCommand(command);
     
     const device = this.state.devices.get(command.deviceId);
     if (device) {
@@ -126,7 +316,7 @@ export class StateManager {
     }
     
     this.updateStats();
-    this.notifyListeners();
+    this.notifyListeners(command.deviceId);
   }
 
   updateCommand(commandId: string, updates: Partial<Command>): void {
@@ -134,9 +324,11 @@ export class StateManager {
     if (!command) return;
 
     Object.assign(command, updates);
+    this.store.putCommand(command);
     
-    // If command is completed or failed, remove from device pending list
-    if (updates.status === 'completed' || updates.status === 'failed') {
+    // Once the command is finished, remove it from the device pending list
+    if (updates.status === 'completed' || updates.status === 'failed' ||
+        updates.status === 'cancelled' || updates.status === 'superseded') {
       const device = this.state.devices.get(command.deviceId);
       if (device) {
         device.pendingCommands = device.pendingCommands.filter(id => id !== commandId);
@@ -144,7 +336,7 @@ export class StateManager {
     }
     
     this.updateStats();
-    this.notifyListeners();
+    this.notifyListeners(command.deviceId);
   }
 
   getCommand(commandId: string): Command | undefined {
@@ -158,7 +350,7 @@ export class StateManager {
     return device.pendingCommands
       .map(id => this.commands.get(id))
       .filter((cmd): cmd is Command => cmd !== undefined)
-      .filter(cmd => cmd.status === 'pending' && new Date() >= cmd.scheduledFor);
+      .filter(cmd => cmd.status === 'pending' && !cmd.delegated && new Date() >= cmd.scheduledFor);
   }
 
   getAllCommands(): Command[] {
@@ -169,7 +361,7 @@ export class StateManager {
   checkDeviceStatus(): void {
     const now = new Date();
     const offlineThreshold = 5 * 60 * 1000; // 5 minutes
-    let statusChanged = false;
+    const changed: string[] = [];
 
     for (const device of this.state.devices.values()) {
       const timeSinceLastSeen = now.getTime() - device.lastSeen.getTime();
@@ -177,13 +369,13 @@ export class StateManager {
       device.isOnline = timeSinceLastSeen < offlineThreshold;
       
       if (wasOnline !== device.isOnline) {
-        statusChanged = true;
+        changed.push(device.id);
       }
     }
 
-    if (statusChanged) {
+    if (changed.length > 0) {
       this.updateStats();
-      this.notifyListeners();
+      changed.forEach(deviceId => this.notifyListeners(deviceId));
     }
   }
 
@@ -202,6 +394,10 @@ export class StateManager {
     };
   }
 
+  getSystemStats(): SystemStats {
+    return { ...this.state.systemStats };
+  }
+
   getDevice(deviceId: string): DeviceState | undefined {
     const device = this.state.devices.get(deviceId);
     return device ? { ...device } : undefined;
@@ -212,19 +408,26 @@ export class StateManager {
   }
 
   // Listeners
-  addListener(listener: (state: SerializableSystemState) => void): void {
+  addListener(listener: StateListener): void {
     this.listeners.add(listener);
   }
 
-  removeListener(listener: (state: SerializableSystemState) => void): void {
+  removeListener(listener: StateListener): void {
     this.listeners.delete(listener);
   }
 
-  private notifyListeners(): void {
-    const state = this.getSerializableState();
+  // Every device mutation ends here, so this is also where it is journaled
+  private notifyListeners(deviceId?: string): void {
+    if (deviceId) {
+      const device = this.state.devices.get(deviceId);
+      if (device) {
+        this.store.putDevice(device);
+      }
+    }
+
     this.listeners.forEach(listener => {
       try {
-        listener(state);
+        listener(deviceId);
       } catch (error) {
         console.error('Error in state listener:', error);
       }
@@ -255,12 +458,16 @@ export class StateManager {
 
     for (const [id, command] of this.commands) {
       if (command.createdAt < cutoff && 
-          (command.status === 'completed' || command.status === 'failed')) {
+          (command.status === 'completed' || command.status === 'failed' ||
+           command.status === 'cancelled' || command.status === 'superseded')) {
         commandsToDelete.push(id);
       }
     }
 
-    commandsToDelete.forEach(id => this.commands.delete(id));
+    commandsToDelete.forEach(id => {
+      this.commands.delete(id);
+      this.store.deleteCommand(id);
+    });
     
     if (commandsToDelete.length > 0) {
       this.updateStats();
@@ -0,0 +1,51 @@
+// Fixed-capacity FIFO. Pushing onto a full buffer overwrites the oldest item
+// in place and returns it, so nothing is copied per push and callers can fold
+// evicted items into coarser storage.
+export class RingBuffer<T> {
+  readonly capacity: number;
+  private items: (T | undefined)[];
+  private head = 0;              // Index of the oldest item
+  private count = 0;
+
+  constructor(capacity: number) {
+    this.capacity = capacity;
+    this.items = new Array(capacity);
+  }
+
+  get length(): number {
+    return this.count;
+  }
+
+  push(item: T): T | undefined {
+    if (this.count < this.capacity) {
+      this.items[(this.head + this.count) % this.capacity] = item;
+      this.count++;
+      return undefined;
+    }
+
+    const evicted = this.items[this.head];
+    this.items[this.head] = item;
+    this.head = (this.head + 1) % this.capacity;
+    return evicted;
+  }
+
+  // 0 is the oldest item
+  at(index: number): T | undefined {
+    if (index < 0 || index >= this.count) return undefined;
+    return this.items[(this.head + index) % this.capacity];
+  }
+
+  last(): T | undefined {
+    return this.at(this.count - 1);
+  }
+
+  // The newest `limit` items, oldest first
+  toArray(limit = this.count): T[] {
+    const n = Math.min(limit, this.count);
+    const result: T[] = new Array(n);
+    for (let i = 0; i < n; i++) {
+      result[i] = this.at(this.count - n + i) as T;
+    }
+    return result;
+  }
+}
@@ -0,0 +1,321 @@
+import { DeviceState } from "../types/device.ts";
+import { Command } from "../types/command.ts";
+
+// Mutations are batched for this long, then written with a single fsync
+const FLUSH_INTERVAL_MS = 200;
+const SNAPSHOT_INTERVAL_MS = 5 * 60 * 1000;
+// Snapshot early once the log tail would take this long to replay
+const SNAPSHOT_LOG_BYTES = 16 * 1024 * 1024;
+
+const SNAPSHOT_FILE = 'snapshot.json';
+
+export interface PersistedState {
+  devices: DeviceState[];
+  commands: Command[];
+}
+
+interface Snapshot extends PersistedState {
+  seq: number;                   // Last log record the snapshot includes
+  takenAt: number;
+}
+
+type LogRecord =
+  | { seq: number; op: 'device'; value: DeviceState }
+  | { seq: number; op: 'command'; value: Command }
+  | { seq: number; op: 'delete-command'; id: string };
+
+type PendingRecord =
+  | { op: 'device'; value: DeviceState }
+  | { op: 'command'; value: Command }
+  | { op: 'delete-command'; id: string };
+
+export interface StateStoreStats {
+  recoveryMs: number;
+  recoveredDevices: number;
+  recoveredCommands: number;
+  replayedRecords: number;
+  recordsWritten: number;
+  bytesWritten: number;
+  batches: number;
+  writeMs: number;               // Total time in write + fsync
+  recordsPerSecond: number;      // Records per second of write time - the log's capacity
+  logBytes: number;              // Log written since the last snapshot
+  lastSnapshotMs: number;
+  lastSnapshotBytes: number;
+}
+
+function reviveDevice(device: DeviceState): DeviceState {
+  device.lastSeen = new Date(device.lastSeen);
+  device.lastAwakeCheck = new Date(device.lastAwakeCheck);
+  device.ruleFirings?.forEach(firing => firing.at = new Date(firing.at));
+  if (device.lastSwitchEdgeAt) {
+    device.lastSwitchEdgeAt = new Date(device.lastSwitchEdgeAt);
+  }
+  if (device.outputReportedAt) {
+    device.outputReportedAt = new Date(device.outputReportedAt);
+  }
+  if (device.outputChangedAt) {
+    device.outputChangedAt = new Date(device.outputChangedAt);
+  }
+  return device;
+}
+
+function reviveCommand(command: Command): Command {
+  command.scheduledFor = new Date(command.scheduledFor);
+  command.createdAt = new Date(command.createdAt);
+  if (command.executedAt) {
+    command.executedAt = new Date(command.executedAt);
+  }
+  return command;
+}
+
+async function writeFully(file: Deno.FsFile, bytes: Uint8Array): Promise<void> {
+  let offset = 0;
+  while (offset < bytes.length) {
+    offset += await file.write(bytes.subarray(offset));
+  }
+}
+
+// Durable copy of StateManager's devices and commands: an append-only log of
+// whole-record upserts, periodically compacted into a snapshot. Records are
+// keyed, so a device that changes many times between flushes is written once,
+// with its latest state. Recovery loads the snapshot and replays the log
+// records after it; a torn last line from a crash is ignored.
+export class StateStore {
+  private dataDir: string;
+  private seq = 0;
+  private pending: Map<string, PendingRecord> = new Map();
+  private log?: Deno.FsFile;
+  private writing: Promise<void> = Promise.resolve();
+  private source?: () => PersistedState;
+  private flushIntervalId?: number;
+  private snapshotIntervalId?: number;
+  private encoder = new TextEncoder();
+  private stats: StateStoreStats = {
+    recoveryMs: 0,
+    recoveredDevices: 0,
+    recoveredCommands: 0,
+    replayedRecords: 0,
+    recordsWritten: 0,
+    bytesWritten: 0,
+    batches: 0,
+    writeMs: 0,
+    recordsPerSecond: 0,
+    logBytes: 0,
+    lastSnapshotMs: 0,
+    lastSnapshotBytes: 0
+  };
+
+  constructor(dataDir = "./data/state") {
+    this.dataDir = dataDir;
+  }
+
+  async load(): Promise<PersistedState> {
+    const startedAt = performance.now();
+    await Deno.mkdir(this.dataDir, { recursive: true });
+
+    const devices: Map<string, DeviceState> = new Map();
+    const commands: Map<string, Command> = new Map();
+    let snapshotSeq = 0;
+
+    try {
+      const snapshot: Snapshot = JSON.parse(await Deno.readTextFile(`${this.dataDir}/${SNAPSHOT_FILE}`));
+      snapshot.devices.forEach(device => devices.set(device.id, reviveDevice(device)));
+      snapshot.commands.forEach(command => commands.set(command.id, reviveCommand(command)));
+      snapshotSeq = snapshot.seq;
+    } catch (error) {
+      if (!(error instanceof Deno.errors.NotFound)) throw error;
+    }
+    this.seq = snapshotSeq;
+
+    const logs = await this.listLogs();
+    let replayed = 0;
+    let damaged = 0;
+    for (const name of logs) {
+      const text = await Deno.readTextFile(`${this.dataDir}/${name}`);
+      this.stats.logBytes += text.length;
+
+      const lines = text.split('\n');
+      for (let i = 0; i < lines.length; i++) {
+        if (!lines[i]) continue;
+
+        let record: LogRecord;
+        try {
+          record = JSON.parse(lines[i]);
+        } catch {
+          damaged++;
+          continue;
+        }
+        if (record.seq <= snapshotSeq) continue;
+
+        if (record.op === 'device') {
+          devices.set(record.value.id, reviveDevice(record.value));
+        } else if (record.op === 'command') {
+          commands.set(record.value.id, reviveCommand(record.value));
+        } else {
+          commands.delete(record.id);
+        }
+        this.seq = Math.max(this.seq, record.seq);
+        replayed++;
+      }
+    }
+    if (damaged > 0) {
+      console.warn(`Skipped ${damaged} unreadable state log record(s)`);
+    }
+
+    this.stats.recoveryMs = Math.round(performance.now() - startedAt);
+    this.stats.recoveredDevices = devices.size;
+    this.stats.recoveredCommands = commands.size;
+    this.stats.replayedRecords = replayed;
+    console.log(`Recovered ${devices.size} devices and ${commands.size} commands ` +
+      `(${replayed} log records after snapshot) in ${this.stats.recoveryMs}ms`);
+
+    return { devices: [...devices.values()], commands: [...commands.values()] };
+  }
+
+  // source returns the live state for snapshots
+  async start(source: () => PersistedState): Promise<void> {
+    this.source = source;
+    await this.openLog();
+
+    this.flushIntervalId = setInterval(() => {
+      this.flush().catch(error => console.error('Error writing state log:', error));
+    }, FLUSH_INTERVAL_MS);
+    this.snapshotIntervalId = setInterval(() => {
+      this.snapshot().catch(error => console.error('Error writing state snapshot:', error));
+    }, SNAPSHOT_INTERVAL_MS);
+  }
+
+  async stop(): Promise<void> {
+    if (this.flushIntervalId) {
+      clearInterval(this.flushIntervalId);
+      this.flushIntervalId = undefined;
+    }
+    if (this.snapshotIntervalId) {
+      clearInterval(this.snapshotIntervalId);
+      this.snapshotIntervalId = undefined;
+    }
+
+    // A clean shutdown leaves nothing to replay
+    await this.snapshot();
+    this.log?.close();
+    this.log = undefined;
+  }
+
+  putDevice(device: DeviceState): void {
+    this.pending.set(`d:${device.id}`, { op: 'device', value: device });
+  }
+
+  putCommand(command: Command): void {
+    this.pending.set(`c:${command.id}`, { op: 'command', value: command });
+  }
+
+  deleteCommand(commandId: string): void {
+    this.pending.set(`c:${commandId}`, { op: 'delete-command', id: commandId });
+  }
+
+  getStats(): StateStoreStats {
+    return { ...this.stats };
+  }
+
+  flush(): Promise<void> {
+    // One writer at a time so snapshots never interleave with appends
+    this.writing = this.writing.catch(() => {}).then(async () => {
+      await this.writePending();
+      if (this.stats.logBytes >= SNAPSHOT_LOG_BYTES) {
+        await this.writeSnapshot();
+      }
+    });
+    return this.writing;
+  }
+
+  snapshot(): Promise<void> {
+    this.writing = this.writing.catch(() => {}).then(async () => {
+      await this.writePending();
+      await this.writeSnapshot();
+    });
+    return this.writing;
+  }
+
+  private async writePending(): Promise<void> {
+    if (this.pending.size === 0 || !this.log) return;
+
+    // Records are serialized now, so each carries the latest state of its key
+    const lines: string[] = [];
+    for (const record of this.pending.values()) {
+      lines.push(JSON.stringify({ seq: ++this.seq, ...record }));
+    }
+    this.pending = new Map();
+
+    const bytes = this.encoder.encode(lines.join('\n') + '\n');
+    const startedAt = performance.now();
+    await writeFully(this.log, bytes);
+    await this.log.syncData();
+
+    this.stats.writeMs += performance.now() - startedAt;
+    this.stats.recordsWritten += lines.length;
+    this.stats.bytesWritten += bytes.length;
+    this.stats.batches++;
+    this.stats.logBytes += bytes.length;
+    this.stats.recordsPerSecond = this.stats.writeMs > 0
+      ? Math.round(this.stats.recordsWritten / (this.stats.writeMs / 1000))
+      : 0;
+  }
+
+  private async writeSnapshot(): Promise<void> {
+    if (!this.source) return;
+    const startedAt = performance.now();
+
+    // Mutations made while this runs are pending with later sequence numbers;
+    // replaying them over the snapshot is harmless as records are upserts
+    const state = this.source();
+    const snapshot: Snapshot = { seq: this.seq, takenAt: Date.now(), ...state };
+
+    // New records go to a fresh log so the older ones can be dropped
+    await this.openLog();
+
+    const bytes = this.encoder.encode(JSON.stringify(snapshot));
+    const tmpPath = `${this.dataDir}/${SNAPSHOT_FILE}.tmp`;
+    const file = await Deno.open(tmpPath, { write: true, create: true, truncate: true });
+    try {
+      await writeFully(file, bytes);
+      await file.syncData();
+    } finally {
+      file.close();
+    }
+    await Deno.rename(tmpPath, `${this.dataDir}/${SNAPSHOT_FILE}`);
+
+    const current = this.logName(this.seq + 1);
+    for (const name of await this.listLogs()) {
+      if (name < current) {
+        await Deno.remove(`${this.dataDir}/${name}`);
+      }
+    }
+
+    this.stats.logBytes = 0;
+    this.stats.lastSnapshotMs = Math.round(performance.now() - startedAt);
+    this.stats.lastSnapshotBytes = bytes.length;
+    console.log(`State snapshot: ${state.devices.length} devices, ${state.commands.length} commands, ` +
+      `${Math.round(bytes.length / 1024)}KB in ${this.stats.lastSnapshotMs}ms`);
+  }
+
+  private async openLog(): Promise<void> {
+    this.log?.close();
+    this.log = await Deno.open(`${this.dataDir}/${this.logName(this.seq + 1)}`, { append: true, create: true });
+  }
+
+  // Named by the first sequence number they can hold, zero-padded to sort
+  private logName(firstSeq: number): string {
+    return `${String(firstSeq).padStart(15, '0')}.wal`;
+  }
+
+  private async listLogs(): Promise<string[]> {
+    const names: string[] = [];
+    for await (const entry of Deno.readDir(this.dataDir)) {
+      if (entry.isFile && entry.name.endsWith('.wal')) {
+        names.push(entry.name);
+      }
+    }
+    return names.sort();
+  }
+}
@@ -0,0 +1,307 @@
+import { ContactRecord, SeriesPoint } from "../types/device.ts";
+import { RingBuffer } from "./RingBuffer.ts";
+import { SegmentRun, decodeSegment, encodeBlock } from "./segmentCodec.ts";
+
+// Newest samples kept at full resolution per series (a day at one per minute)
+const RAW_CAPACITY = 1440;
+
+// Samples pushed out of the raw ring fold into the first tier, buckets pushed
+// out of a tier fold into the next, and the last tier drops them
+const TIERS = [
+  { bucketMs: 15 * 60 * 1000, capacity: 7 * 96 },     // 15 minutes for a week
+  { bucketMs: 60 * 60 * 1000, capacity: 90 * 24 }     // Hourly for 90 days
+];
+
+const CONTACT_CAPACITY = 50;
+
+const FLUSH_INTERVAL_MS = 10000;
+const SEGMENT_MAX_BYTES = 1024 * 1024;
+// Segments older than the coarsest tier can no longer contribute anything
+const RETENTION_MS = TIERS[TIERS.length - 1].bucketMs * TIERS[TIERS.length - 1].capacity;
+
+interface Bucket {
+  start: number;
+  min: number;
+  max: number;
+  sum: number;
+  count: number;
+}
+
+class Series {
+  private times = new Float64Array(RAW_CAPACITY);
+  private values = new Float64Array(RAW_CAPACITY);
+  private head = 0;
+  private size = 0;
+  private tiers = TIERS.map(tier => new RingBuffer<Bucket>(tier.capacity));
+
+  get lastTime(): number {
+    return this.size === 0 ? 0 : this.times[(this.head + this.size - 1) % RAW_CAPACITY];
+  }
+
+  add(time: number, value: number): void {
+    if (this.size < RAW_CAPACITY) {
+      const index = (this.head + this.size) % RAW_CAPACITY;
+      this.times[index] = time;
+      this.values[index] = value;
+      this.size++;
+      return;
+    }
+
+    const evictedTime = this.times[this.head];
+    const evictedValue = this.values[this.head];
+    this.times[this.head] = time;
+    this.values[this.head] = value;
+    this.head = (this.head + 1) % RAW_CAPACITY;
+    this.fold(0, { start: evictedTime, min: evictedValue, max: evictedValue, sum: evictedValue, count: 1 });
+  }
+
+  private fold(tier: number, bucket: Bucket): void {
+    if (tier >= TIERS.length) return;
+
+    const bucketMs = TIERS[tier].bucketMs;
+    const start = Math.floor(bucket.start / bucketMs) * bucketMs;
+    const ring = this.tiers[tier];
+    const last = ring.last();
+
+    // Folded data arrives oldest first, so only the newest bucket can be open
+    if (last && last.start === start) {
+      last.min = Math.min(last.min, bucket.min);
+      last.max = Math.max(last.max, bucket.max);
+      last.sum += bucket.sum;
+      last.count += bucket.count;
+      return;
+    }
+
+    const evicted = ring.push({ ...bucket, start });
+    if (evicted) {
+      this.fold(tier + 1, evicted);
+    }
+  }
+
+  // Oldest first, coarsest data first; tiers never overlap because each only
+  // holds what the finer one has let go of
+  query(from: number, to: number): SeriesPoint[] {
+    const points: SeriesPoint[] = [];
+
+    for (let tier = TIERS.length - 1; tier >= 0; tier--) {
+      const ring = this.tiers[tier];
+      for (let i = 0; i < ring.length; i++) {
+        const bucket = ring.at(i) as Bucket;
+        if (bucket.start + TIERS[tier].bucketMs > from && bucket.start <= to) {
+          points.push({
+            t: bucket.start,
+            min: bucket.min,
+            max: bucket.max,
+            mean: bucket.sum / bucket.count,
+            count: bucket.count
+          });
+        }
+      }
+    }
+
+    for (let i = 0; i < this.size; i++) {
+      const index = (this.head + i) % RAW_CAPACITY;
+      const time = this.times[index];
+      if (time >= from && time <= to) {
+        const value = this.values[index];
+        points.push({ t: time, min: value, max: value, mean: value, count: 1 });
+      }
+    }
+
+    return points;
+  }
+}
+
+// Per-device sensor readings and contact history in fixed-size rings, so
+// recording a sample never copies or grows anything. Older data survives as
+// min/max/mean buckets. Samples are also appended to compressed segment files
+// and replayed on start, which rebuilds the same rings.
+export class TimeSeriesStore {
+  private dataDir: string;
+  private series: Map<string, Series> = new Map();
+  private contacts: Map<string, RingBuffer<ContactRecord>> = new Map();
+  private pending: Map<string, { times: number[]; values: number[] }> = new Map();
+  private segmentPath?: string;
+  private segmentBytes = 0;
+  private writing: Promise<void> = Promise.resolve();
+  private intervalId?: number;
+
+  constructor(dataDir = "./data/timeseries") {
+    this.dataDir = dataDir;
+  }
+
+  async start(): Promise<void> {
+    await Deno.mkdir(this.dataDir, { recursive: true });
+    await this.load();
+
+    this.intervalId = setInterval(() => {
+      this.flush().catch(error => console.error('Error writing time series segment:', error));
+    }, FLUSH_INTERVAL_MS);
+  }
+
+  async stop(): Promise<void> {
+    if (this.intervalId) {
+      clearInterval(this.intervalId);
+      this.intervalId = undefined;
+    }
+    await this.flush();
+  }
+
+  addSample(deviceId: string, seriesName: string, value: number, time = Date.now()): void {
+    // The segment codec stores scaled integers, which NaN and Infinity are not
+    if (!Number.isFinite(value) || !Number.isFinite(time)) return;
+
+    const key = `${deviceId}:${seriesName}`;
+    let series = this.series.get(key);
+    if (!series) {
+      series = new Series();
+      this.series.set(key, series);
+    }
+
+    // Keep each series in time order even if the clock steps back
+    time = Math.max(time, series.lastTime);
+    series.add(time, value);
+
+    let pending = this.pending.get(key);
+    if (!pending) {
+      pending = { times: [], values: [] };
+      this.pending.set(key, pending);
+    }
+    pending.times.push(time);
+    pending.values.push(value);
+  }
+
+  addContact(deviceId: string, contact: ContactRecord): void {
+    let contacts = this.contacts.get(deviceId);
+    if (!contacts) {
+      contacts = new RingBuffer<ContactRecord>(CONTACT_CAPACITY);
+      this.contacts.set(deviceId, contacts);
+    }
+    contacts.push(contact);
+
+    // Contact rate over time comes from the bucket counts
+    this.addSample(deviceId, 'contacts', 1, contact.timestamp.getTime());
+  }
+
+  // Newest `limit` contacts, oldest first
+  getContacts(deviceId: string, limit = CONTACT_CAPACITY): ContactRecord[] {
+    return this.contacts.get(deviceId)?.toArray(limit) ?? [];
+  }
+
+  getSeriesNames(deviceId: string): string[] {
+    const prefix = `${deviceId}:`;
+    return [...this.series.keys()]
+      .filter(key => key.startsWith(prefix))
+      .map(key => key.slice(prefix.length));
+  }
+
+  // Points between from and to (ms), merged down to at most maxPoints
+  query(deviceId: string, seriesName: string, from: number, to: number, maxPoints: number): SeriesPoint[] {
+    const series = this.series.get(`${deviceId}:${seriesName}`);
+    if (!series) return [];
+
+    const points = series.query(from, to);
+    if (points.length <= maxPoints) return points;
+
+    const width = Math.ceil((to - from + 1) / maxPoints);
+    const merged: SeriesPoint[] = [];
+    for (const point of points) {
+      const start = from + Math.floor((Math.max(point.t, from) - from) / width) * width;
+      const last = merged[merged.length - 1];
+      if (last && last.t === start) {
+        last.mean = (last.mean * last.count + point.mean * point.count) / (last.count + point.count);
+        last.min = Math.min(last.min, point.min);
+        last.max = Math.max(last.max, point.max);
+        last.count += point.count;
+      } else {
+        merged.push({ ...point, t: start });
+      }
+    }
+    return merged;
+  }
+
+  flush(): Promise<void> {
+    // One write at a time so rotation and appends never interleave
+    this.writing = this.writing.catch(() => {}).then(() => this.writePending());
+    return this.writing;
+  }
+
+  private async writePending(): Promise<void> {
+    if (this.pending.size === 0) return;
+
+    const runs: SegmentRun[] = [];
+    for (const [key, pending] of this.pending) {
+      runs.push({ series: key, times: pending.times, values: pending.values });
+    }
+    this.pending = new Map();
+
+    if (!this.segmentPath || this.segmentBytes >= SEGMENT_MAX_BYTES) {
+      await this.rotateSegment();
+    }
+
+    const block = await encodeBlock(runs);
+    await Deno.writeFile(this.segmentPath!, block, { append: true, create: true });
+    this.segmentBytes += block.length;
+  }
+
+  private async load(): Promise<void> {
+    const segments = await this.listSegments();
+    let samples = 0;
+
+    for (const name of segments) {
+      const path = `${this.dataDir}/${name}`;
+      const { runs, damaged } = await decodeSegment(await Deno.readFile(path));
+      if (damaged) {
+        console.warn(`Time series segment ${name} is damaged; kept what could be read`);
+      }
+
+      for (const run of runs) {
+        const separator = run.series.lastIndexOf(':');
+        const deviceId = run.series.slice(0, separator);
+        const seriesName = run.series.slice(separator + 1);
+        for (let i = 0; i < run.times.length; i++) {
+          this.addSample(deviceId, seriesName, run.values[i], run.times[i]);
+        }
+        samples += run.times.length;
+      }
+    }
+
+    // Replayed samples are already on disk
+    this.pending = new Map();
+
+    if (segments.length > 0) {
+      const last = segments[segments.length - 1];
+      this.segmentPath = `${this.dataDir}/${last}`;
+      this.segmentBytes = (await Deno.stat(this.segmentPath)).size;
+    }
+
+    console.log(`Loaded ${samples} samples in ${this.series.size} series from ${segments.length} segments`);
+  }
+
+  private async rotateSegment(): Promise<void> {
+    // Zero-padded start time so names sort in time order
+    const name = `${String(Date.now()).padStart(15, '0')}.seg`;
+    this.segmentPath = `${this.dataDir}/${name}`;
+    this.segmentBytes = 0;
+
+    // A segment is done with once the one after it starts before the cutoff
+    const segments = await this.listSegments();
+    const cutoff = Date.now() - RETENTION_MS;
+    for (let i = 0; i + 1 < segments.length; i++) {
+      if (parseInt(segments[i + 1]) < cutoff) {
+        await Deno.remove(`${this.dataDir}/${segments[i]}`);
+        console.log(`Removed expired time series segment ${segments[i]}`);
+      }
+    }
+  }
+
+  private async listSegments(): Promise<string[]> {
+    const names: string[] = [];
+    for await (const entry of Deno.readDir(this.dataDir)) {
+      if (entry.isFile && entry.name.endsWith('.seg')) {
+        names.push(entry.name);
+      }
+    }
+    return names.sort();
+  }
+}
@@ -0,0 +1,31 @@
+import { assertEquals } from "std/assert/mod.ts";
+import { TimeSeriesStore } from "./TimeSeriesStore.ts";
+
+Deno.test("non-finite samples are dropped, in memory and on disk", async () => {
+  const dataDir = await Deno.makeTempDir();
+  try {
+    const store = new TimeSeriesStore(dataDir);
+    await store.start();
+    store.addSample("dev", "temperature", 21.5, 1000);
+    store.addSample("dev", "temperature", NaN, 2000);
+    store.addSample("dev", "temperature", Infinity, 3000);
+    store.addSample("dev", "temperature", -Infinity, 4000);
+    store.addSample("dev", "temperature", 22.25, 5000);
+    store.addSample("dev", "temperature", 23, NaN);
+
+    const expected = [
+      { t: 1000, min: 21.5, max: 21.5, mean: 21.5, count: 1 },
+      { t: 5000, min: 22.25, max: 22.25, mean: 22.25, count: 1 }
+    ];
+    assertEquals(store.query("dev", "temperature", 0, 10000, 100), expected);
+    await store.stop();
+
+    // The segment written on stop replays to the same samples
+    const reloaded = new TimeSeriesStore(dataDir);
+    await reloaded.start();
+    assertEquals(reloaded.query("dev", "temperature", 0, 10000, 100), expected);
+    await reloaded.stop();
+  } finally {
+    await Deno.remove(dataDir, { recursive: true });
+  }
+});
@@ -0,0 +1,173 @@
+// Encoding of time-series segment files.
+//
+// A segment is a sequence of blocks, each a varint byte length followed by a
+// deflate-raw compressed payload. A payload holds one run per series:
+//
+//   varint nameLength, name (UTF-8), varint sampleCount,
+//   varint firstTime, zigzag firstValue,
+//   then per further sample: varint timeDelta, zigzag valueDelta
+//
+// Times are milliseconds and never go backwards within a series. Values are
+// stored as integers in hundredths. Every block decodes on its own, so a block
+// torn by a crash only loses itself.
+
+export const VALUE_SCALE = 100;
+
+export interface SegmentRun {
+  series: string;
+  times: number[];
+  values: number[];
+}
+
+const encoder = new TextEncoder();
+const decoder = new TextDecoder();
+
+class ByteWriter {
+  private buffer = new Uint8Array(256);
+  length = 0;
+
+  private ensure(extra: number): void {
+    if (this.length + extra <= this.buffer.length) return;
+    const grown = new Uint8Array(Math.max(this.buffer.length * 2, this.length + extra));
+    grown.set(this.buffer.subarray(0, this.length));
+    this.buffer = grown;
+  }
+
+  byte(value: number): void {
+    this.ensure(1);
+    this.buffer[this.length++] = value;
+  }
+
+  // Unsigned LEB128; arithmetic rather than bitwise so timestamps above 2^32 survive
+  varint(value: number): void {
+    while (value >= 0x80) {
+      this.byte((value % 0x80) | 0x80);
+      value = Math.floor(value / 0x80);
+    }
+    this.byte(value);
+  }
+
+  zigzag(value: number): void {
+    this.varint(value >= 0 ? value * 2 : -value * 2 - 1);
+  }
+
+  bytes(data: Uint8Array): void {
+    this.ensure(data.length);
+    this.buffer.set(data, this.length);
+    this.length += data.length;
+  }
+
+  result(): Uint8Array {
+    return this.buffer.slice(0, this.length);
+  }
+}
+
+class ByteReader {
+  private data: Uint8Array;
+  private offset = 0;
+
+  constructor(data: Uint8Array) {
+    this.data = data;
+  }
+
+  get done(): boolean {
+    return this.offset >= this.data.length;
+  }
+
+  varint(): number {
+    let value = 0;
+    let multiplier = 1;
+    for (;;) {
+      if (this.offset >= this.data.length) throw new Error("Truncated varint");
+      const b = this.data[this.offset++];
+      value += (b & 0x7f) * multiplier;
+      if (b < 0x80) return value;
+      multiplier *= 0x80;
+    }
+  }
+
+  zigzag(): number {
+    const value = this.varint();
+    return value % 2 === 0 ? value / 2 : -(value + 1) / 2;
+  }
+
+  bytes(length: number): Uint8Array {
+    if (this.offset + length > this.data.length) throw new Error("Truncated block");
+    const result = this.data.subarray(this.offset, this.offset + length);
+    this.offset += length;
+    return result;
+  }
+}
+
+export function encodeRuns(runs: SegmentRun[]): Uint8Array {
+  const writer = new ByteWriter();
+  for (const run of runs) {
+    const name = encoder.encode(run.series);
+    writer.varint(name.length);
+    writer.bytes(name);
+    writer.varint(run.times.length);
+
+    let lastTime = 0;
+    let lastValue = 0;
+    for (let i = 0; i < run.times.length; i++) {
+      const value = Math.round(run.values[i] * VALUE_SCALE);
+      writer.varint(run.times[i] - lastTime);
+      writer.zigzag(value - lastValue);
+      lastTime = run.times[i];
+      lastValue = value;
+    }
+  }
+  return writer.result();
+}
+
+export function decodeRuns(payload: Uint8Array): SegmentRun[] {
+  const reader = new ByteReader(payload);
+  const runs: SegmentRun[] = [];
+  while (!reader.done) {
+    const series = decoder.decode(reader.bytes(reader.varint()));
+    const count = reader.varint();
+    const times: number[] = new Array(count);
+    const values: number[] = new Array(count);
+
+    let time = 0;
+    let value = 0;
+    for (let i = 0; i < count; i++) {
+      time += reader.varint();
+      value += reader.zigzag();
+      times[i] = time;
+      values[i] = value / VALUE_SCALE;
+    }
+    runs.push({ series, times, values });
+  }
+  return runs;
+}
+
+async function transform(data: Uint8Array, stream: CompressionStream | DecompressionStream): Promise<Uint8Array> {
+  const output = new Blob([data]).stream().pipeThrough(stream);
+  return new Uint8Array(await new Response(output).arrayBuffer());
+}
+
+// One framed, compressed block ready to append to a segment
+export async function encodeBlock(runs: SegmentRun[]): Promise<Uint8Array> {
+  const compressed = await transform(encodeRuns(runs), new CompressionStream("deflate-raw"));
+  const writer = new ByteWriter();
+  writer.varint(compressed.length);
+  writer.bytes(compressed);
+  return writer.result();
+}
+
+// Decodes every intact block of a segment. Stops at the first damaged one.
+export async function decodeSegment(data: Uint8Array): Promise<{ runs: SegmentRun[]; damaged: boolean }> {
+  const reader = new ByteReader(data);
+  const runs: SegmentRun[] = [];
+  try {
+    while (!reader.done) {
+      const compressed = reader.bytes(reader.varint());
+      const payload = await transform(compressed, new DecompressionStream("deflate-raw"));
+      runs.push(...decodeRuns(payload));
+    }
+  } catch {
+    return { runs, damaged: true };
+  }
+  return { runs, damaged: false };
+}
@@ -1,5 +1,6 @@
-import { DeviceState, SystemState } from "./device.ts";
+import { DeviceState, SerializableSystemState, SystemStats } from "./device.ts";
 import { Command } from "./command.ts";
+import { DeviceRule, ServoMove, RgbSequence } from "./deviceConfig.ts";
 
 export interface ApiResponse<T = any> {
   success: boolean;
@@ -8,10 +9,31 @@ export interface ApiResponse<T = any> {
   timestamp: Date;
 }
 
+// Snapshot, sent on connect and when a client asks to resync
 export interface StateMessage {
   type: 'full-state';
+  version: number;               // Patches with this baseVersion apply on top
   timestamp: Date;
-  data: SystemState;
+  data: SerializableSystemState;
+}
+
+// Fields of one device that changed since the last patch
+export interface DevicePatch {
+  version: number;               // Bumped on every change to this device
+  set: Partial<DeviceState>;
+  unset?: string[];              // Fields that no longer exist
+}
+
+// Changes gathered over one broadcast tick. A client whose version is not
+// baseVersion has missed a patch and must request a snapshot.
+export interface StatePatchMessage {
+  type: 'state-patch';
+  version: number;
+  baseVersion: number;
+  timestamp: Date;
+  devices: Record<string, DevicePatch>;
+  removed: string[];
+  systemStats: SystemStats;
 }
 
 export interface WebSocketMessage {
@@ -37,6 +59,18 @@ export interface DeviceForceAwakeRequest {
   forceAwake: boolean;
 }
 
+export interface DeviceRulesRequest {
+  rules: DeviceRule[];
+}
+
+export interface DeviceServoRequest extends ServoMove {
+  scheduleDelay?: number; // milliseconds
+}
+
+export interface DeviceRgbRequest extends RgbSequence {
+  scheduleDelay?: number; // milliseconds
+}
+
 export interface PaginatedResponse<T> {
   items: T[];
   total: number;
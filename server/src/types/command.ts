@@ -5,14 +5,17 @@ export type CommandType =
   | 'rename'
   | 'one-sec-on'
   | 'valve-open'
-  | 'valve-close';
+  | 'valve-close'
+  | 'servo-move'         // payload: ServoMove
+  | 'rgb-sequence';      // payload: RgbSequence
 
 export type CommandStatus = 
   | 'pending' 
   | 'executing' 
   | 'completed' 
   | 'failed' 
-  | 'cancelled';
+  | 'cancelled'
+  | 'superseded';
 
 export interface Command {
   id: string;
@@ -26,6 +29,9 @@ export interface Command {
   status: CommandStatus;
   error?: string;
   executedAt?: Date;
+  delegated?: boolean;   // Handed to the device's local schedule; the device runs it
+  supersededBy?: string; // Later command for the same actuator that replaced this one
+  satisfied?: boolean;   // Completed without sending - the device already reported the state
 }
 
 export interface CommandRequest {
@@ -38,6 +44,17 @@ export interface ScheduledCommand extends Command {
   scheduledFor: Date;
 }
 
+// Upcoming valve events the device runs itself while asleep
+export interface ValveScheduleEvent {
+  at: number;      // Unix timestamp in milliseconds
+  open: boolean;
+}
+
+export interface ValveSchedule {
+  version: number; // Changes whenever the event list does, 0 when empty
+  events: ValveScheduleEvent[];
+}
+
 export interface CommandResult {
   success: boolean;
   error?: string;
@@ -49,5 +66,9 @@ export interface CommandQueueStats {
   executing: number;
   completed: number;
   failed: number;
+  superseded: number;      // Replaced by a later command before delivery
   total: number;
+  activeDevices: number;   // Devices with a command in flight
+  waitingDevices: number;  // Due devices waiting for a free dispatch slot
+  scheduledWakes: number;  // Devices waiting on a scheduled or retry deadline
 }
\ No newline at end of file
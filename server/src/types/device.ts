@@ -1,3 +1,6 @@
+import { DeviceRule } from "./deviceConfig.ts";
+import { EnergyReport } from "./energy.ts";
+
 export interface ContactRecord {
   timestamp: Date;
   ipAddress: string;
@@ -5,10 +8,40 @@ export interface ContactRecord {
 }
 
 export interface SensorReading {
-  timestamp: Date;
   type: 'temperature' | 'soil_moisture' | 'analog';
   value: number;
-  unit?: string;
+  probe?: string;                // ROM ID (16 hex digits) of the DS18B20 a temperature came from
+}
+
+// Point of a time-series range query. Raw samples have count 1; older data
+// comes back as buckets.
+export interface SeriesPoint {
+  t: number;                     // Sample time or bucket start (ms)
+  min: number;
+  max: number;
+  mean: number;
+  count: number;
+}
+
+export interface RuleFiringRecord {
+  rule: number;                  // Index into the device's rules
+  at: Date;
+  value: number;                 // Sample that completed the condition
+}
+
+// Servo as the device last reported it
+export interface ServoStatus {
+  position: number;              // Degrees
+  target: number;
+  atTarget: boolean;
+}
+
+// RGB light as the device last reported it, 0-255 per channel
+export interface RgbStatus {
+  red: number;
+  green: number;
+  blue: number;
+  playing: boolean;              // A fade or sequence is running
 }
 
 export interface DeviceState {
@@ -17,16 +50,27 @@ export interface DeviceState {
   ipAddress: string;
   macAddress: string;
   firmwareVersion?: string;
+  firmwareBuild?: number;
   mode: number;                  // Operating mode (0-5)
   isOnline: boolean;
-  lastSeen: Date;
-  contactHistory: ContactRecord[];
-  currentOutput: boolean;        // Current on/off state
-  sensorData: SensorReading[];
+  lastSeen: Date;                // Contact history and readings live in TimeSeriesStore
+  currentOutput: boolean;        // Current on/off state (reported, else last known)
+  reportedOutput?: boolean;      // Output as the device last reported or acknowledged it
+  outputReportedAt?: Date;       // When reportedOutput came in
+  outputChangedAt?: Date;        // Latest output change the device made on its own, as far as we know
+  desiredOutput?: boolean;       // Output the latest due command asks for
   pendingCommands: string[];     // Command IDs
   sleepStatus: 'awake' | 'asleep' | 'unknown';  // Current sleep state
   forceAwake: boolean;           // Manual stay-awake override
   lastAwakeCheck: Date;          // Last time device checked if it should stay awake
+  missedSlots?: number;          // Sampling grid slots the device skipped (cumulative)
+  energy?: EnergyReport;         // Last complete wake cycle and its battery estimate
+  switchClosed?: boolean;        // Input switch devices
+  servo?: ServoStatus;           // Servo devices, once the position is known
+  rgb?: RgbStatus;               // RGB LED devices
+  lastSwitchEdgeAt?: Date;
+  rules?: DeviceRule[];          // Closed-loop rules run on the device
+  ruleFirings?: RuleFiringRecord[];
 }
 
 export interface SystemStats {
@@ -71,6 +115,37 @@ export interface DeviceRegistration {
   ipAddress: string;
   macAddress: string;
   mode: number;
+  firmwareVersion?: string;
+  buildNumber?: number;
+  platform?: string;             // PLATFORM_NAME, picks the firmware image
+  missedSlots?: number;
+  valveOpen?: boolean;
+  valveEventAt?: number;  // Last local schedule event the device ran (ms)
+  outputOn?: boolean;     // Relay or valve state, for devices with an output
+  energy?: EnergyReport;  // Absent until the device has slept once
+  switchClosed?: boolean; // Input switch state at check-in
+  servo?: ServoStatus;
+  rgb?: RgbStatus;
+}
+
+export interface SensorReadingReport {
+  id: string;
+  readings: SensorReading[];
+  outputOn?: boolean;            // Relay or valve state after the readings were taken
+}
+
+export interface RuleFiringReport {
+  id: string;
+  firings: { rule: number; at: number; value: number }[];
+  dropped?: number;              // Firings the device could not keep
+}
+
+// Switch edges caught on the device, oldest first. "at" is missing for edges
+// seen before the device clock was synchronized; those are stamped on arrival.
+export interface SwitchEventReport {
+  id: string;
+  events: { closed: boolean; at?: number }[];
+  dropped?: number;              // Edges the device could not keep
 }
 
 export interface WiFiFailureReport {
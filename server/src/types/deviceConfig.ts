@@ -52,6 +52,120 @@ export function isValidDeviceMode(mode: number): mode is DeviceModeType {
   return Object.values(DeviceMode).includes(mode as DeviceModeType);
 }
 
+// Closed-loop rule run on the device itself: if the sensor is below/above the
+// threshold for `samples` consecutive samples, hold the output on for
+// durationSeconds, then keep it off for at least minOffSeconds
+export interface DeviceRule {
+  sensor: 'analog' | 'temperature';
+  comparison: 'below' | 'above';
+  threshold: number;        // ADC counts, or degrees C for temperature
+  samples: number;
+  durationSeconds: number;
+  minOffSeconds: number;
+}
+
+// Matches RuleSet::MAX_RULES in the firmware
+export const MAX_DEVICE_RULES = 8;
+
+export function validateDeviceRules(rules: DeviceRule[]): string | null {
+  if (!Array.isArray(rules)) return "Rules must be an array";
+  if (rules.length > MAX_DEVICE_RULES) return `At most ${MAX_DEVICE_RULES} rules are supported`;
+
+  for (const [index, rule] of rules.entries()) {
+    if (rule.sensor !== 'analog' && rule.sensor !== 'temperature') {
+      return `Rule ${index}: sensor must be 'analog' or 'temperature'`;
+    }
+    if (rule.comparison !== 'below' && rule.comparison !== 'above') {
+      return `Rule ${index}: comparison must be 'below' or 'above'`;
+    }
+    // Stored on the device as int16 (temperature in tenths of a degree)
+    const scaled = rule.sensor === 'temperature' ? rule.threshold * 10 : rule.threshold;
+    if (typeof rule.threshold !== 'number' || scaled < -32768 || scaled > 32767) {
+      return `Rule ${index}: threshold out of range`;
+    }
+    if (!Number.isInteger(rule.samples) || rule.samples < 1 || rule.samples > 255) {
+      return `Rule ${index}: samples must be between 1 and 255`;
+    }
+    if (!Number.isInteger(rule.durationSeconds) || rule.durationSeconds < 1) {
+      return `Rule ${index}: durationSeconds must be at least 1`;
+    }
+    if (!Number.isInteger(rule.minOffSeconds) || rule.minOffSeconds < 0) {
+      return `Rule ${index}: minOffSeconds must not be negative`;
+    }
+  }
+
+  return null;
+}
+
+// Servo move, run on the device along a motion profile. Speed and
+// acceleration default on the device (90 deg/s, 180 deg/s^2).
+export interface ServoMove {
+  position: number;          // Degrees, 0-180
+  profile?: 'trapezoidal' | 's-curve';
+  speed?: number;            // Peak degrees per second
+  accel?: number;            // Peak degrees per second squared
+}
+
+export function validateServoMove(move: ServoMove): string | null {
+  if (typeof move.position !== 'number' || !(move.position >= 0 && move.position <= 180)) {
+    return "position must be between 0 and 180";
+  }
+  if (move.profile !== undefined && move.profile !== 'trapezoidal' && move.profile !== 's-curve') {
+    return "profile must be 'trapezoidal' or 's-curve'";
+  }
+  if (move.speed !== undefined && !(typeof move.speed === 'number' && move.speed > 0)) {
+    return "speed must be positive";
+  }
+  if (move.accel !== undefined && !(typeof move.accel === 'number' && move.accel > 0)) {
+    return "accel must be positive";
+  }
+  return null;
+}
+
+// Light sequence, played on the device from one command. Each keyframe fades
+// from the previous color to [red, green, blue] over fadeMs, then holds it
+// for holdMs. loops is how many times the frames play (default 1); 0 repeats
+// them until the next command.
+export type RgbKeyframe = [number, number, number, number, number];
+
+export interface RgbSequence {
+  frames: RgbKeyframe[];
+  loops?: number;
+}
+
+// Matches RgbSequence::MAX_KEYFRAMES in the firmware
+export const MAX_RGB_KEYFRAMES = 12;
+
+function isIntegerIn(value: unknown, min: number, max: number): boolean {
+  return Number.isInteger(value) && (value as number) >= min && (value as number) <= max;
+}
+
+export function validateRgbSequence(sequence: RgbSequence): string | null {
+  if (!Array.isArray(sequence.frames) || sequence.frames.length === 0) {
+    return "frames must be a non-empty array";
+  }
+  if (sequence.frames.length > MAX_RGB_KEYFRAMES) {
+    return `A sequence holds at most ${MAX_RGB_KEYFRAMES} keyframes`;
+  }
+  for (let i = 0; i < sequence.frames.length; i++) {
+    const frame = sequence.frames[i];
+    if (!Array.isArray(frame) || frame.length !== 5 ||
+        !frame.slice(0, 3).every((channel) => isIntegerIn(channel, 0, 255)) ||
+        !frame.slice(3).every((ms) => isIntegerIn(ms, 0, 65535))) {
+      return `Keyframe ${i}: expected [red, green, blue, fadeMs, holdMs] with colors 0-255 and times 0-65535`;
+    }
+  }
+  if (sequence.loops !== undefined && !isIntegerIn(sequence.loops, 0, 255)) {
+    return "loops must be between 0 and 255";
+  }
+  // The device refuses to repeat frames that take no time
+  const cycleMs = sequence.frames.reduce((total, frame) => total + frame[3] + frame[4], 0);
+  if (sequence.loops === 0 && cycleMs < 10) {
+    return "A repeating sequence must last at least 10 ms";
+  }
+  return null;
+}
+
 export function compareConfigurations(
   current: DeviceConfiguration, 
   incoming: DeviceConfiguration
@@ -0,0 +1,69 @@
+// Energy model shared by the server and tools/energyModel.ts. Mirrors
+// EnergyMonitor in the firmware: a wake cycle is priced from its phase
+// durations and the current the board draws in each phase. A relay driven
+// from SENSE_POWER is not one of the phases: relay on-time is not in sensorMs
+// and the relay's own draw is not priced.
+
+// Phase durations of one wake cycle. radioMs and sensorMs are parts of awakeMs.
+export interface EnergyCycle {
+  awakeMs: number;
+  radioMs: number;
+  sensorMs: number;
+  sleepMs: number;
+}
+
+// What the device reported in its check-in: the cycle that ended with its last
+// deep sleep, priced with the firmware's own profile
+export interface EnergyReport extends EnergyCycle {
+  mAhPerCycle: number;
+  batteryDays: number;
+}
+
+export interface EnergyProfile {
+  cpuMa: number;        // Awake, radio off
+  radioMa: number;      // Awake, radio on (total draw, not an extra)
+  sensorMa: number;     // Powered sensor, added to the above
+  sleepUa: number;      // Deep sleep, whole board
+  batteryMah: number;   // Usable battery capacity
+}
+
+// Matches EnergyMonitor::PROFILE in the firmware, by PLATFORM_NAME
+export const DEFAULT_ENERGY_PROFILES: Record<string, EnergyProfile> = {
+  ESP8266: { cpuMa: 17, radioMa: 75, sensorMa: 5, sleepUa: 25, batteryMah: 2000 },
+  ESP32: { cpuMa: 40, radioMa: 120, sensorMa: 5, sleepUa: 15, batteryMah: 2000 }
+};
+
+const MS_PER_HOUR = 3600000;
+const MS_PER_DAY = 86400000;
+
+export function chargePerCycleMah(cycle: EnergyCycle, profile: EnergyProfile): number {
+  const radioMs = Math.min(cycle.radioMs, cycle.awakeMs);
+  const mAms = profile.cpuMa * (cycle.awakeMs - radioMs) +
+    profile.radioMa * radioMs +
+    profile.sensorMa * cycle.sensorMs +
+    profile.sleepUa / 1000 * cycle.sleepMs;
+  return mAms / MS_PER_HOUR;
+}
+
+// Days one battery lasts if every cycle looks like this one
+export function batteryDays(cycle: EnergyCycle, profile: EnergyProfile): number {
+  const chargeMah = chargePerCycleMah(cycle, profile);
+  const cycleMs = cycle.awakeMs + cycle.sleepMs;
+  if (chargeMah <= 0 || cycleMs <= 0) return 0;
+  return profile.batteryMah / (chargeMah * MS_PER_DAY / cycleMs);
+}
+
+export function isEnergyReport(value: unknown): value is EnergyReport {
+  if (typeof value !== 'object' || value === null) return false;
+  const report = value as Record<string, unknown>;
+  return ['awakeMs', 'radioMs', 'sensorMs', 'sleepMs', 'mAhPerCycle', 'batteryDays']
+    .every(key => typeof report[key] === 'number' && Number.isFinite(report[key]) && (report[key] as number) >= 0);
+}
+
+// Time series the server keeps each reported cycle in, by phase
+export const ENERGY_SERIES: Record<keyof EnergyCycle, string> = {
+  awakeMs: 'energy_awake_ms',
+  radioMs: 'energy_radio_ms',
+  sensorMs: 'energy_sensor_ms',
+  sleepMs: 'energy_sleep_ms'
+};
@@ -0,0 +1,63 @@
+// Update offered to a device in its registration response
+export interface FirmwareOffer {
+  version: string;
+  build: number;
+  path: string;                  // Image download path, relative to the server URL
+}
+
+export interface FirmwareResultReport {
+  id: string;
+  build: number;
+  success: boolean;
+  error?: string;
+}
+
+export interface FirmwareRolloutRequest {
+  version: string;
+  build: number;
+  percentage?: number;           // Share of the fleet eligible, 0-100
+  maxConcurrent?: number;        // Devices allowed to be mid-update at once
+  maxFailures?: number;          // Failed devices that pause the rollout
+}
+
+export interface FirmwareRolloutUpdate {
+  percentage?: number;
+  maxConcurrent?: number;
+  maxFailures?: number;
+  status?: 'active' | 'paused';
+}
+
+export interface FirmwareRolloutStatus {
+  version: string;
+  build: number;
+  percentage: number;
+  maxConcurrent: number;
+  maxFailures: number;
+  status: 'active' | 'paused';
+  pausedReason?: string;
+  startedAt: Date;
+  platforms: string[];           // Platforms with an image for this build
+  updating: string[];            // Devices given the image and not yet back
+  updated: string[];
+  failed: Record<string, string>;  // Device ID -> error
+}
+
+// Returns an error message, or null if the values are usable
+export function validateRolloutSettings(settings: FirmwareRolloutUpdate): string | null {
+  if (settings.percentage !== undefined &&
+      (!Number.isFinite(settings.percentage) || settings.percentage < 0 || settings.percentage > 100)) {
+    return "percentage must be between 0 and 100";
+  }
+  if (settings.maxConcurrent !== undefined &&
+      (!Number.isInteger(settings.maxConcurrent) || settings.maxConcurrent < 1)) {
+    return "maxConcurrent must be a positive integer";
+  }
+  if (settings.maxFailures !== undefined &&
+      (!Number.isInteger(settings.maxFailures) || settings.maxFailures < 1)) {
+    return "maxFailures must be a positive integer";
+  }
+  if (settings.status !== undefined && settings.status !== 'active' && settings.status !== 'paused') {
+    return "status must be 'active' or 'paused'";
+  }
+  return null;
+}
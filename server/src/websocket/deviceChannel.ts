@@ -0,0 +1,214 @@
+import { StateManager } from "../managers/StateManager.ts";
+import { DeviceManager } from "../managers/DeviceManager.ts";
+import { CommandResult } from "../types/command.ts";
+import { toSensorReadingReport } from "../api/deviceRoutes.ts";
+
+// How long a command sent down a channel waits for the device's result
+const RESULT_TIMEOUT_MS = 10000;
+
+// Devices send a heartbeat every 30 s; a channel quiet for three is dead even
+// if TCP has not noticed
+const IDLE_TIMEOUT_MS = 90000;
+
+interface PendingResult {
+  deviceId: string;
+  resolve: (result: CommandResult) => void;
+  timeoutId: number;
+}
+
+// Control channels devices open to /device-ws while they stay awake (see
+// ControlChannel in the firmware). Commands go down the device's own
+// connection instead of an HTTP request to its address, and stay-awake changes
+// are pushed as they happen instead of waiting for the device's next check.
+//
+// Device to server: heartbeat, readings ({report}), result ({id, success, error?})
+// Server to device: stay-awake ({value}), command ({id, route, payload})
+export class DeviceChannels {
+  private stateManager: StateManager;
+  private deviceManager: DeviceManager;
+  private channels: Map<string, WebSocket> = new Map();
+  private idleTimers: Map<string, number> = new Map();
+  private stayAwakeSent: Map<string, boolean> = new Map();
+  private pending: Map<number, PendingResult> = new Map();
+  private nextCommandId = 1;
+
+  constructor(stateManager: StateManager, deviceManager: DeviceManager) {
+    this.stateManager = stateManager;
+    this.deviceManager = deviceManager;
+
+    // A queued command or a force-awake toggle reaches the device at once
+    this.stateManager.addListener((deviceId?: string) => {
+      if (deviceId && this.channels.has(deviceId)) {
+        this.pushStayAwake(deviceId);
+      }
+    });
+  }
+
+  handleConnection(ws: WebSocket, deviceId: string): void {
+    ws.addEventListener('open', () => {
+      if (!this.stateManager.getDevice(deviceId)) {
+        console.warn(`Control channel from unregistered device ${deviceId} refused`);
+        ws.close(1008, 'Unknown device');
+        return;
+      }
+
+      // A device that reconnects replaces its old channel
+      const previous = this.channels.get(deviceId);
+      this.channels.set(deviceId, ws);
+      this.stayAwakeSent.delete(deviceId);
+      if (previous) {
+        previous.close(1000, 'Replaced');
+      }
+      this.resetIdleTimer(deviceId, ws);
+      console.log(`Device ${deviceId} opened a control channel`);
+
+      this.stateManager.updateDeviceContact(deviceId, 'control-channel');
+      this.pushStayAwake(deviceId);
+    });
+
+    ws.addEventListener('close', (event) => {
+      if (this.channels.get(deviceId) !== ws) return;
+      this.removeChannel(deviceId);
+      console.log(`Device ${deviceId} closed its control channel (${event.code})`);
+      // Devices close normally just before deep sleep
+      if (event.code === 1000) {
+        this.stateManager.updateDeviceSleepStatus(deviceId, 'asleep');
+      }
+    });
+
+    ws.addEventListener('error', (event) => {
+      console.error(`Control channel error for device ${deviceId}:`, event);
+    });
+
+    ws.addEventListener('message', (event) => {
+      if (this.channels.get(deviceId) !== ws) return;
+      this.resetIdleTimer(deviceId, ws);
+      try {
+        this.handleMessage(deviceId, JSON.parse(event.data));
+      } catch (error) {
+        console.error(`Error handling control channel message from ${deviceId}:`, error);
+      }
+    });
+  }
+
+  private handleMessage(deviceId: string, message: any): void {
+    switch (message.type) {
+      case 'heartbeat': {
+        // Noted first, so the check-in's own state change does not push it too
+        this.stayAwakeSent.set(deviceId, this.deviceManager.shouldRemainAwake(deviceId));
+        const outputOn = typeof message.outputOn === 'boolean' ? message.outputOn : undefined;
+        const stayAwake = this.deviceManager.handleShouldRemainAwake(deviceId, outputOn);
+        this.stayAwakeSent.set(deviceId, stayAwake);
+        this.send(deviceId, { type: 'stay-awake', value: stayAwake });
+        break;
+      }
+
+      case 'readings': {
+        const report = toSensorReadingReport(message.report);
+        if (!report || report.id !== deviceId) {
+          console.warn(`Invalid readings over control channel from ${deviceId}`);
+          break;
+        }
+        this.deviceManager.handleSensorReadings(report);
+        break;
+      }
+
+      case 'result': {
+        const pending = this.pending.get(message.id);
+        if (!pending || pending.deviceId !== deviceId) break;
+        this.pending.delete(message.id);
+        clearTimeout(pending.timeoutId);
+        pending.resolve({
+          success: message.success === true,
+          error: message.success === true ? undefined : (message.error || 'Rejected by device'),
+          timestamp: new Date()
+        });
+        break;
+      }
+
+      default:
+        console.warn(`Unknown control channel message type from ${deviceId}:`, message.type);
+    }
+  }
+
+  private pushStayAwake(deviceId: string): void {
+    const stayAwake = this.deviceManager.shouldRemainAwake(deviceId);
+    if (this.stayAwakeSent.get(deviceId) === stayAwake) return;
+
+    this.stayAwakeSent.set(deviceId, stayAwake);
+    this.send(deviceId, { type: 'stay-awake', value: stayAwake });
+  }
+
+  private resetIdleTimer(deviceId: string, ws: WebSocket): void {
+    clearTimeout(this.idleTimers.get(deviceId));
+    this.idleTimers.set(deviceId, setTimeout(() => {
+      console.warn(`Control channel for device ${deviceId} went quiet - closing it`);
+      ws.close(1001, 'Idle');
+      if (this.channels.get(deviceId) === ws) {
+        this.removeChannel(deviceId);
+      }
+    }, IDLE_TIMEOUT_MS));
+  }
+
+  private removeChannel(deviceId: string): void {
+    this.channels.delete(deviceId);
+    this.stayAwakeSent.delete(deviceId);
+    clearTimeout(this.idleTimers.get(deviceId));
+    this.idleTimers.delete(deviceId);
+
+    for (const [id, pending] of this.pending) {
+      if (pending.deviceId === deviceId) {
+        this.pending.delete(id);
+        clearTimeout(pending.timeoutId);
+        pending.resolve({ success: false, error: 'Control channel closed', timestamp: new Date() });
+      }
+    }
+  }
+
+  private send(deviceId: string, message: unknown): boolean {
+    const ws = this.channels.get(deviceId);
+    if (!ws || ws.readyState !== WebSocket.OPEN) return false;
+    try {
+      ws.send(JSON.stringify(message));
+      return true;
+    } catch (error) {
+      console.error(`Error sending over control channel to ${deviceId}:`, error);
+      return false;
+    }
+  }
+
+  isConnected(deviceId: string): boolean {
+    return this.channels.get(deviceId)?.readyState === WebSocket.OPEN;
+  }
+
+  // route is the device's HTTP path for the command, without the '/'
+  sendCommand(deviceId: string, route: string, payload: unknown): Promise<CommandResult> {
+    const id = this.nextCommandId++;
+    if (!this.send(deviceId, { type: 'command', id, route, payload })) {
+      return Promise.resolve({ success: false, error: 'Control channel closed', timestamp: new Date() });
+    }
+
+    return new Promise(resolve => {
+      const timeoutId = setTimeout(() => {
+        this.pending.delete(id);
+        resolve({ success: false, error: 'Request timeout', timestamp: new Date() });
+      }, RESULT_TIMEOUT_MS);
+      this.pending.set(id, { deviceId, resolve, timeoutId });
+    });
+  }
+
+  getConnectionCount(): number {
+    return this.channels.size;
+  }
+
+  closeAll(): void {
+    for (const [deviceId, ws] of this.channels) {
+      this.removeChannel(deviceId);
+      try {
+        ws.close(1001, 'Server shutting down');
+      } catch (error) {
+        console.error('Error closing control channel:', error);
+      }
+    }
+  }
+}
@@ -1,17 +1,37 @@
 import { StateManager } from "../managers/StateManager.ts";
-import { StateMessage } from "../types/api.ts";
-import { SerializableSystemState } from "../types/device.ts";
+import { DevicePatch, StateMessage, StatePatchMessage } from "../types/api.ts";
+import { DeviceState } from "../types/device.ts";
+
+// Changes are gathered for this long and go out as one patch
+const TICK_MS = 100;
+
+// A client with more than this queued is skipped until it drains below the low
+// mark, then resynced with a snapshot instead of the patches it missed
+const MAX_BUFFERED_BYTES = 1024 * 1024;
+const RESUME_BUFFERED_BYTES = 64 * 1024;
 
 export class WebSocketHandler {
   private stateManager: StateManager;
   private connections: Set<WebSocket> = new Set();
+  private lagging: Set<WebSocket> = new Set();
+  private version = 0;
+  private dirtyDevices: Set<string> = new Set();
+  private dirty = false;
+  private tickTimer?: number;
+  // Per device, each field's JSON as last broadcast, to find what changed
+  private sentFields: Map<string, Map<string, string>> = new Map();
+  private deviceVersions: Map<string, number> = new Map();
 
   constructor(stateManager: StateManager) {
     this.stateManager = stateManager;
     
-    // Listen for state changes and broadcast to all connected clients
-    this.stateManager.addListener((state: SerializableSystemState) => {
-      this.broadcastState(state);
+    // Mutations only mark what changed; a timer coalesces them into one patch
+    this.stateManager.addListener((deviceId?: string) => {
+      if (deviceId) {
+        this.dirtyDevices.add(deviceId);
+      }
+      this.dirty = true;
+      this.scheduleTick();
     });
   }
 
@@ -20,17 +40,21 @@ export class WebSocketHandler {
     
     this.connections.add(ws);
 
-    // Send current state immediately upon connection
-    this.sendStateToClient(ws, this.stateManager.getSerializableState());
+    // Send current state as soon as the socket can carry it
+    if (ws.readyState === WebSocket.OPEN) {
+      this.sendSnapshot(ws);
+    } else {
+      ws.addEventListener('open', () => this.sendSnapshot(ws));
+    }
 
     ws.addEventListener('close', () => {
       console.log('WebSocket connection closed');
-      this.connections.delete(ws);
+      this.removeConnection(ws);
     });
 
     ws.addEventListener('error', (event) => {
       console.error('WebSocket error:', event);
-      this.connections.delete(ws);
+      this.removeConnection(ws);
     });
 
     ws.addEventListener('message', (event) => {
@@ -51,7 +75,8 @@ export class WebSocketHandler {
         break;
       
       case 'request-state':
-        this.sendStateToClient(ws, this.stateManager.getSerializableState());
+        this.lagging.delete(ws);
+        this.sendSnapshot(ws);
         break;
       
       default:
@@ -60,36 +85,119 @@ export class WebSocketHandler {
     }
   }
 
-  private broadcastState(state: any): void {
+  // Patches only set fields, so applying one whose changes the snapshot
+  // already contains is harmless
+  private sendSnapshot(ws: WebSocket): void {
     const message: StateMessage = {
       type: 'full-state',
+      version: this.version,
       timestamp: new Date(),
-      data: state
+      data: this.stateManager.getSerializableState()
     };
 
-    this.broadcast(message);
+    this.sendMessage(ws, message);
   }
 
-  private sendStateToClient(ws: WebSocket, state: any): void {
-    const message: StateMessage = {
-      type: 'full-state',
+  private scheduleTick(): void {
+    if (this.tickTimer !== undefined) return;
+    this.tickTimer = setTimeout(() => this.tick(), TICK_MS);
+  }
+
+  private tick(): void {
+    this.tickTimer = undefined;
+
+    if (this.dirty) {
+      this.dirty = false;
+      this.broadcast(this.buildPatch());
+    }
+
+    // Lagging clients need another look even if nothing else changes
+    for (const ws of this.lagging) {
+      if (ws.bufferedAmount <= RESUME_BUFFERED_BYTES) {
+        this.lagging.delete(ws);
+        this.sendSnapshot(ws);
+      }
+    }
+    if (this.lagging.size > 0) {
+      this.scheduleTick();
+    }
+  }
+
+  private buildPatch(): StatePatchMessage {
+    const devices: Record<string, DevicePatch> = {};
+    const removed: string[] = [];
+
+    for (const deviceId of this.dirtyDevices) {
+      const device = this.stateManager.getDevice(deviceId);
+      if (!device) {
+        if (this.sentFields.delete(deviceId)) {
+          this.deviceVersions.delete(deviceId);
+          removed.push(deviceId);
+        }
+        continue;
+      }
+
+      let sent = this.sentFields.get(deviceId);
+      if (!sent) {
+        sent = new Map();
+        this.sentFields.set(deviceId, sent);
+      }
+
+      const fields = new Map(Object.entries(device));
+      const set: Record<string, unknown> = {};
+      let changed = false;
+      for (const [field, value] of fields) {
+        const json = JSON.stringify(value);
+        if (json !== undefined && sent.get(field) !== json) {
+          set[field] = value;
+          sent.set(field, json);
+          changed = true;
+        }
+      }
+      const unset = [...sent.keys()].filter(field => fields.get(field) === undefined);
+      unset.forEach(field => sent!.delete(field));
+
+      if (changed || unset.length > 0) {
+        const version = (this.deviceVersions.get(deviceId) ?? 0) + 1;
+        this.deviceVersions.set(deviceId, version);
+        const patch: DevicePatch = { version, set: set as Partial<DeviceState> };
+        if (unset.length > 0) {
+          patch.unset = unset;
+        }
+        devices[deviceId] = patch;
+      }
+    }
+    this.dirtyDevices.clear();
+
+    this.version++;
+    return {
+      type: 'state-patch',
+      version: this.version,
+      baseVersion: this.version - 1,
       timestamp: new Date(),
-      data: state
+      devices,
+      removed,
+      systemStats: this.stateManager.getSystemStats()
     };
-
-    this.sendMessage(ws, message);
   }
 
-  private broadcast(message: any): void {
+  private broadcast(message: StatePatchMessage): void {
     const messageStr = JSON.stringify(message);
     const deadConnections: WebSocket[] = [];
 
     for (const ws of this.connections) {
       try {
-        if (ws.readyState === WebSocket.OPEN) {
-          ws.send(messageStr);
+        if (ws.readyState !== WebSocket.OPEN) {
+          if (ws.readyState !== WebSocket.CONNECTING) {
+            deadConnections.push(ws);
+          }
+        } else if (this.lagging.has(ws)) {
+          // Gets a snapshot once it has drained
+        } else if (ws.bufferedAmount > MAX_BUFFERED_BYTES) {
+          console.warn('WebSocket client falling behind - pausing updates until it catches up');
+          this.lagging.add(ws);
         } else {
-          deadConnections.push(ws);
+          ws.send(messageStr);
         }
       } catch (error) {
         console.error('Error sending WebSocket message:', error);
@@ -98,7 +206,12 @@ export class WebSocketHandler {
     }
 
     // Clean up dead connections
-    deadConnections.forEach(ws => this.connections.delete(ws));
+    deadConnections.forEach(ws => this.removeConnection(ws));
+  }
+
+  private removeConnection(ws: WebSocket): void {
+    this.connections.delete(ws);
+    this.lagging.delete(ws);
   }
 
   private sendMessage(ws: WebSocket, message: any): void {
@@ -108,7 +221,7 @@ export class WebSocketHandler {
       }
     } catch (error) {
       console.error('Error sending WebSocket message:', error);
-      this.connections.delete(ws);
+      this.removeConnection(ws);
     }
   }
 
@@ -125,6 +238,10 @@ export class WebSocketHandler {
   }
 
   closeAllConnections(): void {
+    if (this.tickTimer !== undefined) {
+      clearTimeout(this.tickTimer);
+      this.tickTimer = undefined;
+    }
     for (const ws of this.connections) {
       try {
         ws.close();
@@ -133,5 +250,6 @@ export class WebSocketHandler {
       }
     }
     this.connections.clear();
+    this.lagging.clear();
   }
 }
\ No newline at end of file
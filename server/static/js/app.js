@@ -141,6 +141,35 @@ function updateDeviceCard(device) {
         lastSeenElement.textContent = `Last seen: ${new Date(device.lastSeen).toLocaleString()}`;
     }
     
+    // Update servo position
+    const servoElement = deviceCard.querySelector('.servo-state');
+    if (servoElement && device.servo) {
+        const moving = device.servo.atTarget ? '' : ` (moving to ${device.servo.target}\u00b0)`;
+        servoElement.innerHTML = `<strong>Servo:</strong> ${device.servo.position.toFixed(1)}\u00b0${moving}`;
+    }
+    
+    // Update light color
+    const rgbElement = deviceCard.querySelector('.rgb-state');
+    if (rgbElement && device.rgb) {
+        const { red, green, blue } = device.rgb;
+        const playing = device.rgb.playing ? ' (sequence playing)' : '';
+        rgbElement.innerHTML = `<strong>Light:</strong> <span style="display: inline-block; width: 1em; height: 1em; vertical-align: middle; border: 1px solid #ccc; background: rgb(${red}, ${green}, ${blue});"></span> rgb(${red}, ${green}, ${blue})${playing}`;
+    }
+    
+    // Update input switch state
+    const switchElement = deviceCard.querySelector('.switch-state');
+    if (switchElement && device.switchClosed !== undefined) {
+        const since = device.lastSwitchEdgeAt ? ` since ${new Date(device.lastSwitchEdgeAt).toLocaleString()}` : '';
+        switchElement.innerHTML = `<strong>Switch:</strong> <span class="${device.switchClosed ? 'device-online' : 'device-offline'}">${device.switchClosed ? 'CLOSED' : 'OPEN'}</span>${since}`;
+    }
+    
+    // Update battery estimate
+    const batteryElement = deviceCard.querySelector('.battery-estimate');
+    if (batteryElement && device.energy) {
+        batteryElement.style.display = 'block';
+        batteryElement.innerHTML = `<i class="material-icons" style="font-size: 16px; vertical-align: middle;">battery_std</i> ~${Math.round(device.energy.batteryDays)} days battery (${device.energy.mAhPerCycle.toFixed(3)} mAh/wake)`;
+    }
+    
     // Update pending commands count
     const pendingElement = deviceCard.querySelector('[style*="color: #FF9800"]');
     if (pendingElement) {
@@ -219,6 +248,53 @@ function controlDevice(deviceId, action, scheduleDelay = null) {
     });
 }
 
+function moveServo(deviceId, position, profile) {
+    fetch(`/api/devices/${deviceId}/servo`, {
+        method: 'POST',
+        headers: {
+            'Content-Type': 'application/json'
+        },
+        body: JSON.stringify({ position, profile })
+    })
+    .then(response => response.json())
+    .then(data => {
+        if (data.success) {
+            showNotification(`Servo move to ${position}\u00b0 sent to device`);
+        } else {
+            showNotification(`Failed to move servo: ${data.error}`, 'error');
+        }
+    })
+    .catch(error => {
+        console.error('Error moving servo:', error);
+        showNotification('Failed to move servo', 'error');
+    });
+}
+
+// One keyframe: fade from the current color to this one
+function setRgbColor(deviceId, hexColor, fadeMs) {
+    const value = parseInt(hexColor.slice(1), 16);
+    const frame = [(value >> 16) & 0xff, (value >> 8) & 0xff, value & 0xff, fadeMs, 0];
+    fetch(`/api/devices/${deviceId}/rgb`, {
+        method: 'POST',
+        headers: {
+            'Content-Type': 'application/json'
+        },
+        body: JSON.stringify({ frames: [frame] })
+    })
+    .then(response => response.json())
+    .then(data => {
+        if (data.success) {
+            showNotification(`Color ${hexColor} sent to device`);
+        } else {
+            showNotification(`Failed to set color: ${data.error}`, 'error');
+        }
+    })
+    .catch(error => {
+        console.error('Error setting color:', error);
+        showNotification('Failed to set color', 'error');
+    });
+}
+
 function editDeviceName(deviceId) {
     const aliasElement = document.querySelector(`[data-device-id="${deviceId}"]`);
     if (!aliasElement) return;
@@ -355,6 +431,8 @@ function formatTimeAgo(timestamp) {
 
 // Export functions for global use
 window.controlDevice = controlDevice;
+window.moveServo = moveServo;
+window.setRgbColor = setRgbColor;
 window.editDeviceName = editDeviceName;
 window.renameDevice = renameDevice;
 window.toggleForceAwake = toggleForceAwake;
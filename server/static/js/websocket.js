@@ -6,6 +6,11 @@ class WebSocketManager {
         this.reconnectDelay = 1000;
         this.listeners = new Set();
         
+        // Local copy kept current by patches; version is the last one applied
+        this.state = null;
+        this.version = null;
+        this.resyncRequested = false;
+        
         this.connect();
     }
 
@@ -53,7 +58,13 @@ class WebSocketManager {
     handleMessage(message) {
         switch (message.type) {
             case 'full-state':
-                this.notifyListeners('state-update', message.data);
+                this.state = message.data;
+                this.version = message.version;
+                this.resyncRequested = false;
+                this.notifyListeners('state-update', this.state);
+                break;
+            case 'state-patch':
+                this.applyPatch(message);
                 break;
             case 'pong':
                 // Handle ping/pong if needed
@@ -66,6 +77,28 @@ class WebSocketManager {
         }
     }
 
+    applyPatch(message) {
+        if (this.state === null || message.baseVersion !== this.version) {
+            // Missed a patch (or no snapshot yet) - start over from a snapshot
+            if (!this.resyncRequested) {
+                this.resyncRequested = true;
+                this.requestState();
+            }
+            return;
+        }
+        
+        for (const [deviceId, patch] of Object.entries(message.devices)) {
+            const device = this.state.devices[deviceId] || (this.state.devices[deviceId] = {});
+            Object.assign(device, patch.set);
+            (patch.unset || []).forEach(field => delete device[field]);
+        }
+        message.removed.forEach(deviceId => delete this.state.devices[deviceId]);
+        this.state.systemStats = message.systemStats;
+        this.version = message.version;
+        
+        this.notifyListeners('state-update', this.state);
+    }
+
     scheduleReconnect() {
         if (this.reconnectAttempts >= this.maxReconnectAttempts) {
             console.error('Max reconnection attempts reached');
@@ -0,0 +1,220 @@
+// Offline energy what-if calculator: re-prices recorded wake cycles with a
+// different current profile or with phases made shorter or longer, so the
+// battery life gained or lost by a firmware change can be quantified before it
+// is rolled out.
+//
+// Cycles come from the phase trace the server records with every check-in
+// (series energy_awake_ms, energy_radio_ms, ...) or from a trace file saved
+// earlier with --save:
+//
+//   deno task energy --device 123456 --hours 168 --save greenhouse.json
+//   deno task energy --trace greenhouse.json --scale radio=0.6
+//   deno task energy --trace greenhouse.json --platform ESP32 --sleep-ua 8
+//
+// --scale multiplies phase durations (cpu = awake with the radio off, radio,
+// sensor). The sampling period stays as recorded, so time taken off the wake
+// goes to deep sleep, as it does on the device; --period-ms sets another period.
+// Older parts of the trace come back as bucket means, which price the same as
+// the cycles they stand for because the model is linear in the durations.
+// Relay-mode devices are priced without their relay: its on-time is not a
+// recorded phase, so add the relay's draw separately if it runs off the battery.
+
+import { parse } from "std/flags/mod.ts";
+import {
+  batteryDays,
+  chargePerCycleMah,
+  DEFAULT_ENERGY_PROFILES,
+  ENERGY_SERIES,
+  EnergyCycle,
+  EnergyProfile
+} from "../src/types/energy.ts";
+import { SeriesPoint } from "../src/types/device.ts";
+
+const args = parse(Deno.args, {
+  string: ["server", "device", "trace", "save", "scale", "platform"],
+  boolean: ["json"],
+  default: {
+    server: `http://localhost:${Deno.env.get("PORT") || "3000"}`,
+    platform: "ESP8266",
+    hours: 24,
+    json: false
+  }
+});
+
+// A recorded cycle, or the mean of `count` cycles
+interface TraceCycle extends EnergyCycle {
+  t: number;
+  count: number;
+}
+
+interface Trace {
+  device: string;
+  cycles: TraceCycle[];
+}
+
+type Phase = 'cpu' | 'radio' | 'sensor';
+
+function fail(message: string): never {
+  console.error(message);
+  Deno.exit(2);
+}
+
+function parseProfile(): EnergyProfile {
+  const base = DEFAULT_ENERGY_PROFILES[args.platform];
+  if (!base) fail(`Unknown platform ${args.platform} (${Object.keys(DEFAULT_ENERGY_PROFILES).join(", ")})`);
+
+  const profile = { ...base };
+  const overrides: [string, keyof EnergyProfile][] = [
+    ["cpu-ma", "cpuMa"], ["radio-ma", "radioMa"], ["sensor-ma", "sensorMa"],
+    ["sleep-ua", "sleepUa"], ["battery-mah", "batteryMah"]
+  ];
+  for (const [flag, key] of overrides) {
+    if (args[flag] !== undefined) {
+      const value = Number(args[flag]);
+      if (!(value >= 0)) fail(`--${flag} must be a non-negative number`);
+      profile[key] = value;
+    }
+  }
+  return profile;
+}
+
+function parseScale(): Record<Phase, number> {
+  const scale: Record<Phase, number> = { cpu: 1, radio: 1, sensor: 1 };
+  for (const term of (args.scale ?? "").split(",").filter(Boolean)) {
+    const [phase, factor] = term.split("=");
+    if (!(phase in scale) || !(Number(factor) >= 0)) {
+      fail(`Bad --scale term "${term}": expected cpu|radio|sensor=<factor>`);
+    }
+    scale[phase as Phase] = Number(factor);
+  }
+  return scale;
+}
+
+async function fetchSeries(device: string, series: string, from: number, to: number): Promise<SeriesPoint[]> {
+  const url = `${args.server.replace(/\/$/, "")}/api/devices/${device}/series/${series}?from=${from}&to=${to}&points=5000`;
+  const response = await fetch(url);
+  if (!response.ok) fail(`GET ${url}: ${response.status}`);
+  return (await response.json()).data.points;
+}
+
+// The four phase series share their sample times, so cycles line up by t
+async function fetchTrace(device: string): Promise<Trace> {
+  const to = Date.now();
+  const from = to - Number(args.hours) * 60 * 60 * 1000;
+  const byPhase: Partial<Record<keyof EnergyCycle, Map<number, SeriesPoint>>> = {};
+  for (const [phase, series] of Object.entries(ENERGY_SERIES)) {
+    const points = await fetchSeries(device, series, from, to);
+    byPhase[phase as keyof EnergyCycle] = new Map(points.map(point => [point.t, point]));
+  }
+
+  const cycles: TraceCycle[] = [];
+  for (const [t, awake] of byPhase.awakeMs!) {
+    const radio = byPhase.radioMs!.get(t);
+    const sensor = byPhase.sensorMs!.get(t);
+    const sleep = byPhase.sleepMs!.get(t);
+    if (!radio || !sensor || !sleep) continue;
+    cycles.push({
+      t,
+      count: awake.count,
+      awakeMs: awake.mean,
+      radioMs: radio.mean,
+      sensorMs: sensor.mean,
+      sleepMs: sleep.mean
+    });
+  }
+  return { device, cycles: cycles.sort((a, b) => a.t - b.t) };
+}
+
+function applyScale(cycle: TraceCycle, scale: Record<Phase, number>, periodMs?: number): TraceCycle {
+  const radioMs = cycle.radioMs * scale.radio;
+  const awakeMs = (cycle.awakeMs - cycle.radioMs) * scale.cpu + radioMs;
+  const period = periodMs ?? cycle.awakeMs + cycle.sleepMs;
+  return {
+    ...cycle,
+    awakeMs,
+    radioMs,
+    sensorMs: Math.min(cycle.sensorMs * scale.sensor, awakeMs),
+    sleepMs: Math.max(0, period - awakeMs)
+  };
+}
+
+interface Summary {
+  cycles: number;
+  mean: EnergyCycle;
+  mAhPerCycle: number;
+  mAhPerDay: number;
+  batteryDays: number;
+  shares: Record<'cpu' | 'radio' | 'sensor' | 'sleep', number>;   // Fraction of the charge per phase
+}
+
+function summarize(cycles: TraceCycle[], profile: EnergyProfile): Summary {
+  const total = cycles.reduce((sum, cycle) => sum + cycle.count, 0);
+  const mean: EnergyCycle = { awakeMs: 0, radioMs: 0, sensorMs: 0, sleepMs: 0 };
+  for (const cycle of cycles) {
+    for (const key of Object.keys(mean) as (keyof EnergyCycle)[]) {
+      mean[key] += cycle[key] * cycle.count / total;
+    }
+  }
+
+  const mAhPerCycle = chargePerCycleMah(mean, profile);
+  const only = (cycle: EnergyCycle) => chargePerCycleMah(cycle, profile) / mAhPerCycle;
+  return {
+    cycles: total,
+    mean,
+    mAhPerCycle,
+    mAhPerDay: mAhPerCycle * 86400000 / (mean.awakeMs + mean.sleepMs),
+    batteryDays: batteryDays(mean, profile),
+    shares: {
+      cpu: only({ awakeMs: mean.awakeMs - mean.radioMs, radioMs: 0, sensorMs: 0, sleepMs: 0 }),
+      radio: only({ awakeMs: mean.radioMs, radioMs: mean.radioMs, sensorMs: 0, sleepMs: 0 }),
+      sensor: only({ awakeMs: 0, radioMs: 0, sensorMs: mean.sensorMs, sleepMs: 0 }),
+      sleep: only({ awakeMs: 0, radioMs: 0, sensorMs: 0, sleepMs: mean.sleepMs })
+    }
+  };
+}
+
+function printSummary(label: string, summary: Summary): void {
+  const m = summary.mean;
+  const pct = (share: number) => `${(share * 100).toFixed(0)}%`;
+  console.log(`${label}`);
+  console.log(`  mean cycle: awake ${m.awakeMs.toFixed(0)}ms (radio ${m.radioMs.toFixed(0)}ms, sensor ${m.sensorMs.toFixed(0)}ms), sleep ${(m.sleepMs / 1000).toFixed(1)}s`);
+  console.log(`  charge: ${summary.mAhPerCycle.toFixed(4)} mAh/cycle, ${summary.mAhPerDay.toFixed(2)} mAh/day`);
+  console.log(`  share: cpu ${pct(summary.shares.cpu)}, radio ${pct(summary.shares.radio)}, sensor ${pct(summary.shares.sensor)}, sleep ${pct(summary.shares.sleep)}`);
+  console.log(`  battery: ~${summary.batteryDays.toFixed(0)} days`);
+}
+
+let trace: Trace;
+if (args.trace) {
+  trace = JSON.parse(await Deno.readTextFile(args.trace));
+} else if (args.device) {
+  trace = await fetchTrace(args.device);
+} else {
+  fail("Usage: energyModel.ts (--device <id> [--server url] [--hours n] [--save file] | --trace file) " +
+    "[--platform ESP8266|ESP32] [--cpu-ma n] [--radio-ma n] [--sensor-ma n] [--sleep-ua n] [--battery-mah n] " +
+    "[--scale cpu=f,radio=f,sensor=f] [--period-ms n] [--json]");
+}
+
+if (trace.cycles.length === 0) fail(`No recorded cycles for device ${trace.device}`);
+if (args.save) {
+  await Deno.writeTextFile(args.save, JSON.stringify(trace, null, 2));
+}
+
+const profile = parseProfile();
+const scale = parseScale();
+const periodMs = args["period-ms"] !== undefined ? Number(args["period-ms"]) : undefined;
+if (periodMs !== undefined && !(periodMs > 0)) fail("--period-ms must be positive");
+
+const recorded = summarize(trace.cycles, profile);
+const whatIf = summarize(trace.cycles.map(cycle => applyScale(cycle, scale, periodMs)), profile);
+const gainDays = whatIf.batteryDays - recorded.batteryDays;
+
+if (args.json) {
+  console.log(JSON.stringify({ device: trace.device, profile, scale, periodMs, recorded, whatIf }, null, 2));
+} else {
+  console.log(`Device ${trace.device}: ${recorded.cycles} cycles, ${args.platform} profile ${JSON.stringify(profile)}\n`);
+  printSummary("Recorded", recorded);
+  console.log();
+  printSummary(`What-if (scale ${JSON.stringify(scale)}${periodMs ? `, period ${periodMs}ms` : ""})`, whatIf);
+  console.log();
+  console.log(`Battery life ${gainDays >= 0 ? "+" : ""}${gainDays.toFixed(1)} days (${(gainDays / recorded.batteryDays * 100).toFixed(1)}%)`);
+}
@@ -0,0 +1,396 @@
+// Fleet load generator: runs N devices against a local server and reports how
+// it copes as the fleet grows.
+//
+// Each device is the firmware itself, built for the host on the native HAL
+// (`pio run -e fleet`, see fleet/fleet_device.cpp in the firmware tree). One
+// wake is one run of that program: it boots, registers, reports, answers
+// commands on its web server and control channel, and deep sleeps, leaving its
+// flash and RTC memory in a state file for the next wake. This supervisor
+// starts each device's next run when its sleep is over, stretched or shrunk by
+// the device's RTC drift, and plays the dashboard in the meantime. Each device
+// listens on its own port (--port plus its index) and registers
+// 127.0.0.1:<port>, the host:port form the server sends commands to.
+//
+//   pio run -e fleet
+//   deno task simulate --devices 100,1000,5000 --stage-seconds 60
+//
+// Reports per stage: device request throughput and p50/p99 latency per
+// endpoint as the firmware saw them, command delivery delay (dashboard request
+// to the relay switching on), wakes the host started late (the load is then
+// lower than the fleet's) and server memory from /api/health. --json prints
+// the same as one JSON document.
+
+import { parse } from "std/flags/mod.ts";
+import { TextLineStream } from "std/streams/text_line_stream.ts";
+
+const args = parse(Deno.args, {
+  string: ["server", "devices", "firmware", "state-dir"],
+  boolean: ["json"],
+  default: {
+    server: `http://127.0.0.1:${Deno.env.get("PORT") || "3000"}`,
+    devices: "100,500,1000",
+    firmware: "../.pio/build/fleet/program",
+    "stage-seconds": 60,
+    "ramp-seconds": 60,      // First wakes are spread over this long
+    "command-rate": 2,       // Dashboard commands per second, fleet-wide
+    drift: 0.02,             // Largest RTC error, as a fraction of the sleep
+    "max-running": 256,      // Device processes at once; later wakes wait
+    port: 18000,
+    json: false
+  }
+});
+
+const SERVER = args.server.replace(/\/$/, "");
+const STAGES = args.devices.split(",").map((n: string) => parseInt(n)).filter((n: number) => n > 0);
+const FIRMWARE = args.firmware;
+const STAGE_MS = Number(args["stage-seconds"]) * 1000;
+const RAMP_MS = Number(args["ramp-seconds"]) * 1000;
+const COMMAND_RATE = Number(args["command-rate"]);
+const DRIFT = Number(args.drift);
+const MAX_RUNNING = Math.max(1, Number(args["max-running"]));
+const PORT = Number(args.port);
+const MAX_PORT = 65535;
+const MEMORY_SAMPLE_MS = 5000;
+const CRASH_RETRY_MS = 10000;
+const LATE_WAKE_MS = 1000;
+
+class Metrics {
+  latencies: Map<string, number[]> = new Map();
+  errors: Map<string, number> = new Map();
+  deliveryDelays: number[] = [];
+  commandsIssued = 0;
+  commandErrors = 0;
+  wakes = 0;
+  wakeDelays: number[] = [];
+  crashes = 0;
+  rss: number[] = [];
+
+  record(route: string, ms: number, ok: boolean): void {
+    let list = this.latencies.get(route);
+    if (!list) {
+      list = [];
+      this.latencies.set(route, list);
+    }
+    list.push(ms);
+    if (!ok) {
+      this.errors.set(route, (this.errors.get(route) ?? 0) + 1);
+    }
+  }
+}
+
+function percentile(values: number[], p: number): number {
+  if (values.length === 0) return 0;
+  const sorted = [...values].sort((a, b) => a - b);
+  return sorted[Math.min(sorted.length - 1, Math.floor(p / 100 * sorted.length))];
+}
+
+let metrics = new Metrics();
+
+// What fleet_device prints, one object per line
+type DeviceEvent =
+  | { event: "boot"; id: string }
+  | { event: "request"; route: string; ms: number; code: number }
+  | { event: "output"; on: boolean }
+  | { event: "sleep"; ms: number }
+  | { event: "restart" };
+
+// Wakes past MAX_RUNNING queue here until a running device sleeps
+const waiting: Array<() => void> = [];
+let running = 0;
+
+function released(): void {
+  running--;
+  waiting.shift()?.();
+}
+
+class SimulatedDevice {
+  readonly index: number;
+  readonly port: number;
+  readonly statePath: string;
+  // Each RTC runs fast or slow by its own amount
+  readonly drift = (Math.random() * 2 - 1) * DRIFT;
+  id?: string;                  // Serial number, known once it has booted
+  output = false;
+  commandIssuedAt?: number;     // Dashboard command not yet delivered
+  private process?: Deno.ChildProcess;
+  private timerId?: number;
+  private stopped = false;
+
+  constructor(index: number, stateDir: string) {
+    this.index = index;
+    this.port = PORT + index;
+    this.statePath = `${stateDir}/device-${index}.state`;
+  }
+
+  start(): void {
+    // Powered up over the ramp, then on whatever cadence the firmware keeps
+    this.schedule(Math.random() * RAMP_MS);
+  }
+
+  async stop(): Promise<void> {
+    this.stopped = true;
+    if (this.timerId !== undefined) {
+      clearTimeout(this.timerId);
+    }
+    try {
+      this.process?.kill("SIGTERM");
+      await this.process?.status;
+    } catch {
+      // Already gone
+    }
+  }
+
+  private schedule(delayMs: number): void {
+    if (this.stopped) return;
+    const dueAt = Date.now() + delayMs;
+    this.timerId = setTimeout(() => {
+      if (running < MAX_RUNNING) {
+        this.wake(dueAt);
+      } else {
+        waiting.push(() => this.wake(dueAt));
+      }
+    }, delayMs);
+  }
+
+  private async wake(dueAt: number): Promise<void> {
+    if (this.stopped) {
+      waiting.shift()?.();
+      return;
+    }
+    running++;
+    metrics.wakes++;
+    metrics.wakeDelays.push(Date.now() - dueAt);
+    // Relay outputs come up off
+    this.output = false;
+
+    const command = new Deno.Command(FIRMWARE, {
+      args: ["--state", this.statePath, "--port", String(this.port), "--index", String(this.index),
+        "--server", SERVER],
+      stdout: "piped",
+      stderr: "inherit"
+    });
+    let next: number | undefined;
+    try {
+      this.process = command.spawn();
+      const lines = this.process.stdout.pipeThrough(new TextDecoderStream()).pipeThrough(new TextLineStream());
+      for await (const line of lines) {
+        const event = this.parse(line);
+        if (event?.event === "sleep") {
+          next = event.ms * (1 + this.drift);
+        } else if (event?.event === "restart") {
+          next = 0;
+        } else if (event) {
+          this.handle(event);
+        }
+      }
+      await this.process.status;
+    } finally {
+      this.process = undefined;
+      released();
+    }
+
+    if (next === undefined) {
+      // Killed, or the firmware crashed; try a cold start later
+      if (!this.stopped) metrics.crashes++;
+      next = CRASH_RETRY_MS;
+    }
+    this.schedule(next);
+  }
+
+  private parse(line: string): DeviceEvent | null {
+    try {
+      return JSON.parse(line) as DeviceEvent;
+    } catch {
+      return null;
+    }
+  }
+
+  private handle(event: DeviceEvent): void {
+    switch (event.event) {
+      case "boot":
+        this.id = event.id;
+        break;
+      case "request":
+        metrics.record(event.route, event.ms, event.code >= 200 && event.code < 300);
+        break;
+      case "output":
+        this.output = event.on;
+        if (event.on && this.commandIssuedAt !== undefined) {
+          metrics.deliveryDelays.push(Date.now() - this.commandIssuedAt);
+          this.commandIssuedAt = undefined;
+        }
+        break;
+    }
+  }
+}
+
+const devices: SimulatedDevice[] = [];
+
+// Each device takes a port, so the largest stage has to fit above --port
+const largestStage = Math.max(0, ...STAGES);
+if (PORT + largestStage - 1 > MAX_PORT) {
+  console.error(`--port ${PORT} leaves room for ${MAX_PORT - PORT + 1} devices, not ${largestStage}`);
+  Deno.exit(1);
+}
+try {
+  await Deno.stat(FIRMWARE);
+} catch {
+  console.error(`No device program at ${FIRMWARE}: build it with "pio run -e fleet" in the firmware tree, or pass --firmware`);
+  Deno.exit(1);
+}
+
+// One command at a time per device, each turning on a relay that is off, so
+// every one shows up as the relay switching rather than being coalesced away.
+// Relays drop when their device sleeps, so there is always one to turn on.
+async function issueCommand(): Promise<void> {
+  const idle = devices.filter(device => device.id && !device.output && device.commandIssuedAt === undefined);
+  if (idle.length === 0) return;
+
+  const device = idle[Math.floor(Math.random() * idle.length)];
+  device.commandIssuedAt = Date.now();
+  metrics.commandsIssued++;
+
+  const startedAt = performance.now();
+  try {
+    const response = await fetch(`${SERVER}/api/devices/${device.id}/control`, {
+      method: "POST",
+      headers: { "Content-Type": "application/json" },
+      body: JSON.stringify({ action: "output-on" }),
+      signal: AbortSignal.timeout(10000)
+    });
+    await response.text();
+    metrics.record("/api/devices/:id/control", performance.now() - startedAt, response.ok);
+    if (!response.ok) {
+      metrics.commandErrors++;
+      device.commandIssuedAt = undefined;
+    }
+  } catch {
+    metrics.record("/api/devices/:id/control", performance.now() - startedAt, false);
+    metrics.commandErrors++;
+    device.commandIssuedAt = undefined;
+  }
+}
+
+async function sampleMemory(): Promise<void> {
+  try {
+    const response = await fetch(`${SERVER}/api/health`, { signal: AbortSignal.timeout(5000) });
+    const body = await response.json();
+    if (body.data?.memory?.rss) {
+      metrics.rss.push(body.data.memory.rss);
+    }
+  } catch {
+    // Health is best effort
+  }
+}
+
+interface StageReport {
+  devices: number;
+  seconds: number;
+  requests: number;
+  requestsPerSecond: number;
+  errors: number;
+  latency: Record<string, { count: number; p50: number; p99: number; errors: number }>;
+  commands: { issued: number; delivered: number; outstanding: number; p50DelayMs: number; p99DelayMs: number };
+  wakes: { started: number; late: number; p99DelayMs: number; crashes: number };
+  serverRssMb: { start: number; end: number };
+}
+
+function report(deviceCount: number, seconds: number): StageReport {
+  const latency: StageReport["latency"] = {};
+  let requests = 0;
+  let errors = 0;
+  for (const [route, values] of metrics.latencies) {
+    if (route.startsWith("/api/")) continue;   // Dashboard traffic, not device load
+    const routeErrors = metrics.errors.get(route) ?? 0;
+    latency[route] = {
+      count: values.length,
+      p50: Math.round(percentile(values, 50) * 10) / 10,
+      p99: Math.round(percentile(values, 99) * 10) / 10,
+      errors: routeErrors
+    };
+    requests += values.length;
+    errors += routeErrors;
+  }
+
+  const toMb = (bytes: number) => Math.round(bytes / 1024 / 1024 * 10) / 10;
+  return {
+    devices: deviceCount,
+    seconds,
+    requests,
+    requestsPerSecond: Math.round(requests / seconds * 10) / 10,
+    errors,
+    latency,
+    commands: {
+      issued: metrics.commandsIssued,
+      delivered: metrics.deliveryDelays.length,
+      outstanding: devices.filter(device => device.commandIssuedAt !== undefined).length,
+      p50DelayMs: Math.round(percentile(metrics.deliveryDelays, 50)),
+      p99DelayMs: Math.round(percentile(metrics.deliveryDelays, 99))
+    },
+    wakes: {
+      started: metrics.wakes,
+      late: metrics.wakeDelays.filter(ms => ms > LATE_WAKE_MS).length,
+      p99DelayMs: Math.round(percentile(metrics.wakeDelays, 99)),
+      crashes: metrics.crashes
+    },
+    serverRssMb: {
+      start: toMb(metrics.rss[0] ?? 0),
+      end: toMb(metrics.rss[metrics.rss.length - 1] ?? 0)
+    }
+  };
+}
+
+function printStage(stage: StageReport): void {
+  console.log(`\n=== ${stage.devices} devices, ${stage.seconds}s ===`);
+  console.log(`Device requests: ${stage.requests} (${stage.requestsPerSecond}/s), ${stage.errors} errors`);
+  for (const [route, stats] of Object.entries(stage.latency)) {
+    console.log(`  ${route.padEnd(22)} n=${String(stats.count).padEnd(7)} p50=${stats.p50}ms p99=${stats.p99}ms errors=${stats.errors}`);
+  }
+  const c = stage.commands;
+  console.log(`Commands: ${c.issued} issued, ${c.delivered} delivered, ${c.outstanding} outstanding; delay p50=${c.p50DelayMs}ms p99=${c.p99DelayMs}ms`);
+  const w = stage.wakes;
+  console.log(`Wakes: ${w.started} started, ${w.late} more than ${LATE_WAKE_MS}ms late (p99 ${w.p99DelayMs}ms), ${w.crashes} crashed`);
+  console.log(`Server RSS: ${stage.serverRssMb.start}MB -> ${stage.serverRssMb.end}MB`);
+}
+
+// Devices keep their flash between stages, not between runs
+const stateDir = args["state-dir"] ?? await Deno.makeTempDir({ prefix: "omnisensor-fleet-" });
+await Deno.mkdir(stateDir, { recursive: true });
+
+const reports: StageReport[] = [];
+try {
+  for (const target of STAGES) {
+    while (devices.length < target) {
+      const device = new SimulatedDevice(devices.length, stateDir);
+      devices.push(device);
+      device.start();
+    }
+
+    metrics = new Metrics();
+    await sampleMemory();
+    const memoryTimer = setInterval(sampleMemory, MEMORY_SAMPLE_MS);
+    const commandTimer = COMMAND_RATE > 0 ? setInterval(issueCommand, 1000 / COMMAND_RATE) : undefined;
+
+    await new Promise(resolve => setTimeout(resolve, STAGE_MS));
+
+    clearInterval(memoryTimer);
+    if (commandTimer !== undefined) clearInterval(commandTimer);
+    await sampleMemory();
+
+    const stage = report(target, STAGE_MS / 1000);
+    reports.push(stage);
+    if (!args.json) printStage(stage);
+  }
+} finally {
+  await Promise.all(devices.map(device => device.stop()));
+  if (args["state-dir"] === undefined) {
+    await Deno.remove(stateDir, { recursive: true });
+  }
+}
+
+if (args.json) {
+  console.log(JSON.stringify({ server: SERVER, maxDriftFraction: DRIFT, stages: reports }, null, 2));
+}
+
+// Don't wait out wakes still scheduled
+Deno.exit(0);
@@ -0,0 +1,96 @@
+#include "CadenceScheduler.h"
+#include "RTCMemoryManager.h"
+#include "TimeSyncManager.h"
+
+CadenceScheduler::CadenceScheduler(RTCMemoryManager* rtc, TimeSyncManager* timeSync, uint32_t period) :
+    rtcMemoryManager(rtc), timeSyncManager(timeSync), periodMs(period), wakeSlotMs(0), started(false) {
+}
+
+void CadenceScheduler::begin(bool wokeFromDeepSleep) {
+    CadenceState& saved = rtcMemoryManager->getState().cadence;
+
+    // A changed period invalidates the grid position
+    if (saved.periodMs != periodMs) {
+        saved.currentSlotMs = 0;
+        saved.missedSlots = 0;
+        saved.periodMs = periodMs;
+    }
+
+    wakeSlotMs = wokeFromDeepSleep ? saved.currentSlotMs : 0;
+    if (wakeSlotMs != 0) {
+        Serial.print("Woke for scheduled time ");
+        Serial.println((unsigned long)(wakeSlotMs / 1000));
+    }
+    started = true;
+}
+
+void CadenceScheduler::setPeriodMs(uint32_t period) {
+    if (period == periodMs) {
+        return;
+    }
+    periodMs = period;
+    if (!started) {
+        // begin() compares it with the saved period
+        return;
+    }
+
+    // This wake's slot is on the old grid, so it cannot measure an overrun on
+    // the new one, and the missed count was against the old period
+    CadenceState& saved = rtcMemoryManager->getState().cadence;
+    saved.currentSlotMs = 0;
+    saved.missedSlots = 0;
+    saved.periodMs = periodMs;
+    wakeSlotMs = 0;
+}
+
+uint32_t CadenceScheduler::planSleep(uint64_t wakeByMs) {
+    CadenceState& saved = rtcMemoryManager->getState().cadence;
+
+    if (!timeSyncManager->isSynchronized()) {
+        // No grid without a clock - at least take the awake time off the period
+        uint32_t awakeMs = millis();
+        uint32_t sleepMs = awakeMs + MIN_SLEEP_MS < periodMs ? periodMs - awakeMs : MIN_SLEEP_MS;
+        saved.currentSlotMs = 0;
+        Serial.print("Clock not synchronized - sleeping ");
+        Serial.print(sleepMs);
+        Serial.println("ms to keep the period");
+        return sleepMs;
+    }
+
+    uint64_t now = timeSyncManager->getCurrentTime();
+    uint64_t earliestWake = now + MIN_SLEEP_MS;
+    uint64_t nextSlotMs = ((earliestWake + periodMs - 1) / periodMs) * periodMs;
+
+    // Anything between the time we woke for and the slot we can still reach is
+    // lost. Event wakes fall between slots, so count from the first slot after it.
+    uint64_t firstMissableMs = (wakeSlotMs / periodMs + 1) * periodMs;
+    if (wakeSlotMs != 0 && nextSlotMs > firstMissableMs) {
+        uint32_t skipped = (uint32_t)((nextSlotMs - firstMissableMs) / periodMs);
+        saved.missedSlots += skipped;
+        Serial.print("Wake overran its period - skipping ");
+        Serial.print(skipped);
+        Serial.println(" sample slot(s)");
+    }
+
+    uint64_t wakeAtMs = nextSlotMs;
+    if (wakeByMs != 0 && wakeByMs < nextSlotMs) {
+        wakeAtMs = max(wakeByMs, earliestWake);
+        Serial.println("Waking early for a scheduled event");
+    }
+
+    saved.currentSlotMs = wakeAtMs;
+    uint32_t sleepMs = timeSyncManager->toRtcDuration((uint32_t)(wakeAtMs - now));
+
+    Serial.print("Next wake ");
+    Serial.print((unsigned long)(wakeAtMs / 1000));
+    Serial.print(" in ");
+    Serial.print((unsigned long)(wakeAtMs - now));
+    Serial.print("ms (RTC sleep ");
+    Serial.print(sleepMs);
+    Serial.println("ms)");
+    return sleepMs;
+}
+
+uint32_t CadenceScheduler::getMissedSlots() const {
+    return rtcMemoryManager->getState().cadence.missedSlots;
+}
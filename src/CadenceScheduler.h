@@ -0,0 +1,46 @@
+#ifndef CADENCE_SCHEDULER_H
+#define CADENCE_SCHEDULER_H
+
+#include <Arduino.h>
+
+class RTCMemoryManager;
+class TimeSyncManager;
+
+// Schedules wakes on a fixed grid of server time (e.g. every minute on the
+// minute) instead of sleeping a fixed duration after each wake, so the time
+// spent awake no longer stretches the sampling period.
+//
+// A wake that overruns its slot skips straight to the next slot that can still
+// be reached; missed slots are counted but never made up with catch-up wakes.
+// Until the clock is synchronized the scheduler falls back to sleeping the
+// period minus the time spent awake.
+class CadenceScheduler {
+public:
+    // Never plan a sleep shorter than this - boot and WiFi need the headroom
+    static const uint32_t MIN_SLEEP_MS = 2000;
+
+private:
+    RTCMemoryManager* rtcMemoryManager;
+    TimeSyncManager* timeSyncManager;
+    uint32_t periodMs;
+    uint64_t wakeSlotMs;  // Time this wake was scheduled for (0 if unknown)
+    bool started;         // begin() has taken up the saved grid
+
+public:
+    CadenceScheduler(RTCMemoryManager* rtc, TimeSyncManager* timeSync, uint32_t period);
+
+    void begin(bool wokeFromDeepSleep);
+
+    // Picks the next slot and returns the duration to hand to the RTC. A non-zero
+    // wakeByMs (server time) wakes early for it, e.g. a scheduled valve event.
+    uint32_t planSleep(uint64_t wakeByMs = 0);
+
+    uint64_t getWakeSlotTime() const { return wakeSlotMs; }
+    uint32_t getMissedSlots() const;
+    uint32_t getPeriodMs() const { return periodMs; }
+    // A different period restarts the grid: at begin() when set before it, or
+    // straight away (slot and missed count dropped) when set while running
+    void setPeriodMs(uint32_t period);
+};
+
+#endif
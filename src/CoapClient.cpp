@@ -0,0 +1,229 @@
+#include "CoapClient.h"
+#include "ServerEndpoint.h"
+
+CoapClient::CoapClient(ServerEndpoint* endpoint) :
+    serverEndpoint(endpoint), started(false), nextMessageId(0) {
+}
+
+int CoapClient::get(const char* path, const String& query, String& responsePayload) {
+    return exchange(CODE_GET, path, query.c_str(), String(), responsePayload);
+}
+
+int CoapClient::post(const char* path, const String& json, String& responsePayload) {
+    return exchange(CODE_POST, path, "", json, responsePayload);
+}
+
+// Options go in ascending order, each as the difference from the one before;
+// the delta and the length share a byte, with 13 and 14 meaning one or two
+// more bytes follow
+bool CoapClient::appendOption(size_t& length, uint16_t& previousNumber, uint16_t number, const uint8_t* value,
+    size_t valueLength) {
+    uint16_t delta = number - previousNumber;
+    if (length + 5 + valueLength > MAX_REQUEST) {
+        return false;
+    }
+    uint8_t& header = request[length++];
+    header = 0;
+    uint16_t fields[2] = { delta, (uint16_t)valueLength };
+    for (uint8_t i = 0; i < 2; i++) {
+        uint8_t nibble;
+        if (fields[i] < 13) {
+            nibble = fields[i];
+        } else if (fields[i] < 269) {
+            nibble = 13;
+            request[length++] = fields[i] - 13;
+        } else {
+            nibble = 14;
+            request[length++] = (fields[i] - 269) >> 8;
+            request[length++] = (fields[i] - 269) & 0xFF;
+        }
+        header |= i == 0 ? nibble << 4 : nibble;
+    }
+    memcpy(request + length, value, valueLength);
+    length += valueLength;
+    previousNumber = number;
+    return true;
+}
+
+// Returns the message length, or 0 if it does not fit
+size_t CoapClient::buildRequest(uint8_t method, uint16_t messageId, const uint8_t* token, const char* path,
+    const char* query, const String& payload) {
+    size_t length = 0;
+    request[length++] = 0x40 | (TYPE_CON << 4) | TOKEN_LENGTH;
+    request[length++] = method;
+    request[length++] = messageId >> 8;
+    request[length++] = messageId & 0xFF;
+    memcpy(request + length, token, TOKEN_LENGTH);
+    length += TOKEN_LENGTH;
+
+    // One Uri-Path option per segment, one Uri-Query per parameter
+    uint16_t previousNumber = 0;
+    const char* segment = path;
+    while (*segment) {
+        if (*segment == '/') {
+            segment++;
+            continue;
+        }
+        const char* end = strchr(segment, '/');
+        size_t segmentLength = end ? (size_t)(end - segment) : strlen(segment);
+        if (!appendOption(length, previousNumber, OPTION_URI_PATH, (const uint8_t*)segment, segmentLength)) {
+            return 0;
+        }
+        segment += segmentLength;
+    }
+    const uint8_t format = FORMAT_JSON;
+    if (payload.length() > 0 && !appendOption(length, previousNumber, OPTION_CONTENT_FORMAT, &format, 1)) {
+        return 0;
+    }
+    const char* parameter = query;
+    while (*parameter) {
+        const char* end = strchr(parameter, '&');
+        size_t parameterLength = end ? (size_t)(end - parameter) : strlen(parameter);
+        if (!appendOption(length, previousNumber, OPTION_URI_QUERY, (const uint8_t*)parameter, parameterLength)) {
+            return 0;
+        }
+        parameter += parameterLength + (end ? 1 : 0);
+    }
+
+    if (payload.length() > 0) {
+        if (length + 1 + payload.length() > MAX_REQUEST) {
+            return 0;
+        }
+        request[length++] = 0xFF;
+        memcpy(request + length, payload.c_str(), payload.length());
+        length += payload.length();
+    }
+    return length;
+}
+
+bool CoapClient::send(const IPAddress& server, const uint8_t* message, size_t length) {
+    if (!udp.beginPacket(server, PORT)) {
+        return false;
+    }
+    udp.write(message, length);
+    return udp.endPacket();
+}
+
+int CoapClient::exchange(uint8_t method, const char* path, const char* query, const String& payload,
+    String& responsePayload) {
+    responsePayload = "";
+    IPAddress server;
+    if (!serverEndpoint->getAddress(server)) {
+        return ERROR_NO_SERVER;
+    }
+    if (!started) {
+        if (!udp.begin(49152 + random(16384))) {
+            return ERROR_NO_SERVER;
+        }
+        started = true;
+        nextMessageId = (uint16_t)random(0x10000);
+    }
+
+    uint16_t messageId = nextMessageId++;
+    uint8_t token[TOKEN_LENGTH];
+    for (uint8_t i = 0; i < TOKEN_LENGTH; i++) {
+        token[i] = (uint8_t)random(256);
+    }
+    size_t length = buildRequest(method, messageId, token, path, query, payload);
+    if (length == 0) {
+        Serial.print("CoAP request too large for ");
+        Serial.println(path);
+        return ERROR_TOO_LARGE;
+    }
+
+    unsigned long startedAt = millis();
+    // ACK_RANDOM_FACTOR 1.5 spreads out devices that lost the same datagram
+    unsigned long timeoutMs = ACK_TIMEOUT_MS + random(ACK_TIMEOUT_MS / 2);
+    bool acknowledged = false;
+    uint8_t attempt = 0;
+    while (true) {
+        if (!acknowledged) {
+            send(server, request, length);
+        }
+        unsigned long sentAt = millis();
+        if (!acknowledged && sentAt - startedAt + timeoutMs > MAX_WAIT_MS) {
+            timeoutMs = sentAt - startedAt < MAX_WAIT_MS ? MAX_WAIT_MS - (sentAt - startedAt) : 0;
+        }
+        while (millis() - sentAt < timeoutMs) {
+            // One byte kept back to terminate the payload
+            int received = udp.parsePacket() > 0 ? udp.read(response, sizeof(response) - 1) : 0;
+            if (received < 4 || (response[0] >> 6) != 1) {
+                delay(2);
+                continue;
+            }
+            uint8_t type = (response[0] >> 4) & 0x03;
+            uint8_t tokenLength = response[0] & 0x0F;
+            uint8_t code = response[1];
+            uint16_t receivedId = (response[2] << 8) | response[3];
+
+            if ((type == TYPE_ACK || type == TYPE_RST) && receivedId == messageId) {
+                if (type == TYPE_RST) {
+                    return ERROR_RESET;
+                }
+                if (code == 0) {
+                    // The server has the request and answers separately
+                    acknowledged = true;
+                    timeoutMs = SEPARATE_RESPONSE_MS;
+                    sentAt = millis();
+                    continue;
+                }
+            } else if (type != TYPE_CON && type != TYPE_NON) {
+                continue;
+            }
+            if (tokenLength != TOKEN_LENGTH || received < 4 + TOKEN_LENGTH ||
+                memcmp(response + 4, token, TOKEN_LENGTH) != 0 || (code >> 5) < 2) {
+                continue;
+            }
+            if (type == TYPE_CON) {
+                // A separate response wants its own acknowledgement
+                uint8_t ack[4] = { (uint8_t)(0x40 | (TYPE_ACK << 4)), 0, response[2], response[3] };
+                send(server, ack, sizeof(ack));
+            }
+
+            // Skip the options to the payload marker
+            int position = 4 + TOKEN_LENGTH;
+            while (position < received && response[position] != 0xFF) {
+                uint8_t header = response[position++];
+                uint16_t fields[2] = { (uint16_t)(header >> 4), (uint16_t)(header & 0x0F) };
+                for (uint8_t i = 0; i < 2; i++) {
+                    if (fields[i] == 13 && position < received) {
+                        fields[i] = response[position++] + 13;
+                    } else if (fields[i] == 14 && position + 1 < received) {
+                        fields[i] = ((response[position] << 8) | response[position + 1]) + 269;
+                        position += 2;
+                    }
+                }
+                position += fields[1];
+            }
+            if (position < received) {
+                response[received] = '\0';
+                responsePayload = (const char*)response + position + 1;
+            }
+
+            int result = (code >> 5) * 100 + (code & 0x1F);
+            Serial.print("CoAP ");
+            Serial.print(path);
+            Serial.print(": ");
+            Serial.print(result);
+            Serial.print(" in ");
+            Serial.print(millis() - startedAt);
+            Serial.print("ms, ");
+            Serial.print(attempt + 1);
+            Serial.println(attempt == 0 ? " try" : " tries");
+            return result;
+        }
+
+        if (acknowledged || attempt >= MAX_RETRANSMIT || millis() - startedAt >= MAX_WAIT_MS) {
+            break;
+        }
+        attempt++;
+        timeoutMs *= 2;
+    }
+
+    Serial.print("CoAP ");
+    Serial.print(path);
+    Serial.print(": no response after ");
+    Serial.print(millis() - startedAt);
+    Serial.println("ms");
+    return ERROR_TIMEOUT;
+}
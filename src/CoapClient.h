@@ -0,0 +1,72 @@
+#ifndef COAP_CLIENT_H
+#define COAP_CLIENT_H
+
+#include "platform_config.h"
+#include <WiFiUdp.h>
+
+class ServerEndpoint;
+
+// Just enough CoAP (RFC 7252) for the requests every wake makes: sending
+// readings and asking whether to stay awake. Each is one confirmable datagram
+// that the server answers in its acknowledgement, where HTTP needs a TCP
+// handshake, headers both ways and a close.
+//
+// A request that goes unanswered is sent again after 1-1.5 s, then after
+// twice that, up to three times. The retransmission keeps its message ID, so
+// the server answers it from its cache instead of handling it again. Unlike
+// RFC 7252's 45 s, the whole exchange gives up after MAX_WAIT_MS: a port the
+// firewall drops would otherwise hold every wake for 22 s before HTTP.
+class CoapClient {
+public:
+    static const uint16_t PORT = 5683;
+
+    // Results that are not a response code. Response codes come back as
+    // class * 100 + detail, like HTTP status codes: 2.05 Content is 205.
+    static const int ERROR_NO_SERVER = -1;
+    static const int ERROR_TOO_LARGE = -2;
+    static const int ERROR_TIMEOUT = -3;
+    static const int ERROR_RESET = -4;      // The server could not read the request
+
+private:
+    static const uint32_t ACK_TIMEOUT_MS = 1000;
+    static const uint8_t MAX_RETRANSMIT = 3;
+    static const uint32_t MAX_WAIT_MS = 4000;           // Until acknowledged
+    static const uint32_t SEPARATE_RESPONSE_MS = 2000; // After an empty ACK
+    static const uint8_t TOKEN_LENGTH = 4;
+    static const size_t MAX_REQUEST = 1024;
+    static const size_t MAX_RESPONSE = 256;
+
+    static const uint8_t TYPE_CON = 0;
+    static const uint8_t TYPE_NON = 1;
+    static const uint8_t TYPE_ACK = 2;
+    static const uint8_t TYPE_RST = 3;
+    static const uint8_t CODE_GET = 0x01;
+    static const uint8_t CODE_POST = 0x02;
+    static const uint16_t OPTION_URI_PATH = 11;
+    static const uint16_t OPTION_CONTENT_FORMAT = 12;
+    static const uint16_t OPTION_URI_QUERY = 15;
+    static const uint8_t FORMAT_JSON = 50;
+
+    ServerEndpoint* serverEndpoint;
+    WiFiUDP udp;
+    bool started;
+    uint16_t nextMessageId;
+    uint8_t request[MAX_REQUEST];
+    uint8_t response[MAX_RESPONSE];
+
+    size_t buildRequest(uint8_t method, uint16_t messageId, const uint8_t* token, const char* path,
+        const char* query, const String& payload);
+    bool appendOption(size_t& length, uint16_t& previousNumber, uint16_t number, const uint8_t* value,
+        size_t valueLength);
+    bool send(const IPAddress& server, const uint8_t* message, size_t length);
+    int exchange(uint8_t method, const char* path, const char* query, const String& payload, String& responsePayload);
+
+public:
+    CoapClient(ServerEndpoint* endpoint);
+
+    // path starts with '/'; query is without the '?', may be empty
+    int get(const char* path, const String& query, String& responsePayload);
+    int post(const char* path, const String& json, String& responsePayload);
+};
+
+#endif
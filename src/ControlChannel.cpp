@@ -0,0 +1,271 @@
+#include "ControlChannel.h"
+#include "ServerEndpoint.h"
+
+ControlChannel::ControlChannel(ServerEndpoint* endpoint) :
+    serverEndpoint(endpoint), open(false), retryAt(0), retryMs(RETRY_MS), incomingLength(0) {
+}
+
+bool ControlChannel::connect(const String& serialNumber) {
+    if (open) {
+        return true;
+    }
+    if ((long)(millis() - retryAt) < 0 || !serverEndpoint->isConfigured()) {
+        return false;
+    }
+    if (serverEndpoint->isHttps()) {
+        // No wss:// client; HTTPS servers keep polling
+        retryAt = millis() + MAX_RETRY_MS;
+        return false;
+    }
+
+    unsigned long startedAt = millis();
+    if (!serverEndpoint->connectClient(client)) {
+        failed("no connection");
+        return false;
+    }
+    // Commands are small and latency is the point
+    client.setNoDelay(true);
+    if (!sendHandshake(serialNumber) || !readHandshake()) {
+        client.stop();
+        failed("server did not upgrade");
+        return false;
+    }
+
+    open = true;
+    incomingLength = 0;
+    retryMs = RETRY_MS;
+    Serial.print("Control channel open in ");
+    Serial.print(millis() - startedAt);
+    Serial.println("ms");
+    return true;
+}
+
+void ControlChannel::failed(const char* reason) {
+    Serial.print("Control channel: ");
+    Serial.print(reason);
+    Serial.print(", trying again in ");
+    Serial.print(retryMs / 1000);
+    Serial.println("s");
+    retryAt = millis() + retryMs;
+    retryMs = retryMs * 2 > MAX_RETRY_MS ? MAX_RETRY_MS : retryMs * 2;
+}
+
+bool ControlChannel::sendHandshake(const String& serialNumber) {
+    static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    // Sec-WebSocket-Key: 16 random bytes, base64
+    uint8_t nonce[18];
+    for (uint8_t i = 0; i < 16; i++) {
+        nonce[i] = (uint8_t)random(256);
+    }
+    nonce[16] = nonce[17] = 0;
+    char key[25];
+    for (uint8_t i = 0, j = 0; i < 18; i += 3) {
+        uint32_t triple = ((uint32_t)nonce[i] << 16) | (nonce[i + 1] << 8) | nonce[i + 2];
+        key[j++] = base64[(triple >> 18) & 0x3F];
+        key[j++] = base64[(triple >> 12) & 0x3F];
+        key[j++] = base64[(triple >> 6) & 0x3F];
+        key[j++] = base64[triple & 0x3F];
+    }
+    key[22] = key[23] = '=';
+    key[24] = '\0';
+
+    String request;
+    request.reserve(256);
+    request += "GET ";
+    request += serverEndpoint->getPathPrefix();
+    request += "/device-ws?id=";
+    request += serialNumber;
+    request += " HTTP/1.1\r\nHost: ";
+    request += serverEndpoint->getHost();
+    if (serverEndpoint->getPort() != 80) {
+        request += ':';
+        request += serverEndpoint->getPort();
+    }
+    request += "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: ";
+    request += key;
+    request += "\r\n\r\n";
+    return client.write((const uint8_t*)request.c_str(), request.length()) == request.length();
+}
+
+// The status line has to be 101; the server is our own, so the accept hash
+// is not checked
+bool ControlChannel::readHandshake() {
+    char statusLine[16];
+    size_t lineLength = 0;
+    bool firstLine = true;
+    bool upgraded = false;
+    unsigned long startedAt = millis();
+    while (millis() - startedAt < HANDSHAKE_TIMEOUT_MS) {
+        if (client.available() <= 0) {
+            if (!client.connected()) {
+                return false;
+            }
+            delay(5);
+            continue;
+        }
+        int c = client.read();
+        if (c == '\n') {
+            if (lineLength == 0) {
+                // The blank line after the headers
+                return upgraded;
+            }
+            if (firstLine) {
+                statusLine[lineLength < sizeof(statusLine) ? lineLength : sizeof(statusLine) - 1] = '\0';
+                upgraded = strncmp(statusLine, "HTTP/1.1 101", 12) == 0;
+                firstLine = false;
+            }
+            lineLength = 0;
+        } else if (c != '\r') {
+            if (lineLength < sizeof(statusLine)) {
+                statusLine[lineLength] = (char)c;
+            }
+            lineLength++;
+        }
+    }
+    return false;
+}
+
+bool ControlChannel::poll(String& message) {
+    if (!open) {
+        return false;
+    }
+    if (!client.connected()) {
+        open = false;
+        failed("server went away");
+        return false;
+    }
+
+    int available = client.available();
+    if (available > 0 && incomingLength < sizeof(incoming)) {
+        size_t room = sizeof(incoming) - incomingLength;
+        int received = client.read(incoming + incomingLength, (size_t)available < room ? (size_t)available : room);
+        if (received > 0) {
+            incomingLength += received;
+        }
+    }
+
+    while (incomingLength >= 2) {
+        uint8_t opcode = incoming[0] & 0x0F;
+        bool masked = incoming[1] & 0x80;
+        size_t length = incoming[1] & 0x7F;
+        size_t headerLength = 2;
+        if (length == 126) {
+            if (incomingLength < 4) {
+                return false;
+            }
+            length = (incoming[2] << 8) | incoming[3];
+            headerLength = 4;
+        } else if (length == 127) {
+            length = MAX_MESSAGE + 1;
+        }
+        if (masked) {
+            headerLength += 4;
+        }
+        if (length > MAX_MESSAGE || !(incoming[0] & 0x80)) {
+            Serial.println("Control channel message too large or fragmented");
+            close();
+            return false;
+        }
+        if (incomingLength < headerLength + length) {
+            return false;
+        }
+
+        uint8_t* payload = incoming + headerLength;
+        if (masked) {
+            // Servers do not mask, but undo it if one does
+            for (size_t i = 0; i < length; i++) {
+                payload[i] ^= incoming[headerLength - 4 + i % 4];
+            }
+        }
+
+        bool isText = false;
+        if (opcode == OPCODE_TEXT) {
+            // Terminated in place for the String, then put back
+            uint8_t following = payload[length];
+            payload[length] = '\0';
+            message = (const char*)payload;
+            payload[length] = following;
+            isText = true;
+        } else if (opcode == OPCODE_PING) {
+            writeFrame(OPCODE_PONG, payload, length);
+        } else if (opcode == OPCODE_CLOSE) {
+            Serial.println("Server closed the control channel");
+            writeFrame(OPCODE_CLOSE, payload, length < 2 ? length : 2);
+            client.stop();
+            open = false;
+            failed("closed by server");
+            return false;
+        }
+
+        size_t frameLength = headerLength + length;
+        memmove(incoming, incoming + frameLength, incomingLength - frameLength);
+        incomingLength -= frameLength;
+        if (isText) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ControlChannel::send(const String& text) {
+    if (!open) {
+        return false;
+    }
+    if (!writeFrame(OPCODE_TEXT, (const uint8_t*)text.c_str(), text.length())) {
+        client.stop();
+        open = false;
+        failed("send failed");
+        return false;
+    }
+    return true;
+}
+
+// Client frames are masked with a fresh key each
+bool ControlChannel::writeFrame(uint8_t opcode, const uint8_t* payload, size_t length) {
+    if (length > 0xFFFF) {
+        return false;
+    }
+    uint8_t chunk[256];
+    size_t chunkLength = 0;
+    chunk[chunkLength++] = 0x80 | opcode;
+    if (length < 126) {
+        chunk[chunkLength++] = 0x80 | length;
+    } else {
+        chunk[chunkLength++] = 0x80 | 126;
+        chunk[chunkLength++] = length >> 8;
+        chunk[chunkLength++] = length & 0xFF;
+    }
+    uint8_t mask[4];
+    for (uint8_t i = 0; i < 4; i++) {
+        mask[i] = (uint8_t)random(256);
+        chunk[chunkLength++] = mask[i];
+    }
+
+    // Header and payload go out together when they fit in one chunk
+    for (size_t i = 0; i < length; i++) {
+        chunk[chunkLength++] = payload[i] ^ mask[i % 4];
+        if (chunkLength == sizeof(chunk)) {
+            if (client.write(chunk, chunkLength) != chunkLength) {
+                return false;
+            }
+            chunkLength = 0;
+        }
+    }
+    if (chunkLength > 0 && client.write(chunk, chunkLength) != chunkLength) {
+        return false;
+    }
+    return true;
+}
+
+void ControlChannel::close() {
+    if (!open) {
+        return;
+    }
+    const uint8_t normalClosure[2] = { 1000 >> 8, 1000 & 0xFF };
+    writeFrame(OPCODE_CLOSE, normalClosure, sizeof(normalClosure));
+    client.stop();
+    open = false;
+    retryAt = millis();
+    Serial.println("Control channel closed");
+}
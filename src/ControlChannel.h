@@ -0,0 +1,58 @@
+#ifndef CONTROL_CHANNEL_H
+#define CONTROL_CHANNEL_H
+
+#include "platform_config.h"
+#include <WiFiClient.h>
+
+class ServerEndpoint;
+
+// A WebSocket (RFC 6455) the device opens to the server while it stays
+// awake. The server pushes commands and stay-awake changes down it as they
+// happen, so it never has to reach the device by its IP address, and the
+// device sends live readings and command results back up. Messages are single
+// JSON text frames; fragmented frames are not used by either side.
+//
+// Plain ws:// only, alongside an http:// server URL. There is no wss:// client:
+// with an https:// server the channel stays closed and the device polls.
+class ControlChannel {
+private:
+    static const uint32_t HANDSHAKE_TIMEOUT_MS = 3000;
+    static const uint32_t RETRY_MS = 30000;         // Doubles per failed attempt
+    static const uint32_t MAX_RETRY_MS = 300000;
+    static const size_t MAX_MESSAGE = 1024;         // Fits a full RGB sequence command
+
+    static const uint8_t OPCODE_TEXT = 0x1;
+    static const uint8_t OPCODE_CLOSE = 0x8;
+    static const uint8_t OPCODE_PING = 0x9;
+    static const uint8_t OPCODE_PONG = 0xA;
+
+    ServerEndpoint* serverEndpoint;
+    WiFiClient client;
+    bool open;
+    unsigned long retryAt;
+    unsigned long retryMs;
+    uint8_t incoming[MAX_MESSAGE + 9];  // Frame header, payload and room for a terminator
+    size_t incomingLength;
+
+    bool sendHandshake(const String& serialNumber);
+    bool readHandshake();
+    bool writeFrame(uint8_t opcode, const uint8_t* payload, size_t length);
+    void failed(const char* reason);
+
+public:
+    ControlChannel(ServerEndpoint* endpoint);
+
+    // Opens the channel unless a recent attempt failed. Returns whether it is open.
+    bool connect(const String& serialNumber);
+    bool isOpen() const { return open; }
+
+    // Next text message from the server, answering pings and closes on the way
+    bool poll(String& message);
+    bool hasData() { return open && client.available() > 0; }
+    bool send(const String& text);
+
+    // Closes with status 1000, as before deep sleep
+    void close();
+};
+
+#endif
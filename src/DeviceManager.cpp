@@ -2,6 +2,21 @@
 #include "EEPROMManager.h"
 #include "SensorManager.h"
 #include "WiFiManager.h"
+#include "RTCMemoryManager.h"
+#include "TimeSyncManager.h"
+#include "CadenceScheduler.h"
+#include "ValveController.h"
+#include "RuleEngine.h"
+#include "FirmwareUpdater.h"
+#include "EnergyMonitor.h"
+#include "InputSwitch.h"
+#include "ServoController.h"
+#include "RgbController.h"
+#include "ServerEndpoint.h"
+#include "PresenceBeacon.h"
+#include "CoapClient.h"
+#include "ControlChannel.h"
+#include "version.h"
 #include <WiFiClient.h>
 
 #ifdef ESP8266_PLATFORM
@@ -20,13 +35,42 @@ void tcpCleanup() {
 }
 #endif
 
-DeviceManager::DeviceManager(EEPROMManager* eeprom, SensorManager* sensor, WiFiManager* wifi) :
-    eepromManager(eeprom), sensorManager(sensor), wifiManager(wifi), deviceId(0), operatingMode(0),
-    stayAwake(false), timeAtLastSend(0), timeAtLastCheck(0), serverTimestamp(0),
-    localTimeAtSync(0), sleepDurationMs(SLEEP_DURATION_MS), timeIsSynchronized(false) {
+DeviceManager::DeviceManager(EEPROMManager* eeprom, SensorManager* sensor, WiFiManager* wifi, RTCMemoryManager* rtc) :
+    eepromManager(eeprom), sensorManager(sensor), wifiManager(wifi), rtcMemoryManager(rtc), deviceId(0),
+    operatingMode(0), stayAwake(false), timeAtLastSend(0), timeAtLastCheck(0),
+    switchReportFailed(false), switchReportFailedAt(0),
+    awakeLatencyMs(EEPROMManager::DEFAULT_AWAKE_LATENCY_MS), powerSaveIntervals(-1), powerSaveLightSleep(false),
+    transport(EEPROMManager::TRANSPORT_HTTP) {
+    timeSyncManager = new TimeSyncManager(rtcMemoryManager);
+    cadenceScheduler = new CadenceScheduler(rtcMemoryManager, timeSyncManager, SLEEP_DURATION_MS);
+    // H-bridge: AUX drives the opening side, SENSE_POWER the closing side
+    valveController = new ValveController(eepromManager, rtcMemoryManager, timeSyncManager, AUX_PIN, SENSE_POWER_PIN);
+    ruleEngine = new RuleEngine(eepromManager, rtcMemoryManager, timeSyncManager);
+    firmwareUpdater = new FirmwareUpdater(rtcMemoryManager);
+    energyMonitor = new EnergyMonitor(rtcMemoryManager);
+    inputSwitch = new InputSwitch(rtcMemoryManager, timeSyncManager, SWITCH_PIN);
+    servoController = new ServoController(rtcMemoryManager, AUX_PIN);
+    rgbController = new RgbController(AUX_PIN, SENSE_POWER_PIN, BLUE_PIN);
+    serverEndpoint = new ServerEndpoint(rtcMemoryManager, timeSyncManager);
+    presenceBeacon = new PresenceBeacon();
+    coapClient = new CoapClient(serverEndpoint);
+    controlChannel = new ControlChannel(serverEndpoint);
 }
 
 DeviceManager::~DeviceManager() {
+    delete controlChannel;
+    delete coapClient;
+    delete presenceBeacon;
+    delete serverEndpoint;
+    delete rgbController;
+    delete servoController;
+    delete inputSwitch;
+    delete energyMonitor;
+    delete firmwareUpdater;
+    delete ruleEngine;
+    delete valveController;
+    delete cadenceScheduler;
+    delete timeSyncManager;
 }
 
 void DeviceManager::init() {
@@ -36,6 +80,108 @@ void DeviceManager::init() {
     operatingMode = eepromManager->getMode();
     Serial.print("Loaded in mode ");
     Serial.println(operatingMode);
+    applyServerSettings();
+    
+    if (hasOutput()) {
+        ruleEngine->begin();
+    }
+    if (operatingMode == MODE_INPUT_SWITCH) {
+        cadenceScheduler->setPeriodMs(SWITCH_HEARTBEAT_MS);
+    }
+}
+
+// Everything about reaching the server, from EEPROM. At boot and again
+// whenever /api/config changes it.
+void DeviceManager::applyServerSettings() {
+    awakeLatencyMs = eepromManager->getAwakeLatencyMs();
+    TlsPin tlsPin;
+    eepromManager->getTlsPin(tlsPin);
+    serverEndpoint->setTlsPin(tlsPin);
+    if (eepromManager->hasServerUrl()) {
+        serverEndpoint->begin(eepromManager->getServerUrl());
+    }
+    transport = eepromManager->getTransport();
+    if (transport == EEPROMManager::TRANSPORT_COAP) {
+        uint16_t skipWakes = rtcMemoryManager->getState().transport.coapSkipWakes;
+        if (skipWakes > 0) {
+            Serial.print("CoAP went unanswered recently - using HTTP for ");
+            Serial.print(skipWakes);
+            Serial.println(" more wake(s)");
+            transport = EEPROMManager::TRANSPORT_HTTP;
+        } else {
+            Serial.println("Sending readings over CoAP");
+        }
+    }
+    // It may be open to the old server; it reopens on the next loop
+    controlChannel->close();
+}
+
+// A mode saved while running: the old mode lets go of its pins and timers and
+// the new one starts the way it would at boot
+void DeviceManager::applyMode() {
+    int mode = eepromManager->getMode();
+    if (mode == operatingMode) {
+        return;
+    }
+    Serial.print("Switching from mode ");
+    Serial.print(operatingMode);
+    Serial.print(" to mode ");
+    Serial.println(mode);
+    
+    stopMode();
+    operatingMode = mode;
+    cadenceScheduler->setPeriodMs(operatingMode == MODE_INPUT_SWITCH ? SWITCH_HEARTBEAT_MS : SLEEP_DURATION_MS);
+    if (hasOutput()) {
+        ruleEngine->begin();
+    }
+    initProbes();
+    initInputSwitch();
+    initValve(false);
+    initServo(false);
+    initRgb();
+}
+
+void DeviceManager::stopMode() {
+    if (operatingMode == MODE_SERVO) {
+        finishServoMotion();
+    } else if (operatingMode == MODE_INPUT_SWITCH) {
+        inputSwitch->end();
+    } else if (operatingMode == MODE_RELAY) {
+        setOutput(false);
+    } else if (operatingMode == MODE_RGB_LED) {
+        rgbController->end();
+    } else if (operatingMode == MODE_LATCHING_VALVE) {
+        // Closed, so no other mode leaves water running it knows nothing about.
+        // Only the closing pulse is waited for: a due schedule event must not
+        // reopen the valve on the way out of valve mode.
+        if (valveController->getState() == ValveController::STATE_OPEN) {
+            setValveState(false);
+        }
+        valveController->finishPulse();
+    }
+}
+
+bool DeviceManager::reconnectWiFi() {
+    if (wifiManager->reconnect(eepromManager->getSSID(), eepromManager->getPassword())) {
+        return true;
+    }
+    digitalWrite(GREEN_PIN, HIGH);
+    stayAwake = true;
+    return false;
+}
+
+// Everything a boot does with the server once WiFi is up
+void DeviceManager::contactServer() {
+    announcePresence();
+    sendFailureLogToServer();
+    registerWithServer();
+    syncTimeIfNeeded();
+    reportSwitchEvents();
+    fetchValveSchedule();
+    fetchRules();
+    reportRuleFirings();
+    // Last, so everything above has reached the server before a restart
+    applyFirmwareUpdate();
 }
 
 void DeviceManager::initPins() {
@@ -225,25 +371,56 @@ void DeviceManager::printDebugInfo() {
 
 void DeviceManager::askServerIfShouldStayUp() {
     timeAtLastCheck = millis();
+    // Each check-in carries the output, so the server knows what a rule or a
+    // local request did to it before deciding whether a command is needed
+    if (controlChannel->isOpen()) {
+        // The server answers with a stay-awake message, and pushes any change
+        // before the next heartbeat on its own
+        if (!hasOutput()) {
+            controlChannel->send("{\"type\":\"heartbeat\"}");
+        } else {
+            controlChannel->send(isOutputOn() ? "{\"type\":\"heartbeat\",\"outputOn\":true}" :
+                "{\"type\":\"heartbeat\",\"outputOn\":false}");
+        }
+        return;
+    }
     Serial.println("Asking service if should stay up");
-    String url = eepromManager->getServerUrl();
+    String query = "id=";
+    query += serialNumber;
+    if (hasOutput()) {
+        query += isOutputOn() ? "&output=1" : "&output=0";
+    }
+    String payload;
+    if (transport == EEPROMManager::TRANSPORT_COAP) {
+        int coapCode = coapClient->get("/should-remain-awake", query, payload);
+        if (coapCode < 0) {
+            fallBackToHttp(coapCode);
+        } else if (coapCode != 205) {
+            Serial.println("Failed to get a response");
+            stayAwake = false;
+            return;
+        }
+    }
 
-    url += "/should-remain-awake?id=";
-    url += serialNumber;
-    
-    PlatformUtils::beginHTTPClient(httpClient, url);
+    if (transport == EEPROMManager::TRANSPORT_HTTP) {
+        String path = "/should-remain-awake?";
+        path += query;
+        serverEndpoint->open(httpClient, path);
 
-    int httpCode = httpClient.GET();
-    if (httpCode != 200) {
-        Serial.println("Failed to get a response");
-        stayAwake = false;
-        return;
-    }
+        int httpCode = httpClient.GET();
+        if (httpCode != 200) {
+            Serial.println("Failed to get a response");
+            stayAwake = false;
+            return;
+        }
 
-    Serial.print("Got status code: ");
-    Serial.println(httpCode);
+        Serial.print("Got status code: ");
+        Serial.println(httpCode);
+
+        payload = httpClient.getString();
+        httpClient.end();
+    }
 
-    String payload = httpClient.getString();
     Serial.println("Got payload: " + payload);
     if (payload == "1") {
         stayAwake = true;
@@ -251,8 +428,19 @@ void DeviceManager::askServerIfShouldStayUp() {
     if (payload == "0") {
         stayAwake = false;
     }
+}
 
-    httpClient.end();
+// The server may not run a CoAP listener, or a firewall may drop it; HTTP
+// carries on for the rest of the wake and CoAP gets another go next wake
+void DeviceManager::fallBackToHttp(int coapError) {
+    transport = EEPROMManager::TRANSPORT_HTTP;
+    if (coapError != CoapClient::ERROR_TIMEOUT) {
+        Serial.println("CoAP request failed - using HTTP for the rest of this wake");
+        return;
+    }
+    // Most likely a firewall dropping the port, which the next wake would wait out too
+    Serial.println("No answer over CoAP - using HTTP for this wake and the next ones");
+    rtcMemoryManager->getState().transport.coapSkipWakes = COAP_RETRY_WAKES;
 }
 
 void DeviceManager::enterDeepSleep() {
@@ -260,43 +448,137 @@ void DeviceManager::enterDeepSleep() {
     Serial.print(millis());
     Serial.println(" milliseconds");
     
-    // Store sleep duration for time tracking
-    sleepDurationMs = SLEEP_DURATION_MS;
+    // A clean close, so the server routes commands back over HTTP at once
+    controlChannel->close();
+    
+    uint64_t wakeByMs = 0;
+    if (operatingMode == MODE_LATCHING_VALVE) {
+        finishValveActivity();
+        wakeByMs = valveController->getNextEventTime();
+    }
+    if (operatingMode == MODE_INPUT_SWITCH) {
+        inputSwitch->prepareForSleep();
+    }
+    if (operatingMode == MODE_SERVO) {
+        finishServoMotion();
+    }
+    
+    // A latched valve held open by a rule has to be closed on time
+    uint64_t ruleDeadlineMs = ruleEngine->getNextDeadline();
+    if (ruleDeadlineMs != 0 && (wakeByMs == 0 || ruleDeadlineMs < wakeByMs)) {
+        wakeByMs = ruleDeadlineMs;
+    }
+    
+    // Sleep until the next slot on the sampling grid (or event), not a fixed duration
+    uint32_t sleepMs = cadenceScheduler->planSleep(wakeByMs);
+    energyMonitor->recordCycle(millis(), wifiManager->getRadioOnMs(), sensorManager->getPoweredMs(), sleepMs);
+    
+    // Counts this wake off the CoAP fallback
+    uint16_t& coapSkipWakes = rtcMemoryManager->getState().transport.coapSkipWakes;
+    if (coapSkipWakes > 0) {
+        coapSkipWakes--;
+    }
+    
+    // Carry the clock, grid position and server address across sleep in RTC memory
+    serverEndpoint->prepareForSleep();
+    timeSyncManager->prepareForSleep(sleepMs);
+    rtcMemoryManager->save();
     Serial.print("Entering deep sleep for ");
-    Serial.print(sleepDurationMs);
+    Serial.print(sleepMs);
     Serial.println(" milliseconds");
     
     Serial.println("Sleeping...");
-    PlatformUtils::deepSleep(SLEEP_DURATION_US);
+    PlatformUtils::deepSleep((uint64_t)sleepMs * 1000);
+}
+
+void DeviceManager::announcePresence() {
+    // Holds an alias and a server URL of the longest EEPROM keeps
+    DynamicJsonDocument presenceDoc(PresenceBeacon::DOCUMENT_SIZE);
+    presenceDoc["omni"] = 1;    // Announcement format version
+    presenceDoc["id"] = serialNumber;
+    presenceDoc["alias"] = eepromManager->getAlias();
+    presenceDoc["ipAddress"] = WiFi.localIP().toString();
+    presenceDoc["macAddress"] = WiFi.macAddress();
+    presenceDoc["mode"] = operatingMode;
+    presenceDoc["firmwareVersion"] = FIRMWARE_VERSION;
+    presenceDoc["buildNumber"] = FIRMWARE_BUILD_NUMBER;
+    presenceDoc["platform"] = PLATFORM_NAME;
+    presenceDoc["serverUrl"] = serverEndpoint->getBaseUrl();
+    presenceDoc["awake"] = stayAwake;
+    // Seconds until the next announcement: the next wake, or the repeat while awake
+    presenceDoc["interval"] = (stayAwake ? PresenceBeacon::REPEAT_MS : cadenceScheduler->getPeriodMs()) / 1000;
+    presenceBeacon->announce(presenceDoc);
 }
 
 void DeviceManager::registerWithServer() {
-    PlatformUtils::beginHTTPClient(httpClient, eepromManager->getServerUrl() + "/register");
-    StaticJsonDocument<200> registrationDoc;
+    serverEndpoint->open(httpClient, "/register");
+    StaticJsonDocument<512> registrationDoc;
     registrationDoc["id"] = serialNumber;
     registrationDoc["alias"] = eepromManager->getAlias();
     registrationDoc["ipAddress"] = WiFi.localIP().toString();
     registrationDoc["macAddress"] = WiFi.macAddress();
     registrationDoc["mode"] = operatingMode;
+    registrationDoc["firmwareVersion"] = FIRMWARE_VERSION;
+    registrationDoc["buildNumber"] = FIRMWARE_BUILD_NUMBER;
+    registrationDoc["platform"] = PLATFORM_NAME;
+    registrationDoc["missedSlots"] = cadenceScheduler->getMissedSlots();
+    if (operatingMode == MODE_LATCHING_VALVE && valveController->getState() != ValveController::STATE_UNKNOWN) {
+        registrationDoc["valveOpen"] = valveController->getState() == ValveController::STATE_OPEN;
+        registrationDoc["valveEventAt"] = (unsigned long long)valveController->getLastEventAt() * 1000;
+    }
+    // Lets the server skip commands for a state the output is already in
+    if (hasOutput() && (operatingMode != MODE_LATCHING_VALVE || valveController->getState() != ValveController::STATE_UNKNOWN)) {
+        registrationDoc["outputOn"] = isOutputOn();
+    }
+    if (operatingMode == MODE_INPUT_SWITCH) {
+        registrationDoc["switchClosed"] = inputSwitch->isClosed();
+    }
+    if (operatingMode == MODE_SERVO && servoController->isPositionKnown()) {
+        addServoStatus(registrationDoc.createNestedObject("servo"));
+    }
+    if (operatingMode == MODE_RGB_LED) {
+        addRgbStatus(registrationDoc.createNestedObject("rgb"));
+    }
+    // The cycle that ended with the last deep sleep; this one is still running
+    if (energyMonitor->hasLastCycle()) {
+        const EnergyState& cycle = energyMonitor->getLastCycle();
+        JsonObject energy = registrationDoc.createNestedObject("energy");
+        energy["awakeMs"] = cycle.awakeMs;
+        energy["radioMs"] = cycle.radioMs;
+        energy["sensorMs"] = cycle.sensorMs;
+        energy["sleepMs"] = cycle.sleepMs;
+        energy["mAhPerCycle"] = EnergyMonitor::chargePerCycleMah(cycle, EnergyMonitor::PROFILE);
+        energy["batteryDays"] = EnergyMonitor::batteryDays(cycle, EnergyMonitor::PROFILE);
+    }
     String registrationDocJson = "";
     serializeJson(registrationDoc, registrationDocJson);
     Serial.println("Sending: ");
     Serial.println(registrationDocJson);
     httpClient.addHeader("Content-Type", "application/json");
+    unsigned long requestSentAt = timeSyncManager->beginExchange();
     int httpCode = httpClient.POST(registrationDocJson);
     if (httpCode > 0) {
+        // Registration doubles as a time exchange, but only when the clock needs it
+        // so the drift estimate gets long baselines
+        bool wantTime = timeSyncManager->needsSync();
         Serial.println("Response: ");
         String payload = httpClient.getString();
         Serial.println(payload);
         
-        // Parse response to extract timestamp for time synchronization
         if (httpCode == 200) {
-            StaticJsonDocument<200> responseDoc;
+            StaticJsonDocument<384> responseDoc;
             DeserializationError error = deserializeJson(responseDoc, payload);
-            if (!error && responseDoc.containsKey("timestamp")) {
-                unsigned long long serverTime = responseDoc["timestamp"];
-                syncTimeWithServer(serverTime);
-                Serial.println("Time synchronized with server");
+            if (!error) {
+                if (wantTime) {
+                    applyServerTime(responseDoc, requestSentAt);
+                }
+                // Present only when the rollout has picked this device
+                JsonObject firmware = responseDoc["firmware"];
+                if (!firmware.isNull()) {
+                    String version = firmware["version"] | "";
+                    String path = firmware["path"] | "";
+                    firmwareUpdater->offer(firmware["build"] | 0, version, path);
+                }
             }
         }
     } else {
@@ -317,7 +599,7 @@ void DeviceManager::sendFailureLogToServer() {
     Serial.println("Sending WiFi failure log to server");
     Serial.println("Failure log: " + failureLog);
     
-    PlatformUtils::beginHTTPClient(httpClient, eepromManager->getServerUrl() + "/wifi-failures");
+    serverEndpoint->open(httpClient, "/wifi-failures");
     
     StaticJsonDocument<1024> failureDoc;
     failureDoc["id"] = serialNumber;
@@ -356,28 +638,115 @@ void DeviceManager::reportNow() {
     Serial.println("Reporting sensor data");
     
     // Show current time if synchronized
-    if (timeIsSynchronized) {
+    if (isTimeSynchronized()) {
         Serial.print("Current time: ");
         Serial.println(getCurrentTimeString());
     }
     
+    // Room for a reading from every probe, each with its ROM ID
+    StaticJsonDocument<1024> readingDoc;
+    readingDoc["id"] = serialNumber;
+    JsonArray readings = readingDoc.createNestedArray("readings");
+    
     if (operatingMode == MODE_THERMOMETER) {
         Serial.println("Reading temperature");
-        float temperature = sensorManager->readTemperature();
-        Serial.print("Temperature: ");
-        Serial.print(temperature);
-        Serial.println("°C");
+        float temperatures[SensorManager::MAX_PROBES];
+        uint8_t probeCount = sensorManager->readTemperatures(temperatures);
+        for (uint8_t i = 0; i < probeCount; i++) {
+            if (temperatures[i] == DEVICE_DISCONNECTED_C) {
+                continue;
+            }
+            JsonObject reading = readings.createNestedObject();
+            reading["type"] = "temperature";
+            reading["value"] = temperatures[i];
+            reading["probe"] = sensorManager->getProbeId(i);
+        }
+        if (probeCount > 0 && temperatures[0] != DEVICE_DISCONNECTED_C) {
+            // Rules watch the first probe found on the bus
+            feedRuleSample(Rule::SENSOR_TEMPERATURE, (int16_t)(temperatures[0] * 10));
+        }
     }
 
     Serial.println("Reading analog sensor");
-    int soil = sensorManager->readSoilMoisture();
+    int soil;
+    if (hasOutput() || operatingMode == MODE_RGB_LED) {
+        // SENSE_POWER drives the output in relay and valve modes, and the
+        // green channel in RGB mode
+        soil = sensorManager->readAnalogUnpowered();
+    } else {
+        soil = sensorManager->readSoilMoisture();
+    }
     Serial.print("Analog voltage: ");
     Serial.println(soil);
-
+    feedRuleSample(Rule::SENSOR_ANALOG, soil);
+    JsonObject reading = readings.createNestedObject();
+    reading["type"] = operatingMode == MODE_SOIL_SENSOR ? "soil_moisture" : "analog";
+    reading["value"] = soil;
+    // After the samples, which may have fired a rule
+    if (hasOutput()) {
+        readingDoc["outputOn"] = isOutputOn();
+    }
+    
+    sendReadings(readingDoc);
     timeAtLastSend = millis();
 }
 
+void DeviceManager::sendReadings(JsonDocument& readingDoc) {
+    if (WiFi.status() != WL_CONNECTED || !eepromManager->hasServerUrl()) {
+        return;
+    }
+    
+    String readingDocJson = "";
+    serializeJson(readingDoc, readingDocJson);
+    
+    if (controlChannel->isOpen()) {
+        String message = "{\"type\":\"readings\",\"report\":";
+        message += readingDocJson;
+        message += '}';
+        if (controlChannel->send(message)) {
+            return;
+        }
+    }
+    
+    if (transport == EEPROMManager::TRANSPORT_COAP) {
+        String response;
+        int coapCode = coapClient->post("/readings", readingDocJson, response);
+        if (coapCode >= 0) {
+            if (coapCode != 204) {
+                Serial.print("Failed to send readings, CoAP response code: ");
+                Serial.println(coapCode);
+            }
+            return;
+        }
+        fallBackToHttp(coapCode);
+    }
+    
+    serverEndpoint->open(httpClient, "/readings");
+    httpClient.addHeader("Content-Type", "application/json");
+    int httpCode = httpClient.POST(readingDocJson);
+    if (httpCode != 200) {
+        Serial.print("Failed to send readings, response code: ");
+        Serial.println(httpCode);
+    }
+    
+    httpClient.end();
+}
+
 void DeviceManager::loop() {
+    // Scheduled valve events and rules run even while waiting for configuration
+    if (operatingMode == MODE_LATCHING_VALVE) {
+        valveController->loop();
+    }
+    if (operatingMode == MODE_SERVO) {
+        servoController->loop();
+    }
+    runRules();
+    
+    // A device waiting for its server URL needs the server to find it
+    if (stayAwake && presenceBeacon->isDue() && WiFi.status() == WL_CONNECTED) {
+        announcePresence();
+    }
+    
     // Handle configuration mode - returns true if device should stay awake for config
     if (handleConfigurationMode()) {
         return; // Early return - don't do any server communication or sleep logic
@@ -386,24 +755,47 @@ void DeviceManager::loop() {
     // Configuration is complete and device is not in config mode - proceed with normal operation
     bool wifiConnected = (WiFi.status() == WL_CONNECTED);
     
-    if (stayAwake) {
+    // Edges caught while awake go out straight away
+    if (operatingMode == MODE_INPUT_SWITCH) {
+        inputSwitch->loop();
+        if (wifiConnected) {
+            reportSwitchEvents();
+        }
+    }
+    // Deep sleep would drop a relay that a rule is holding on, or put out a
+    // light that is lit or playing
+    bool holdingOutput = holdsRelayOn() || holdsLightOn();
+    
+    // Opened while the server keeps us up; it stays open until we sleep
+    if (wifiConnected && (stayAwake ? controlChannel->connect(serialNumber) : controlChannel->isOpen())) {
+        pollControlChannel();
+    }
+    
+    if (stayAwake || holdingOutput) {
         if (millis() - timeAtLastSend > 30 * 1000) {
             reportNow();
         }
         // Only ask server if WiFi is connected
         if (wifiConnected && millis() - timeAtLastCheck > 30 * 1000) {
             askServerIfShouldStayUp();
+            syncTimeIfNeeded();
+            fetchValveSchedule();
+            fetchRules();
+            reportRuleFirings();
         }
     }
 
-    // Only check with server if WiFi is connected
-    if (!stayAwake && wifiConnected) {
+    // Only check with server if WiFi is connected. With the channel open the
+    // server has already said so over it.
+    if (!stayAwake && !holdingOutput && wifiConnected && !controlChannel->isOpen()) {
         askServerIfShouldStayUp();
     }
 
-    if (!stayAwake) {
+    if (!stayAwake && !holdingOutput) {
         reportNow();
-        enterDeepSleep();
+        if (!holdsRelayOn() && !holdsLightOn()) {
+            enterDeepSleep();
+        }
         return;
     }
 
@@ -413,6 +805,261 @@ void DeviceManager::loop() {
         PlatformUtils::restart();
         return;
     }
+    
+    if (wifiConnected) {
+        idleAwake();
+    }
+}
+
+// Staying awake: rather than spinning on handleClient(), sleep in delay() and
+// let the radio doze between beacons. A request then waits at most for the
+// radio's next listen interval plus the rest of the idle slice, which together
+// fit in awakeLatencyMs. Two thirds of the budget go to the radio, where the
+// savings are; the loop slice takes the rest.
+void DeviceManager::idleAwake() {
+    unsigned long latencyMs = awakeLatencyMs;
+    if (controlChannel->isOpen() && latencyMs > CHANNEL_LATENCY_MS) {
+        latencyMs = CHANNEL_LATENCY_MS;
+    }
+    uint8_t listenIntervals = min(latencyMs * 2 / 3 / BEACON_INTERVAL_MS, 10UL);
+    unsigned long sliceMs = latencyMs - listenIntervals * BEACON_INTERVAL_MS;
+    if (sliceMs < MIN_IDLE_SLICE_MS) {
+        sliceMs = MIN_IDLE_SLICE_MS;
+    }
+    
+    // PWM and servo pulses stop while the CPU light-sleeps
+    bool lightSleep = !holdsLightOn() && !(operatingMode == MODE_SERVO && servoController->isBusy());
+    if (listenIntervals != powerSaveIntervals || lightSleep != powerSaveLightSleep) {
+        PlatformUtils::setWiFiPowerSave(listenIntervals, lightSleep);
+        powerSaveIntervals = listenIntervals;
+        powerSaveLightSleep = lightSleep;
+        Serial.print("Awake power save: listen interval ");
+        Serial.print(listenIntervals);
+        Serial.print(lightSleep ? ", light sleep, " : ", modem sleep, ");
+        Serial.print(sliceMs);
+        Serial.println(" ms idle slice");
+    }
+    
+    if (!controlChannel->isOpen()) {
+        delay(sliceMs);
+        return;
+    }
+    // A pushed command cuts the slice short
+    unsigned long idleStart = millis();
+    while (millis() - idleStart < sliceMs && !controlChannel->hasData()) {
+        delay(MIN_IDLE_SLICE_MS);
+    }
+}
+
+void DeviceManager::pollControlChannel() {
+    String message;
+    while (controlChannel->poll(message)) {
+        handleChannelMessage(message);
+    }
+}
+
+// {"type": "stay-awake", "value": bool} or
+// {"type": "command", "id": n, "route": "output-on", "payload": {...}}, the
+// latter answered with {"type": "result", "id": n, "success": bool}
+void DeviceManager::handleChannelMessage(const String& message) {
+    // Sized for a full RGB sequence, as the HTTP route takes
+    StaticJsonDocument<1536> messageDoc;
+    if (deserializeJson(messageDoc, message)) {
+        Serial.println("Unreadable control channel message");
+        return;
+    }
+    
+    String type = messageDoc["type"] | "";
+    if (type == "stay-awake") {
+        stayAwake = messageDoc["value"] | false;
+        Serial.print("Server says stay awake: ");
+        Serial.println(stayAwake ? "yes" : "no");
+    } else if (type == "command") {
+        String route = messageDoc["route"] | "";
+        Serial.print("Command over control channel: ");
+        Serial.println(route);
+        bool success = runCommand(route.c_str(), messageDoc["payload"]);
+        
+        StaticJsonDocument<128> resultDoc;
+        resultDoc["type"] = "result";
+        resultDoc["id"] = messageDoc["id"];
+        resultDoc["success"] = success;
+        if (!success) {
+            resultDoc["error"] = "Invalid command or wrong mode";
+        }
+        String resultDocJson;
+        serializeJson(resultDoc, resultDocJson);
+        controlChannel->send(resultDocJson);
+    }
+}
+
+void DeviceManager::initValve(bool wokeFromDeepSleep) {
+    if (operatingMode != MODE_LATCHING_VALVE) {
+        return;
+    }
+    
+    valveController->begin(wokeFromDeepSleep);
+    // Events due right now run before WiFi comes up so they land on time
+    valveController->loop();
+}
+
+void DeviceManager::fetchValveSchedule() {
+    if (operatingMode != MODE_LATCHING_VALVE) {
+        return;
+    }
+    
+    String path = "/valve-schedule?id=";
+    path += serialNumber;
+    path += "&version=";
+    path += valveController->getScheduleVersion();
+    serverEndpoint->open(httpClient, path);
+    
+    int httpCode = httpClient.GET();
+    if (httpCode == 304) {
+        Serial.println("Valve schedule up to date");
+    } else if (httpCode == 200) {
+        StaticJsonDocument<1024> scheduleDoc;
+        DeserializationError error = deserializeJson(scheduleDoc, httpClient.getString());
+        JsonArray events = scheduleDoc["events"];
+        if (error || events.isNull()) {
+            Serial.println("Failed to parse valve schedule");
+        } else {
+            ValveSchedule schedule = {};
+            schedule.version = scheduleDoc["version"];
+            for (JsonObject event : events) {
+                if (schedule.count == ValveSchedule::MAX_EVENTS) {
+                    break;
+                }
+                unsigned long long atMs = event["at"];
+                schedule.events[schedule.count].atSeconds = (uint32_t)(atMs / 1000);
+                schedule.events[schedule.count].open = event["open"] ? 1 : 0;
+                schedule.count++;
+            }
+            valveController->setSchedule(schedule);
+        }
+    } else {
+        Serial.print("Failed to fetch valve schedule, response code: ");
+        Serial.println(httpCode);
+    }
+    
+    httpClient.end();
+}
+
+void DeviceManager::finishValveActivity() {
+    // Never sleep mid-pulse, and stay up for events too close to sleep for
+    unsigned long waitStart = millis();
+    while (millis() - waitStart < CadenceScheduler::MIN_SLEEP_MS * 2) {
+        valveController->loop();
+        uint64_t nextEventMs = valveController->getNextEventTime();
+        bool eventImminent = nextEventMs != 0 &&
+            nextEventMs <= timeSyncManager->getCurrentTime() + CadenceScheduler::MIN_SLEEP_MS;
+        if (!valveController->isBusy() && !eventImminent) {
+            return;
+        }
+        delay(10);
+    }
+}
+
+void DeviceManager::initServo(bool wokeFromDeepSleep) {
+    if (operatingMode != MODE_SERVO) {
+        return;
+    }
+    
+    servoController->begin(wokeFromDeepSleep);
+}
+
+bool DeviceManager::moveServo(float target, uint8_t profile, float speed, float accel) {
+    if (operatingMode != MODE_SERVO) {
+        Serial.println("Error: moveServo called but device not in servo mode");
+        return false;
+    }
+    
+    return servoController->moveTo(target, profile, speed, accel);
+}
+
+// {"position": 0-180, "profile": "trapezoidal" | "s-curve", "speed": deg/s, "accel": deg/s^2}
+bool DeviceManager::moveServo(JsonVariantConst request) {
+    String profileName = request["profile"] | "trapezoidal";
+    if (profileName != "s-curve" && profileName != "trapezoidal") {
+        return false;
+    }
+    uint8_t profile = profileName == "s-curve" ? ServoController::PROFILE_S_CURVE : ServoController::PROFILE_TRAPEZOIDAL;
+    float position = request["position"] | -1.0f;
+    float speed = request["speed"] | (float)ServoController::DEFAULT_SPEED;
+    float accel = request["accel"] | (float)ServoController::DEFAULT_ACCEL;
+    return moveServo(position, profile, speed, accel);
+}
+
+void DeviceManager::addServoStatus(JsonObject status) const {
+    status["position"] = roundf(servoController->getPosition() * 10) / 10;
+    status["target"] = servoController->getTarget();
+    status["atTarget"] = servoController->isAtTarget();
+}
+
+void DeviceManager::initRgb() {
+    if (operatingMode != MODE_RGB_LED) {
+        return;
+    }
+    
+    pinMode(BLUE_PIN, OUTPUT);
+    rgbController->begin();
+}
+
+bool DeviceManager::playRgbSequence(const RgbSequence& sequence) {
+    if (operatingMode != MODE_RGB_LED) {
+        Serial.println("Error: playRgbSequence called but device not in RGB mode");
+        return false;
+    }
+    
+    return rgbController->play(sequence);
+}
+
+// {"frames": [[red, green, blue, fadeMs, holdMs], ...], "loops": n}, loops 0
+// repeating until the next command
+bool DeviceManager::playRgbSequence(JsonVariantConst request) {
+    JsonArrayConst frames = request["frames"];
+    int loops = request["loops"] | 1;
+    if (frames.isNull() || frames.size() > RgbSequence::MAX_KEYFRAMES || loops < 0 || loops > 255) {
+        return false;
+    }
+    
+    RgbSequence sequence = {};
+    for (JsonArrayConst frame : frames) {
+        long values[5];
+        for (int i = 0; i < 5; i++) {
+            values[i] = frame[i] | -1L;
+        }
+        if (frame.size() != 5 || values[0] < 0 || values[0] > 255 || values[1] < 0 || values[1] > 255 ||
+            values[2] < 0 || values[2] > 255 || values[3] < 0 || values[3] > 65535 ||
+            values[4] < 0 || values[4] > 65535) {
+            return false;
+        }
+        RgbKeyframe& keyframe = sequence.frames[sequence.count++];
+        keyframe.red = values[0];
+        keyframe.green = values[1];
+        keyframe.blue = values[2];
+        keyframe.fadeMs = values[3];
+        keyframe.holdMs = values[4];
+    }
+    sequence.loops = loops;
+    return playRgbSequence(sequence);
+}
+
+void DeviceManager::addRgbStatus(JsonObject status) const {
+    status["red"] = rgbController->getRed();
+    status["green"] = rgbController->getGreen();
+    status["blue"] = rgbController->getBlue();
+    status["playing"] = rgbController->isPlaying();
+}
+
+void DeviceManager::finishServoMotion() {
+    // Never sleep mid-move: the servo would stop wherever it was. A move cut
+    // off by the timeout is not saved, so the next one starts from scratch.
+    unsigned long waitStart = millis();
+    while (servoController->isBusy() && millis() - waitStart < SERVO_MOTION_TIMEOUT_MS) {
+        servoController->loop();
+        delay(10);
+    }
 }
 
 void DeviceManager::setValveState(bool open) {
@@ -423,21 +1070,323 @@ void DeviceManager::setValveState(bool open) {
     
     Serial.print("Setting valve state to: ");
     Serial.println(open ? "OPEN" : "CLOSED");
+    valveController->actuate(open);
+}
+
+bool DeviceManager::hasOutput() const {
+    return operatingMode == MODE_RELAY || operatingMode == MODE_LATCHING_VALVE;
+}
+
+bool DeviceManager::isOutputOn() const {
+    if (operatingMode == MODE_LATCHING_VALVE) {
+        return valveController->getState() == ValveController::STATE_OPEN;
+    }
+    // Reads back the driven level of the output pin
+    return operatingMode == MODE_RELAY && digitalRead(SENSE_POWER_PIN) == HIGH;
+}
+
+bool DeviceManager::holdsRelayOn() const {
+    return operatingMode == MODE_RELAY && ruleEngine->isOutputHeld();
+}
+
+bool DeviceManager::holdsLightOn() const {
+    return operatingMode == MODE_RGB_LED && rgbController->isLit();
+}
+
+void DeviceManager::setOutput(bool on) {
+    if (operatingMode == MODE_LATCHING_VALVE) {
+        setValveState(on);
+    } else if (operatingMode == MODE_RELAY) {
+        Serial.print("Setting output ");
+        Serial.println(on ? "ON" : "OFF");
+        if (on) {
+            sensorManager->powerSensorOn();
+        } else {
+            sensorManager->powerSensorOff();
+        }
+    }
+}
+
+void DeviceManager::feedRuleSample(uint8_t sensor, int16_t value) {
+    if (!hasOutput()) {
+        return;
+    }
+    
+    if (ruleEngine->addSample(sensor, value) == RuleEngine::OUTPUT_ON) {
+        setOutput(true);
+    }
+}
+
+void DeviceManager::runRules() {
+    if (!hasOutput()) {
+        return;
+    }
     
-    if (open) {
-        // Pulse positive: AUX=HIGH, SENSE_POWER=LOW for H-bridge
-        digitalWrite(AUX_PIN, HIGH);
-        digitalWrite(SENSE_POWER_PIN, LOW);
-        delay(100); // Pulse duration for valve actuation
-        digitalWrite(AUX_PIN, LOW); // Return to neutral state
-        Serial.println("Valve opened with positive pulse");
+    if (ruleEngine->loop() == RuleEngine::OUTPUT_OFF) {
+        setOutput(false);
+    }
+}
+
+void DeviceManager::fetchRules() {
+    if (!hasOutput()) {
+        return;
+    }
+    
+    String path = "/rules?id=";
+    path += serialNumber;
+    path += "&version=";
+    path += ruleEngine->getRulesVersion();
+    serverEndpoint->open(httpClient, path);
+    
+    int httpCode = httpClient.GET();
+    if (httpCode == 304) {
+        Serial.println("Rules up to date");
+    } else if (httpCode == 200) {
+        // Too big for the stack with eight rules
+        DynamicJsonDocument rulesDoc(2048);
+        DeserializationError error = deserializeJson(rulesDoc, httpClient.getString());
+        JsonArray rules = rulesDoc["rules"];
+        if (error || rules.isNull()) {
+            Serial.println("Failed to parse rules");
+        } else {
+            RuleSet ruleSet = {};
+            ruleSet.version = rulesDoc["version"];
+            bool fits = true;
+            for (JsonObject rule : rules) {
+                if (ruleSet.count == RuleSet::MAX_RULES) {
+                    break;
+                }
+                String sensor = rule["sensor"] | "";
+                String comparison = rule["comparison"] | "";
+                bool temperature = sensor == "temperature";
+                // Checked as read: a missing value reads as out of range, and
+                // narrowing one that is would store something else entirely
+                double threshold = rule["threshold"] | NAN;
+                double samples = rule["samples"] | 0.0;
+                double durationSeconds = rule["durationSeconds"] | 0.0;
+                double minOffSeconds = rule["minOffSeconds"] | -1.0;
+                if (temperature) {
+                    threshold *= 10;
+                }
+                if (!(threshold >= INT16_MIN && threshold <= INT16_MAX) || !(samples >= 1 && samples <= UINT8_MAX) ||
+                    !(durationSeconds >= 1 && durationSeconds <= UINT32_MAX) ||
+                    !(minOffSeconds >= 0 && minOffSeconds <= UINT32_MAX)) {
+                    // The old rules stay: firings are reported by index, so
+                    // leaving out just this one would misnumber the rest
+                    Serial.print("Rejecting rule set - rule ");
+                    Serial.print(ruleSet.count);
+                    Serial.println(" has a value out of range");
+                    fits = false;
+                    break;
+                }
+                
+                Rule& parsed = ruleSet.rules[ruleSet.count++];
+                parsed.sensor = temperature ? Rule::SENSOR_TEMPERATURE : Rule::SENSOR_ANALOG;
+                parsed.comparison = comparison == "above" ? Rule::ABOVE : Rule::BELOW;
+                parsed.threshold = (int16_t)lround(threshold);
+                parsed.samples = (uint8_t)samples;
+                parsed.durationSeconds = (uint32_t)durationSeconds;
+                parsed.minOffSeconds = (uint32_t)minOffSeconds;
+            }
+            if (fits) {
+                ruleEngine->setRules(ruleSet);
+            }
+        }
+    } else {
+        Serial.print("Failed to fetch rules, response code: ");
+        Serial.println(httpCode);
+    }
+    
+    httpClient.end();
+}
+
+void DeviceManager::reportRuleFirings() {
+    uint8_t count = ruleEngine->getFiringCount();
+    if (count == 0) {
+        return;
+    }
+    
+    serverEndpoint->open(httpClient, "/rule-firings");
+    
+    StaticJsonDocument<512> firingDoc;
+    firingDoc["id"] = serialNumber;
+    firingDoc["dropped"] = ruleEngine->getDroppedFirings();
+    JsonArray firings = firingDoc.createNestedArray("firings");
+    for (uint8_t i = 0; i < count; i++) {
+        const RuleFiring& firing = ruleEngine->getFiring(i);
+        JsonObject entry = firings.createNestedObject();
+        entry["rule"] = firing.rule;
+        entry["at"] = (unsigned long long)firing.atSeconds * 1000;
+        entry["value"] = firing.value;
+    }
+    
+    String firingDocJson = "";
+    serializeJson(firingDoc, firingDocJson);
+    Serial.println("Sending rule firings: ");
+    Serial.println(firingDocJson);
+    
+    httpClient.addHeader("Content-Type", "application/json");
+    int httpCode = httpClient.POST(firingDocJson);
+    if (httpCode == 200) {
+        ruleEngine->clearFirings();
     } else {
-        // Pulse negative: AUX=LOW, SENSE_POWER=HIGH for H-bridge
-        digitalWrite(AUX_PIN, LOW);
-        digitalWrite(SENSE_POWER_PIN, HIGH);
-        delay(100); // Pulse duration for valve actuation
-        digitalWrite(SENSE_POWER_PIN, LOW); // Return to neutral state
-        Serial.println("Valve closed with negative pulse");
+        Serial.print("Failed to report rule firings, response code: ");
+        Serial.println(httpCode);
+    }
+    
+    httpClient.end();
+}
+
+void DeviceManager::initProbes() {
+    if (operatingMode != MODE_THERMOMETER) {
+        return;
+    }
+    
+    sensorManager->beginProbes();
+    sensorManager->startConversion();
+}
+
+bool DeviceManager::rescanProbes() {
+    if (operatingMode != MODE_THERMOMETER) {
+        Serial.println("Error: rescanProbes called but device not in thermometer mode");
+        return false;
+    }
+    
+    sensorManager->rescanProbes();
+    return true;
+}
+
+void DeviceManager::initInputSwitch() {
+    if (operatingMode != MODE_INPUT_SWITCH) {
+        return;
+    }
+    
+    inputSwitch->begin();
+}
+
+void DeviceManager::reportSwitchEvents() {
+    // In other modes the switch pin is an output or left floating
+    if (operatingMode != MODE_INPUT_SWITCH) {
+        return;
+    }
+    
+    // Queued edges are only timestamped once the clock is synchronized
+    inputSwitch->loop();
+    uint8_t count = inputSwitch->getEdgeCount();
+    if (count == 0) {
+        return;
+    }
+    if (switchReportFailed && millis() - switchReportFailedAt < SWITCH_REPORT_RETRY_MS) {
+        return;
+    }
+    
+    serverEndpoint->open(httpClient, "/switch-events");
+    
+    StaticJsonDocument<384> eventDoc;
+    eventDoc["id"] = serialNumber;
+    eventDoc["dropped"] = inputSwitch->getDroppedEdges();
+    JsonArray events = eventDoc.createNestedArray("events");
+    for (uint8_t i = 0; i < count; i++) {
+        const SwitchEdge& edge = inputSwitch->getEdge(i);
+        JsonObject entry = events.createNestedObject();
+        entry["closed"] = edge.closed != 0;
+        // Without a time the server stamps the edge on arrival
+        if (edge.atSeconds != 0) {
+            entry["at"] = (unsigned long long)edge.atSeconds * 1000 + edge.atMillis;
+        }
+    }
+    
+    String eventDocJson = "";
+    serializeJson(eventDoc, eventDocJson);
+    Serial.println("Sending switch events: ");
+    Serial.println(eventDocJson);
+    
+    httpClient.addHeader("Content-Type", "application/json");
+    int httpCode = httpClient.POST(eventDocJson);
+    if (httpCode == 200) {
+        inputSwitch->clearEdges();
+        switchReportFailed = false;
+    } else {
+        Serial.print("Failed to report switch events, response code: ");
+        Serial.println(httpCode);
+        switchReportFailed = true;
+        switchReportFailedAt = millis();
+    }
+    
+    httpClient.end();
+}
+
+void DeviceManager::applyFirmwareUpdate() {
+    if (!firmwareUpdater->hasOffer()) {
+        return;
+    }
+    
+    // The restart would drop a relay a rule is holding on; the server offers
+    // the update again at a later check-in
+    if (holdsRelayOn()) {
+        Serial.println("Output held by a rule - postponing firmware update");
+        return;
+    }
+    if (operatingMode == MODE_LATCHING_VALVE) {
+        finishValveActivity();
+    }
+    if (operatingMode == MODE_SERVO) {
+        finishServoMotion();
+    }
+    
+    if (firmwareUpdater->apply(serverEndpoint->prepareClient(), serverEndpoint->getBaseUrl())) {
+        Serial.println("Restarting into new firmware");
+        delay(100);
+        PlatformUtils::restart();
+        return;
+    }
+    
+    reportFirmwareFailure();
+}
+
+void DeviceManager::reportFirmwareFailure() {
+    serverEndpoint->open(httpClient, "/firmware-result");
+    
+    StaticJsonDocument<256> resultDoc;
+    resultDoc["id"] = serialNumber;
+    resultDoc["build"] = firmwareUpdater->getOfferedBuild();
+    resultDoc["success"] = false;
+    resultDoc["error"] = firmwareUpdater->getLastError();
+    
+    String resultDocJson = "";
+    serializeJson(resultDoc, resultDocJson);
+    
+    httpClient.addHeader("Content-Type", "application/json");
+    int httpCode = httpClient.POST(resultDocJson);
+    if (httpCode != 200) {
+        Serial.print("Failed to report firmware result, response code: ");
+        Serial.println(httpCode);
+    }
+    
+    httpClient.end();
+}
+
+bool DeviceManager::runCommand(const char* route, JsonVariantConst request) {
+    if (strcmp(route, "output-on") == 0 || strcmp(route, "output-off") == 0) {
+        switchOutput(strcmp(route, "output-on") == 0);
+        return true;
+    }
+    if (strcmp(route, "servo") == 0) {
+        return moveServo(request);
+    }
+    if (strcmp(route, "rgb") == 0) {
+        return playRgbSequence(request);
+    }
+    return false;
+}
+
+void DeviceManager::switchOutput(bool on) {
+    if (operatingMode == MODE_LATCHING_VALVE) {
+        setValveState(on);
+    } else if (on) {
+        sensorManager->powerSensorOn();
+    } else {
+        sensorManager->powerSensorOff();
     }
 }
 
@@ -450,48 +1399,76 @@ void DeviceManager::closeValve() {
 }
 
 // Time synchronization methods
-void DeviceManager::syncTimeWithServer(unsigned long long serverTime) {
-    serverTimestamp = serverTime;
-    localTimeAtSync = millis();
-    timeIsSynchronized = true;
-    
-    Serial.print("Time synchronized - Server time: ");
-    Serial.print((unsigned long)(serverTime / 1000)); // Convert to seconds for display
-    Serial.print(", Local millis: ");
-    Serial.println(localTimeAtSync);
+void DeviceManager::restoreTime(bool wokeFromDeepSleep) {
+#ifdef ESP8266_PLATFORM
+    // The switch wakes the ESP8266 through RST, which it cannot tell from the
+    // timer wake it cut short: how long it slept is unknown
+    if (operatingMode == MODE_INPUT_SWITCH) {
+        wokeFromDeepSleep = false;
+    }
+#endif
+    timeSyncManager->begin(wokeFromDeepSleep);
+    cadenceScheduler->begin(wokeFromDeepSleep);
 }
 
-unsigned long long DeviceManager::getCurrentTime() {
-    if (!timeIsSynchronized) {
-        return 0; // Return 0 if time is not synchronized
+bool DeviceManager::syncTimeWithServer() {
+    serverEndpoint->open(httpClient, "/time");
+    unsigned long requestSentAt = timeSyncManager->beginExchange();
+    int httpCode = httpClient.GET();
+    bool synchronized = false;
+
+    if (httpCode == 200) {
+        StaticJsonDocument<128> responseDoc;
+        DeserializationError error = deserializeJson(responseDoc, httpClient.getString());
+        if (!error) {
+            synchronized = applyServerTime(responseDoc, requestSentAt);
+        }
+    } else {
+        Serial.print("Time sync failed, response code: ");
+        Serial.println(httpCode);
     }
-    
-    unsigned long currentLocalTime = millis();
-    unsigned long elapsedSinceSync = currentLocalTime - localTimeAtSync;
-    
-    // Handle millis() rollover (occurs every ~49 days)
-    if (currentLocalTime < localTimeAtSync) {
-        elapsedSinceSync = (0xFFFFFFFF - localTimeAtSync) + currentLocalTime + 1;
+
+    httpClient.end();
+    return synchronized;
+}
+
+void DeviceManager::syncTimeIfNeeded() {
+    if (!timeSyncManager->needsSync()) {
+        return;
     }
-    
-    return serverTimestamp + elapsedSinceSync;
+
+    Serial.print("Clock error bound ");
+    Serial.print(timeSyncManager->getErrorBoundMs());
+    Serial.println("ms exceeds limit - syncing time");
+    syncTimeWithServer();
 }
 
-void DeviceManager::updateTimeAfterSleep(unsigned long sleepDuration) {
-    if (timeIsSynchronized) {
-        // Update our time tracking after waking from sleep
-        localTimeAtSync = millis(); // Reset local time reference
-        serverTimestamp += sleepDuration; // Add sleep duration to server time
-        
-        Serial.print("Time updated after sleep - Added ");
-        Serial.print(sleepDuration);
-        Serial.print("ms, Current estimated time: ");
-        Serial.println(getCurrentTimeString());
+bool DeviceManager::applyServerTime(JsonDocument& responseDoc, unsigned long requestSentAt) {
+    if (!responseDoc.containsKey("timestamp")) {
+        return false;
+    }
+
+    unsigned long long serverSent = responseDoc["timestamp"];
+    if (!responseDoc.containsKey("receivedAt")) {
+        // Older servers only report when they replied
+        timeSyncManager->syncToServerTime(serverSent, requestSentAt);
+        return true;
     }
+
+    unsigned long long serverReceived = responseDoc["receivedAt"];
+    return timeSyncManager->completeExchange(requestSentAt, serverReceived, serverSent);
+}
+
+unsigned long long DeviceManager::getCurrentTime() {
+    return timeSyncManager->getCurrentTime();
+}
+
+bool DeviceManager::isTimeSynchronized() const {
+    return timeSyncManager->isSynchronized();
 }
 
 String DeviceManager::getCurrentTimeString() {
-    if (!timeIsSynchronized) {
+    if (!timeSyncManager->isSynchronized()) {
         return "Time not synchronized";
     }
     
@@ -499,5 +1476,6 @@ String DeviceManager::getCurrentTimeString() {
     unsigned long timeInSeconds = (unsigned long)(currentTime / 1000);
     
     // Simple time formatting (Unix timestamp)
-    return "Unix: " + String(timeInSeconds) + " (" + String(currentTime) + "ms)";
-}
\ No newline at end of file
+    return "Unix: " + String(timeInSeconds) + " (" + String(currentTime) + "ms +/- " +
+        String(timeSyncManager->getErrorBoundMs()) + "ms)";
+}
@@ -7,13 +7,41 @@
 class EEPROMManager;
 class SensorManager;
 class WiFiManager;
+class RTCMemoryManager;
+class TimeSyncManager;
+class CadenceScheduler;
+class ValveController;
+class RuleEngine;
+class FirmwareUpdater;
+class EnergyMonitor;
+class InputSwitch;
+class ServoController;
+class RgbController;
+class ServerEndpoint;
+class PresenceBeacon;
+class CoapClient;
+class ControlChannel;
+struct RgbSequence;
 
 
 class DeviceManager {
 public:
     // Sleep configuration (public for external access)
-    static const unsigned long SLEEP_DURATION_MS = 60000; // 1 minute in milliseconds
+    static const unsigned long SLEEP_DURATION_MS = 60000; // Sampling period: wakes land on this grid of server time
     static const unsigned long SLEEP_DURATION_US = SLEEP_DURATION_MS * 1000; // Convert to microseconds
+    // Input switch mode: the switch wakes the device, the grid is only a heartbeat
+    static const unsigned long SWITCH_HEARTBEAT_MS = 3600000;
+    // Beacon interval most APs use (100 TU); power save wakes on a multiple of it
+    static const unsigned long BEACON_INTERVAL_MS = 102;
+    static const unsigned long MIN_IDLE_SLICE_MS = 10;
+    // Command latency while the control channel is open, whatever awakeLatencyMs says
+    static const unsigned long CHANNEL_LATENCY_MS = 100;
+    // Longest a servo move may keep the device from sleeping
+    static const unsigned long SERVO_MOTION_TIMEOUT_MS = 60000;
+    // Wait before sending switch events again after the server refused them
+    static const unsigned long SWITCH_REPORT_RETRY_MS = 30000;
+    // Wakes, the failing one included, that use HTTP after CoAP went unanswered
+    static const uint16_t COAP_RETRY_WAKES = 30;
 
 private:
     // Device modes
@@ -31,10 +59,30 @@ private:
     static const int GREEN_PIN = 13;
     static const int SENSE_POWER_PIN = 14;
     static const int AUX_PIN = 5;
+    static const int BLUE_PIN = 15;     // RGB mode: AUX is red, SENSE_POWER green
+#ifdef ESP32_PLATFORM
+    static const int SWITCH_PIN = 27;   // ext0 wake needs an RTC GPIO
+#else
+    static const int SWITCH_PIN = AUX_PIN;
+#endif
     
     EEPROMManager* eepromManager;
     SensorManager* sensorManager;
     WiFiManager* wifiManager;
+    RTCMemoryManager* rtcMemoryManager;
+    TimeSyncManager* timeSyncManager;
+    CadenceScheduler* cadenceScheduler;
+    ValveController* valveController;
+    RuleEngine* ruleEngine;
+    FirmwareUpdater* firmwareUpdater;
+    EnergyMonitor* energyMonitor;
+    InputSwitch* inputSwitch;
+    ServoController* servoController;
+    RgbController* rgbController;
+    ServerEndpoint* serverEndpoint;
+    PresenceBeacon* presenceBeacon;
+    CoapClient* coapClient;
+    ControlChannel* controlChannel;
     HTTPClient httpClient;
     
     int deviceId;
@@ -43,15 +91,33 @@ private:
     bool stayAwake;
     unsigned long timeAtLastSend;
     unsigned long timeAtLastCheck;
+    bool switchReportFailed;
+    unsigned long switchReportFailedAt;
+    uint16_t awakeLatencyMs;        // HTTP response bound while staying awake
+    int8_t powerSaveIntervals;      // Listen interval last applied, -1 = not yet
+    bool powerSaveLightSleep;
+    uint8_t transport;              // For readings and check-ins; back to HTTP for a while if CoAP fails
     
-    // Time synchronization
-    unsigned long long serverTimestamp;  // Server time in milliseconds
-    unsigned long localTimeAtSync;       // Local millis() when sync occurred
-    unsigned long sleepDurationMs;       // Duration of last sleep in milliseconds
-    bool timeIsSynchronized;             // Whether we have valid time sync
+    bool applyServerTime(JsonDocument& responseDoc, unsigned long requestSentAt);
+    void finishValveActivity();
+    void finishServoMotion();
+    bool hasOutput() const;
+    bool isOutputOn() const;
+    bool holdsRelayOn() const;
+    bool holdsLightOn() const;
+    void setOutput(bool on);
+    void feedRuleSample(uint8_t sensor, int16_t value);
+    void runRules();
+    void stopMode();
+    void reportFirmwareFailure();
+    void sendReadings(JsonDocument& readingDoc);
+    void fallBackToHttp(int coapError);
+    void pollControlChannel();
+    void handleChannelMessage(const String& message);
+    void idleAwake();
 
 public:
-    DeviceManager(EEPROMManager* eeprom, SensorManager* sensor, WiFiManager* wifi);
+    DeviceManager(EEPROMManager* eeprom, SensorManager* sensor, WiFiManager* wifi, RTCMemoryManager* rtc);
     ~DeviceManager();
     
     void init();
@@ -63,6 +129,11 @@ public:
     void printDebugInfo();
     bool handleConfigurationMode();
     
+    // Configuration changed while running, applied without a restart
+    void applyServerSettings();     // Server URL, TLS pin, transport, awakeLatencyMs
+    void applyMode();
+    bool reconnectWiFi();           // Falls back to the setup hotspot if the new network fails
+    
     // Power management
     bool shouldStayAwake() const { return stayAwake; }
     void setStayAwake(bool awake) { stayAwake = awake; }
@@ -70,15 +141,24 @@ public:
     void enterDeepSleep();
     
     // Server communication
+    void announcePresence();    // Multicast, so the server finds us without searching
     void registerWithServer();
     void sendFailureLogToServer();
-    void reportNow();
+    void contactServer();       // Registration and the rest a boot sends once WiFi is up
+    void reportNow(); // Reads the sensors, feeds the rules and sends the readings
+    void setTransport(uint8_t value) { transport = value; }    // EEPROMManager::TRANSPORT_*
+    
+    // Commands, whether they come in over HTTP or the control channel. route is
+    // the HTTP path without the '/': output-on, output-off, servo or rgb.
+    bool runCommand(const char* route, JsonVariantConst request);
+    void switchOutput(bool on);
     
     // Time synchronization
-    void syncTimeWithServer(unsigned long long serverTime);
+    void restoreTime(bool wokeFromDeepSleep);
+    bool syncTimeWithServer();
+    void syncTimeIfNeeded();
     unsigned long long getCurrentTime();
-    void updateTimeAfterSleep(unsigned long sleepDuration);
-    bool isTimeSynchronized() const { return timeIsSynchronized; }
+    bool isTimeSynchronized() const;
     String getCurrentTimeString(); // For debugging/display purposes
     
     // Getters
@@ -87,10 +167,39 @@ public:
     int getOperatingMode() const { return operatingMode; }
     
     // Latching valve control
+    void initValve(bool wokeFromDeepSleep);
+    void fetchValveSchedule();
     void setValveState(bool open);
     void openValve();
     void closeValve();
     
+    // Servo
+    void initServo(bool wokeFromDeepSleep);
+    bool moveServo(float target, uint8_t profile, float speed, float accel);
+    bool moveServo(JsonVariantConst request);
+    void addServoStatus(JsonObject status) const;
+    
+    // RGB light
+    void initRgb();
+    bool playRgbSequence(const RgbSequence& sequence);
+    bool playRgbSequence(JsonVariantConst request);
+    void addRgbStatus(JsonObject status) const;
+    
+    // Temperature probes
+    void initProbes();
+    bool rescanProbes();    // After probes are added to or taken off the bus
+    
+    // Input switch
+    void initInputSwitch();
+    void reportSwitchEvents();
+    
+    // Local rules
+    void fetchRules();
+    void reportRuleFirings();
+    
+    // Firmware updates offered at registration
+    void applyFirmwareUpdate();
+    
     // Main loop
     void loop();
 };
@@ -4,7 +4,7 @@ EEPROMManager::EEPROMManager() {
 }
 
 void EEPROMManager::init() {
-    EEPROM.begin(1024);
+    EEPROM.begin(EEPROM_SIZE);
 }
 
 bool EEPROMManager::hasDeviceId() {
@@ -54,6 +54,34 @@ void EEPROMManager::setMode(int mode) {
     EEPROM.commit();
 }
 
+uint16_t EEPROMManager::getAwakeLatencyMs() {
+    uint16_t latencyMs = 0;
+    EEPROM.get(EEPROM_AWAKE_LATENCY_POSITION, latencyMs);
+    // Uninitialized EEPROM reads back as 0xFFFF
+    if (latencyMs < MIN_AWAKE_LATENCY_MS || latencyMs > MAX_AWAKE_LATENCY_MS) {
+        return DEFAULT_AWAKE_LATENCY_MS;
+    }
+    return latencyMs;
+}
+
+void EEPROMManager::setAwakeLatencyMs(uint16_t latencyMs) {
+    EEPROM.put(EEPROM_AWAKE_LATENCY_POSITION, latencyMs);
+    EEPROM.commit();
+}
+
+uint8_t EEPROMManager::getTransport() {
+    // Uninitialized EEPROM reads back as 0xFF
+    if (EEPROM.read(EEPROM_TRANSPORT_POSITION) == TRANSPORT_COAP) {
+        return TRANSPORT_COAP;
+    }
+    return TRANSPORT_HTTP;
+}
+
+void EEPROMManager::setTransport(uint8_t transport) {
+    EEPROM.write(EEPROM_TRANSPORT_POSITION, transport);
+    EEPROM.commit();
+}
+
 String EEPROMManager::getAlias() {
     return readString(EEPROM_ALIAS_POSITION);
 }
@@ -92,6 +120,11 @@ void EEPROMManager::addWiFiFailure(unsigned long timestamp) {
         newLog += "," + String(timestamp) + "]";
     }
     
+    // Keep the most recent failures that fit; older ones fall off the front
+    while (newLog.length() > MAX_FAILURE_LOG_LENGTH) {
+        newLog = "[" + newLog.substring(newLog.indexOf(',') + 1);
+    }
+    
     Serial.println("Adding WiFi failure timestamp: " + String(timestamp));
     Serial.println("Updated failure log: " + newLog);
     
@@ -107,6 +140,87 @@ void EEPROMManager::clearWiFiFailureLog() {
     writeString("", EEPROM_FAILURE_LOG_POSITION);
 }
 
+uint8_t EEPROMManager::getValveState(uint32_t& lastEventAtSeconds) {
+    EEPROM.get(EEPROM_VALVE_STATE_POSITION + 4, lastEventAtSeconds);
+    uint8_t state = EEPROM.read(EEPROM_VALVE_STATE_POSITION);
+    // Uninitialized EEPROM reads back as 255 - position unknown, no events run
+    if (state == 255) {
+        lastEventAtSeconds = 0;
+    }
+    return state;
+}
+
+void EEPROMManager::setValveState(uint8_t state, uint32_t lastEventAtSeconds) {
+    EEPROM.write(EEPROM_VALVE_STATE_POSITION, state);
+    EEPROM.put(EEPROM_VALVE_STATE_POSITION + 4, lastEventAtSeconds);
+    EEPROM.commit();
+}
+
+void EEPROMManager::getValveSchedule(ValveSchedule& schedule) {
+    EEPROM.get(EEPROM_VALVE_SCHEDULE_POSITION, schedule);
+    if (schedule.count > ValveSchedule::MAX_EVENTS || schedule.version == 0xFFFFFFFF) {
+        schedule.version = 0;
+        schedule.count = 0;
+    }
+}
+
+void EEPROMManager::setValveSchedule(const ValveSchedule& schedule) {
+    Serial.print("Writing valve schedule version ");
+    Serial.print(schedule.version);
+    Serial.print(" with ");
+    Serial.print(schedule.count);
+    Serial.println(" events");
+    EEPROM.put(EEPROM_VALVE_SCHEDULE_POSITION, schedule);
+    EEPROM.commit();
+}
+
+void EEPROMManager::getRules(RuleSet& rules) {
+    EEPROM.get(EEPROM_RULES_POSITION, rules);
+    if (rules.count > RuleSet::MAX_RULES || rules.version == 0xFFFFFFFF) {
+        rules.version = 0;
+        rules.count = 0;
+    }
+}
+
+void EEPROMManager::setRules(const RuleSet& rules) {
+    Serial.print("Writing rule set version ");
+    Serial.print(rules.version);
+    Serial.print(" with ");
+    Serial.print(rules.count);
+    Serial.println(" rules");
+    EEPROM.put(EEPROM_RULES_POSITION, rules);
+    EEPROM.commit();
+}
+
+void EEPROMManager::getProbes(ProbeList& probes) {
+    EEPROM.get(EEPROM_PROBES_POSITION, probes);
+    if (probes.count > ProbeList::MAX_PROBES) {
+        probes.count = 0;
+        probes.parasite = 0;
+    }
+}
+
+void EEPROMManager::setProbes(const ProbeList& probes) {
+    Serial.print("Writing ");
+    Serial.print(probes.count);
+    Serial.println(" probe addresses");
+    EEPROM.put(EEPROM_PROBES_POSITION, probes);
+    EEPROM.commit();
+}
+
+void EEPROMManager::getTlsPin(TlsPin& pin) {
+    EEPROM.get(EEPROM_TLS_PIN_POSITION, pin);
+    // Erased EEPROM, or a pin saved by the other platform
+    if (pin.length != TlsPin::FINGERPRINT_LENGTH) {
+        pin.length = 0;
+    }
+}
+
+void EEPROMManager::setTlsPin(const TlsPin& pin) {
+    EEPROM.put(EEPROM_TLS_PIN_POSITION, pin);
+    EEPROM.commit();
+}
+
 void EEPROMManager::clearAll() {
     Serial.println("CLEARING EEPROM");
     writeString("", EEPROM_ALIAS_POSITION);
@@ -119,6 +233,22 @@ void EEPROMManager::clearAll() {
     // Clear the WiFi credentials flag so hasWiFiCredentials() returns false
     EEPROM.write(HAS_SET_SSID_EEPROM_POSITION, 0);
     
+    // Back to the defaults a new device reads
+    uint16_t unsetLatency = 0xFFFF;
+    EEPROM.put(EEPROM_AWAKE_LATENCY_POSITION, unsetLatency);
+    EEPROM.write(EEPROM_TRANSPORT_POSITION, TRANSPORT_HTTP);
+    
+    // Forget the valve schedule; the valve position itself is physical and stays
+    ValveSchedule emptySchedule = {};
+    EEPROM.put(EEPROM_VALVE_SCHEDULE_POSITION, emptySchedule);
+    RuleSet emptyRules = {};
+    EEPROM.put(EEPROM_RULES_POSITION, emptyRules);
+    ProbeList noProbes = {};
+    EEPROM.put(EEPROM_PROBES_POSITION, noProbes);
+    
+    TlsPin noPin = {};
+    EEPROM.put(EEPROM_TLS_PIN_POSITION, noPin);
+    
     EEPROM.commit();
 }
 
@@ -4,17 +4,113 @@
 #include <EEPROM.h>
 #include <Arduino.h>
 
+// Open/close event pushed from the server for ValveController to run locally
+struct ValveEvent {
+    uint32_t atSeconds;             // Server time (Unix seconds)
+    uint8_t open;
+    uint8_t reserved[3];
+};
+
+struct ValveSchedule {
+    static const uint8_t MAX_EVENTS = 16;
+
+    uint32_t version;               // Server-assigned, 0 = no schedule
+    uint8_t count;
+    uint8_t reserved[3];
+    ValveEvent events[MAX_EVENTS];  // Sorted by atSeconds
+};
+
+// Closed-loop rule delivered from the server for RuleEngine: if <sensor> is
+// <comparison> threshold for <samples> consecutive samples, hold the output on
+// for durationSeconds, then keep it off for at least minOffSeconds
+struct Rule {
+    static const uint8_t SENSOR_ANALOG = 0;         // ADC counts
+    static const uint8_t SENSOR_TEMPERATURE = 1;    // Tenths of a degree C
+    static const uint8_t BELOW = 0;
+    static const uint8_t ABOVE = 1;
+
+    uint8_t sensor;
+    uint8_t comparison;
+    uint8_t samples;
+    uint8_t reserved;
+    int16_t threshold;
+    uint16_t reserved2;
+    uint32_t durationSeconds;
+    uint32_t minOffSeconds;
+};
+
+struct RuleSet {
+    static const uint8_t MAX_RULES = 8;
+
+    uint32_t version;               // Server-assigned, 0 = no rules
+    uint8_t count;
+    uint8_t reserved[3];
+    Rule rules[MAX_RULES];
+};
+
+// ROM addresses of the DS18B20 probes on the OneWire bus, found once so later
+// boots can skip the bus search
+struct ProbeList {
+    static const uint8_t MAX_PROBES = 8;
+
+    uint8_t count;                  // 0 = not enumerated yet
+    uint8_t parasite;               // A probe draws its power from the data line
+    uint8_t reserved[2];
+    uint8_t addresses[MAX_PROBES][8];
+};
+
+// Certificate fingerprint an https:// server is pinned to: SHA-1 on the
+// ESP8266, whose TLS client checks that, SHA-256 on the ESP32
+struct TlsPin {
+#ifdef ESP32_PLATFORM
+    static const uint8_t FINGERPRINT_LENGTH = 32;
+#else
+    static const uint8_t FINGERPRINT_LENGTH = 20;
+#endif
+
+    uint8_t length;                 // 0 = not pinned
+    uint8_t reserved[3];
+    uint8_t fingerprint[32];
+};
+
 class EEPROMManager {
+public:
+    // Longest an HTTP request may wait while the device stays awake with the
+    // radio dozing
+    static const uint16_t DEFAULT_AWAKE_LATENCY_MS = 500;
+    static const uint16_t MIN_AWAKE_LATENCY_MS = 20;
+    static const uint16_t MAX_AWAKE_LATENCY_MS = 3000;
+
+    // How readings and wake check-ins reach the server; the rest is always HTTP
+    static const uint8_t TRANSPORT_HTTP = 0;
+    static const uint8_t TRANSPORT_COAP = 1;
+
 private:
+    static const int EEPROM_SIZE = 2048;
+
     static const int HAS_SET_ID_EEPROM_POSITION = 100;
     static const int ID_EEPROM_POSITION = 101;
     static const int HAS_SET_SSID_EEPROM_POSITION = 103;
     static const int EEPROM_MODE_POSITION = 200;
+    static const int EEPROM_AWAKE_LATENCY_POSITION = EEPROM_MODE_POSITION + 2;
+    static const int EEPROM_TRANSPORT_POSITION = EEPROM_MODE_POSITION + 4;
     static const int EEPROM_ALIAS_POSITION = EEPROM_MODE_POSITION + 10;
     static const int EEPROM_SERVER_POSITION = EEPROM_ALIAS_POSITION + 255;
     static const int EEPROM_SSID_POSITION = EEPROM_SERVER_POSITION + 255;
     static const int EEPROM_PASSWORD_POSITION = EEPROM_SSID_POSITION + 255;
     static const int EEPROM_FAILURE_LOG_POSITION = EEPROM_PASSWORD_POSITION + 255;
+    // A length byte of 255 reads back as unset
+    static const int MAX_FAILURE_LOG_LENGTH = 254;
+    // Binary records live past the string area
+    static const int EEPROM_VALVE_STATE_POSITION = 1536;
+    static_assert(EEPROM_FAILURE_LOG_POSITION + 1 + MAX_FAILURE_LOG_LENGTH <= EEPROM_VALVE_STATE_POSITION,
+        "WiFi failure log runs into the valve block");
+    static const int EEPROM_VALVE_SCHEDULE_POSITION = EEPROM_VALVE_STATE_POSITION + 8;
+    static const int EEPROM_RULES_POSITION = EEPROM_VALVE_SCHEDULE_POSITION + sizeof(ValveSchedule);
+    static const int EEPROM_PROBES_POSITION = EEPROM_RULES_POSITION + sizeof(RuleSet);
+    static const int EEPROM_TLS_PIN_POSITION = EEPROM_PROBES_POSITION + sizeof(ProbeList);
+    static_assert(EEPROM_TLS_PIN_POSITION + sizeof(TlsPin) <= EEPROM_SIZE,
+        "Binary records run past the end of EEPROM");
     static const int SSID_SET_VALUE = 233;
 
 public:
@@ -40,12 +136,34 @@ public:
     String getServerUrl();
     void setServerUrl(String server);
     bool hasServerUrl();
+    uint16_t getAwakeLatencyMs();
+    void setAwakeLatencyMs(uint16_t latencyMs);
+    uint8_t getTransport();
+    void setTransport(uint8_t transport);
     
     // WiFi Failure Log
     void addWiFiFailure(unsigned long timestamp);
     String getWiFiFailureLog();
     void clearWiFiFailureLog();
     
+    // Latching valve
+    uint8_t getValveState(uint32_t& lastEventAtSeconds);
+    void setValveState(uint8_t state, uint32_t lastEventAtSeconds);
+    void getValveSchedule(ValveSchedule& schedule);
+    void setValveSchedule(const ValveSchedule& schedule);
+    
+    // Rule engine
+    void getRules(RuleSet& rules);
+    void setRules(const RuleSet& rules);
+    
+    // Temperature probes
+    void getProbes(ProbeList& probes);
+    void setProbes(const ProbeList& probes);
+    
+    // Server certificate pin
+    void getTlsPin(TlsPin& pin);
+    void setTlsPin(const TlsPin& pin);
+    
     // Utility
     void clearAll();
     
@@ -0,0 +1,58 @@
+#include "EnergyMonitor.h"
+#include "RTCMemoryManager.h"
+
+#ifdef ESP32_PLATFORM
+const EnergyProfile EnergyMonitor::PROFILE = { 40.0f, 120.0f, 5.0f, 15.0f, 2000.0f };
+#else
+const EnergyProfile EnergyMonitor::PROFILE = { 17.0f, 75.0f, 5.0f, 25.0f, 2000.0f };
+#endif
+
+static const float MS_PER_HOUR = 3600000.0f;
+static const float MS_PER_DAY = 86400000.0f;
+
+EnergyMonitor::EnergyMonitor(RTCMemoryManager* rtc) : rtcMemoryManager(rtc) {
+}
+
+void EnergyMonitor::recordCycle(uint32_t awakeMs, uint32_t radioMs, uint32_t sensorMs, uint32_t sleepMs) {
+    EnergyState& saved = rtcMemoryManager->getState().energy;
+    saved.awakeMs = awakeMs;
+    saved.radioMs = min(radioMs, awakeMs);
+    saved.sensorMs = min(sensorMs, awakeMs);
+    saved.sleepMs = sleepMs;
+    saved.cycles++;
+
+    Serial.print("Cycle energy ");
+    Serial.print(chargePerCycleMah(saved, PROFILE), 4);
+    Serial.print("mAh (radio ");
+    Serial.print(saved.radioMs);
+    Serial.print("ms, sensor ");
+    Serial.print(saved.sensorMs);
+    Serial.println("ms)");
+}
+
+bool EnergyMonitor::hasLastCycle() const {
+    return rtcMemoryManager->getState().energy.cycles != 0;
+}
+
+const EnergyState& EnergyMonitor::getLastCycle() const {
+    return rtcMemoryManager->getState().energy;
+}
+
+float EnergyMonitor::chargePerCycleMah(const EnergyState& cycle, const EnergyProfile& profile) {
+    float cpuOnlyMs = (float)(cycle.awakeMs - cycle.radioMs);
+    float mAms = profile.cpuMa * cpuOnlyMs +
+        profile.radioMa * cycle.radioMs +
+        profile.sensorMa * cycle.sensorMs +
+        profile.sleepUa / 1000.0f * cycle.sleepMs;
+    return mAms / MS_PER_HOUR;
+}
+
+float EnergyMonitor::batteryDays(const EnergyState& cycle, const EnergyProfile& profile) {
+    float chargeMah = chargePerCycleMah(cycle, profile);
+    float cycleMs = (float)cycle.awakeMs + cycle.sleepMs;
+    if (chargeMah <= 0 || cycleMs <= 0) {
+        return 0;
+    }
+    float cyclesPerDay = MS_PER_DAY / cycleMs;
+    return profile.batteryMah / (chargeMah * cyclesPerDay);
+}
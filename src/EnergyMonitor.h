@@ -0,0 +1,52 @@
+#ifndef ENERGY_MONITOR_H
+#define ENERGY_MONITOR_H
+
+#include <Arduino.h>
+
+class RTCMemoryManager;
+struct EnergyState;
+
+// Current the board draws in each phase of a wake cycle. Phases overlap: the
+// CPU runs for the whole wake, the radio for part of it (radioMa is the total
+// draw then, not an extra), and a powered sensor adds sensorMa on top.
+struct EnergyProfile {
+    float cpuMa;                    // Awake, radio off
+    float radioMa;                  // Awake, radio on
+    float sensorMa;                 // Sensor on SENSE_POWER, added to the above
+    float sleepUa;                  // Deep sleep, whole board including the regulator
+    float batteryMah;               // Usable battery capacity
+};
+
+// Estimates battery life from what a wake cycle actually spent its time on.
+// Each cycle's phase durations (awake, radio on, sensor powered, deep sleep)
+// are recorded in RTC memory just before sleeping and reported with the next
+// check-in, priced with the board's current profile. The server keeps the
+// durations, so server/tools/energyModel.ts can re-price recorded cycles with
+// other profiles or phase changes before a firmware change is rolled out.
+//
+// A relay on SENSE_POWER is not a phase: its on-time is not counted as sensor
+// time and its coil current is not priced, so relay-mode estimates leave out
+// whatever the relay draws from the battery.
+class EnergyMonitor {
+public:
+    // Datasheet-typical figures for an ESP-12F or ESP32 module on a low
+    // quiescent current LDO; measure the deployed board and set them here
+    static const EnergyProfile PROFILE;
+
+private:
+    RTCMemoryManager* rtcMemoryManager;
+
+public:
+    EnergyMonitor(RTCMemoryManager* rtc);
+
+    void recordCycle(uint32_t awakeMs, uint32_t radioMs, uint32_t sensorMs, uint32_t sleepMs);
+
+    bool hasLastCycle() const;
+    const EnergyState& getLastCycle() const;
+
+    static float chargePerCycleMah(const EnergyState& cycle, const EnergyProfile& profile);
+    // Days one battery lasts if every cycle looks like this one
+    static float batteryDays(const EnergyState& cycle, const EnergyProfile& profile);
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "FirmwareUpdater.h"
+#include "RTCMemoryManager.h"
+#include "platform_config.h"
+#include "version.h"
+
+FirmwareUpdater::FirmwareUpdater(RTCMemoryManager* rtc) :
+    rtcMemoryManager(rtc), offeredBuild(0) {
+}
+
+bool FirmwareUpdater::offer(uint32_t build, const String& version, const String& path) {
+    if (build == 0 || build == FIRMWARE_BUILD_NUMBER || path.length() == 0) {
+        return false;
+    }
+
+    const FirmwareState& saved = rtcMemoryManager->getState().firmware;
+    if (saved.failedBuild == build && saved.failures >= MAX_ATTEMPTS) {
+        Serial.print("Ignoring offer of build ");
+        Serial.print(build);
+        Serial.print(" - failed ");
+        Serial.print(saved.failures);
+        Serial.println(" times");
+        return false;
+    }
+
+    offeredBuild = build;
+    offeredVersion = version;
+    offeredPath = path;
+
+    Serial.print("Server offers firmware ");
+    Serial.print(version);
+    Serial.print(" (build ");
+    Serial.print(build);
+    Serial.println(")");
+    return true;
+}
+
+bool FirmwareUpdater::apply(WiFiClient& client, const String& serverUrl) {
+    if (!hasOffer()) {
+        return false;
+    }
+
+    Serial.print("Updating firmware " FIRMWARE_VERSION " -> ");
+    Serial.println(offeredVersion);
+
+    FirmwareState& saved = rtcMemoryManager->getState().firmware;
+    unsigned long startedAt = millis();
+    String error;
+    if (PlatformUtils::updateFirmware(client, serverUrl + offeredPath, error)) {
+        saved.failedBuild = 0;
+        saved.failures = 0;
+        Serial.print("Firmware written in ");
+        Serial.print(millis() - startedAt);
+        Serial.println("ms");
+        return true;
+    }
+
+    if (saved.failedBuild != offeredBuild) {
+        saved.failedBuild = offeredBuild;
+        saved.failures = 0;
+    }
+    if (saved.failures < 255) {
+        saved.failures++;
+    }
+    lastError = error;
+
+    Serial.print("Firmware update failed: ");
+    Serial.println(error);
+    return false;
+}
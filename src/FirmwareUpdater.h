@@ -0,0 +1,42 @@
+#ifndef FIRMWARE_UPDATER_H
+#define FIRMWARE_UPDATER_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+class RTCMemoryManager;
+
+// Pulls firmware images the server offers in its check-in response. The server
+// decides which devices update and when (staged rollout); the device only
+// downloads what it is offered and reports failures so the rollout can stop.
+//
+// A build that keeps failing is not retried on every wake: after MAX_ATTEMPTS
+// the offer is ignored until a different build is offered, so a bad image or a
+// weak link does not drain the battery. The count survives deep sleep in RTC memory.
+class FirmwareUpdater {
+private:
+    static const uint8_t MAX_ATTEMPTS = 3;
+
+    RTCMemoryManager* rtcMemoryManager;
+    uint32_t offeredBuild;
+    String offeredVersion;
+    String offeredPath;
+    String lastError;
+
+public:
+    FirmwareUpdater(RTCMemoryManager* rtc);
+
+    // Takes the offer from a check-in response. Returns false if it is ignored.
+    bool offer(uint32_t build, const String& version, const String& path);
+
+    // Downloads and flashes the offered image from serverUrl over client, the
+    // server's own (pinned, and for https:// authenticated) connection. On
+    // success the caller restarts into it; on failure getLastError() says why.
+    bool apply(WiFiClient& client, const String& serverUrl);
+
+    bool hasOffer() const { return offeredBuild != 0; }
+    uint32_t getOfferedBuild() const { return offeredBuild; }
+    const String& getLastError() const { return lastError; }
+};
+
+#endif
@@ -0,0 +1,207 @@
+#include "InputSwitch.h"
+#include "RTCMemoryManager.h"
+#include "TimeSyncManager.h"
+#include "platform_config.h"
+
+// The queue is shared with the interrupt handler. noInterrupts() does nothing
+// on the ESP32 core, which has a second core to guard against as well.
+#ifdef ESP32_PLATFORM
+static portMUX_TYPE queueLock = portMUX_INITIALIZER_UNLOCKED;
+#define LOCK_QUEUE() portENTER_CRITICAL(&queueLock)
+#define UNLOCK_QUEUE() portEXIT_CRITICAL(&queueLock)
+#define LOCK_QUEUE_FROM_ISR() portENTER_CRITICAL_ISR(&queueLock)
+#define UNLOCK_QUEUE_FROM_ISR() portEXIT_CRITICAL_ISR(&queueLock)
+#else
+#define LOCK_QUEUE() noInterrupts()
+#define UNLOCK_QUEUE() interrupts()
+#define LOCK_QUEUE_FROM_ISR()
+#define UNLOCK_QUEUE_FROM_ISR()
+#endif
+
+// Longest we wait at boot for the contacts to stop bouncing
+static const uint32_t SETTLE_TIMEOUT_MS = 200;
+
+InputSwitch* InputSwitch::instance = nullptr;
+
+InputSwitch::InputSwitch(RTCMemoryManager* rtc, TimeSyncManager* timeSync, int switchPin) :
+    rtcMemoryManager(rtc), timeSyncManager(timeSync), pin(switchPin), closed(false),
+    lastAcceptedAt(0), lastChangeAt(0), queueHead(0), queueTail(0), queueDropped(0),
+    changedWhileAsleep(false) {
+}
+
+void InputSwitch::begin() {
+    instance = this;
+#ifdef ESP32_PLATFORM
+    // Still routed to the RTC domain if it woke us
+    rtc_gpio_deinit((gpio_num_t)pin);
+#endif
+    pinMode(pin, INPUT_PULLUP);
+
+    // Two reads DEBOUNCE_MS apart that agree
+    bool level = readClosed();
+    unsigned long startedAt = millis();
+    while (millis() - startedAt < SETTLE_TIMEOUT_MS) {
+        delay(DEBOUNCE_MS);
+        bool again = readClosed();
+        if (again == level) {
+            break;
+        }
+        level = again;
+    }
+    closed = level;
+    lastAcceptedAt = millis();
+    lastChangeAt = lastAcceptedAt;
+
+    InputSwitchState& saved = rtcMemoryManager->getState().inputSwitch;
+    changedWhileAsleep = saved.known && saved.closed != (level ? 1 : 0);
+    if (changedWhileAsleep) {
+        // The edge is what woke us, just before millis() started counting
+        LOCK_QUEUE();
+        queueEdge(0, level);
+        UNLOCK_QUEUE();
+    }
+    saved.closed = level ? 1 : 0;
+    saved.known = 1;
+
+    Serial.print("Switch ");
+    Serial.print(level ? "CLOSED" : "OPEN");
+    Serial.println(changedWhileAsleep ? " - changed while asleep" : "");
+
+    attachInterrupt(digitalPinToInterrupt(pin), onChange, CHANGE);
+}
+
+void InputSwitch::end() {
+    detachInterrupt(digitalPinToInterrupt(pin));
+    rtcMemoryManager->getState().inputSwitch.known = 0;
+}
+
+void InputSwitch::loop() {
+    // A burst that bounced back to the other level after the handler took its
+    // first edge: the pin has been quiet for DEBOUNCE_MS and disagrees
+    LOCK_QUEUE();
+    if (millis() - lastChangeAt >= DEBOUNCE_MS) {
+        bool level = readClosed();
+        if (level != closed) {
+            queueEdge(lastChangeAt, level);
+        }
+    }
+    UNLOCK_QUEUE();
+
+    timestampQueuedEdges(false);
+}
+
+void IRAM_ATTR InputSwitch::onChange() {
+    InputSwitch* self = instance;
+    unsigned long now = millis();
+    self->lastChangeAt = now;
+
+    bool level = self->readClosed();
+    if (level == self->closed || now - self->lastAcceptedAt < DEBOUNCE_MS) {
+        return;
+    }
+
+    LOCK_QUEUE_FROM_ISR();
+    self->queueEdge(now, level);
+    UNLOCK_QUEUE_FROM_ISR();
+}
+
+bool IRAM_ATTR InputSwitch::readClosed() const {
+    return digitalRead(pin) == LOW;
+}
+
+// Caller holds the queue lock
+void IRAM_ATTR InputSwitch::queueEdge(unsigned long atMillis, bool isClosed) {
+    closed = isClosed;
+    lastAcceptedAt = atMillis;
+
+    uint8_t next = (queueHead + 1) % QUEUE_SIZE;
+    if (next == queueTail) {
+        queueTail = (queueTail + 1) % QUEUE_SIZE;
+        queueDropped++;
+    }
+    queuedAt[queueHead] = atMillis;
+    queuedClosed[queueHead] = isClosed ? 1 : 0;
+    queueHead = next;
+}
+
+// Edges move to RTC memory once they can be put on server time; with force
+// they go without a time (before sleeping on an unsynchronized clock)
+void InputSwitch::timestampQueuedEdges(bool force) {
+    if (!force && !timeSyncManager->isSynchronized()) {
+        return;
+    }
+
+    while (true) {
+        LOCK_QUEUE();
+        if (queueTail == queueHead) {
+            UNLOCK_QUEUE();
+            break;
+        }
+        unsigned long atMillis = queuedAt[queueTail];
+        bool isClosed = queuedClosed[queueTail];
+        queueTail = (queueTail + 1) % QUEUE_SIZE;
+        UNLOCK_QUEUE();
+
+        uint64_t atMs = timeSyncManager->toServerTime(atMillis);   // 0 if not synchronized
+        recordEdge((uint32_t)(atMs / 1000), (uint16_t)(atMs % 1000), isClosed);
+    }
+
+    LOCK_QUEUE();
+    uint8_t dropped = queueDropped;
+    queueDropped = 0;
+    UNLOCK_QUEUE();
+    InputSwitchState& saved = rtcMemoryManager->getState().inputSwitch;
+    saved.droppedEdges = (uint8_t)min(255, saved.droppedEdges + dropped);
+}
+
+void InputSwitch::recordEdge(uint32_t atSeconds, uint16_t atMillis, bool isClosed) {
+    InputSwitchState& saved = rtcMemoryManager->getState().inputSwitch;
+
+    // Keep the newest edges: they tell what the switch is doing now
+    if (saved.edgeCount >= InputSwitchState::MAX_EDGES) {
+        memmove(&saved.edges[0], &saved.edges[1], sizeof(SwitchEdge) * (InputSwitchState::MAX_EDGES - 1));
+        saved.edgeCount--;
+        if (saved.droppedEdges < 255) {
+            saved.droppedEdges++;
+        }
+    }
+
+    SwitchEdge& edge = saved.edges[saved.edgeCount++];
+    edge.atSeconds = atSeconds;
+    edge.atMillis = atMillis;
+    edge.closed = isClosed ? 1 : 0;
+
+    Serial.print("Switch ");
+    Serial.println(isClosed ? "closed" : "opened");
+}
+
+uint8_t InputSwitch::getEdgeCount() const {
+    return rtcMemoryManager->getState().inputSwitch.edgeCount;
+}
+
+const SwitchEdge& InputSwitch::getEdge(uint8_t index) const {
+    return rtcMemoryManager->getState().inputSwitch.edges[index];
+}
+
+uint8_t InputSwitch::getDroppedEdges() const {
+    return rtcMemoryManager->getState().inputSwitch.droppedEdges;
+}
+
+void InputSwitch::clearEdges() {
+    InputSwitchState& saved = rtcMemoryManager->getState().inputSwitch;
+    saved.edgeCount = 0;
+    saved.droppedEdges = 0;
+}
+
+void InputSwitch::prepareForSleep() {
+    detachInterrupt(digitalPinToInterrupt(pin));
+    loop();
+    timestampQueuedEdges(true);
+
+    InputSwitchState& saved = rtcMemoryManager->getState().inputSwitch;
+    saved.closed = closed ? 1 : 0;
+    saved.known = 1;
+
+    // Wake as soon as the switch leaves the state it is in now
+    PlatformUtils::enableWakeOnPin(pin, closed ? HIGH : LOW);
+}
@@ -0,0 +1,81 @@
+#ifndef INPUT_SWITCH_H
+#define INPUT_SWITCH_H
+
+#include <Arduino.h>
+
+class RTCMemoryManager;
+class TimeSyncManager;
+struct SwitchEdge;
+
+// Reports a door, float or reed switch the moment it changes instead of at the
+// next sampling slot. The switch closes the input to ground (pulled up).
+//
+// While awake, edges are caught by a pin interrupt and debounced in the
+// interrupt handler: the first edge of a bounce burst is taken and timestamped,
+// the rest of the burst is ignored. A burst that settles back on the other
+// level is picked up by loop() once the pin has been quiet for DEBOUNCE_MS.
+//
+// While asleep the switch wakes the device itself. The ESP32 arms an ext0
+// wake on the level the switch would change to. The ESP8266 can only wake
+// through RST, so the switch is also wired to RST through an edge-to-pulse
+// circuit, and the state latched in RTC memory before sleeping tells whether
+// the switch moved. Either way the wake cuts the sleep short, so the clock has
+// to be synchronized again before the edge can be timestamped.
+class InputSwitch {
+public:
+    static const uint32_t DEBOUNCE_MS = 20;
+
+private:
+    static const uint8_t QUEUE_SIZE = 8;   // Edges caught but not yet timestamped
+    static InputSwitch* instance;          // For the interrupt handler
+
+    RTCMemoryManager* rtcMemoryManager;
+    TimeSyncManager* timeSyncManager;
+    int pin;
+
+    // Written by the interrupt handler
+    volatile bool closed;                   // Debounced state
+    volatile unsigned long lastAcceptedAt;
+    volatile unsigned long lastChangeAt;
+    volatile unsigned long queuedAt[QUEUE_SIZE];
+    volatile uint8_t queuedClosed[QUEUE_SIZE];
+    volatile uint8_t queueHead;
+    volatile uint8_t queueTail;
+    volatile uint8_t queueDropped;
+
+    bool changedWhileAsleep;
+
+    static void IRAM_ATTR onChange();
+    bool readClosed() const;
+    void queueEdge(unsigned long atMillis, bool isClosed);
+    void recordEdge(uint32_t atSeconds, uint16_t atMillis, bool isClosed);
+    void timestampQueuedEdges(bool force);
+
+public:
+    InputSwitch(RTCMemoryManager* rtc, TimeSyncManager* timeSync, int switchPin);
+
+    // Reads the settled state and compares it with the one latched before
+    // sleeping. Call before restoring the clock.
+    void begin();
+    bool wasChangedWhileAsleep() const { return changedWhileAsleep; }
+    // Stops watching the pin, for a change to another mode. Unsent edges stay
+    // queued; the latched state is forgotten so a later begin() does not take
+    // the change for a wake.
+    void end();
+
+    // Settles bounce bursts and timestamps edges once the clock allows
+    void loop();
+
+    bool isClosed() const { return closed; }
+
+    // Edges waiting to be uploaded, oldest first
+    uint8_t getEdgeCount() const;
+    const SwitchEdge& getEdge(uint8_t index) const;
+    uint8_t getDroppedEdges() const;
+    void clearEdges();
+
+    // Keeps unsent edges and the current state in RTC memory and arms the wake
+    void prepareForSleep();
+};
+
+#endif
@@ -0,0 +1,45 @@
+#include "PresenceBeacon.h"
+#include <WiFiUdp.h>
+
+// Administratively scoped, so routers keep it on the LAN
+static const uint8_t GROUP[4] = { 239, 255, 79, 77 };
+
+PresenceBeacon::PresenceBeacon() : sent(false), lastSentAt(0) {
+}
+
+bool PresenceBeacon::announce(const JsonDocument& announcement) {
+    size_t length = measureJson(announcement);
+    if (length == 0 || length > MAX_DATAGRAM) {
+        Serial.println("Presence announcement too large");
+        return false;
+    }
+    // On the heap: the largest one would take a third of the ESP8266's stack
+    String datagram;
+    datagram.reserve(length);
+    serializeJson(announcement, datagram);
+
+    IPAddress group(GROUP[0], GROUP[1], GROUP[2], GROUP[3]);
+    WiFiUDP udp;
+#ifdef ESP8266_PLATFORM
+    bool started = udp.beginPacketMulticast(group, PORT, WiFi.localIP());
+#else
+    bool started = udp.beginPacket(group, PORT);
+#endif
+    bool delivered = started && udp.write((const uint8_t*)datagram.c_str(), length) == length && udp.endPacket();
+
+    // Counted as sent either way: a beacon is not worth retrying every loop
+    sent = true;
+    lastSentAt = millis();
+    if (!delivered) {
+        Serial.println("Failed to send presence announcement");
+        return false;
+    }
+    Serial.print("Announced presence (");
+    Serial.print(length);
+    Serial.println(" bytes)");
+    return true;
+}
+
+bool PresenceBeacon::isDue() const {
+    return !sent || millis() - lastSentAt >= REPEAT_MS;
+}
@@ -0,0 +1,40 @@
+#ifndef PRESENCE_BEACON_H
+#define PRESENCE_BEACON_H
+
+#include "platform_config.h"
+
+// Announces the device with one small UDP datagram to a multicast group each
+// time it comes online, so the server learns about it, and where it is, the
+// moment it wakes instead of having to catch it with a search of the LAN.
+// A device that stays awake announces itself again every REPEAT_MS, for a
+// server that starts while it is up.
+//
+// The datagram is the JSON the caller builds; "interval" in it tells the
+// server when to expect the next one.
+class PresenceBeacon {
+public:
+    static const uint16_t PORT = 4277;
+    static const uint32_t REPEAT_MS = 300000;
+
+    // Longest alias and server URL EEPROMManager keeps
+    static const uint16_t MAX_FIELD = 254;
+    // For the caller's document: both of those copied in, the rest and the
+    // object itself well inside the remainder
+    static const size_t DOCUMENT_SIZE = 2 * (MAX_FIELD + 1) + 512;
+
+private:
+    // The fixed fields come to under 256 bytes; the alias and URL at most twice
+    // their length once escaped. Still one frame on any LAN.
+    static const uint16_t MAX_DATAGRAM = 256 + 4 * MAX_FIELD;
+
+    bool sent;
+    unsigned long lastSentAt;
+
+public:
+    PresenceBeacon();
+
+    bool announce(const JsonDocument& announcement);
+    bool isDue() const;
+};
+
+#endif
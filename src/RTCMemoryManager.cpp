@@ -0,0 +1,61 @@
+#include "RTCMemoryManager.h"
+#include "platform_config.h"
+
+#ifdef ESP8266_PLATFORM
+static_assert(sizeof(RTCState) <= 384, "RTCState does not fit in ESP8266 user RTC memory");
+static_assert(sizeof(RTCState) % 4 == 0, "RTCState must be a whole number of RTC blocks");
+#elif defined(ESP32_PLATFORM)
+// Survives deep sleep; contents are validated by magic and CRC on load
+RTC_DATA_ATTR static RTCState rtcStateStorage;
+#endif
+
+RTCMemoryManager::RTCMemoryManager() : valid(false) {
+    memset(&state, 0, sizeof(state));
+}
+
+bool RTCMemoryManager::load() {
+#ifdef ESP8266_PLATFORM
+    ESP.rtcUserMemoryRead(RTC_USER_OFFSET_BLOCKS, (uint32_t*)&state, sizeof(state));
+#elif defined(ESP32_PLATFORM)
+    memcpy(&state, &rtcStateStorage, sizeof(state));
+#endif
+
+    valid = state.magic == RTC_MAGIC && state.crc == calculateCrc();
+    if (!valid) {
+        Serial.println("RTC memory empty or corrupt - starting fresh");
+        clear();
+    }
+    return valid;
+}
+
+void RTCMemoryManager::save() {
+    state.magic = RTC_MAGIC;
+    state.crc = calculateCrc();
+
+#ifdef ESP8266_PLATFORM
+    ESP.rtcUserMemoryWrite(RTC_USER_OFFSET_BLOCKS, (uint32_t*)&state, sizeof(state));
+#elif defined(ESP32_PLATFORM)
+    memcpy(&rtcStateStorage, &state, sizeof(state));
+#endif
+    valid = true;
+}
+
+void RTCMemoryManager::clear() {
+    memset(&state, 0, sizeof(state));
+    valid = false;
+}
+
+uint32_t RTCMemoryManager::calculateCrc() const {
+    // CRC32 over everything after the crc field
+    const uint8_t* data = (const uint8_t*)&state + sizeof(state.crc);
+    size_t length = sizeof(state) - sizeof(state.crc);
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
@@ -0,0 +1,169 @@
+#ifndef RTC_MEMORY_MANAGER_H
+#define RTC_MEMORY_MANAGER_H
+
+#include <Arduino.h>
+
+// Clock state carried across deep sleep by TimeSyncManager
+struct TimeSyncState {
+    uint64_t wallTimeAtSleepMs;     // Estimated server time when deep sleep began
+    uint32_t requestedSleepMs;      // Sleep duration handed to the RTC
+    uint32_t sleptSinceSyncMs;      // Nominal sleep accumulated since the last exchange
+    uint32_t errorBoundAtSleepMs;   // Estimated clock error when deep sleep began
+    int32_t driftPpm;               // Estimated RTC rate error (positive = RTC runs slow)
+    uint32_t driftUncertaintyPpm;   // Confidence in driftPpm
+    uint16_t syncCount;             // Number of exchanges feeding the drift estimate
+    uint16_t lastSyncErrorMs;       // Error bound of the last exchange (half its round trip)
+    uint8_t timeValid;              // wallTimeAtSleepMs holds a synchronized time
+    uint8_t reserved[3];
+};
+
+// Sampling grid position carried across deep sleep by CadenceScheduler
+struct CadenceState {
+    uint64_t currentSlotMs;         // Server time the next wake is planned for: grid slot or event (0 = none)
+    uint32_t missedSlots;           // Slots skipped because a wake overran its period
+    uint32_t periodMs;              // Grid period currentSlotMs was computed for
+};
+
+// Valve position carried across deep sleep by ValveController (mirrored in EEPROM)
+struct ValveState {
+    uint32_t lastEventAtSeconds;    // Schedule event most recently actuated (0 = none)
+    uint8_t state;                  // ValveController::STATE_*; 0 in fresh RTC memory
+    uint8_t known;                  // state/lastEventAtSeconds have been restored
+    uint8_t reserved[2];
+};
+
+// Rule engine progress carried across deep sleep by RuleEngine
+struct RuleRuntime {
+    uint32_t activeUntilSeconds;    // Output held on until this time (0 = idle)
+    uint32_t lastEndedAtSeconds;    // End of the last firing, for the minimum off time
+    uint8_t matchCount;             // Consecutive samples meeting the condition
+    uint8_t reserved[3];
+};
+
+// Rule firing not yet reported to the server
+struct RuleFiring {
+    uint32_t atSeconds;
+    uint8_t rule;
+    uint8_t reserved;
+    int16_t value;                  // Sample that completed the condition
+};
+
+struct RuleEngineState {
+    static const uint8_t MAX_RULES = 8;
+    static const uint8_t MAX_FIRINGS = 4;
+
+    uint32_t rulesVersion;          // Rule set the runtime below belongs to
+    RuleRuntime rules[MAX_RULES];
+    RuleFiring firings[MAX_FIRINGS];
+    uint8_t firingCount;
+    uint8_t droppedFirings;         // Firings lost because the log was full
+    uint8_t reserved[2];
+};
+
+// Firmware update attempts carried across deep sleep by FirmwareUpdater
+struct FirmwareState {
+    uint32_t failedBuild;           // Build whose download or flash last failed (0 = none)
+    uint8_t failures;               // Consecutive failures for failedBuild
+    uint8_t reserved[3];
+};
+
+// Switch edge not yet uploaded, kept by InputSwitch
+struct SwitchEdge {
+    uint32_t atSeconds;             // Server time of the edge (0 = clock was not synchronized)
+    uint16_t atMillis;
+    uint8_t closed;                 // Switch state the edge left it in
+    uint8_t reserved;
+};
+
+// Input switch state carried across deep sleep by InputSwitch
+struct InputSwitchState {
+    static const uint8_t MAX_EDGES = 4;
+
+    SwitchEdge edges[MAX_EDGES];
+    uint8_t edgeCount;
+    uint8_t droppedEdges;           // Older edges pushed out by newer ones
+    uint8_t closed;                 // Debounced switch state when deep sleep began
+    uint8_t known;                  // closed is valid
+};
+
+// Servo position at rest carried across deep sleep by ServoController
+struct ServoState {
+    int16_t positionTenths;         // Tenths of a degree
+    uint8_t known;                  // The servo was left at positionTenths
+    uint8_t reserved;
+};
+
+// Phase durations of the last complete wake cycle, recorded by EnergyMonitor
+struct EnergyState {
+    uint32_t awakeMs;               // Boot to deep sleep
+    uint32_t radioMs;               // Part of awakeMs with the WiFi radio on
+    uint32_t sensorMs;              // Part of awakeMs with the sensor powered from SENSE_POWER for a reading
+    uint32_t sleepMs;               // Deep sleep that followed
+    uint32_t cycles;                // Cycles recorded since RTC memory was cleared (0 = none yet)
+};
+
+// Server address carried across deep sleep by ServerEndpoint
+struct DnsCacheState {
+    uint32_t hostHash;              // Server host the address belongs to (0 = none)
+    uint32_t expiresAtSeconds;      // Server time the DNS record's TTL runs out
+    uint8_t address[4];
+};
+
+// TLS session carried across deep sleep by ServerEndpoint, so a wake resumes
+// it instead of making a full handshake. session holds the TLS client's
+// session object byte for byte: ID, cipher suite and master secret.
+struct TlsSessionState {
+    uint32_t hostHash;              // Server host the session belongs to (0 = none)
+    uint8_t session[88];
+};
+
+// CoAP fallback carried across deep sleep by DeviceManager, so wakes after one
+// that got no answer over CoAP go straight to HTTP instead of waiting it out
+struct TransportState {
+    uint16_t coapSkipWakes;         // Wakes left that use HTTP in place of CoAP
+    uint8_t reserved[2];
+};
+
+// Everything we keep in RTC memory. Must stay a multiple of 4 bytes and fit in
+// the 384 bytes of ESP8266 user RTC memory left over after the OTA area.
+struct RTCState {
+    uint32_t crc;
+    uint32_t magic;
+    TimeSyncState timeSync;
+    CadenceState cadence;
+    ValveState valve;
+    RuleEngineState ruleEngine;
+    FirmwareState firmware;
+    EnergyState energy;
+    InputSwitchState inputSwitch;
+    ServoState servo;
+    DnsCacheState dnsCache;
+    TlsSessionState tlsSession;
+    TransportState transport;       // In the tail padding left by the 8-byte alignment
+};
+
+class RTCMemoryManager {
+private:
+    static const uint32_t RTC_MAGIC = 0x4F4D4E31; // "OMN1"
+#ifdef ESP8266_PLATFORM
+    // The first 128 bytes (32 blocks) of user RTC memory are used by OTA
+    static const uint32_t RTC_USER_OFFSET_BLOCKS = 32;
+#endif
+
+    RTCState state;
+    bool valid;
+
+    uint32_t calculateCrc() const;
+
+public:
+    RTCMemoryManager();
+
+    bool load();
+    void save();
+    void clear();
+
+    bool isValid() const { return valid; }
+    RTCState& getState() { return state; }
+};
+
+#endif
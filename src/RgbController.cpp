@@ -0,0 +1,196 @@
+#include "RgbController.h"
+
+// Gamma table, built by the compiler. pow() is not constexpr, so the curve
+// is x^2.25 = x^2 * sqrt(sqrt(x)), with the square root found by Newton's
+// method; written for C++11 since the ESP32 core still builds with it.
+namespace {
+    constexpr double newtonSqrt(double x, double guess, int steps) {
+        return steps == 0 ? guess : newtonSqrt(x, (guess + x / guess) / 2, steps - 1);
+    }
+
+    constexpr double constSqrt(double x) {
+        return x <= 0 ? 0 : newtonSqrt(x, 1, 24);
+    }
+
+    constexpr uint16_t gammaDuty(int level) {
+        return (uint16_t)(RgbController::PWM_MAX * (level / 255.0) * (level / 255.0) *
+            constSqrt(constSqrt(level / 255.0)) + 0.5);
+    }
+
+    template <int... Levels> struct LevelList {};
+    template <int N, int... Levels> struct MakeLevels : MakeLevels<N - 1, N - 1, Levels...> {};
+    template <int... Levels> struct MakeLevels<0, Levels...> { typedef LevelList<Levels...> type; };
+
+    template <typename List> struct GammaTable;
+    template <int... Levels> struct GammaTable<LevelList<Levels...>> {
+        static const uint16_t duty[sizeof...(Levels)];
+    };
+    template <int... Levels>
+    const uint16_t GammaTable<LevelList<Levels...>>::duty[sizeof...(Levels)] PROGMEM = { gammaDuty(Levels)... };
+
+    typedef GammaTable<MakeLevels<256>::type> Gamma;
+}
+
+RgbController::RgbController(int redPin, int greenPin, int bluePin) :
+    frame(0), loopsLeft(0), playing(false), frameStartedAt(0) {
+    pins[0] = redPin;
+    pins[1] = greenPin;
+    pins[2] = bluePin;
+    memset(&sequence, 0, sizeof(sequence));
+    for (uint8_t i = 0; i < CHANNELS; i++) {
+        current[i] = 0;
+        fadeFrom[i] = 0;
+        writtenDuty[i] = 0;
+    }
+}
+
+void RgbController::begin() {
+#ifdef ESP32_PLATFORM
+    for (uint8_t i = 0; i < CHANNELS; i++) {
+        ledcSetup(LEDC_FIRST_CHANNEL + i, PWM_FREQUENCY, 10);
+        ledcWrite(LEDC_FIRST_CHANNEL + i, 0);
+        ledcAttachPin(pins[i], LEDC_FIRST_CHANNEL + i);
+    }
+#else
+    analogWriteRange(PWM_MAX);
+    analogWriteFreq(PWM_FREQUENCY);
+    for (uint8_t i = 0; i < CHANNELS; i++) {
+        pinMode(pins[i], OUTPUT);
+        analogWrite(pins[i], 0);
+    }
+#endif
+}
+
+void RgbController::end() {
+    frameTicker.detach();
+    playing = false;
+    for (uint8_t i = 0; i < CHANNELS; i++) {
+        current[i] = 0;
+        fadeFrom[i] = 0;
+        writtenDuty[i] = 0;
+#ifdef ESP32_PLATFORM
+        ledcWrite(LEDC_FIRST_CHANNEL + i, 0);
+        ledcDetachPin(pins[i]);
+#else
+        analogWrite(pins[i], 0);
+#endif
+        pinMode(pins[i], OUTPUT);
+        digitalWrite(pins[i], LOW);
+    }
+}
+
+bool RgbController::play(const RgbSequence& newSequence) {
+    if (newSequence.count == 0 || newSequence.count > RgbSequence::MAX_KEYFRAMES) {
+        return false;
+    }
+    // Looping frames that take no time would keep the timer busy forever
+    uint32_t cycleMs = 0;
+    for (uint8_t i = 0; i < newSequence.count; i++) {
+        cycleMs += newSequence.frames[i].fadeMs + newSequence.frames[i].holdMs;
+    }
+    if (newSequence.loops == 0 && cycleMs < FRAME_MS) {
+        return false;
+    }
+
+    frameTicker.detach();
+    sequence = newSequence;
+    frame = 0;
+    loopsLeft = sequence.loops;
+    memcpy(fadeFrom, current, sizeof(current));
+    frameStartedAt = millis();
+    playing = true;
+
+    Serial.print("Playing ");
+    Serial.print(sequence.count);
+    Serial.print(" light keyframe(s), ");
+    Serial.print(cycleMs);
+    Serial.println(" ms per pass");
+
+    onFrame(this);
+    if (playing) {
+        frameTicker.attach_ms(FRAME_MS, &RgbController::onFrame, this);
+    }
+    return true;
+}
+
+void RgbController::setColor(uint8_t red, uint8_t green, uint8_t blue, uint16_t fadeMs) {
+    RgbSequence single = {};
+    single.frames[0].red = red;
+    single.frames[0].green = green;
+    single.frames[0].blue = blue;
+    single.frames[0].fadeMs = fadeMs;
+    single.count = 1;
+    single.loops = 1;
+    play(single);
+}
+
+bool RgbController::isLit() const {
+    return playing || current[0] != 0 || current[1] != 0 || current[2] != 0;
+}
+
+void RgbController::onFrame(RgbController* controller) {
+    // Timer context
+    controller->advance(millis());
+    controller->writeOutput();
+    if (!controller->playing) {
+        controller->frameTicker.detach();
+    }
+}
+
+void RgbController::advance(unsigned long now) {
+    while (playing) {
+        const RgbKeyframe& keyframe = sequence.frames[frame];
+        uint16_t target[CHANNELS] = {
+            (uint16_t)(keyframe.red << 8), (uint16_t)(keyframe.green << 8), (uint16_t)(keyframe.blue << 8)
+        };
+        uint32_t elapsed = now - frameStartedAt;
+
+        if (elapsed < keyframe.fadeMs) {
+            // Q15 fraction of the fade; elapsed < 65536 so the shift fits
+            int32_t fraction = (int32_t)((elapsed << 15) / keyframe.fadeMs);
+            for (uint8_t i = 0; i < CHANNELS; i++) {
+                int32_t span = (int32_t)target[i] - fadeFrom[i];
+                current[i] = (uint16_t)(fadeFrom[i] + ((span * fraction) >> 15));
+            }
+            return;
+        }
+
+        memcpy(current, target, sizeof(current));
+        if (elapsed < (uint32_t)keyframe.fadeMs + keyframe.holdMs) {
+            return;
+        }
+
+        // On to the next keyframe, timed from where this one ended rather than
+        // from now, so a late frame does not shift the rest of the sequence
+        frameStartedAt += keyframe.fadeMs + keyframe.holdMs;
+        memcpy(fadeFrom, current, sizeof(current));
+        if (frame + 1 < sequence.count) {
+            frame++;
+        } else if (sequence.loops == 0 || --loopsLeft > 0) {
+            frame = 0;
+        } else {
+            playing = false;
+        }
+    }
+}
+
+void RgbController::writeOutput() {
+    for (uint8_t i = 0; i < CHANNELS; i++) {
+        // Interpolate between neighbouring table entries with the low byte
+        uint8_t level = current[i] >> 8;
+        uint8_t fraction = current[i] & 0xFF;
+        uint16_t low = pgm_read_word(&Gamma::duty[level]);
+        uint16_t high = level < 255 ? pgm_read_word(&Gamma::duty[level + 1]) : low;
+        uint16_t duty = low + (uint16_t)(((uint32_t)(high - low) * fraction) >> 8);
+
+        if (duty == writtenDuty[i]) {
+            continue;
+        }
+        writtenDuty[i] = duty;
+#ifdef ESP32_PLATFORM
+        ledcWrite(LEDC_FIRST_CHANNEL + i, duty);
+#else
+        analogWrite(pins[i], duty);
+#endif
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef RGB_CONTROLLER_H
+#define RGB_CONTROLLER_H
+
+#include <Arduino.h>
+#include <Ticker.h>
+
+// One step of a light sequence: fade from wherever the light is to this color,
+// then hold it
+struct RgbKeyframe {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    uint8_t reserved;
+    uint16_t fadeMs;
+    uint16_t holdMs;
+};
+
+struct RgbSequence {
+    static const uint8_t MAX_KEYFRAMES = 12;
+
+    RgbKeyframe frames[MAX_KEYFRAMES];
+    uint8_t count;
+    uint8_t loops;                  // Times to play the frames, 0 = until replaced
+};
+
+// Drives an RGB LED (or a strip through MOSFETs) from hardware PWM - LEDC on
+// the ESP32, the waveform generator behind analogWrite() on the ESP8266 - and
+// plays fades and keyframe sequences on it in the background. A whole
+// sequence arrives in one command, so the server does not stream colors.
+//
+// A Ticker advances the sequence every FRAME_MS; loop() is never involved.
+// Colors are interpolated in 8.8 fixed point and the fraction carried into
+// the gamma table lookup, so slow fades at low brightness step smoothly
+// instead of in visible jumps between the table entries. The gamma table is
+// computed by the compiler and lives in flash.
+class RgbController {
+public:
+    static const uint16_t PWM_MAX = 1023;   // 10-bit duty on both platforms
+
+private:
+    static const uint32_t FRAME_MS = 10;
+    static const uint8_t CHANNELS = 3;
+#ifdef ESP32_PLATFORM
+    static const uint32_t PWM_FREQUENCY = 5000;
+    static const uint8_t LEDC_FIRST_CHANNEL = 2;   // Clear of the timer the servo's channel 0 uses
+#else
+    static const uint32_t PWM_FREQUENCY = 1000;
+#endif
+
+    int pins[CHANNELS];
+    Ticker frameTicker;
+    RgbSequence sequence;
+
+    // 8.8 fixed point, so fades keep their fraction between frames
+    uint16_t current[CHANNELS];
+    uint16_t fadeFrom[CHANNELS];
+    uint16_t writtenDuty[CHANNELS];
+    uint8_t frame;
+    uint8_t loopsLeft;
+    volatile bool playing;
+    unsigned long frameStartedAt;
+
+    static void onFrame(RgbController* controller);
+    void advance(unsigned long now);
+    void writeOutput();
+
+public:
+    RgbController(int redPin, int greenPin, int bluePin);
+
+    void begin();
+    // Dark, and the pins released for another mode
+    void end();
+
+    // Replaces whatever is playing, starting from the current color. Returns
+    // false if the sequence is empty or would loop forever without taking time.
+    bool play(const RgbSequence& newSequence);
+    void setColor(uint8_t red, uint8_t green, uint8_t blue, uint16_t fadeMs);
+
+    bool isPlaying() const { return playing; }
+    bool isLit() const;
+    uint8_t getRed() const { return current[0] >> 8; }
+    uint8_t getGreen() const { return current[1] >> 8; }
+    uint8_t getBlue() const { return current[2] >> 8; }
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "RuleEngine.h"
+#include "RTCMemoryManager.h"
+#include "TimeSyncManager.h"
+
+static_assert(RuleEngineState::MAX_RULES == RuleSet::MAX_RULES, "RTC rule runtime must cover every rule");
+
+RuleEngine::RuleEngine(EEPROMManager* eeprom, RTCMemoryManager* rtc, TimeSyncManager* timeSync) :
+    eepromManager(eeprom), rtcMemoryManager(rtc), timeSyncManager(timeSync) {
+    memset(&ruleSet, 0, sizeof(ruleSet));
+}
+
+void RuleEngine::begin() {
+    eepromManager->getRules(ruleSet);
+
+    // Progress towards a different rule set means nothing
+    if (rtcMemoryManager->getState().ruleEngine.rulesVersion != ruleSet.version) {
+        resetProgress();
+    }
+
+    if (ruleSet.count > 0) {
+        Serial.print("Loaded rule set version ");
+        Serial.print(ruleSet.version);
+        Serial.print(" with ");
+        Serial.print(ruleSet.count);
+        Serial.println(" rules");
+    }
+}
+
+RuleEngine::OutputChange RuleEngine::addSample(uint8_t sensor, int16_t value) {
+    if (ruleSet.count == 0) {
+        return OUTPUT_UNCHANGED;
+    }
+
+    RuleEngineState& saved = rtcMemoryManager->getState().ruleEngine;
+    bool synchronized = timeSyncManager->isSynchronized();
+    uint32_t nowSeconds = (uint32_t)(timeSyncManager->getCurrentTime() / 1000);
+    bool wasHeld = isOutputHeld();
+
+    for (uint8_t i = 0; i < ruleSet.count; i++) {
+        const Rule& rule = ruleSet.rules[i];
+        RuleRuntime& runtime = saved.rules[i];
+        if (rule.sensor != sensor) {
+            continue;
+        }
+
+        bool met = rule.comparison == Rule::BELOW ? value < rule.threshold : value > rule.threshold;
+        if (!met) {
+            runtime.matchCount = 0;
+            continue;
+        }
+        if (runtime.matchCount < 255) {
+            runtime.matchCount++;
+        }
+
+        if (runtime.activeUntilSeconds != 0 || runtime.matchCount < rule.samples) {
+            continue;
+        }
+        if (!synchronized) {
+            Serial.print("Rule ");
+            Serial.print(i);
+            Serial.println(" matched but the clock is not set - not firing");
+            continue;
+        }
+        if (runtime.lastEndedAtSeconds != 0 && nowSeconds - runtime.lastEndedAtSeconds < rule.minOffSeconds) {
+            continue;
+        }
+
+        runtime.activeUntilSeconds = nowSeconds + rule.durationSeconds;
+        runtime.matchCount = 0;
+        recordFiring(i, nowSeconds, value);
+
+        Serial.print("Rule ");
+        Serial.print(i);
+        Serial.print(" fired on ");
+        Serial.print(value);
+        Serial.print(" - output on for ");
+        Serial.print(rule.durationSeconds);
+        Serial.println("s");
+    }
+
+    return !wasHeld && isOutputHeld() ? OUTPUT_ON : OUTPUT_UNCHANGED;
+}
+
+RuleEngine::OutputChange RuleEngine::loop() {
+    if (!isOutputHeld() || !timeSyncManager->isSynchronized()) {
+        return OUTPUT_UNCHANGED;
+    }
+
+    RuleEngineState& saved = rtcMemoryManager->getState().ruleEngine;
+    uint32_t nowSeconds = (uint32_t)(timeSyncManager->getCurrentTime() / 1000);
+
+    for (uint8_t i = 0; i < RuleSet::MAX_RULES; i++) {
+        RuleRuntime& runtime = saved.rules[i];
+        if (runtime.activeUntilSeconds != 0 && nowSeconds >= runtime.activeUntilSeconds) {
+            runtime.activeUntilSeconds = 0;
+            runtime.lastEndedAtSeconds = nowSeconds;
+            Serial.print("Rule ");
+            Serial.print(i);
+            Serial.println(" finished");
+        }
+    }
+
+    // Overlapping rules share the output; it goes off when the last one ends
+    return isOutputHeld() ? OUTPUT_UNCHANGED : OUTPUT_OFF;
+}
+
+bool RuleEngine::setRules(const RuleSet& rules) {
+    if (rules.count > RuleSet::MAX_RULES) {
+        Serial.println("Rejecting rule set - too many rules");
+        return false;
+    }
+    for (uint8_t i = 0; i < rules.count; i++) {
+        const Rule& rule = rules.rules[i];
+        if (rule.sensor > Rule::SENSOR_TEMPERATURE || rule.comparison > Rule::ABOVE ||
+            rule.samples == 0 || rule.durationSeconds == 0) {
+            Serial.print("Rejecting rule set - rule ");
+            Serial.print(i);
+            Serial.println(" is invalid");
+            return false;
+        }
+    }
+
+    if (rules.version == ruleSet.version) {
+        return true;
+    }
+
+    ruleSet = rules;
+    eepromManager->setRules(ruleSet);
+    resetProgress();
+    return true;
+}
+
+void RuleEngine::resetProgress() {
+    // Firings already under way keep running so a held output is still released
+    RuleEngineState& saved = rtcMemoryManager->getState().ruleEngine;
+    for (uint8_t i = 0; i < RuleSet::MAX_RULES; i++) {
+        saved.rules[i].matchCount = 0;
+        saved.rules[i].lastEndedAtSeconds = 0;
+    }
+    saved.rulesVersion = ruleSet.version;
+}
+
+bool RuleEngine::isOutputHeld() const {
+    // Every slot, not just ruleSet.count - a removed rule may still be firing
+    const RuleEngineState& saved = rtcMemoryManager->getState().ruleEngine;
+    for (uint8_t i = 0; i < RuleSet::MAX_RULES; i++) {
+        if (saved.rules[i].activeUntilSeconds != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t RuleEngine::getNextDeadline() const {
+    const RuleEngineState& saved = rtcMemoryManager->getState().ruleEngine;
+    uint32_t nextSeconds = 0;
+    for (uint8_t i = 0; i < RuleSet::MAX_RULES; i++) {
+        uint32_t until = saved.rules[i].activeUntilSeconds;
+        if (until != 0 && (nextSeconds == 0 || until < nextSeconds)) {
+            nextSeconds = until;
+        }
+    }
+    return (uint64_t)nextSeconds * 1000;
+}
+
+void RuleEngine::recordFiring(uint8_t rule, uint32_t atSeconds, int16_t value) {
+    RuleEngineState& saved = rtcMemoryManager->getState().ruleEngine;
+    if (saved.firingCount >= RuleEngineState::MAX_FIRINGS) {
+        // Keep the oldest firings; the dropped count tells the server there were more
+        if (saved.droppedFirings < 255) {
+            saved.droppedFirings++;
+        }
+        return;
+    }
+
+    RuleFiring& firing = saved.firings[saved.firingCount++];
+    firing.atSeconds = atSeconds;
+    firing.rule = rule;
+    firing.value = value;
+}
+
+uint8_t RuleEngine::getFiringCount() const {
+    return rtcMemoryManager->getState().ruleEngine.firingCount;
+}
+
+const RuleFiring& RuleEngine::getFiring(uint8_t index) const {
+    return rtcMemoryManager->getState().ruleEngine.firings[index];
+}
+
+uint8_t RuleEngine::getDroppedFirings() const {
+    return rtcMemoryManager->getState().ruleEngine.droppedFirings;
+}
+
+void RuleEngine::clearFirings() {
+    RuleEngineState& saved = rtcMemoryManager->getState().ruleEngine;
+    saved.firingCount = 0;
+    saved.droppedFirings = 0;
+}
@@ -0,0 +1,64 @@
+#ifndef RULE_ENGINE_H
+#define RULE_ENGINE_H
+
+#include <Arduino.h>
+#include "EEPROMManager.h"
+
+class RTCMemoryManager;
+class TimeSyncManager;
+struct RuleFiring;
+
+// Evaluates server-delivered rules against local sensor samples so the device
+// can drive its output (relay or valve) without a round trip to the server.
+//
+// Each sample updates a per-rule run of consecutive matches; once a rule has
+// matched for its sample count it holds the output on for its duration, and
+// may not fire again until its minimum off time has passed. Progress survives
+// deep sleep in RTC memory. Durations are measured on the synchronized clock,
+// so rules do not fire until the clock has been set once since power-up.
+//
+// The engine only decides; the caller applies the returned output change.
+class RuleEngine {
+public:
+    enum OutputChange {
+        OUTPUT_UNCHANGED,
+        OUTPUT_ON,
+        OUTPUT_OFF
+    };
+
+private:
+    EEPROMManager* eepromManager;
+    RTCMemoryManager* rtcMemoryManager;
+    TimeSyncManager* timeSyncManager;
+    RuleSet ruleSet;
+
+    void recordFiring(uint8_t rule, uint32_t atSeconds, int16_t value);
+    void resetProgress();
+
+public:
+    RuleEngine(EEPROMManager* eeprom, RTCMemoryManager* rtc, TimeSyncManager* timeSync);
+
+    void begin();
+
+    // Feed a sample (ADC counts, or tenths of a degree for temperature)
+    OutputChange addSample(uint8_t sensor, int16_t value);
+
+    // Ends firings whose duration is up
+    OutputChange loop();
+
+    // Replaces the rule set. Returns false if the rules are invalid.
+    bool setRules(const RuleSet& rules);
+
+    bool hasRules() const { return ruleSet.count > 0; }
+    uint32_t getRulesVersion() const { return ruleSet.version; }
+    bool isOutputHeld() const;
+    uint64_t getNextDeadline() const; // Server time in ms a firing ends, 0 if none
+
+    // Firings waiting to be reported upstream
+    uint8_t getFiringCount() const;
+    const RuleFiring& getFiring(uint8_t index) const;
+    uint8_t getDroppedFirings() const;
+    void clearFirings();
+};
+
+#endif
@@ -1,10 +1,16 @@
 #include "SensorManager.h"
 
-SensorManager::SensorManager(int oneWirePin, int powerPin) : 
+SensorManager::SensorManager(EEPROMManager* eeprom, int oneWirePin, int powerPin) : 
+    eepromManager(eeprom),
     oneWireBus(oneWirePin), 
-    sensePowerPin(powerPin) {
+    sensePowerPin(powerPin),
+    poweredMs(0),
+    converting(false),
+    rescanPending(false),
+    conversionStartedAt(0) {
     oneWire = new OneWire(oneWireBus);
     sensors = new DallasTemperature(oneWire);
+    memset(&probes, 0, sizeof(probes));
 }
 
 SensorManager::~SensorManager() {
@@ -20,38 +26,162 @@ void SensorManager::init() {
     #ifdef ESP32_PLATFORM
         pinMode(A0, INPUT);
     #endif
+}
+
+// Only for modes with probes on the bus: it shares its pin with other modes' I/O
+void SensorManager::beginProbes() {
+    eepromManager->getProbes(probes);
+    if (probes.count == 0) {
+        findProbes();
+    } else if (probes.parasite) {
+        // The library only drives the strong pull-up a parasite probe needs
+        // for its conversion after begin() has found it on the bus
+        sensors->begin();
+    }
+    sensors->setWaitForConversion(false);
     
+    Serial.print(probes.count);
+    Serial.println(" temperature probe(s)");
+}
+
+void SensorManager::findProbes() {
+    Serial.println("Searching OneWire bus for probes");
     sensors->begin();
-    // First reading is often inaccurate, so do a dummy read
+    
+    ProbeList found = {};
+    uint8_t onBus = sensors->getDeviceCount();
+    for (uint8_t i = 0; i < onBus && found.count < MAX_PROBES; i++) {
+        if (sensors->getAddress(found.addresses[found.count], i)) {
+            found.count++;
+        }
+    }
+    found.parasite = sensors->isParasitePowerMode();
+    if (onBus > MAX_PROBES) {
+        Serial.print("Ignoring probes beyond the first ");
+        Serial.println(MAX_PROBES);
+    }
+    
+    // Nothing to remember from an empty bus; search again next boot
+    if (found.count > 0 && memcmp(&found, &probes, sizeof(found)) != 0) {
+        eepromManager->setProbes(found);
+    }
+    probes = found;
+}
+
+void SensorManager::rescanProbes() {
+    converting = false;
+    findProbes();
+    sensors->setWaitForConversion(false);
+}
+
+void SensorManager::startConversion() {
+    if (probes.count == 0) {
+        return;
+    }
+    
+    // Skip ROM: every probe converts at once, so the wait does not grow with
+    // the number of probes
     sensors->requestTemperatures();
-    sensors->getTempCByIndex(0);
+    conversionStartedAt = millis();
+    converting = true;
+}
+
+void SensorManager::waitForConversion() {
+    // A probe holds the line low until it is done, unless it is powered from
+    // the line itself; then the datasheet time is all there is to go by
+    while (millis() - conversionStartedAt < CONVERSION_MS) {
+        if (!probes.parasite && sensors->isConversionComplete()) {
+            break;
+        }
+        delay(5);
+    }
+    converting = false;
+}
+
+uint8_t SensorManager::readTemperatures(float* celsius) {
+    if (!converting) {
+        startConversion();
+    }
+    if (probes.count == 0) {
+        return 0;
+    }
+    waitForConversion();
+    
+    bool missing = false;
+    for (uint8_t i = 0; i < probes.count; i++) {
+        celsius[i] = sensors->getTempC(probes.addresses[i]);
+        missing = missing || celsius[i] == DEVICE_DISCONNECTED_C;
+        Serial.print("Temperature probe ");
+        Serial.print(i);
+        Serial.print(": ");
+        Serial.print(celsius[i]);
+        Serial.println("°C");
+    }
+    
+    // A probe that stopped answering may have been swapped; look again next
+    // boot rather than spending this wake on it
+    if (missing && !rescanPending) {
+        rescanPending = true;
+        Serial.println("Probe missing - searching the bus next boot");
+        ProbeList forget = {};
+        eepromManager->setProbes(forget);
+    }
+    return probes.count;
 }
 
 float SensorManager::readTemperature() {
-    sensors->requestTemperatures();
-    float temperatureC = sensors->getTempCByIndex(0);
-    Serial.print("Temperature: ");
-    Serial.print(temperatureC);
-    Serial.println("°C");
-    return temperatureC;
+    float celsius[MAX_PROBES];
+    if (readTemperatures(celsius) == 0) {
+        return DEVICE_DISCONNECTED_C;
+    }
+    return celsius[0];
+}
+
+String SensorManager::getProbeId(uint8_t index) const {
+    static const char hex[] = "0123456789ABCDEF";
+    String id;
+    if (index >= probes.count) {
+        return id;
+    }
+    id.reserve(16);
+    for (uint8_t i = 0; i < 8; i++) {
+        id += hex[probes.addresses[index][i] >> 4];
+        id += hex[probes.addresses[index][i] & 0x0F];
+    }
+    return id;
 }
 
 int SensorManager::readSoilMoisture() {
     // Delay prevents voltage drop on 3.3v line when using capacitive soil sensor
     delay(100);
     powerSensorOn();
+    unsigned long poweredAt = millis();
     delay(100);
     int soil = analogRead(A0);
     powerSensorOff();
+    poweredMs += millis() - poweredAt;
     Serial.print("Read soil: ");
     Serial.println(soil);
     return soil;
 }
 
+// For modes where the sense power pin drives an output: the sensor on A0
+// has to be powered some other way
+int SensorManager::readAnalogUnpowered() {
+    int value = analogRead(A0);
+    Serial.print("Read analog: ");
+    Serial.println(value);
+    return value;
+}
+
 void SensorManager::powerSensorOn() {
     digitalWrite(sensePowerPin, HIGH);
 }
 
 void SensorManager::powerSensorOff() {
     digitalWrite(sensePowerPin, LOW);
+}
+
+unsigned long SensorManager::getPoweredMs() const {
+    return poweredMs;
 }
\ No newline at end of file
@@ -4,22 +4,51 @@
 #include <DallasTemperature.h>
 #include <OneWire.h>
 #include <Arduino.h>
+#include "EEPROMManager.h"
 
+// DS18B20 probes are addressed by the ROM IDs saved in EEPROM, so a boot does
+// not search the bus. One broadcast conversion covers every probe, and it is
+// started as early as possible in the wake so it runs while WiFi connects;
+// reading the probes afterwards only waits for whatever is left of it.
 class SensorManager {
+public:
+    static const uint8_t MAX_PROBES = ProbeList::MAX_PROBES;
+    static const uint16_t CONVERSION_MS = 750;     // 12-bit, the DS18B20 default
+
 private:
+    EEPROMManager* eepromManager;
     OneWire* oneWire;
     DallasTemperature* sensors;
     int oneWireBus;
     int sensePowerPin;
+    unsigned long poweredMs;    // Time the sensor was powered for readings this wake, not relay on-time
+    ProbeList probes;
+    bool converting;
+    bool rescanPending;         // A probe went missing; the saved list is cleared
+    unsigned long conversionStartedAt;
+
+    void findProbes();
+    void waitForConversion();
 
 public:
-    SensorManager(int oneWirePin, int powerPin);
+    SensorManager(EEPROMManager* eeprom, int oneWirePin, int powerPin);
     ~SensorManager();
     void init();
-    float readTemperature();
+    
+    // Temperature probes
+    void beginProbes();
+    void rescanProbes();
+    void startConversion();
+    uint8_t readTemperatures(float* celsius);   // One per probe, DEVICE_DISCONNECTED_C if it did not answer
+    float readTemperature();                    // First probe
+    uint8_t getProbeCount() const { return probes.count; }
+    String getProbeId(uint8_t index) const;
+    
     int readSoilMoisture();
+    int readAnalogUnpowered();
     void powerSensorOn();
     void powerSensorOff();
+    unsigned long getPoweredMs() const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,496 @@
+#include "ServerEndpoint.h"
+#include "RTCMemoryManager.h"
+#include "TimeSyncManager.h"
+#include "server_ca.h"
+#include <WiFiUdp.h>
+
+#ifdef ESP8266_PLATFORM
+static_assert(sizeof(BearSSL::Session) <= sizeof(TlsSessionState::session), "TLS session does not fit in RTC memory");
+
+// Certificate dates are checked against the server's time once we have it,
+// and before that against the day the firmware was built
+static uint32_t buildTimeSeconds() {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    const char* date = __DATE__;    // "Mmm dd yyyy"
+    char monthName[4] = { date[0], date[1], date[2], '\0' };
+    int month = (strstr(months, monthName) - months) / 3 + 1;
+    int day = atoi(date + 4);
+    int year = atoi(date + 7);
+
+    // Days since 1970-01-01 in the proleptic Gregorian calendar
+    year -= month <= 2;
+    int era = year / 400;
+    int yearOfEra = year - era * 400;
+    int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return (uint32_t)(era * 146097 + dayOfEra - 719468) * 86400UL;
+}
+#endif
+
+ServerEndpoint::ServerEndpoint(RTCMemoryManager* rtc, TimeSyncManager* timeSync) :
+    rtcMemoryManager(rtc), timeSyncManager(timeSync), client(this), secureClient(this), tlsReady(false),
+#ifdef ESP8266_PLATFORM
+    trustAnchors(nullptr), sessionHeld(false),
+#endif
+    configured(false), https(false), port(0),
+    hostIsAddress(false), cacheChecked(false), resolved(false), expiresAtMs(0) {
+    tlsPin = {};
+}
+
+ServerEndpoint::~ServerEndpoint() {
+#ifdef ESP8266_PLATFORM
+    delete trustAnchors;
+#endif
+}
+
+void ServerEndpoint::setTlsPin(const TlsPin& pin) {
+    tlsPin = pin;
+    tlsReady = false;
+}
+
+bool ServerEndpoint::begin(const String& url) {
+    configured = false;
+    resolved = false;
+    cacheChecked = false;
+    tlsReady = false;
+#ifdef ESP8266_PLATFORM
+    sessionHeld = false;
+#endif
+
+    int schemeEnd = url.indexOf("://");
+    if (schemeEnd <= 0) {
+        Serial.println("Server URL has no scheme: " + url);
+        return false;
+    }
+    String scheme = url.substring(0, schemeEnd);
+    scheme.toLowerCase();
+    if (scheme != "http" && scheme != "https") {
+        Serial.println("Unsupported server URL scheme: " + scheme);
+        return false;
+    }
+    https = scheme == "https";
+
+    int hostStart = schemeEnd + 3;
+    int pathStart = url.indexOf('/', hostStart);
+    if (pathStart < 0) {
+        pathStart = url.length();
+    }
+    String authority = url.substring(hostStart, pathStart);
+    pathPrefix = url.substring(pathStart);
+    while (pathPrefix.endsWith("/")) {
+        pathPrefix = pathPrefix.substring(0, pathPrefix.length() - 1);
+    }
+
+    int colon = authority.lastIndexOf(':');
+    if (colon >= 0) {
+        long parsedPort = authority.substring(colon + 1).toInt();
+        if (parsedPort <= 0 || parsedPort > 65535) {
+            Serial.println("Bad port in server URL: " + url);
+            return false;
+        }
+        port = (uint16_t)parsedPort;
+        host = authority.substring(0, colon);
+    } else {
+        port = https ? 443 : 80;
+        host = authority;
+    }
+    if (host.length() == 0) {
+        Serial.println("Server URL has no host: " + url);
+        return false;
+    }
+
+    hostIsAddress = address.fromString(host);
+    resolved = hostIsAddress;
+    baseUrl = scheme + "://" + authority + pathPrefix;
+    configured = true;
+    return true;
+}
+
+bool ServerEndpoint::open(HTTPClient& http, const String& path) {
+    if (!configured) {
+        Serial.println("No server configured");
+        return false;
+    }
+
+    // Before HTTPClient takes its copy of the client
+    WiFiClient& connection = prepareClient();
+    if (pathPrefix.length() == 0) {
+        http.begin(connection, host, port, path, https);
+    } else {
+        http.begin(connection, host, port, pathPrefix + path, https);
+    }
+    return true;
+}
+
+WiFiClient& ServerEndpoint::prepareClient() {
+    if (https && !tlsReady) {
+        setUpTls();
+    }
+    WiFiClient& connection = https ? (WiFiClient&)secureClient : (WiFiClient&)client;
+#ifdef ESP32_PLATFORM
+    // This HTTPClient looks the host up itself unless the client it is
+    // handed is already connected, so connect it here
+    if (configured && !connection.connected()) {
+        if (https) {
+            connectSecure(secureClient);
+        } else {
+            connectClient(client);
+        }
+    }
+#endif
+    return connection;
+}
+
+void ServerEndpoint::setUpTls() {
+    tlsReady = true;
+#ifdef ESP8266_PLATFORM
+    if (!sessionHeld) {
+        const TlsSessionState& saved = rtcMemoryManager->getState().tlsSession;
+        if (saved.hostHash == hashHost(host)) {
+            memcpy((void*)&tlsSession, saved.session, sizeof(tlsSession));
+            sessionHeld = true;
+        }
+    }
+    secureClient.setSession(&tlsSession);
+    if (SERVER_CA_PEM[0] != '\0') {
+        if (!trustAnchors) {
+            trustAnchors = new BearSSL::X509List(SERVER_CA_PEM);
+        }
+        secureClient.setTrustAnchors(trustAnchors);
+    } else if (tlsPin.length > 0) {
+        secureClient.setFingerprint(tlsPin.fingerprint);
+    } else {
+        Serial.println("No CA or fingerprint pinned - the https:// server is not authenticated");
+        secureClient.setInsecure();
+    }
+#else
+    if (SERVER_CA_PEM[0] != '\0') {
+        secureClient.setCACert(SERVER_CA_PEM);
+    } else {
+        // A pinned fingerprint is checked once connected
+        if (tlsPin.length == 0) {
+            Serial.println("No CA or fingerprint pinned - the https:// server is not authenticated");
+        }
+        secureClient.setInsecure();
+    }
+#endif
+}
+
+int ServerEndpoint::PinnedSecureClient::connect(const char* host, uint16_t port) {
+    (void)host;
+    (void)port;
+    if (connected()) {
+        return 1;
+    }
+    return endpoint->connectSecure(*this);
+}
+
+// Times each handshake, and on the ESP8266 tells a resumed session from a new
+// one: resuming leaves the session as it was
+int ServerEndpoint::connectSecure(PinnedSecureClient& connection) {
+    if (!tlsReady) {
+        setUpTls();
+    }
+    unsigned long startedAt = millis();
+#ifdef ESP8266_PLATFORM
+    if (SERVER_CA_PEM[0] != '\0') {
+        connection.setX509Time(timeSyncManager->isSynchronized() ?
+            (uint32_t)(timeSyncManager->getCurrentTime() / 1000) : buildTimeSeconds());
+    }
+    BearSSL::Session offered = tlsSession;
+    bool offeredSession = sessionHeld;
+    int connected = connectClient(connection);
+    if (!connected) {
+        Serial.println("TLS connection to " + host + " failed");
+        return 0;
+    }
+    bool resumed = offeredSession && memcmp((const void*)&offered, (const void*)&tlsSession, sizeof(tlsSession)) == 0;
+    sessionHeld = true;
+#else
+    // Its TLS client checks the certificate against the name it connected
+    // to, so it goes by name rather than by the address we hold
+    int connected = connection.SecureClient::connect(host.c_str(), port);
+    if (connected && tlsPin.length > 0) {
+        char fingerprint[TlsPin::FINGERPRINT_LENGTH * 2 + 1];
+        for (uint8_t i = 0; i < TlsPin::FINGERPRINT_LENGTH; i++) {
+            sprintf(fingerprint + i * 2, "%02x", tlsPin.fingerprint[i]);
+        }
+        if (!connection.verify(fingerprint, nullptr)) {
+            Serial.println("Server certificate does not match the pinned fingerprint");
+            connection.stop();
+            return 0;
+        }
+    }
+    if (!connected) {
+        Serial.println("TLS connection to " + host + " failed");
+        return 0;
+    }
+    bool resumed = false;
+#endif
+    Serial.print("TLS handshake with ");
+    Serial.print(host);
+    Serial.print(resumed ? " resumed in " : " in ");
+    Serial.print(millis() - startedAt);
+    Serial.println("ms");
+    return connected;
+}
+
+bool ServerEndpoint::getAddress(IPAddress& serverAddress) {
+    if (!configured || !resolve(false)) {
+        return false;
+    }
+    serverAddress = address;
+    return true;
+}
+
+int ServerEndpoint::PinnedClient::connect(const char* host, uint16_t port) {
+    (void)host;
+    (void)port;
+    if (connected()) {
+        return 1;
+    }
+    return endpoint->connectClient(*this);
+}
+
+int ServerEndpoint::connectClient(WiFiClient& connection) {
+    if (!resolve(false)) {
+        return 0;
+    }
+    if (connection.connect(address, port)) {
+        return 1;
+    }
+    if (hostIsAddress) {
+        return 0;
+    }
+
+    // The server may have moved before its record expired
+    Serial.println("Server not answering at " + address.toString() + " - looking up " + host + " again");
+    IPAddress previous = address;
+    if (!resolve(true) || address == previous) {
+        return 0;
+    }
+    return connection.connect(address, port);
+}
+
+void ServerEndpoint::restoreCache() {
+    cacheChecked = true;
+    const DnsCacheState& saved = rtcMemoryManager->getState().dnsCache;
+    if (saved.hostHash != hashHost(host) || !timeSyncManager->isSynchronized()) {
+        return;
+    }
+    uint32_t nowSeconds = (uint32_t)(timeSyncManager->getCurrentTime() / 1000);
+    if (saved.expiresAtSeconds <= nowSeconds) {
+        return;
+    }
+
+    address = IPAddress(saved.address[0], saved.address[1], saved.address[2], saved.address[3]);
+    expiresAtMs = millis() + (saved.expiresAtSeconds - nowSeconds) * 1000;
+    resolved = true;
+    Serial.print("Using cached address ");
+    Serial.print(address.toString());
+    Serial.print(" for ");
+    Serial.print(host);
+    Serial.print(" (");
+    Serial.print(saved.expiresAtSeconds - nowSeconds);
+    Serial.println("s left)");
+}
+
+bool ServerEndpoint::resolve(bool fresh) {
+    if (hostIsAddress) {
+        return true;
+    }
+    if (!cacheChecked) {
+        restoreCache();
+    }
+    if (!fresh && resolved && (long)(millis() - expiresAtMs) < 0) {
+        return true;
+    }
+
+    unsigned long startedAt = millis();
+    IPAddress found;
+    uint32_t ttlSeconds = 0;
+    if (!queryDns(found, ttlSeconds)) {
+        if (WiFi.hostByName(host.c_str(), found) != 1) {
+            Serial.println("Could not resolve " + host);
+            // An expired address is still worth a try, a refused one is not
+            return resolved && !fresh;
+        }
+        ttlSeconds = FALLBACK_TTL_S;
+    }
+    if (ttlSeconds < MIN_TTL_S) {
+        ttlSeconds = MIN_TTL_S;
+    } else if (ttlSeconds > MAX_TTL_S) {
+        ttlSeconds = MAX_TTL_S;
+    }
+
+    address = found;
+    expiresAtMs = millis() + ttlSeconds * 1000;
+    resolved = true;
+    Serial.print("Resolved ");
+    Serial.print(host);
+    Serial.print(" to ");
+    Serial.print(address.toString());
+    Serial.print(" for ");
+    Serial.print(ttlSeconds);
+    Serial.print("s in ");
+    Serial.print(millis() - startedAt);
+    Serial.println("ms");
+    return true;
+}
+
+// A single A query to the DNS server DHCP gave us. Returns false on any
+// trouble, and the caller falls back to the core's resolver.
+bool ServerEndpoint::queryDns(IPAddress& found, uint32_t& ttlSeconds) {
+    uint8_t packet[512];
+    if (host.length() > 253) {
+        return false;
+    }
+
+    // Header: id, recursion desired, one question
+    uint16_t id = (uint16_t)random(0x10000);
+    size_t length = 0;
+    packet[length++] = id >> 8;
+    packet[length++] = id & 0xFF;
+    packet[length++] = 0x01;
+    packet[length++] = 0x00;
+    packet[length++] = 0x00;
+    packet[length++] = 0x01;
+    memset(packet + length, 0, 6);
+    length += 6;
+
+    // Question: the name as length-prefixed labels, type A, class IN
+    int labelStart = 0;
+    while (labelStart <= (int)host.length()) {
+        int labelEnd = host.indexOf('.', labelStart);
+        if (labelEnd < 0) {
+            labelEnd = host.length();
+        }
+        int labelLength = labelEnd - labelStart;
+        if (labelLength == 0 || labelLength > 63) {
+            return false;
+        }
+        packet[length++] = labelLength;
+        memcpy(packet + length, host.c_str() + labelStart, labelLength);
+        length += labelLength;
+        labelStart = labelEnd + 1;
+    }
+    const uint8_t questionTail[] = { 0x00, 0x00, 0x01, 0x00, 0x01 };
+    memcpy(packet + length, questionTail, sizeof(questionTail));
+    length += sizeof(questionTail);
+
+    WiFiUDP udp;
+    if (!udp.begin(49152 + random(16384)) || !udp.beginPacket(WiFi.dnsIP(), DNS_PORT)) {
+        return false;
+    }
+    udp.write(packet, length);
+    if (!udp.endPacket()) {
+        udp.stop();
+        return false;
+    }
+
+    int received = 0;
+    unsigned long sentAt = millis();
+    while (millis() - sentAt < DNS_TIMEOUT_MS) {
+        if (udp.parsePacket() > 0) {
+            received = udp.read(packet, sizeof(packet));
+            if (received >= 12 && packet[0] == (id >> 8) && packet[1] == (id & 0xFF)) {
+                break;
+            }
+            received = 0;
+        }
+        delay(5);
+    }
+    udp.stop();
+
+    // A response without errors, with at least one answer
+    if (received < 12 || !(packet[2] & 0x80) || (packet[3] & 0x0F) != 0) {
+        return false;
+    }
+    uint16_t questions = (packet[4] << 8) | packet[5];
+    uint16_t answers = (packet[6] << 8) | packet[7];
+
+    size_t position = 12;
+    // Names are labels ending in a zero byte or a compression pointer
+    auto skipName = [&]() {
+        while (position < (size_t)received) {
+            uint8_t label = packet[position];
+            if ((label & 0xC0) == 0xC0) {
+                position += 2;
+                return;
+            }
+            position += label + 1;
+            if (label == 0) {
+                return;
+            }
+        }
+    };
+    for (uint16_t i = 0; i < questions; i++) {
+        skipName();
+        position += 4;
+    }
+
+    // Follow any CNAMEs to the address; the shortest TTL on the way counts
+    uint32_t shortestTtl = 0xFFFFFFFF;
+    for (uint16_t i = 0; i < answers; i++) {
+        skipName();
+        if (position + 10 > (size_t)received) {
+            return false;
+        }
+        uint16_t type = (packet[position] << 8) | packet[position + 1];
+        uint16_t recordClass = (packet[position + 2] << 8) | packet[position + 3];
+        uint32_t ttl = ((uint32_t)packet[position + 4] << 24) | ((uint32_t)packet[position + 5] << 16) |
+            ((uint32_t)packet[position + 6] << 8) | packet[position + 7];
+        uint16_t dataLength = (packet[position + 8] << 8) | packet[position + 9];
+        position += 10;
+        if (position + dataLength > (size_t)received) {
+            return false;
+        }
+        if (ttl < shortestTtl) {
+            shortestTtl = ttl;
+        }
+        if (type == 1 && recordClass == 1 && dataLength == 4) {
+            found = IPAddress(packet[position], packet[position + 1], packet[position + 2], packet[position + 3]);
+            ttlSeconds = shortestTtl;
+            return true;
+        }
+        position += dataLength;
+    }
+    return false;
+}
+
+void ServerEndpoint::prepareForSleep() {
+#ifdef ESP8266_PLATFORM
+    TlsSessionState& savedSession = rtcMemoryManager->getState().tlsSession;
+    memset(&savedSession, 0, sizeof(savedSession));
+    if (configured && https && sessionHeld) {
+        savedSession.hostHash = hashHost(host);
+        memcpy(savedSession.session, (const void*)&tlsSession, sizeof(tlsSession));
+    }
+#endif
+
+    DnsCacheState& saved = rtcMemoryManager->getState().dnsCache;
+    memset(&saved, 0, sizeof(saved));
+    if (hostIsAddress || !resolved || !timeSyncManager->isSynchronized()) {
+        return;
+    }
+    long leftMs = (long)(expiresAtMs - millis());
+    if (leftMs < 1000) {
+        return;
+    }
+
+    saved.hostHash = hashHost(host);
+    saved.expiresAtSeconds = (uint32_t)(timeSyncManager->getCurrentTime() / 1000) + leftMs / 1000;
+    for (uint8_t i = 0; i < 4; i++) {
+        saved.address[i] = address[i];
+    }
+}
+
+// FNV-1a; only has to tell a changed server URL from the one cached
+uint32_t ServerEndpoint::hashHost(const String& name) {
+    uint32_t hash = 2166136261UL;
+    for (unsigned int i = 0; i < name.length(); i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
@@ -0,0 +1,152 @@
+#ifndef SERVER_ENDPOINT_H
+#define SERVER_ENDPOINT_H
+
+#include "platform_config.h"
+#include "EEPROMManager.h"
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+
+class RTCMemoryManager;
+class TimeSyncManager;
+
+// The server URL from EEPROM, split once at boot into scheme, host, port and
+// path prefix, so a request only has to name its path.
+//
+// The server's address is looked up with a DNS query of our own, which
+// unlike WiFi.hostByName() tells us the record's TTL, and is kept in RTC
+// memory across deep sleep until the TTL runs out: most wakes send their
+// requests without asking the DNS server first. Connections go to the kept
+// address while the Host header still names the server. If the server is not
+// there any more, the name is looked up again before giving up.
+//
+// An https:// server is pinned by the CA in server_ca.h or by the certificate
+// fingerprint from EEPROM. The ESP8266 connects to the held address, so BearSSL
+// has no host name to match the certificate against: only the fingerprint pin,
+// or a CA that signs nothing but this server, authenticates the connection.
+// (The ESP32 connects by name, and checks it against a CA-signed certificate.)
+// On the ESP8266 the TLS session is kept in RTC memory too, so a wake offers it
+// back and the server resumes it: one round trip and no public-key operations,
+// where a full handshake takes seconds of CPU.
+class ServerEndpoint {
+private:
+    static const uint16_t DNS_PORT = 53;
+    static const uint32_t DNS_TIMEOUT_MS = 1000;
+    static const uint32_t MIN_TTL_S = 30;       // Lower TTLs would mean a lookup per request
+    static const uint32_t MAX_TTL_S = 86400;
+    static const uint32_t FALLBACK_TTL_S = 300; // hostByName() does not report the TTL
+
+    // Connects to the address we hold rather than looking up the host name
+    // it is handed, which HTTPClient passes on from the URL
+    class PinnedClient : public WiFiClient {
+    private:
+        ServerEndpoint* endpoint;
+
+    public:
+        PinnedClient(ServerEndpoint* owner) : endpoint(owner) {}
+        using WiFiClient::connect;
+        int connect(const char* host, uint16_t port) override;
+#ifdef ESP8266_PLATFORM
+        // HTTPClient keeps a copy of the client; it has to be one of these
+        std::unique_ptr<WiFiClient> clone() const override {
+            return std::unique_ptr<WiFiClient>(new PinnedClient(*this));
+        }
+#endif
+    };
+
+#ifdef ESP8266_PLATFORM
+    typedef BearSSL::WiFiClientSecure SecureClient;
+#else
+    typedef WiFiClientSecure SecureClient;
+#endif
+
+    // The same over TLS, for https:// servers
+    class PinnedSecureClient : public SecureClient {
+    private:
+        ServerEndpoint* endpoint;
+
+    public:
+        PinnedSecureClient(ServerEndpoint* owner) : endpoint(owner) {}
+        using SecureClient::connect;
+        int connect(const char* host, uint16_t port) override;
+#ifdef ESP8266_PLATFORM
+        std::unique_ptr<WiFiClient> clone() const override {
+            return std::unique_ptr<WiFiClient>(new PinnedSecureClient(*this));
+        }
+#endif
+    };
+
+    RTCMemoryManager* rtcMemoryManager;
+    TimeSyncManager* timeSyncManager;
+    PinnedClient client;
+    PinnedSecureClient secureClient;
+    TlsPin tlsPin;
+    bool tlsReady;              // Pin and session handed to secureClient
+#ifdef ESP8266_PLATFORM
+    BearSSL::Session tlsSession;
+    BearSSL::X509List* trustAnchors;
+    bool sessionHeld;           // tlsSession is one the server gave us
+#endif
+
+    bool configured;
+    bool https;
+    String host;
+    uint16_t port;
+    String pathPrefix;          // Without the trailing slash, may be empty
+    String baseUrl;
+
+    bool hostIsAddress;         // IP literal: nothing to look up
+    bool cacheChecked;          // RTC memory consulted this wake
+    bool resolved;
+    IPAddress address;
+    unsigned long expiresAtMs;
+
+    static uint32_t hashHost(const String& name);
+    void restoreCache();
+    bool resolve(bool fresh);
+    bool queryDns(IPAddress& found, uint32_t& ttlSeconds);
+    void setUpTls();
+    int connectSecure(PinnedSecureClient& connection);
+
+public:
+    ServerEndpoint(RTCMemoryManager* rtc, TimeSyncManager* timeSync);
+
+    ~ServerEndpoint();
+
+    // Parses the server URL. Returns false if it is not http:// or https://.
+    bool begin(const String& url);
+    // Certificate fingerprint for an https:// server; takes effect from the
+    // next connection
+    void setTlsPin(const TlsPin& pin);
+
+    // Points http at path on the server, path starting with '/' and
+    // including any query string. Returns false if there is no server URL.
+    // An unreachable server shows up as a connection error from the request.
+    bool open(HTTPClient& http, const String& path);
+
+    // The client open() hands HTTPClient, for code that drives HTTPClient
+    // itself from a full URL under getBaseUrl(): pinned to our address and,
+    // for https://, carrying the CA or fingerprint and the saved session.
+    WiFiClient& prepareClient();
+
+    // Connects connection to the server's port at the address we hold, looking
+    // the host up again if nothing answers there. For connections HTTPClient
+    // does not make.
+    int connectClient(WiFiClient& connection);
+
+    // The server's address, for transports other than HTTP. Looked up and
+    // cached the same way. Returns false if there is none.
+    bool getAddress(IPAddress& serverAddress);
+
+    // Keeps the address in RTC memory for the next wake, with the part of
+    // its TTL that is left, and the TLS session with it
+    void prepareForSleep();
+
+    bool isConfigured() const { return configured; }
+    bool isHttps() const { return https; }
+    const String& getHost() const { return host; }
+    uint16_t getPort() const { return port; }
+    const String& getPathPrefix() const { return pathPrefix; }
+    const String& getBaseUrl() const { return baseUrl; }
+};
+
+#endif
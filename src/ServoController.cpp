@@ -0,0 +1,199 @@
+#include "ServoController.h"
+#include "RTCMemoryManager.h"
+
+// Peaks of the minimum-jerk profile s(u) = 10u^3 - 15u^4 + 6u^5 over a move of
+// distance d and duration T: velocity 1.875 d/T, acceleration 5.774 d/T^2
+static const float S_CURVE_PEAK_SPEED = 1.875f;
+static const float S_CURVE_PEAK_ACCEL = 5.774f;
+
+ServoController::ServoController(RTCMemoryManager* rtc, int servoPin) :
+    rtcMemoryManager(rtc), pin(servoPin), from(0), distance(0), peakSpeed(0), accel(0),
+    profile(PROFILE_TRAPEZOIDAL), rampMs(0), durationMs(0), startedAt(0), position(0),
+    moving(false), reachedAt(0), driving(false), positionKnown(false) {
+}
+
+void ServoController::begin(bool wokeFromDeepSleep) {
+    // Low rather than floating until there is something to drive
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, LOW);
+
+    ServoState& saved = rtcMemoryManager->getState().servo;
+    positionKnown = wokeFromDeepSleep && saved.known;
+    if (positionKnown) {
+        position = saved.positionTenths / 10.0f;
+        from = position;
+        Serial.print("Servo at ");
+        Serial.println(position, 1);
+    } else {
+        saved.known = 0;
+        Serial.println("Servo position unknown until the first move");
+    }
+}
+
+void ServoController::loop() {
+    if (!driving || moving || millis() - reachedAt < HOLD_MS) {
+        return;
+    }
+
+    frameTicker.detach();
+    stopOutput();
+
+    ServoState& saved = rtcMemoryManager->getState().servo;
+    saved.positionTenths = (int16_t)lroundf(position * 10);
+    saved.known = 1;
+    Serial.print("Servo at rest at ");
+    Serial.println(position, 1);
+}
+
+bool ServoController::moveTo(float target, uint8_t newProfile, float speed, float newAccel) {
+    if (!(target >= 0 && target <= MAX_POSITION) || !(speed > 0) || !(newAccel > 0) ||
+        newProfile > PROFILE_S_CURVE) {
+        return false;
+    }
+
+    frameTicker.detach();
+
+    // Without a known position there is nothing to plan from
+    if (!positionKnown) {
+        position = target;
+        positionKnown = true;
+    }
+
+    // A new target mid-move restarts from the current position; the servo's
+    // own inertia absorbs the change in velocity
+    from = position;
+    distance = target - from;
+    profile = newProfile;
+    accel = newAccel;
+    float d = fabsf(distance);
+
+    if (profile == PROFILE_S_CURVE) {
+        // Shortest duration that keeps both peaks within the limits
+        float seconds = max(S_CURVE_PEAK_SPEED * d / speed, sqrtf(S_CURVE_PEAK_ACCEL * d / accel));
+        durationMs = (uint32_t)(seconds * 1000);
+        rampMs = 0;
+        peakSpeed = seconds > 0 ? S_CURVE_PEAK_SPEED * d / seconds : 0;
+    } else {
+        float rampSeconds = speed / accel;
+        peakSpeed = speed;
+        if (accel * rampSeconds * rampSeconds > d) {
+            // Too short to reach cruising speed: accelerate halfway, then brake
+            rampSeconds = sqrtf(d / accel);
+            peakSpeed = accel * rampSeconds;
+        }
+        float cruiseSeconds = peakSpeed > 0 ? (d - accel * rampSeconds * rampSeconds) / peakSpeed : 0;
+        rampMs = (uint32_t)(rampSeconds * 1000);
+        durationMs = 2 * rampMs + (uint32_t)(cruiseSeconds * 1000);
+    }
+
+    Serial.print("Servo moving from ");
+    Serial.print(from, 1);
+    Serial.print(" to ");
+    Serial.print(target, 1);
+    Serial.print(profile == PROFILE_S_CURVE ? " (S-curve, " : " (trapezoidal, ");
+    Serial.print(durationMs);
+    Serial.println(" ms)");
+
+    // Saved again once the servo is at rest; a move cut short by deep sleep
+    // leaves the position unknown rather than where it started
+    rtcMemoryManager->getState().servo.known = 0;
+
+    startedAt = millis();
+    moving = true;
+    if (!driving) {
+        startOutput(from);
+    }
+    frameTicker.attach_ms(FRAME_MS, &ServoController::onFrame, this);
+    onFrame(this);
+    return true;
+}
+
+void ServoController::onFrame(ServoController* controller) {
+    // Timer context: one step along the profile
+    unsigned long now = millis();
+    uint32_t elapsed = now - controller->startedAt;
+    float next = controller->positionAt(elapsed);
+    controller->writeOutput(next);
+    controller->position = next;
+
+    if (controller->moving && elapsed >= controller->durationMs) {
+        controller->reachedAt = now;
+        controller->moving = false;
+    }
+}
+
+float ServoController::positionAt(uint32_t elapsedMs) const {
+    if (elapsedMs >= durationMs) {
+        return from + distance;
+    }
+
+    float d = fabsf(distance);
+    float travelled;
+    if (profile == PROFILE_S_CURVE) {
+        float u = (float)elapsedMs / durationMs;
+        travelled = d * u * u * u * (10 - 15 * u + 6 * u * u);
+    } else {
+        float t = elapsedMs / 1000.0f;
+        float ramp = rampMs / 1000.0f;
+        float total = durationMs / 1000.0f;
+        if (t < ramp) {
+            travelled = 0.5f * accel * t * t;
+        } else if (t < total - ramp) {
+            travelled = 0.5f * accel * ramp * ramp + peakSpeed * (t - ramp);
+        } else {
+            float left = total - t;
+            travelled = d - 0.5f * accel * left * left;
+        }
+        // Phases are rounded to whole milliseconds
+        travelled = constrain(travelled, 0.0f, d);
+    }
+    return distance < 0 ? from - travelled : from + travelled;
+}
+
+bool ServoController::isBusy() const {
+    return moving || driving;
+}
+
+uint32_t ServoController::getRemainingMs() const {
+    if (!moving) {
+        return 0;
+    }
+    uint32_t elapsed = millis() - startedAt;
+    return elapsed < durationMs ? durationMs - elapsed : 0;
+}
+
+uint16_t ServoController::pulseWidth(float degrees) const {
+    return MIN_PULSE_US + (uint16_t)lroundf(degrees * (MAX_PULSE_US - MIN_PULSE_US) / MAX_POSITION);
+}
+
+// The first pulse is already at the start position, so the horn does not
+// twitch towards the centre when the output comes on
+void ServoController::startOutput(float degrees) {
+#ifdef ESP32_PLATFORM
+    ledcSetup(LEDC_CHANNEL, 1000 / FRAME_MS, LEDC_BITS);
+    writeOutput(degrees);
+    ledcAttachPin(pin, LEDC_CHANNEL);
+#else
+    servo.attach(pin, MIN_PULSE_US, MAX_PULSE_US, pulseWidth(degrees));
+#endif
+    driving = true;
+}
+
+void ServoController::writeOutput(float degrees) {
+#ifdef ESP32_PLATFORM
+    uint32_t period = FRAME_MS * 1000;
+    ledcWrite(LEDC_CHANNEL, (uint32_t)pulseWidth(degrees) * ((1 << LEDC_BITS) - 1) / period);
+#else
+    servo.writeMicroseconds(pulseWidth(degrees));
+#endif
+}
+
+void ServoController::stopOutput() {
+#ifdef ESP32_PLATFORM
+    ledcDetachPin(pin);
+#else
+    servo.detach();
+#endif
+    digitalWrite(pin, LOW);
+    driving = false;
+}
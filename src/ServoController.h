@@ -0,0 +1,94 @@
+#ifndef SERVO_CONTROLLER_H
+#define SERVO_CONTROLLER_H
+
+#include <Arduino.h>
+#include <Ticker.h>
+#ifdef ESP8266_PLATFORM
+#include <Servo.h>
+#endif
+
+class RTCMemoryManager;
+
+// Moves a hobby servo to commanded positions along a motion profile instead of
+// letting it slam there at full speed, which strains the gears and can brown
+// out a battery supply.
+//
+// The pulses come from hardware - LEDC on the ESP32, the timer1 waveform
+// generator behind the Servo library on the ESP8266 - and a Ticker steps the
+// pulse width along the profile once per servo frame, so a move runs in the
+// background without blocking loop(). The profile is a function of the time
+// since the move began, so a late frame does not stretch the move.
+//
+// Once the servo has held its target for HOLD_MS the pulses stop: an idle
+// servo draws little without a signal and its gear train holds the horn. The
+// position at rest is kept in RTC memory, so after deep sleep a move starts
+// from where the servo was left. After power-on it is unknown and the first
+// move goes straight to its target.
+class ServoController {
+public:
+    static const uint8_t PROFILE_TRAPEZOIDAL = 0;  // Constant acceleration, cruise, constant deceleration
+    static const uint8_t PROFILE_S_CURVE = 1;      // Minimum-jerk: acceleration ramps in and out too
+    static const uint16_t MAX_POSITION = 180;      // Degrees
+    static const uint16_t DEFAULT_SPEED = 90;      // Degrees per second
+    static const uint16_t DEFAULT_ACCEL = 180;     // Degrees per second squared
+
+private:
+    static const uint32_t FRAME_MS = 20;           // One servo frame (50 Hz)
+    static const uint32_t HOLD_MS = 300;           // Keep driving the target while the servo settles
+    static const uint16_t MIN_PULSE_US = 500;      // 0 degrees
+    static const uint16_t MAX_PULSE_US = 2500;     // MAX_POSITION
+#ifdef ESP32_PLATFORM
+    static const uint8_t LEDC_CHANNEL = 0;
+    static const uint8_t LEDC_BITS = 16;
+#endif
+
+    RTCMemoryManager* rtcMemoryManager;
+    int pin;
+    Ticker frameTicker;
+#ifdef ESP8266_PLATFORM
+    Servo servo;
+#endif
+
+    // Current move, fixed while the frame ticker runs
+    float from;
+    float distance;             // Signed
+    float peakSpeed;            // Degrees per second actually reached
+    float accel;
+    uint8_t profile;
+    uint32_t rampMs;            // Trapezoidal: length of each acceleration phase
+    uint32_t durationMs;
+    unsigned long startedAt;
+
+    // Written by the frame ticker
+    volatile float position;
+    volatile bool moving;
+    volatile unsigned long reachedAt;
+    bool driving;               // Pulses are being generated
+    bool positionKnown;
+
+    static void onFrame(ServoController* controller);
+    float positionAt(uint32_t elapsedMs) const;
+    uint16_t pulseWidth(float degrees) const;
+    void startOutput(float degrees);
+    void writeOutput(float degrees);
+    void stopOutput();
+
+public:
+    ServoController(RTCMemoryManager* rtc, int servoPin);
+
+    void begin(bool wokeFromDeepSleep);
+    void loop();
+
+    // Starts a move from wherever the servo is, at rest or mid-move. Returns
+    // false if the target, speed or acceleration is out of range.
+    bool moveTo(float target, uint8_t profile, float speed, float accel);
+
+    bool isBusy() const;        // Moving, or holding the target before letting go
+    bool isPositionKnown() const { return positionKnown; }
+    bool isAtTarget() const { return !moving; }
+    float getPosition() const { return position; }
+    float getTarget() const { return from + distance; }
+    uint32_t getRemainingMs() const;
+};
+
+#endif
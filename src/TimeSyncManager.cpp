@@ -0,0 +1,173 @@
+#include "TimeSyncManager.h"
+#include "RTCMemoryManager.h"
+
+TimeSyncManager::TimeSyncManager(RTCMemoryManager* rtc) :
+    rtcMemoryManager(rtc), baseTimeMs(0), localBaseMs(0), baseErrorMs(0),
+    lastRoundTripMs(0), synchronized(false) {
+}
+
+void TimeSyncManager::begin(bool wokeFromDeepSleep) {
+    TimeSyncState& saved = rtcMemoryManager->getState().timeSync;
+
+    // Fresh RTC memory: no drift calibration yet
+    if (saved.driftUncertaintyPpm == 0) {
+        saved.driftPpm = 0;
+        saved.driftUncertaintyPpm = INITIAL_DRIFT_UNCERTAINTY_PPM;
+        saved.syncCount = 0;
+        saved.timeValid = 0;
+    }
+
+    // Drift calibration survives a reset, the clock itself does not
+    if (!wokeFromDeepSleep || !saved.timeValid) {
+        saved.timeValid = 0;
+        saved.sleptSinceSyncMs = 0;
+        synchronized = false;
+        Serial.println("Time not synchronized - waiting for server");
+        return;
+    }
+
+    // millis() starts counting when the RTC wakes us, so boot is the new reference
+    int64_t driftMs = (int64_t)saved.requestedSleepMs * saved.driftPpm / 1000000;
+    baseTimeMs = saved.wallTimeAtSleepMs + saved.requestedSleepMs + driftMs;
+    localBaseMs = 0;
+    baseErrorMs = saved.errorBoundAtSleepMs +
+        (uint32_t)((uint64_t)saved.requestedSleepMs * saved.driftUncertaintyPpm / 1000000);
+    saved.sleptSinceSyncMs += saved.requestedSleepMs;
+    synchronized = true;
+
+    Serial.print("Time restored after sleep - slept ");
+    Serial.print(saved.requestedSleepMs + (long)driftMs);
+    Serial.print("ms (drift ");
+    Serial.print(saved.driftPpm);
+    Serial.print("ppm), error bound ");
+    Serial.print(baseErrorMs);
+    Serial.println("ms");
+}
+
+void TimeSyncManager::prepareForSleep(uint32_t sleepMs) {
+    TimeSyncState& saved = rtcMemoryManager->getState().timeSync;
+
+    saved.timeValid = synchronized ? 1 : 0;
+    saved.requestedSleepMs = sleepMs;
+    if (synchronized) {
+        saved.wallTimeAtSleepMs = getCurrentTime();
+        saved.errorBoundAtSleepMs = getErrorBoundMs();
+    }
+}
+
+bool TimeSyncManager::completeExchange(unsigned long requestSentAt, uint64_t serverReceivedMs, uint64_t serverSentMs) {
+    unsigned long responseReceivedAt = millis();
+    uint32_t elapsedMs = responseReceivedAt - requestSentAt;
+
+    if (serverSentMs < serverReceivedMs || serverSentMs - serverReceivedMs > elapsedMs) {
+        Serial.println("Rejecting time sample - server timestamps inconsistent with round trip");
+        return false;
+    }
+
+    uint32_t roundTripMs = elapsedMs - (uint32_t)(serverSentMs - serverReceivedMs);
+    uint64_t measuredTimeMs = serverSentMs + roundTripMs / 2;
+    uint32_t measuredErrorMs = roundTripMs / 2 + 1;
+
+    if (synchronized) {
+        int64_t predictionErrorMs = (int64_t)(measuredTimeMs - toServerTime(responseReceivedAt));
+        Serial.print("Clock offset corrected by ");
+        Serial.print((long)predictionErrorMs);
+        Serial.println("ms");
+        updateDriftEstimate(predictionErrorMs, measuredErrorMs);
+    }
+
+    baseTimeMs = measuredTimeMs;
+    localBaseMs = responseReceivedAt;
+    baseErrorMs = measuredErrorMs;
+    lastRoundTripMs = roundTripMs;
+    synchronized = true;
+
+    TimeSyncState& saved = rtcMemoryManager->getState().timeSync;
+    saved.sleptSinceSyncMs = 0;
+    saved.lastSyncErrorMs = (uint16_t)min(measuredErrorMs, (uint32_t)0xFFFF);
+
+    Serial.print("Time synchronized - Server time: ");
+    Serial.print((unsigned long)(measuredTimeMs / 1000));
+    Serial.print(", round trip: ");
+    Serial.print(roundTripMs);
+    Serial.print("ms, error bound: ");
+    Serial.print(measuredErrorMs);
+    Serial.println("ms");
+    return true;
+}
+
+void TimeSyncManager::syncToServerTime(uint64_t serverTimeMs, unsigned long requestSentAt) {
+    completeExchange(requestSentAt, serverTimeMs, serverTimeMs);
+}
+
+void TimeSyncManager::updateDriftEstimate(int64_t predictionErrorMs, uint32_t measuredErrorMs) {
+    TimeSyncState& saved = rtcMemoryManager->getState().timeSync;
+
+    // Only sleep time is subject to RTC drift; short baselines are mostly RTT noise
+    if (saved.sleptSinceSyncMs < MIN_DRIFT_SAMPLE_SLEEP_MS) {
+        return;
+    }
+
+    int32_t residualPpm = (int32_t)(predictionErrorMs * 1000000 / (int64_t)saved.sleptSinceSyncMs);
+    int32_t samplePpm = constrain(saved.driftPpm + residualPpm, -MAX_DRIFT_PPM, MAX_DRIFT_PPM);
+    uint32_t noisePpm = (uint32_t)((uint64_t)(saved.lastSyncErrorMs + measuredErrorMs) * 1000000 / saved.sleptSinceSyncMs);
+
+    // Running average over the last few syncs; the first sample is taken as-is
+    uint16_t weight = saved.syncCount < DRIFT_AVERAGING_SYNCS ? saved.syncCount + 1 : DRIFT_AVERAGING_SYNCS;
+    int32_t previousDriftPpm = saved.driftPpm;
+    saved.driftPpm += (samplePpm - previousDriftPpm) / weight;
+
+    // Uncertainty tracks how far samples land from the estimate, never below measurement noise
+    uint32_t spreadPpm = 2 * max((uint32_t)abs(samplePpm - previousDriftPpm), noisePpm);
+    if (saved.syncCount == 0) {
+        spreadPpm = 2 * noisePpm;
+    }
+    uint32_t uncertaintyPpm = (saved.driftUncertaintyPpm * (weight - 1) + spreadPpm) / weight;
+    saved.driftUncertaintyPpm = max(uncertaintyPpm, (uint32_t)MIN_DRIFT_UNCERTAINTY_PPM);
+
+    if (saved.syncCount < 0xFFFF) {
+        saved.syncCount++;
+    }
+
+    Serial.print("RTC drift estimate: ");
+    Serial.print(saved.driftPpm);
+    Serial.print("ppm +/- ");
+    Serial.print(saved.driftUncertaintyPpm);
+    Serial.print("ppm after ");
+    Serial.print(saved.syncCount);
+    Serial.println(" samples");
+}
+
+bool TimeSyncManager::needsSync() const {
+    return !synchronized || getErrorBoundMs() > MAX_ERROR_MS;
+}
+
+uint64_t TimeSyncManager::getCurrentTime() const {
+    return toServerTime(millis());
+}
+
+uint64_t TimeSyncManager::toServerTime(unsigned long localMillis) const {
+    if (!synchronized) {
+        return 0; // Return 0 if time is not synchronized
+    }
+
+    // Unsigned subtraction stays correct across millis() rollover
+    unsigned long elapsedSinceBase = localMillis - localBaseMs;
+    return baseTimeMs + elapsedSinceBase;
+}
+
+uint32_t TimeSyncManager::getErrorBoundMs() const {
+    unsigned long awakeSinceBase = millis() - localBaseMs;
+    return baseErrorMs + (uint32_t)((uint64_t)awakeSinceBase * CPU_CLOCK_UNCERTAINTY_PPM / 1000000);
+}
+
+int32_t TimeSyncManager::getDriftPpm() const {
+    return rtcMemoryManager->getState().timeSync.driftPpm;
+}
+
+uint32_t TimeSyncManager::toRtcDuration(uint32_t serverDurationMs) const {
+    // Inverse of the correction applied in begin(): the RTC will actually sleep
+    // requested * (1 + drift), so ask for correspondingly less (or more)
+    int64_t driftPpm = getDriftPpm();
+    return (uint32_t)((int64_t)serverDurationMs * 1000000 / (1000000 + driftPpm));
+}
@@ -0,0 +1,63 @@
+#ifndef TIME_SYNC_MANAGER_H
+#define TIME_SYNC_MANAGER_H
+
+#include <Arduino.h>
+
+class RTCMemoryManager;
+
+// Tracks server time across wake/sleep cycles.
+//
+// Each exchange with the server is NTP style: the device notes millis() when the
+// request leaves (t0) and when the response arrives (t3), the server reports when
+// it received the request (t1) and when it replied (t2). The server time at t3 is
+// t2 + delay / 2 with delay = (t3 - t0) - (t2 - t1), accurate to +/- delay / 2.
+//
+// Across deep sleep the clock is carried in RTC memory and advanced by the
+// requested sleep time, corrected by the RTC drift measured between exchanges.
+class TimeSyncManager {
+public:
+    // Re-sync once the estimated clock error grows beyond this
+    static const uint32_t MAX_ERROR_MS = 1000;
+
+private:
+    static const int32_t INITIAL_DRIFT_UNCERTAINTY_PPM = 50000; // RTC is only good to a few percent uncalibrated
+    static const int32_t MIN_DRIFT_UNCERTAINTY_PPM = 500;
+    static const int32_t MAX_DRIFT_PPM = 150000;
+    static const uint32_t CPU_CLOCK_UNCERTAINTY_PPM = 100;     // millis() runs off the main crystal
+    static const uint32_t MIN_DRIFT_SAMPLE_SLEEP_MS = 30000;   // Shorter baselines are dominated by RTT noise
+    static const uint16_t DRIFT_AVERAGING_SYNCS = 4;
+
+    RTCMemoryManager* rtcMemoryManager;
+
+    uint64_t baseTimeMs;        // Server time at localBaseMs
+    unsigned long localBaseMs;  // millis() at baseTimeMs
+    uint32_t baseErrorMs;       // Error bound of baseTimeMs
+    uint32_t lastRoundTripMs;
+    bool synchronized;
+
+    void updateDriftEstimate(int64_t predictionErrorMs, uint32_t measuredErrorMs);
+
+public:
+    TimeSyncManager(RTCMemoryManager* rtc);
+
+    void begin(bool wokeFromDeepSleep);
+    void prepareForSleep(uint32_t sleepMs);
+
+    // NTP-style exchange. Returns false if the sample was rejected.
+    unsigned long beginExchange() const { return millis(); }
+    bool completeExchange(unsigned long requestSentAt, uint64_t serverReceivedMs, uint64_t serverSentMs);
+
+    // Servers that only report a single timestamp
+    void syncToServerTime(uint64_t serverTimeMs, unsigned long requestSentAt);
+
+    bool isSynchronized() const { return synchronized; }
+    bool needsSync() const;
+    uint64_t getCurrentTime() const;
+    uint64_t toServerTime(unsigned long localMillis) const;
+    uint32_t getErrorBoundMs() const;
+    uint32_t getLastRoundTripMs() const { return lastRoundTripMs; }
+    int32_t getDriftPpm() const;
+    uint32_t toRtcDuration(uint32_t serverDurationMs) const;
+};
+
+#endif
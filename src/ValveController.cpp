@@ -0,0 +1,184 @@
+#include "ValveController.h"
+#include "RTCMemoryManager.h"
+#include "TimeSyncManager.h"
+
+ValveController::ValveController(EEPROMManager* eeprom, RTCMemoryManager* rtc, TimeSyncManager* timeSync, int openPin, int closePin) :
+    eepromManager(eeprom), rtcMemoryManager(rtc), timeSyncManager(timeSync), openPin(openPin), closePin(closePin),
+    pulseActive(false), pulseEndedAt(0), pendingPulse(NO_PENDING_PULSE) {
+    memset(&schedule, 0, sizeof(schedule));
+}
+
+void ValveController::begin(bool wokeFromDeepSleep) {
+    pinMode(openPin, OUTPUT);
+    pinMode(closePin, OUTPUT);
+    digitalWrite(openPin, LOW);
+    digitalWrite(closePin, LOW);
+
+    eepromManager->getValveSchedule(schedule);
+
+    // RTC memory is only written before deep sleep, so after any other reset
+    // the EEPROM copy is the newer one
+    ValveState& saved = rtcMemoryManager->getState().valve;
+    if (!wokeFromDeepSleep || !saved.known) {
+        uint32_t lastEventAt = 0;
+        saved.state = eepromManager->getValveState(lastEventAt);
+        saved.lastEventAtSeconds = lastEventAt;
+        saved.known = 1;
+    }
+
+    Serial.print("Valve ");
+    Serial.print(saved.state == STATE_OPEN ? "OPEN" : saved.state == STATE_CLOSED ? "CLOSED" : "UNKNOWN");
+    Serial.print(", schedule version ");
+    Serial.print(schedule.version);
+    Serial.print(" with ");
+    Serial.print(schedule.count);
+    Serial.println(" events");
+
+    // A reset can cut a pulse short and leave the latch in between - re-assert it
+    if (!wokeFromDeepSleep && saved.state != STATE_UNKNOWN) {
+        pendingPulse = saved.state;
+    }
+}
+
+void ValveController::loop() {
+    runDueEvents();
+    startPendingPulse();
+}
+
+void ValveController::startPendingPulse() {
+    if (pendingPulse == NO_PENDING_PULSE || pulseActive || millis() - pulseEndedAt < DEAD_TIME_MS) {
+        return;
+    }
+
+    bool open = pendingPulse == STATE_OPEN;
+    pendingPulse = NO_PENDING_PULSE;
+    startPulse(open);
+}
+
+bool ValveController::isBusy() const {
+    return pulseActive || pendingPulse != NO_PENDING_PULSE || millis() - pulseEndedAt < DEAD_TIME_MS;
+}
+
+void ValveController::actuate(bool open) {
+    command(open, 0);
+    startPendingPulse();
+}
+
+void ValveController::finishPulse() {
+    while (isBusy()) {
+        startPendingPulse();
+        delay(10);
+    }
+}
+
+void ValveController::command(bool open, uint32_t eventAtSeconds) {
+    ValveState& saved = rtcMemoryManager->getState().valve;
+    saved.state = open ? STATE_OPEN : STATE_CLOSED;
+    if (eventAtSeconds != 0) {
+        saved.lastEventAtSeconds = eventAtSeconds;
+    }
+    eepromManager->setValveState(saved.state, saved.lastEventAtSeconds);
+
+    // Latest command wins if the bridge is still busy with the previous one
+    pendingPulse = saved.state;
+}
+
+void ValveController::startPulse(bool open) {
+    pulseActive = true;
+    digitalWrite(open ? closePin : openPin, LOW);
+    digitalWrite(open ? openPin : closePin, HIGH);
+    pulseTicker.once_ms(PULSE_MS, &ValveController::endPulse, this);
+
+    Serial.print("Valve ");
+    Serial.print(open ? "opening" : "closing");
+    Serial.println(open ? " with positive pulse" : " with negative pulse");
+}
+
+void ValveController::endPulse(ValveController* controller) {
+    // Timer context: just return the bridge to neutral
+    digitalWrite(controller->openPin, LOW);
+    digitalWrite(controller->closePin, LOW);
+    controller->pulseEndedAt = millis();
+    controller->pulseActive = false;
+}
+
+void ValveController::runDueEvents() {
+    if (schedule.count == 0 || !timeSyncManager->isSynchronized()) {
+        return;
+    }
+
+    uint32_t nowSeconds = (uint32_t)(timeSyncManager->getCurrentTime() / 1000);
+    uint32_t lastEventAt = getLastEventAt();
+    int dueIndex = -1;
+    int skipped = 0;
+
+    for (int i = 0; i < schedule.count; i++) {
+        uint32_t at = schedule.events[i].atSeconds;
+        if (at > lastEventAt && at <= nowSeconds) {
+            if (dueIndex >= 0) {
+                skipped++;
+            }
+            dueIndex = i;
+        }
+    }
+
+    if (dueIndex < 0) {
+        return;
+    }
+
+    // A latching valve only cares about the latest position
+    if (skipped > 0) {
+        Serial.print("Skipping ");
+        Serial.print(skipped);
+        Serial.println(" overdue valve event(s)");
+    }
+
+    const ValveEvent& event = schedule.events[dueIndex];
+    Serial.print("Running scheduled valve event at ");
+    Serial.println(event.atSeconds);
+    command(event.open != 0, event.atSeconds);
+}
+
+bool ValveController::setSchedule(const ValveSchedule& newSchedule) {
+    if (newSchedule.count > ValveSchedule::MAX_EVENTS) {
+        Serial.println("Rejecting valve schedule - too many events");
+        return false;
+    }
+    for (int i = 1; i < newSchedule.count; i++) {
+        if (newSchedule.events[i].atSeconds <= newSchedule.events[i - 1].atSeconds) {
+            Serial.println("Rejecting valve schedule - events not in order");
+            return false;
+        }
+    }
+
+    if (newSchedule.version == schedule.version) {
+        return true;
+    }
+
+    schedule = newSchedule;
+    eepromManager->setValveSchedule(schedule);
+    return true;
+}
+
+uint8_t ValveController::getState() const {
+    return rtcMemoryManager->getState().valve.state;
+}
+
+uint32_t ValveController::getLastEventAt() const {
+    return rtcMemoryManager->getState().valve.lastEventAtSeconds;
+}
+
+uint64_t ValveController::getNextEventTime() const {
+    if (!timeSyncManager->isSynchronized()) {
+        return 0;
+    }
+
+    // May be in the past if it is due but has not run yet
+    uint32_t lastEventAt = getLastEventAt();
+    for (int i = 0; i < schedule.count; i++) {
+        if (schedule.events[i].atSeconds > lastEventAt) {
+            return (uint64_t)schedule.events[i].atSeconds * 1000;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef VALVE_CONTROLLER_H
+#define VALVE_CONTROLLER_H
+
+#include <Arduino.h>
+#include <Ticker.h>
+#include "EEPROMManager.h"
+
+class RTCMemoryManager;
+class TimeSyncManager;
+
+// Drives a latching valve through an H-bridge and runs a local schedule of
+// open/close events pushed from the server, so the device can sleep until the
+// next event instead of staying awake to be commanded.
+//
+// The coil pulse is ended by a timer callback rather than delay(), so actuating
+// never blocks the loop. The commanded position and the last schedule event run
+// are kept in RTC memory across deep sleep and mirrored to EEPROM so a power
+// loss does not forget them. Schedule events need a synchronized clock.
+class ValveController {
+public:
+    static const uint8_t STATE_CLOSED = 0;
+    static const uint8_t STATE_OPEN = 1;
+    static const uint8_t STATE_UNKNOWN = 255;
+
+private:
+    static const uint32_t PULSE_MS = 100;      // Coil pulse needed to flip the latch
+    static const uint32_t DEAD_TIME_MS = 50;   // H-bridge rest between opposite pulses
+    static const int8_t NO_PENDING_PULSE = -1;
+
+    EEPROMManager* eepromManager;
+    RTCMemoryManager* rtcMemoryManager;
+    TimeSyncManager* timeSyncManager;
+    int openPin;
+    int closePin;
+
+    Ticker pulseTicker;
+    volatile bool pulseActive;
+    volatile unsigned long pulseEndedAt;
+    int8_t pendingPulse;        // STATE_OPEN/STATE_CLOSED waiting for the bridge
+    ValveSchedule schedule;
+
+    static void endPulse(ValveController* controller);
+    void startPulse(bool open);
+    void command(bool open, uint32_t eventAtSeconds);
+    void runDueEvents();
+    void startPendingPulse();
+
+public:
+    ValveController(EEPROMManager* eeprom, RTCMemoryManager* rtc, TimeSyncManager* timeSync, int openPin, int closePin);
+
+    void begin(bool wokeFromDeepSleep);
+    void loop();
+
+    // Manual command; pulses straight away unless a pulse is already running
+    void actuate(bool open);
+    // Blocks until commanded pulses are done, without running schedule events
+    void finishPulse();
+
+    // Replaces the local schedule. Returns false if the events are invalid.
+    bool setSchedule(const ValveSchedule& newSchedule);
+
+    bool isBusy() const;
+    uint8_t getState() const;
+    uint32_t getLastEventAt() const;
+    uint32_t getScheduleVersion() const { return schedule.version; }
+    uint64_t getNextEventTime() const; // Server time in ms, 0 if none
+};
+
+#endif
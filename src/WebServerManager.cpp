@@ -3,11 +3,64 @@
 #include "WiFiManager.h"
 #include "SensorManager.h"
 #include "DeviceManager.h"
+#include "RgbController.h"
 #include "html_constants.h"
 #include "version.h"
 
+// Certificate fingerprint as hex, bytes optionally separated by ':'. An empty
+// string clears the pin.
+static bool parseFingerprint(const String& text, TlsPin& pin) {
+    pin = {};
+    uint8_t length = 0;
+    int nibble = -1;
+    for (size_t i = 0; i < text.length(); i++) {
+        char c = text[i];
+        if (c == ':' && nibble < 0) {
+            continue;
+        }
+        int value;
+        if (c >= '0' && c <= '9') {
+            value = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        if (nibble < 0) {
+            nibble = value;
+        } else {
+            if (length == sizeof(pin.fingerprint)) {
+                return false;
+            }
+            pin.fingerprint[length++] = (nibble << 4) | value;
+            nibble = -1;
+        }
+    }
+    if (nibble >= 0 || (length != 0 && length != TlsPin::FINGERPRINT_LENGTH)) {
+        return false;
+    }
+    pin.length = length;
+    return true;
+}
+
+static String formatFingerprint(const TlsPin& pin) {
+    static const char hex[] = "0123456789ABCDEF";
+    String text;
+    for (uint8_t i = 0; i < pin.length; i++) {
+        if (i > 0) {
+            text += ':';
+        }
+        text += hex[pin.fingerprint[i] >> 4];
+        text += hex[pin.fingerprint[i] & 0x0F];
+    }
+    return text;
+}
+
 WebServerManager::WebServerManager(EEPROMManager* eeprom, WiFiManager* wifi, SensorManager* sensor, DeviceManager* device) :
-    eepromManager(eeprom), wifiManager(wifi), sensorManager(sensor), deviceManager(device) {
+    eepromManager(eeprom), wifiManager(wifi), sensorManager(sensor), deviceManager(device),
+    pendingModeChange(false), pendingServerChange(false), pendingWifiChange(false) {
     server = new WebServerType(80);
     httpUpdater = new HTTPUpdateServerType();
     
@@ -40,6 +93,11 @@ void WebServerManager::init() {
     server->on("/api/config", HTTP_GET, [this]() { handleGetConfig(); });
     server->on("/api/config", HTTP_POST, [this]() { handleSetConfig(); });
     server->on("/setMode", HTTP_POST, [this]() { handleSetMode(); });
+    server->on("/servo", HTTP_POST, [this]() { handleServo(); });
+    server->on("/servo", HTTP_GET, [this]() { handleServoStatus(); });
+    server->on("/rgb", HTTP_POST, [this]() { handleRgb(); });
+    server->on("/rgb", HTTP_GET, [this]() { handleRgbStatus(); });
+    server->on("/probes/rescan", HTTP_POST, [this]() { handleRescanProbes(); });
     server->on("/description.xml", HTTP_GET, [this]() { handleSSDPSchema(); });
     
     httpUpdater->setup(server);
@@ -49,6 +107,8 @@ void WebServerManager::init() {
 
 void WebServerManager::handleClient() {
     server->handleClient();
+    // The handler has returned and the server has sent and closed its reply
+    applyConfiguration();
 #ifdef ESP32_PLATFORM
     // Process SSDP for ESP32
     if (ssdpServer) {
@@ -123,20 +183,12 @@ void WebServerManager::handleIsUp() {
 }
 
 void WebServerManager::handleOutputOn() {
-    if (deviceManager->getOperatingMode() == 6) { // MODE_LATCHING_VALVE
-        deviceManager->openValve();
-    } else {
-        sensorManager->powerSensorOn();
-    }
+    deviceManager->switchOutput(true);
     server->send(200, "text/html", "OK");
 }
 
 void WebServerManager::handleOutputOff() {
-    if (deviceManager->getOperatingMode() == 6) { // MODE_LATCHING_VALVE
-        deviceManager->closeValve();
-    } else {
-        sensorManager->powerSensorOff();
-    }
+    deviceManager->switchOutput(false);
     server->send(200, "text/html", "OK");
 }
 
@@ -153,7 +205,11 @@ void WebServerManager::handleConfigure() {
     String password = server->arg("password");
     String alias = server->arg("alias");
     String serverUrl = server->arg("server");
-    byte mode = (byte)server->arg("mode").toInt();
+    int mode = server->arg("mode").toInt();
+    if (mode < 0 || mode > 6) {
+        server->send(400, "text/plain", "Mode is 0-6");
+        return;
+    }
 
     Serial.println("Got SSID: " + ssid);
     Serial.println("Got password: " + password);
@@ -162,16 +218,54 @@ void WebServerManager::handleConfigure() {
     Serial.print("Got mode: ");
     Serial.println(mode);
 
+    bool wifiChanged = ssid != eepromManager->getSSID() || password != eepromManager->getPassword();
+    bool modeChanged = mode != eepromManager->getMode();
+    bool serverChanged = serverUrl != eepromManager->getServerUrl();
     eepromManager->saveWiFiCredentials(ssid, password);
     eepromManager->setMode(mode);
     eepromManager->setAlias(alias);
     eepromManager->setServerUrl(serverUrl);
     
-    Serial.println("Configuration complete - rebooting...");
+    Serial.println("Configuration complete - applying");
     server->send(200, "text/plain", "OK");
-    server->close();
-    delay(500);
-    PlatformUtils::restart();
+    queueConfiguration(modeChanged, serverChanged, wifiChanged);
+}
+
+void WebServerManager::queueConfiguration(bool modeChanged, bool serverChanged, bool wifiChanged) {
+    pendingModeChange = pendingModeChange || modeChanged;
+    pendingServerChange = pendingServerChange || serverChanged;
+    pendingWifiChange = pendingWifiChange || wifiChanged;
+}
+
+// Takes up configuration just saved, in place of a restart. Runs from
+// handleClient() once the handler's reply is out: until the server closes the
+// connection it may still sit in the TCP buffers, and joining a new network
+// would drop it.
+void WebServerManager::applyConfiguration() {
+    if (!pendingModeChange && !pendingServerChange && !pendingWifiChange) {
+        return;
+    }
+    bool modeChanged = pendingModeChange;
+    bool serverChanged = pendingServerChange;
+    bool wifiChanged = pendingWifiChange;
+    pendingModeChange = false;
+    pendingServerChange = false;
+    pendingWifiChange = false;
+    
+    if (modeChanged) {
+        deviceManager->applyMode();
+    }
+    if (serverChanged) {
+        deviceManager->applyServerSettings();
+    }
+    if (wifiChanged && !deviceManager->reconnectWiFi()) {
+        return;
+    }
+    
+    // The server hears the new alias, mode or address straight away
+    if (WiFi.status() == WL_CONNECTED && eepromManager->hasServerUrl()) {
+        deviceManager->contactServer();
+    }
 }
 
 void WebServerManager::handleReport() {
@@ -189,6 +283,11 @@ void WebServerManager::handleCurrentConfig() {
     configDoc["alias"] = eepromManager->getAlias();
     configDoc["server"] = eepromManager->getServerUrl();
     configDoc["mode"] = eepromManager->getMode();
+    configDoc["awakeLatencyMs"] = eepromManager->getAwakeLatencyMs();
+    configDoc["transport"] = eepromManager->getTransport() == EEPROMManager::TRANSPORT_COAP ? "coap" : "http";
+    TlsPin tlsPin;
+    eepromManager->getTlsPin(tlsPin);
+    configDoc["tlsFingerprint"] = formatFingerprint(tlsPin);
     
     String json;
     serializeJson(configDoc, json);
@@ -203,6 +302,10 @@ void WebServerManager::handleGetConfig() {
     configDoc["alias"] = eepromManager->getAlias();
     configDoc["server"] = eepromManager->getServerUrl();
     configDoc["mode"] = eepromManager->getMode();
+    configDoc["transport"] = eepromManager->getTransport() == EEPROMManager::TRANSPORT_COAP ? "coap" : "http";
+    TlsPin tlsPin;
+    eepromManager->getTlsPin(tlsPin);
+    configDoc["tlsFingerprint"] = formatFingerprint(tlsPin);
     
     // Device information
     configDoc["deviceId"] = deviceManager->getSerialNumber();
@@ -237,7 +340,7 @@ void WebServerManager::handleGetConfig() {
 }
 
 void WebServerManager::handleSetConfig() {
-    StaticJsonDocument<512> requestDoc;
+    StaticJsonDocument<768> requestDoc;
     DeserializationError error = deserializeJson(requestDoc, server->arg("plain"));
     
     if (error) {
@@ -256,13 +359,27 @@ void WebServerManager::handleSetConfig() {
     String alias = requestDoc["alias"] | "";
     String serverUrl = requestDoc["server"] | "";
     int mode = requestDoc["mode"] | -1;
+    // Optional; left as it is when absent
+    long awakeLatencyMs = requestDoc["awakeLatencyMs"] | (long)eepromManager->getAwakeLatencyMs();
+    uint8_t currentTransport = eepromManager->getTransport();
+    String transportName = requestDoc["transport"] | (currentTransport == EEPROMManager::TRANSPORT_COAP ? "coap" : "http");
+    uint8_t transport = transportName == "coap" ? EEPROMManager::TRANSPORT_COAP : EEPROMManager::TRANSPORT_HTTP;
+    TlsPin currentTlsPin;
+    eepromManager->getTlsPin(currentTlsPin);
+    String currentFingerprint = formatFingerprint(currentTlsPin);
+    String fingerprintText = requestDoc["tlsFingerprint"] | currentFingerprint;
+    TlsPin tlsPin;
+    bool fingerprintValid = parseFingerprint(fingerprintText, tlsPin);
+    String fingerprint = formatFingerprint(tlsPin);
     
     // Validate required fields
-    if (ssid.length() == 0 || alias.length() == 0 || serverUrl.length() == 0 || mode < 0 || mode > 6) {
+    if (ssid.length() == 0 || alias.length() == 0 || serverUrl.length() == 0 || mode < 0 || mode > 6 ||
+        awakeLatencyMs < EEPROMManager::MIN_AWAKE_LATENCY_MS || awakeLatencyMs > EEPROMManager::MAX_AWAKE_LATENCY_MS ||
+        (transportName != "http" && transportName != "coap") || !fingerprintValid) {
         StaticJsonDocument<256> errorDoc;
         errorDoc["error"] = "Missing or invalid required fields";
         errorDoc["success"] = false;
-        errorDoc["details"] = "ssid, alias, server, and mode (0-6) are required";
+        errorDoc["details"] = "ssid, alias, server, and mode (0-6) are required; awakeLatencyMs is 20-3000; transport is http or coap; tlsFingerprint is the certificate's SHA-1 (ESP8266) or SHA-256 (ESP32) in hex";
         String errorJson;
         serializeJson(errorDoc, errorJson);
         server->send(400, "application/json", errorJson);
@@ -274,12 +391,13 @@ void WebServerManager::handleSetConfig() {
     String currentAlias = eepromManager->getAlias();
     String currentServerUrl = eepromManager->getServerUrl();
     byte currentMode = eepromManager->getMode();
+    uint16_t currentAwakeLatencyMs = eepromManager->getAwakeLatencyMs();
     
     // Check if configuration has actually changed
     bool configChanged = false;
     bool passwordProvided = password.length() > 0;
     
-    StaticJsonDocument<512> changesDoc;
+    StaticJsonDocument<1024> changesDoc;
     JsonArray changes = changesDoc.createNestedArray("changes");
     
     if (ssid != currentSsid) {
@@ -314,6 +432,30 @@ void WebServerManager::handleSetConfig() {
         configChanged = true;
     }
     
+    if (awakeLatencyMs != currentAwakeLatencyMs) {
+        JsonObject change = changes.createNestedObject();
+        change["field"] = "awakeLatencyMs";
+        change["from"] = currentAwakeLatencyMs;
+        change["to"] = awakeLatencyMs;
+        configChanged = true;
+    }
+    
+    if (transport != currentTransport) {
+        JsonObject change = changes.createNestedObject();
+        change["field"] = "transport";
+        change["from"] = currentTransport == EEPROMManager::TRANSPORT_COAP ? "coap" : "http";
+        change["to"] = transportName;
+        configChanged = true;
+    }
+    
+    if (fingerprint != currentFingerprint) {
+        JsonObject change = changes.createNestedObject();
+        change["field"] = "tlsFingerprint";
+        change["from"] = currentFingerprint;
+        change["to"] = fingerprint;
+        configChanged = true;
+    }
+    
     if (passwordProvided) {
         JsonObject change = changes.createNestedObject();
         change["field"] = "password";
@@ -322,7 +464,11 @@ void WebServerManager::handleSetConfig() {
         configChanged = true;
     }
     
-    StaticJsonDocument<512> responseDoc;
+    bool wifiChanged = ssid != currentSsid || passwordProvided;
+    bool serverChanged = serverUrl != currentServerUrl || awakeLatencyMs != currentAwakeLatencyMs ||
+        transport != currentTransport || fingerprint != currentFingerprint;
+    
+    StaticJsonDocument<1024> responseDoc;
     responseDoc["success"] = true;
     responseDoc["deviceId"] = deviceManager->getSerialNumber();
     responseDoc["ipAddress"] = WiFi.localIP().toString();
@@ -333,7 +479,7 @@ void WebServerManager::handleSetConfig() {
         responseDoc["changes"] = changes;
     } else {
         // Apply configuration changes
-        if (ssid != currentSsid || passwordProvided) {
+        if (wifiChanged) {
             eepromManager->saveWiFiCredentials(ssid, password);
         }
         
@@ -349,10 +495,22 @@ void WebServerManager::handleSetConfig() {
             eepromManager->setServerUrl(serverUrl);
         }
         
-        responseDoc["message"] = "Configuration updated successfully - device will restart";
+        if (awakeLatencyMs != currentAwakeLatencyMs) {
+            eepromManager->setAwakeLatencyMs(awakeLatencyMs);
+        }
+        
+        if (transport != currentTransport) {
+            eepromManager->setTransport(transport);
+        }
+        
+        if (fingerprint != currentFingerprint) {
+            eepromManager->setTlsPin(tlsPin);
+        }
+        
+        responseDoc["message"] = wifiChanged ? "Configuration updated - joining the new network" :
+            "Configuration updated and applied";
         responseDoc["updated"] = true;
         responseDoc["changes"] = changes;
-        responseDoc["restartIn"] = 500;
     }
     
     String responseJson;
@@ -360,21 +518,88 @@ void WebServerManager::handleSetConfig() {
     server->send(200, "application/json", responseJson);
     
     if (configChanged) {
-        server->close();
-        delay(500);
-        PlatformUtils::restart();
+        queueConfiguration(mode != currentMode, serverChanged, wifiChanged);
     }
 }
 
 void WebServerManager::handleSetMode() {
     int mode = server->arg("mode").toInt();
+    if (mode < 0 || mode > 6) {
+        server->send(400, "text/plain", "Mode is 0-6");
+        return;
+    }
     Serial.print("Setting mode to ");
     Serial.println(mode);
     eepromManager->setMode(mode);
     server->send(200, "text/plain", "OK");
-    server->close();
-    delay(500);
-    PlatformUtils::restart();
+    queueConfiguration(true, false, false);
+}
+
+// {"position": 0-180, "profile": "trapezoidal" | "s-curve", "speed": deg/s, "accel": deg/s^2}
+// Answers straight away; the move runs in the background
+void WebServerManager::handleServo() {
+    StaticJsonDocument<256> requestDoc;
+    DeserializationError error = deserializeJson(requestDoc, server->arg("plain"));
+    
+    if (error || !deviceManager->moveServo(requestDoc.as<JsonVariantConst>())) {
+        server->send(400, "application/json", "{\"success\":false,\"error\":\"Invalid servo move or not in servo mode\"}");
+        return;
+    }
+    
+    handleServoStatus();
+}
+
+void WebServerManager::handleServoStatus() {
+    StaticJsonDocument<128> statusDoc;
+    deviceManager->addServoStatus(statusDoc.to<JsonObject>());
+    
+    String json;
+    serializeJson(statusDoc, json);
+    server->send(200, "application/json", json);
+}
+
+// {"frames": [[red, green, blue, fadeMs, holdMs], ...], "loops": n}, loops 0
+// repeating until the next command. Answers straight away; the sequence plays
+// in the background.
+void WebServerManager::handleRgb() {
+    // Sized for a full sequence of RgbSequence::MAX_KEYFRAMES
+    StaticJsonDocument<1536> requestDoc;
+    DeserializationError error = deserializeJson(requestDoc, server->arg("plain"));
+    
+    if (error || !deviceManager->playRgbSequence(requestDoc.as<JsonVariantConst>())) {
+        server->send(400, "application/json", "{\"success\":false,\"error\":\"Invalid light sequence or not in RGB mode\"}");
+        return;
+    }
+    
+    handleRgbStatus();
+}
+
+void WebServerManager::handleRgbStatus() {
+    StaticJsonDocument<128> statusDoc;
+    deviceManager->addRgbStatus(statusDoc.to<JsonObject>());
+    
+    String json;
+    serializeJson(statusDoc, json);
+    server->send(200, "application/json", json);
+}
+
+// Searches the OneWire bus again and answers with the ROM IDs found, in the
+// order readings report them
+void WebServerManager::handleRescanProbes() {
+    if (!deviceManager->rescanProbes()) {
+        server->send(400, "application/json", "{\"success\":false,\"error\":\"Not in thermometer mode\"}");
+        return;
+    }
+    
+    StaticJsonDocument<512> probesDoc;
+    JsonArray probes = probesDoc.createNestedArray("probes");
+    for (uint8_t i = 0; i < sensorManager->getProbeCount(); i++) {
+        probes.add(sensorManager->getProbeId(i));
+    }
+    
+    String json;
+    serializeJson(probesDoc, json);
+    server->send(200, "application/json", json);
 }
 
 void WebServerManager::handleSSDPSchema() {
@@ -25,6 +25,14 @@ private:
 #endif
     
     // HTML content constants are now in html_constants.h
+    
+    // Configuration saved by a handler, taken up once its reply has gone
+    bool pendingModeChange;
+    bool pendingServerChange;
+    bool pendingWifiChange;
+    
+    void queueConfiguration(bool modeChanged, bool serverChanged, bool wifiChanged);
+    void applyConfiguration();
 
 public:
     WebServerManager(EEPROMManager* eeprom, WiFiManager* wifi, SensorManager* sensor, DeviceManager* device);
@@ -47,6 +55,11 @@ public:
     void handleGetConfig();
     void handleSetConfig();
     void handleSetMode();
+    void handleServo();
+    void handleServoStatus();
+    void handleRgb();
+    void handleRgbStatus();
+    void handleRescanProbes();
     void handleSSDPSchema();
 };
 
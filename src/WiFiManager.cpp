@@ -7,7 +7,9 @@ WiFiManager::WiFiManager() :
     subnet(255, 255, 255, 0),
     configMode(false),
     deviceId(0),
-    eepromManager(nullptr) {
+    eepromManager(nullptr),
+    radioOn(false),
+    radioOnAt(0) {
 }
 
 void WiFiManager::init(int id, EEPROMManager* eeprom) {
@@ -47,6 +49,10 @@ bool WiFiManager::connectUsingSavedCredentials(String ssid, String password) {
     Serial.print("Connecting to ");
     Serial.println(ssid);
     
+    if (!radioOn) {
+        radioOn = true;
+        radioOnAt = millis();
+    }
     PlatformUtils::setWiFiPower();
     WiFi.begin(ssid.c_str(), password.c_str());
     
@@ -80,6 +86,26 @@ bool WiFiManager::connectUsingSavedCredentials(String ssid, String password) {
     return true;
 }
 
+bool WiFiManager::reconnect(String ssid, String password) {
+    Serial.println("WiFi credentials changed - reconnecting");
+    WiFi.disconnect();
+    if (configMode) {
+        disableAP();
+        WiFi.mode(WIFI_STA);
+    }
+    
+    if (connectUsingSavedCredentials(ssid, password)) {
+        return true;
+    }
+    enableHotspotMode();
+    return false;
+}
+
+unsigned long WiFiManager::getRadioOnMs() const {
+    // The radio stays up until deep sleep, even after a failed connection
+    return radioOn ? millis() - radioOnAt : 0;
+}
+
 bool WiFiManager::connectToWokwiGuest() {
     Serial.println("Attempting to connect to Wokwi-GUEST network");
     return connectUsingSavedCredentials("Wokwi-GUEST", "");
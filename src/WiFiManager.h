@@ -14,6 +14,8 @@ private:
     bool configMode;
     int deviceId;
     EEPROMManager* eepromManager;
+    bool radioOn;
+    unsigned long radioOnAt;
 
 public:
     WiFiManager();
@@ -21,9 +23,13 @@ public:
     void enableHotspotMode();
     void disableAP();
     bool connectUsingSavedCredentials(String ssid, String password);
+    // New credentials without a restart: leaves the current network, or the
+    // setup hotspot, for the new one. Brings the hotspot back if that fails.
+    bool reconnect(String ssid, String password);
     bool connectToWokwiGuest();
     void scanNetworks(JsonArray& networksArray);
     String getEncryptionName(byte type);
+    unsigned long getRadioOnMs() const;  // Time since the radio was brought up this wake
     bool isInConfigMode() const { return configMode; }
     void setConfigMode(bool mode) { configMode = mode; }
 };
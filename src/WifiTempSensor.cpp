@@ -11,6 +11,7 @@
 
 // Include our custom classes
 #include "EEPROMManager.h"
+#include "RTCMemoryManager.h"
 #include "WiFiManager.h"
 #include "SensorManager.h"
 #include "WebServerManager.h"
@@ -32,6 +33,7 @@ const int GREEN_PIN = 13;
 
 // Manager instances
 EEPROMManager* eepromManager;
+RTCMemoryManager* rtcMemoryManager;
 WiFiManager* wifiManager;
 SensorManager* sensorManager;
 WebServerManager* webServerManager;
@@ -47,6 +49,10 @@ void setup() {
     eepromManager = new EEPROMManager();
     eepromManager->init();
     
+    // State carried across deep sleep (clock, drift calibration)
+    rtcMemoryManager = new RTCMemoryManager();
+    rtcMemoryManager->load();
+    
     // Auto-configure for Wokwi emulator if needed
     if (PlatformUtils::isWokwiEmulator() && !eepromManager->hasWiFiCredentials()) {
         Serial.println("Wokwi emulator detected - auto-configuring with Wokwi-GUEST credentials");
@@ -57,19 +63,24 @@ void setup() {
     WiFi.mode(WIFI_STA);
     
     wifiManager = new WiFiManager();
-    sensorManager = new SensorManager(oneWireBus, SENSE_POWER_PIN);
-    deviceManager = new DeviceManager(eepromManager, sensorManager, wifiManager);
+    sensorManager = new SensorManager(eepromManager, oneWireBus, SENSE_POWER_PIN);
+    deviceManager = new DeviceManager(eepromManager, sensorManager, wifiManager, rtcMemoryManager);
     webServerManager = new WebServerManager(eepromManager, wifiManager, sensorManager, deviceManager);
     
     // Initialize device and pins
     deviceManager->init();
     sensorManager->init();
+    // Temperature conversion runs while WiFi connects
+    deviceManager->initProbes();
     
-    // Check if device woke from deep sleep and update time accordingly
-    if (PlatformUtils::wokeFromDeepSleep()) {
-        Serial.println("Device woke from deep sleep - updating time");
-        deviceManager->updateTimeAfterSleep(DeviceManager::SLEEP_DURATION_MS);
-    }
+    // Before the clock: whether the switch woke us decides what the sleep was worth
+    deviceManager->initInputSwitch();
+    
+    // Carry the clock across deep sleep, corrected for RTC drift
+    deviceManager->restoreTime(PlatformUtils::wokeFromDeepSleep());
+    deviceManager->initValve(PlatformUtils::wokeFromDeepSleep());
+    deviceManager->initServo(PlatformUtils::wokeFromDeepSleep());
+    deviceManager->initRgb();
     
     // Configure A0 for analog reading and seed random number generator
     #ifdef ESP32_PLATFORM
@@ -104,8 +115,7 @@ void setup() {
     
     // If WiFi is connected, send failure log and register with server
     if (WiFi.status() == WL_CONNECTED) {
-        deviceManager->sendFailureLogToServer();
-        deviceManager->registerWithServer();
+        deviceManager->contactServer();
     }
 }
 
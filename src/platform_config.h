@@ -9,13 +9,19 @@
     #include <ESP8266HTTPUpdateServer.h>
     #include <ESP8266SSDP.h>
     #include <ESP8266HTTPClient.h>
+    #include <ESP8266httpUpdate.h>
     
     // Type aliases for compatibility
     typedef ESP8266WebServer WebServerType;
     typedef ESP8266HTTPUpdateServer HTTPUpdateServerType;
     
     // Platform-specific constants
-    #define PLATFORM_NAME "ESP8266"
+    #ifdef NATIVE_PLATFORM
+        // Host build against the fake ESP8266 core in hal/native
+        #define PLATFORM_NAME "native"
+    #else
+        #define PLATFORM_NAME "ESP8266"
+    #endif
     
     // WiFi encryption types
     #define WIFI_ENC_OPEN ENC_TYPE_NONE
@@ -30,7 +36,9 @@
     #include <WebServer.h>
     #include <HTTPUpdateServer.h>
     #include <HTTPClient.h>
+    #include <HTTPUpdate.h>
     #include <esp_sleep.h>
+    #include <driver/rtc_io.h>
     #include <ESP32Servo.h>
     #include <uSSDP.h>
     
@@ -84,6 +92,30 @@ namespace PlatformUtils {
         #endif
     }
     
+    // Lets the radio doze between beacons while the device stays awake,
+    // waking every listenIntervals beacon intervals (0 keeps it on). On the
+    // ESP8266 the CPU also light-sleeps whenever loop() is idle in delay(),
+    // unless something needs its clock running, such as PWM. The ESP32 core
+    // has no automatic light sleep, and its listen interval is only set
+    // when it joins the AP, so it picks between the two modem sleep levels.
+    inline void setWiFiPowerSave(uint8_t listenIntervals, bool allowLightSleep) {
+        #ifdef ESP8266_PLATFORM
+            if (listenIntervals == 0) {
+                WiFi.setSleepMode(WIFI_NONE_SLEEP);
+            } else {
+                WiFi.setSleepMode(allowLightSleep ? WIFI_LIGHT_SLEEP : WIFI_MODEM_SLEEP, listenIntervals);
+            }
+        #elif defined(ESP32_PLATFORM)
+            (void)allowLightSleep;
+            if (listenIntervals == 0) {
+                WiFi.setSleep(WIFI_PS_NONE);
+            } else {
+                // Maximum modem sleep uses the default listen interval of 3
+                WiFi.setSleep(listenIntervals >= 3 ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+            }
+        #endif
+    }
+    
     inline void deepSleep(uint64_t microseconds) {
         #ifdef ESP8266_PLATFORM
             ESP.deepSleep(microseconds);
@@ -93,17 +125,44 @@ namespace PlatformUtils {
         #endif
     }
     
+    // Wakes the next deep sleep early when pin reaches level. The ESP32 does
+    // this with ext0, which needs an RTC GPIO; the ESP8266 can only be woken
+    // through RST, so the signal has to be wired there in hardware.
+    inline void enableWakeOnPin(int pin, int level) {
+        #ifdef ESP8266_PLATFORM
+            (void)pin;
+            (void)level;
+        #elif defined(ESP32_PLATFORM)
+            // The digital pull-up is off in deep sleep
+            rtc_gpio_pullup_en((gpio_num_t)pin);
+            rtc_gpio_pulldown_dis((gpio_num_t)pin);
+            esp_sleep_enable_ext0_wakeup((gpio_num_t)pin, level);
+        #endif
+    }
+    
     inline void restart() {
         ESP.restart();
     }
     
-    inline void beginHTTPClient(HTTPClient& client, const String& url) {
+    // Streams a firmware image from url into the spare flash slot over client,
+    // which must speak the url's scheme (a TLS client for https://). Does not
+    // reboot; the caller restarts into the new image when this returns true.
+    // The ESP8266 accepts gzip-compressed images and inflates them while booting
+    // the new image; the ESP32 updater needs a plain one.
+    inline bool updateFirmware(WiFiClient& client, const String& url, String& error) {
         #ifdef ESP8266_PLATFORM
-            WiFiClient wifiClient;
-            client.begin(wifiClient, url);
+            ESPhttpUpdate.rebootOnUpdate(false);
+            t_httpUpdate_return result = ESPhttpUpdate.update(client, url);
+            error = ESPhttpUpdate.getLastErrorString();
         #elif defined(ESP32_PLATFORM)
-            client.begin(url);
+            httpUpdate.rebootOnUpdate(false);
+            t_httpUpdate_return result = httpUpdate.update(client, url);
+            error = httpUpdate.getLastErrorString();
         #endif
+        if (result == HTTP_UPDATE_NO_UPDATES) {
+            error = "Server has no image";
+        }
+        return result == HTTP_UPDATE_OK;
     }
     
     // Wokwi emulator detection
@@ -0,0 +1,9 @@
+#ifndef SERVER_CA_H
+#define SERVER_CA_H
+
+// CA certificate (PEM) an https:// server's certificate has to be signed by.
+// Left empty, the server is pinned by the fingerprint set through /api/config
+// instead. In RAM rather than PROGMEM: the TLS clients parse it in place.
+static const char SERVER_CA_PEM[] = "";
+
+#endif
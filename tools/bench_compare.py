@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""
+Compare two firmware benchmark runs
+
+Reads the JSON written by the native benchmark runner (bench/firmware_bench.cpp)
+for a baseline and a candidate commit and prints the change in each metric:
+
+    .pio/build/native/program > base.json     (on the baseline commit)
+    .pio/build/native/program > new.json      (on the candidate)
+    python tools/bench_compare.py base.json new.json --max-slowdown 10
+
+Exits non-zero if a benchmark got slower than --max-slowdown percent, made more
+allocations or flash writes or put more bytes on the wire per operation, or
+reported incomplete output.
+"""
+
+import argparse
+import json
+import sys
+
+METRICS = [
+    ("nsPerOp", "ns/op"),
+    ("allocationsPerOp", "allocs/op"),
+    ("allocatedBytesPerOp", "bytes/op"),
+    ("flashWritesPerOp", "flash/op"),
+    ("wireBytesPerOp", "wire bytes/op"),
+    ("roundTripsPerOp", "round trips/op"),
+]
+
+def load(path):
+    """
+    Benchmarks in a results file, by name
+    """
+    with open(path, encoding="utf-8") as f:
+        results = json.load(f)
+    return {b["name"]: b for b in results["benchmarks"]}
+
+def change(before, after):
+    """
+    Percentage change, or None when the baseline is zero
+    """
+    if before == 0:
+        return None if after == 0 else float("inf")
+    return (after - before) / before * 100
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare two firmware benchmark runs")
+    parser.add_argument("baseline")
+    parser.add_argument("candidate")
+    parser.add_argument("--max-slowdown", type=float, default=None,
+                        help="fail if any benchmark is this many percent slower")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    candidate = load(args.candidate)
+    failures = []
+
+    header = f"{'benchmark':<30}" + "".join(f"{label:>24}" for _, label in METRICS)
+    print(header)
+    print("-" * len(header))
+
+    for name, after in candidate.items():
+        before = baseline.get(name)
+        if not after.get("ok", True):
+            failures.append(f"{name}: output incomplete or wrong")
+        if before is None:
+            print(f"{name:<30}  (new)")
+            continue
+
+        row = f"{name:<30}"
+        for key, _ in METRICS:
+            if key not in before:
+                # Older runs did not measure it
+                row += f"{f'{after.get(key, 0):g}':>24}"
+                continue
+            pct = change(before[key], after[key])
+            cell = f"{before[key]:g} -> {after[key]:g}"
+            if pct is not None and pct != float("inf"):
+                cell += f" ({pct:+.0f}%)"
+            row += f"{cell:>24}"
+        print(row)
+
+        slowdown = change(before["nsPerOp"], after["nsPerOp"])
+        if args.max_slowdown is not None and slowdown is not None and slowdown > args.max_slowdown:
+            failures.append(f"{name}: {slowdown:.0f}% slower")
+        # Allocation, flash and wire counts are deterministic, so any increase is real
+        for key in ("allocationsPerOp", "flashWritesPerOp", "wireBytesPerOp"):
+            if key in before and after[key] > before[key]:
+                failures.append(f"{name}: {key} up from {before[key]:g} to {after[key]:g}")
+
+    for name in baseline:
+        if name not in candidate:
+            print(f"{name:<30}  (removed)")
+
+    if failures:
+        print()
+        for failure in failures:
+            print(f"REGRESSION {failure}")
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+"""
+PlatformIO Post-Build Script
+Publishes the built firmware image to the server's firmware directory so a
+rollout can offer it to devices
+"""
+
+import gzip
+import re
+import shutil
+from pathlib import Path
+
+Import("env")
+
+project_root = Path(env["PROJECT_DIR"])
+
+# ESP8266 devices inflate gzip images while booting them; the ESP32 updater
+# can only flash plain images
+PLATFORMS = {
+    "espressif8266": ("esp8266", ".bin.gz"),
+    "espressif32": ("esp32", ".bin"),
+}
+
+def read_build_number():
+    """
+    Read the build number the pre-build script gave this image
+    """
+    content = (project_root / "src" / "version.h").read_text(encoding="utf-8")
+    match = re.search(r'#define FIRMWARE_BUILD_NUMBER (\d+)', content)
+    return int(match.group(1)) if match else None
+
+def publish_firmware(source, target, env):
+    """
+    Copy firmware.bin to server/firmware/<platform>-<build>.bin[.gz]
+    """
+    platform = PLATFORMS.get(env["PIOPLATFORM"])
+    build = read_build_number()
+    if platform is None or build is None:
+        print("Not publishing firmware: unknown platform or build number")
+        return
+
+    name, extension = platform
+    image = Path(str(target[0]))
+    output_dir = project_root / "server" / "firmware"
+    output_dir.mkdir(parents=True, exist_ok=True)
+    output = output_dir / f"{name}-{build}{extension}"
+
+    if extension == ".bin.gz":
+        with open(image, "rb") as f_in, gzip.open(output, "wb", compresslevel=9) as f_out:
+            shutil.copyfileobj(f_in, f_out)
+    else:
+        shutil.copyfile(image, output)
+
+    print(f"Published firmware build {build}: {output} "
+          f"({image.stat().st_size} -> {output.stat().st_size} bytes)")
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", publish_firmware)
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""
+Time full and resumed TLS handshakes against the server
+
+Connects the way the ESP8266's BearSSL client does (TLS 1.2, session IDs
+rather than tickets): one full handshake, then reconnects offering the session
+it was given and reports whether the server resumed it and how long each took.
+
+    TLS_CERT=cert.pem TLS_KEY=key.pem deno task start      (the server)
+    python tools/tls_handshake.py localhost 3000 --tries 5
+
+The fingerprint printed is what /api/config takes as tlsFingerprint: SHA-1 for
+the ESP8266, SHA-256 for the ESP32. Exits non-zero if no handshake was resumed.
+"""
+
+import argparse
+import hashlib
+import socket
+import ssl
+import statistics
+import sys
+import time
+
+def handshake(context, host, port, session=None):
+    """
+    One TLS handshake; returns its time in ms, the session and whether it was
+    resumed, and the server's certificate
+    """
+    with socket.create_connection((host, port), timeout=10) as sock:
+        started = time.perf_counter()
+        with context.wrap_socket(sock, server_hostname=host, session=session) as tls:
+            elapsed = (time.perf_counter() - started) * 1000
+            result = (elapsed, tls.session, tls.session_reused, tls.getpeercert(binary_form=True))
+            # A connection dropped without close_notify may take its session with it
+            tls.unwrap()
+            return result
+
+def colon_hex(digest):
+    return ":".join(f"{b:02X}" for b in digest)
+
+def main():
+    parser = argparse.ArgumentParser(description="Time full and resumed TLS handshakes")
+    parser.add_argument("host")
+    parser.add_argument("port", type=int)
+    parser.add_argument("--tries", type=int, default=5, help="handshakes of each kind")
+    parser.add_argument("--cafile", help="CA to verify the server against (default: not verified)")
+    args = parser.parse_args()
+
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    # BearSSL stops at TLS 1.2, where resumption is by session ID
+    context.maximum_version = ssl.TLSVersion.TLSv1_2
+    context.options |= ssl.OP_NO_TICKET
+    if args.cafile:
+        context.load_verify_locations(args.cafile)
+    else:
+        context.check_hostname = False
+        context.verify_mode = ssl.CERT_NONE
+
+    full = []
+    resumed = []
+    certificate = None
+    for _ in range(args.tries):
+        elapsed, session, _, certificate = handshake(context, args.host, args.port)
+        full.append(elapsed)
+        elapsed, _, reused, _ = handshake(context, args.host, args.port, session)
+        if reused:
+            resumed.append(elapsed)
+        else:
+            print("server did not resume the session it gave out")
+
+    print(f"certificate SHA-1:   {colon_hex(hashlib.sha1(certificate).digest())}")
+    print(f"certificate SHA-256: {colon_hex(hashlib.sha256(certificate).digest())}")
+    print(f"full handshake:    {statistics.median(full):8.2f} ms median of {len(full)}")
+    if not resumed:
+        print("resumed handshake:      none")
+        sys.exit(1)
+    print(f"resumed handshake: {statistics.median(resumed):8.2f} ms median of {len(resumed)}")
+
+if __name__ == "__main__":
+    main()